@@ -0,0 +1,218 @@
+/*
+ * chunker_bench.cc
+ *
+ * benchmark of the chunkers on the same input: throughput, chunk size distribution,
+ * and the share of the data still deduplicated after inserting one byte in the middle of the input
+ *
+ * usage: ./chunker_bench [--file=PATH] [--size=MB] [--runs=N]
+ *        the input is the file if given, otherwise --size MB of random data (default 256)
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "chunker.hh"
+#include "conf.hh"
+
+using namespace std;
+
+/* bucket width of the chunk size histogram */
+#define HISTOGRAM_BUCKET_SIZE (2 << 10)
+/* number of buckets of the chunk size histogram, the last one collects larger chunks */
+#define HISTOGRAM_BUCKET_NUM 9
+
+double timerNow()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+}
+
+/*
+ * chunk the input part by part, as the client does
+ *
+ * @param chunker - the chunker
+ * @param input - the input
+ * @param chunkSizeList - a list for returning the size of each chunk <return>
+ */
+void chunkInput(Chunker *chunker, vector<unsigned char> &input, vector<int> &chunkSizeList)
+{
+    Configuration conf;
+    vector<int> chunkEndIndexList(conf.getListSize());
+    int numOfChunks, headSize;
+    unsigned char *head;
+
+    chunkSizeList.clear();
+    for (size_t offset = 0; offset < input.size(); offset += conf.getBufferSize())
+    {
+        int size = (int)min(input.size() - offset, (size_t)conf.getBufferSize());
+        chunker->streamChunking(input.data() + offset, size, offset + size == input.size(), chunkEndIndexList.data(),
+                                &numOfChunks, &head, &headSize);
+        int preEnd = -1;
+        for (int i = 0; i < numOfChunks; i++)
+        {
+            chunkSizeList.push_back(chunkEndIndexList[i] - preEnd + (i == 0 ? headSize : 0));
+            preEnd = chunkEndIndexList[i];
+        }
+    }
+}
+
+/*
+ * the fraction of bytes in the modified input whose chunks also appear in the original input
+ */
+double sharedFraction(vector<unsigned char> &original, vector<int> &originalChunks,
+                      vector<unsigned char> &modified, vector<int> &modifiedChunks)
+{
+    unordered_set<string_view> chunks;
+    size_t offset = 0, shared = 0;
+    for (int size : originalChunks)
+    {
+        chunks.emplace((const char *)original.data() + offset, size);
+        offset += size;
+    }
+    offset = 0;
+    for (int size : modifiedChunks)
+    {
+        if (chunks.count(string_view((const char *)modified.data() + offset, size)))
+        {
+            shared += size;
+        }
+        offset += size;
+    }
+    return (double)shared / modified.size();
+}
+
+void bench(const char *name, int chunkerType, vector<unsigned char> &input, vector<unsigned char> &modified, int runs)
+{
+    Chunker chunker(chunkerType);
+    vector<int> chunkSizeList, modifiedChunkSizeList;
+
+    /* take the best run */
+    double best = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        double begin = timerNow();
+        chunkInput(&chunker, input, chunkSizeList);
+        double elapsed = timerNow() - begin;
+        if (i == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+    chunkInput(&chunker, modified, modifiedChunkSizeList);
+
+    /* chunk size distribution */
+    long histogram[HISTOGRAM_BUCKET_NUM] = {0};
+    int minSize = chunkSizeList.empty() ? 0 : chunkSizeList[0], maxSize = 0;
+    double mean = (double)input.size() / chunkSizeList.size(), variance = 0;
+    for (int size : chunkSizeList)
+    {
+        histogram[min(size / HISTOGRAM_BUCKET_SIZE, HISTOGRAM_BUCKET_NUM - 1)]++;
+        minSize = min(minSize, size);
+        maxSize = max(maxSize, size);
+        variance += (size - mean) * (size - mean);
+    }
+    variance /= chunkSizeList.size();
+
+    printf("%-8s %10.2f MB/s  chunks %9zu  avg %8.1f  stddev %8.1f  min %6d  max %6d  shared after insert %6.2f%%\n",
+           name, input.size() / 1048576.0 / best, chunkSizeList.size(), mean, sqrt(variance), minSize, maxSize,
+           sharedFraction(input, chunkSizeList, modified, modifiedChunkSizeList) * 100);
+    printf("         size histogram (KB):");
+    for (int i = 0; i < HISTOGRAM_BUCKET_NUM; i++)
+    {
+        if (i + 1 < HISTOGRAM_BUCKET_NUM)
+        {
+            printf(" [%d,%d) %.1f%%", i * HISTOGRAM_BUCKET_SIZE >> 10, (i + 1) * HISTOGRAM_BUCKET_SIZE >> 10,
+                   histogram[i] * 100.0 / chunkSizeList.size());
+        }
+        else
+        {
+            printf(" [%d,) %.1f%%", i * HISTOGRAM_BUCKET_SIZE >> 10, histogram[i] * 100.0 / chunkSizeList.size());
+        }
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *fileName = NULL;
+    long sizeMB = 256;
+    int runs = 3;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--file=", 7) == 0)
+        {
+            fileName = argv[i] + 7;
+        }
+        else if (strncmp(argv[i], "--size=", 7) == 0)
+        {
+            sizeMB = atol(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "--runs=", 7) == 0)
+        {
+            runs = atoi(argv[i] + 7);
+        }
+        else
+        {
+            printf("usage: ./chunker_bench [--file=PATH] [--size=MB] [--runs=N]\n");
+            return 1;
+        }
+    }
+    if (runs < 1)
+    {
+        runs = 1;
+    }
+
+    /* prepare the input */
+    vector<unsigned char> input;
+    if (fileName != NULL)
+    {
+        FILE *fin = fopen(fileName, "rb");
+        if (fin == NULL)
+        {
+            fprintf(stderr, "fail to open %s\n", fileName);
+            return 1;
+        }
+        fseek(fin, 0, SEEK_END);
+        input.resize(ftell(fin));
+        fseek(fin, 0, SEEK_SET);
+        if (fread(input.data(), 1, input.size(), fin) != input.size())
+        {
+            fprintf(stderr, "fail to read %s\n", fileName);
+            fclose(fin);
+            return 1;
+        }
+        fclose(fin);
+    }
+    else
+    {
+        input.resize(sizeMB << 20);
+        srand(301);
+        for (size_t i = 0; i < input.size(); i++)
+        {
+            input[i] = (unsigned char)(rand() >> 7);
+        }
+    }
+    if (input.empty())
+    {
+        fprintf(stderr, "empty input\n");
+        return 1;
+    }
+
+    /* the same input with one byte inserted in the middle */
+    vector<unsigned char> modified(input);
+    modified.insert(modified.begin() + modified.size() / 2, (unsigned char)0x5a);
+
+    printf("input: %.2f MB, best of %d runs\n", input.size() / 1048576.0, runs);
+    bench("FIX", FIX_SIZE_TYPE, input, modified, runs);
+    bench("VAR", VAR_SIZE_TYPE, input, modified, runs);
+    bench("FASTCDC", FASTCDC_TYPE, input, modified, runs);
+    return 0;
+}
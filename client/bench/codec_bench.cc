@@ -0,0 +1,241 @@
+/*
+ * codec_bench.cc
+ *
+ * benchmark of CAONT-RS encoding, secret by secret with encoding() and in batches with encodingBatch(),
+ * and of the kernels generating the parity shares alone, for the CAONT packages generated with AES-CBC
+ * and with AES-CTR. every batch result is first checked to give the same shares as the per-secret path,
+ * and the secrets are decoded back from k shares
+ *
+ * usage: ./codec_bench [--size=KB] [--batch=N] [--secrets=N] [--runs=N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <random>
+#include <vector>
+
+#include "CDCodec.hh"
+
+using namespace std;
+
+/* coding parameters of the client */
+#define BENCH_N 4
+#define BENCH_M 1
+#define BENCH_R 2
+
+struct gfKernel_t
+{
+    const char *name;
+    int mode;
+};
+
+struct codecVariant_t
+{
+    const char *name;
+    int type;
+};
+
+static const codecVariant_t codecVariants[] = {
+    {"cbc", CAONT_RS_TYPE},
+    {"ctr", CAONT_RS_CTR_TYPE},
+};
+
+static const gfKernel_t gfKernels[] = {
+    {"gf-complete", GF_KERNEL_GFCOMPLETE},
+    {"ssse3", GF_KERNEL_SSSE3},
+    {"avx2", GF_KERNEL_AVX2},
+};
+
+double timerNow()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+}
+
+int main(int argc, char *argv[])
+{
+    int secretSize = 8 << 10, batch = 16, numOfSecrets = 4096, runs = 3;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--size=", 7) == 0)
+        {
+            secretSize = atoi(argv[i] + 7) << 10;
+        }
+        else if (strncmp(argv[i], "--batch=", 8) == 0)
+        {
+            batch = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "--secrets=", 10) == 0)
+        {
+            numOfSecrets = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--runs=", 7) == 0)
+        {
+            runs = atoi(argv[i] + 7);
+        }
+        else
+        {
+            printf("usage: ./codec_bench [--size=KB] [--batch=N] [--secrets=N] [--runs=N]\n");
+            return 1;
+        }
+    }
+    if (secretSize < 1 || secretSize > MAX_SECRET_SIZE - (1 << 10) || batch < 1 || numOfSecrets < 1 || runs < 1)
+    {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+    numOfSecrets = (numOfSecrets + batch - 1) / batch * batch;
+
+    if (!CryptoPrimitive::opensslLockSetup())
+    {
+        fprintf(stderr, "fail to set up OpenSSL locks\n");
+        return 1;
+    }
+    CryptoPrimitive *cryptoObj = new CryptoPrimitive(LOW_SEC_PAIR_TYPE);
+
+    /* random secrets of random sizes up to secretSize, like variable-size chunks */
+    mt19937_64 rng(37);
+    int shareBufferSize = 2 * MAX_SECRET_SIZE;
+    vector<unsigned char> secrets((size_t)numOfSecrets * secretSize), decoded(secretSize);
+    vector<unsigned char> expected((size_t)numOfSecrets * shareBufferSize), actual(expected.size());
+    vector<unsigned char *> secretBuffers(numOfSecrets), expectedBuffers(numOfSecrets), actualBuffers(numOfSecrets);
+    vector<int> secretSizes(numOfSecrets), expectedSizes(numOfSecrets), actualSizes(numOfSecrets);
+    for (size_t i = 0; i < secrets.size(); i++)
+    {
+        secrets[i] = (unsigned char)rng();
+    }
+    long long totalSize = 0;
+    for (int i = 0; i < numOfSecrets; i++)
+    {
+        secretBuffers[i] = &secrets[(size_t)i * secretSize];
+        secretSizes[i] = secretSize / 2 + (int)(rng() % (secretSize / 2 + 1));
+        expectedBuffers[i] = &expected[(size_t)i * shareBufferSize];
+        actualBuffers[i] = &actual[(size_t)i * shareBufferSize];
+        totalSize += secretSizes[i];
+    }
+
+    /* decode from the last k shares, which takes the parity share */
+    int kShareIDList[BENCH_N - BENCH_M];
+    for (int j = 0; j < BENCH_N - BENCH_M; j++)
+    {
+        kShareIDList[j] = BENCH_M + j;
+    }
+
+    printf("%d secrets of %d-%d bytes, batches of %d, best of %d runs\n", numOfSecrets, secretSize / 2, secretSize,
+           batch, runs);
+
+    bool correct = true;
+    char name[64];
+    double best = 0;
+    for (const codecVariant_t &codecVariant : codecVariants)
+    {
+        CDCodec *codec = new CDCodec(codecVariant.type, BENCH_N, BENCH_M, BENCH_R, cryptoObj);
+
+        /* the per-secret path, whose shares are the reference */
+        codec->setGFKernelMode(GF_KERNEL_GFCOMPLETE);
+        for (int r = 0; r < runs; r++)
+        {
+            double begin = timerNow();
+            for (int i = 0; i < numOfSecrets; i++)
+            {
+                codec->encoding(secretBuffers[i], secretSizes[i], expectedBuffers[i], &expectedSizes[i]);
+            }
+            double elapsed = timerNow() - begin;
+            if (r == 0 || elapsed < best)
+            {
+                best = elapsed;
+            }
+        }
+        snprintf(name, sizeof(name), "%s encoding", codecVariant.name);
+        printf("%-30s %10.2f MB/s\n", name, totalSize / best / (1 << 20));
+
+        for (const gfKernel_t &gfKernel : gfKernels)
+        {
+            if (!codec->setGFKernelMode(gfKernel.mode))
+            {
+                printf("%s %-26s not supported\n", codecVariant.name, gfKernel.name);
+                continue;
+            }
+
+            /* the whole encoding in batches */
+            memset(actual.data(), 0, actual.size());
+            for (int r = 0; r < runs; r++)
+            {
+                double begin = timerNow();
+                for (int i = 0; i < numOfSecrets; i += batch)
+                {
+                    codec->encodingBatch(batch, &secretBuffers[i], &secretSizes[i], &actualBuffers[i], &actualSizes[i]);
+                }
+                double elapsed = timerNow() - begin;
+                if (r == 0 || elapsed < best)
+                {
+                    best = elapsed;
+                }
+            }
+            double encodeSpeed = totalSize / best / (1 << 20);
+
+            for (int i = 0; i < numOfSecrets; i++)
+            {
+                if (actualSizes[i] != expectedSizes[i] ||
+                    memcmp(actualBuffers[i], expectedBuffers[i], (size_t)actualSizes[i] * BENCH_N) != 0)
+                {
+                    fprintf(stderr, "share mismatch: %s, kernel %s, secret %d, size %d\n", codecVariant.name,
+                            gfKernel.name, i, secretSizes[i]);
+                    correct = false;
+                    break;
+                }
+            }
+
+            /* the parity shares alone, from the data shares just generated */
+            for (int r = 0; r < runs; r++)
+            {
+                double begin = timerNow();
+                for (int i = 0; i < numOfSecrets; i += batch)
+                {
+                    codec->parityBatch(batch, &actualBuffers[i], &actualSizes[i]);
+                }
+                double elapsed = timerNow() - begin;
+                if (r == 0 || elapsed < best)
+                {
+                    best = elapsed;
+                }
+            }
+            snprintf(name, sizeof(name), "%s encodingBatch %s", codecVariant.name, gfKernel.name);
+            printf("%-30s %10.2f MB/s    parity only %10.2f MB/s\n", name, encodeSpeed, totalSize / best / (1 << 20));
+        }
+
+        /* decode every secret back */
+        for (int r = 0; r < runs; r++)
+        {
+            double begin = timerNow();
+            for (int i = 0; i < numOfSecrets; i++)
+            {
+                int shareSize = expectedSizes[i];
+                if (!codec->decoding(expectedBuffers[i] + (size_t)shareSize * BENCH_M, kShareIDList, shareSize,
+                                     secretSizes[i], decoded.data()) ||
+                    memcmp(decoded.data(), secretBuffers[i], secretSizes[i]) != 0)
+                {
+                    fprintf(stderr, "decoding mismatch: %s, secret %d, size %d\n", codecVariant.name, i, secretSizes[i]);
+                    correct = false;
+                    break;
+                }
+            }
+            double elapsed = timerNow() - begin;
+            if (r == 0 || elapsed < best)
+            {
+                best = elapsed;
+            }
+        }
+        snprintf(name, sizeof(name), "%s decoding", codecVariant.name);
+        printf("%-30s %10.2f MB/s\n", name, totalSize / best / (1 << 20));
+
+        delete codec;
+    }
+
+    delete cryptoObj;
+    CryptoPrimitive::opensslLockCleanup();
+    return correct ? 0 : 1;
+}
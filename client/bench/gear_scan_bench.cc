@@ -0,0 +1,162 @@
+/*
+ * gear_scan_bench.cc
+ *
+ * microbenchmark of the gear hash scanning methods of the FastCDC chunker, which first verifies that
+ * every method gives the same chunk boundaries as the scalar one on random buffers, and then reports GB/s
+ *
+ * usage: ./gear_scan_bench [--size=MB] [--runs=N] [--verify=N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <random>
+#include <vector>
+
+#include "chunker.hh"
+
+using namespace std;
+
+struct scanMode_t
+{
+    const char *name;
+    int mode;
+};
+
+static const scanMode_t scanModes[] = {
+    {"scalar", GEAR_SCAN_SCALAR},
+    {"striped", GEAR_SCAN_STRIPED},
+    {"avx2", GEAR_SCAN_AVX2},
+};
+
+double timerNow()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+}
+
+/*
+ * chunk random buffers of random sizes with every method, and compare with the scalar method
+ *
+ * @return whether all the boundaries are identical
+ */
+bool verify(Chunker &chunker, int numOfBuffers)
+{
+    mt19937_64 rng(301);
+    vector<unsigned char> buffer(4 << 20);
+    vector<int> expected(buffer.size()), actual(buffer.size());
+    int expectedNum, actualNum;
+    bool identical = true;
+
+    for (int i = 0; i < numOfBuffers; i++)
+    {
+        int size = (int)(rng() % buffer.size()) + 1;
+        /* low-entropy buffers give long runs without a match, and many matches in a stripe */
+        int alphabet = (i % 3 == 0) ? 2 : 256;
+        for (int j = 0; j < size; j++)
+        {
+            buffer[j] = (unsigned char)(rng() % alphabet);
+        }
+
+        chunker.setGearScanMode(GEAR_SCAN_SCALAR);
+        chunker.chunking(buffer.data(), size, expected.data(), &expectedNum);
+        for (const scanMode_t &scanMode : scanModes)
+        {
+            if (!chunker.setGearScanMode(scanMode.mode))
+            {
+                continue;
+            }
+            chunker.chunking(buffer.data(), size, actual.data(), &actualNum);
+            if (actualNum != expectedNum || memcmp(actual.data(), expected.data(), sizeof(int) * actualNum) != 0)
+            {
+                fprintf(stderr, "boundary mismatch: method %s, buffer %d, size %d\n", scanMode.name, i, size);
+                identical = false;
+            }
+        }
+    }
+    return identical;
+}
+
+void bench(const char *name, Chunker &chunker, vector<unsigned char> &input, int runs)
+{
+    vector<int> chunkEndIndexList(input.size() / 64 + 1);
+    int numOfChunks = 0;
+
+    printf("%s\n", name);
+    for (const scanMode_t &scanMode : scanModes)
+    {
+        if (!chunker.setGearScanMode(scanMode.mode))
+        {
+            printf("    %-8s unsupported\n", scanMode.name);
+            continue;
+        }
+        /* take the best run */
+        double best = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double begin = timerNow();
+            chunker.chunking(input.data(), (int)input.size(), chunkEndIndexList.data(), &numOfChunks);
+            double elapsed = timerNow() - begin;
+            if (i == 0 || elapsed < best)
+            {
+                best = elapsed;
+            }
+        }
+        printf("    %-8s %8.3f GB/s  (%d chunks)\n", scanMode.name, input.size() / 1073741824.0 / best, numOfChunks);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long sizeMB = 256;
+    int runs = 5, numOfBuffers = 200;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--size=", 7) == 0)
+        {
+            sizeMB = atol(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "--runs=", 7) == 0)
+        {
+            runs = atoi(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "--verify=", 9) == 0)
+        {
+            numOfBuffers = atoi(argv[i] + 9);
+        }
+        else
+        {
+            printf("usage: ./gear_scan_bench [--size=MB] [--runs=N] [--verify=N]\n");
+            return 1;
+        }
+    }
+    if (sizeMB < 1 || sizeMB > 1024)
+    {
+        fprintf(stderr, "the size should be in [1, 1024] MB\n");
+        return 1;
+    }
+
+    /* the default FastCDC chunker, and one with rare boundaries for measuring the raw scanning speed */
+    Chunker chunker(FASTCDC_TYPE);
+    Chunker scanner(FASTCDC_TYPE, 1 << 20, 64, 4 << 20);
+
+    if (!verify(chunker, numOfBuffers) || !verify(scanner, numOfBuffers / 10))
+    {
+        return 1;
+    }
+    printf("verified: all the methods give identical boundaries\n");
+
+    vector<unsigned char> input(sizeMB << 20);
+    mt19937_64 rng(302);
+    for (size_t i = 0; i < input.size(); i += sizeof(uint64_t))
+    {
+        uint64_t r = rng();
+        memcpy(input.data() + i, &r, sizeof(r));
+    }
+    printf("input: %ld MB of random data, best of %d runs\n", sizeMB, runs);
+    bench("FastCDC 2KB/8KB/16KB", chunker, input, runs);
+    bench("raw scan (64B/1MB/4MB)", scanner, input, runs);
+    return 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * hash_bench.cc
+ *
+ * benchmark of the hashes generating the key of a CAONT package, which reports the cost of hashing a secret
+ * with each of them. the rabin hash with precomputed tables is first checked to give the same hashes as the
+ * previous implementation, which built its tables on every call. then the SHA-256 share fingerprints are
+ * generated in batches with each kernel, and checked against hashing the shares one by one with OpenSSL
+ *
+ * usage: ./hash_bench [--size=KB] [--secrets=N] [--runs=N] [--verify=N]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <random>
+#include <vector>
+
+#include "CryptoPrimitive.hh"
+
+using namespace std;
+
+double timerNow()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+}
+
+/*
+ * the previous rabin hash, which allocated and built its lookup tables on every call (and leaked them)
+ */
+int rabinPerCallTables(unsigned char *buffer, int chunkSize)
+{
+    int winFp = 0, i, slidingWinSize_ = 48;
+    int maxWinFp = 0;
+    if (chunkSize < 48)
+    {
+        slidingWinSize_ = chunkSize;
+    }
+    uint32_t polyBase_ = 257;
+    uint32_t polyMOD_ = (1 << 23);
+
+    uint32_t *powerLUT_ = (uint32_t *)malloc(sizeof(uint32_t) * (slidingWinSize_ > 0 ? slidingWinSize_ : 1));
+    powerLUT_[0] = 1;
+    for (i = 1; i < slidingWinSize_; i++)
+    {
+        powerLUT_[i] = (powerLUT_[i - 1] * polyBase_) & (polyMOD_ - 1);
+    }
+    uint32_t *removeLUT_ = (uint32_t *)malloc(sizeof(uint32_t) * 256);
+    for (i = 0; i < 256; i++)
+    {
+        removeLUT_[i] = (i * powerLUT_[slidingWinSize_ > 0 ? slidingWinSize_ - 1 : 0]) & (polyMOD_ - 1);
+        if (removeLUT_[i] != 0)
+            removeLUT_[i] = polyMOD_ - removeLUT_[i];
+    }
+
+    int chunkEndIndex = -1 + slidingWinSize_;
+    int chunkEndIndexLimit = -1 + chunkSize;
+    for (i = 0; i < slidingWinSize_; i++)
+    {
+        winFp = winFp + ((buffer[chunkEndIndex - i] * powerLUT_[i]) & (polyMOD_ - 1));
+    }
+    winFp = winFp & (polyMOD_ - 1);
+    maxWinFp = (winFp > maxWinFp) ? winFp : maxWinFp;
+    while (chunkEndIndex < chunkEndIndexLimit)
+    {
+        chunkEndIndex++;
+        winFp = ((winFp + removeLUT_[buffer[chunkEndIndex - slidingWinSize_]]) * polyBase_ + buffer[chunkEndIndex]) &
+                (polyMOD_ - 1);
+        maxWinFp = (winFp > maxWinFp) ? winFp : maxWinFp;
+    }
+
+    /* freed here unlike the previous implementation, so that the benchmark does not run out of memory */
+    free(powerLUT_);
+    free(removeLUT_);
+    return maxWinFp;
+}
+
+bool hashPerCallTables(CryptoPrimitive *, unsigned char *data, int size, unsigned char *hash)
+{
+    int fp = rabinPerCallTables(data, size);
+    for (int i = 0; i < 16; i++)
+    {
+        hash[i] = (fp >> (8 * (i % 4))) & 255;
+    }
+    return true;
+}
+
+bool hashRabin(CryptoPrimitive *, unsigned char *data, int size, unsigned char *hash)
+{
+    return CryptoPrimitive::generateHash_rabin(data, size, hash);
+}
+
+bool hashXXH3(CryptoPrimitive *crypto, unsigned char *data, int size, unsigned char *hash)
+{
+    return crypto->generateHash_xxh3(data, size, hash);
+}
+
+bool hashDigest(CryptoPrimitive *crypto, unsigned char *data, int size, unsigned char *hash)
+{
+    return crypto->generateHash(data, size, hash);
+}
+
+/* shares of a secret in CAONT-RS with n = 4 and k = 3, and the shares fingerprinted at a time */
+#define BENCH_SHARES_PER_SECRET 3
+#define BENCH_FP_BATCH 32
+
+struct hashKernel_t
+{
+    const char *name;
+    int mode;
+};
+
+static const hashKernel_t hashKernels[] = {
+    {"openssl", SHA256_KERNEL_OPENSSL},
+    {"sha-ni", SHA256_KERNEL_SHANI},
+    {"avx2", SHA256_KERNEL_AVX2},
+};
+
+struct keyHash_t
+{
+    const char *name;
+    int cryptoType;
+    bool (*hash)(CryptoPrimitive *, unsigned char *, int, unsigned char *);
+};
+
+static const keyHash_t keyHashes[] = {
+    {"rabin, tables per call", LOW_SEC_PAIR_TYPE, hashPerCallTables},
+    {"rabin", LOW_SEC_PAIR_TYPE, hashRabin},
+    {"xxh3 128-bit", LOW_SEC_PAIR_TYPE, hashXXH3},
+    {"xxh3 256-bit", HIGH_SEC_PAIR_TYPE, hashXXH3},
+    {"md5", LOW_SEC_PAIR_TYPE, hashDigest},
+    {"sha-256", HIGH_SEC_PAIR_TYPE, hashDigest},
+};
+
+/*
+ * hash random buffers of random sizes with both rabin implementations
+ *
+ * @return whether all the hashes are identical
+ */
+bool verify(int numOfBuffers)
+{
+    mt19937_64 rng(39);
+    vector<unsigned char> buffer(64 << 10);
+    unsigned char expected[16], actual[16];
+    bool identical = true;
+
+    for (int i = 0; i < numOfBuffers; i++)
+    {
+        /* include the sizes shorter than a window */
+        int size = (i % 4 == 0) ? (int)(rng() % 64) : (int)(rng() % buffer.size()) + 1;
+        for (int j = 0; j < size; j++)
+        {
+            buffer[j] = (unsigned char)rng();
+        }
+        hashPerCallTables(NULL, buffer.data(), size, expected);
+        CryptoPrimitive::generateHash_rabin(buffer.data(), size, actual);
+        if (memcmp(expected, actual, sizeof(expected)) != 0)
+        {
+            fprintf(stderr, "rabin hash mismatch: buffer %d, size %d\n", i, size);
+            identical = false;
+        }
+    }
+    return identical;
+}
+
+int main(int argc, char *argv[])
+{
+    int secretSize = 8 << 10, numOfSecrets = 4096, runs = 3, numOfVerify = 1000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--size=", 7) == 0)
+        {
+            secretSize = atoi(argv[i] + 7) << 10;
+        }
+        else if (strncmp(argv[i], "--secrets=", 10) == 0)
+        {
+            numOfSecrets = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--runs=", 7) == 0)
+        {
+            runs = atoi(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "--verify=", 9) == 0)
+        {
+            numOfVerify = atoi(argv[i] + 9);
+        }
+        else
+        {
+            printf("usage: ./hash_bench [--size=KB] [--secrets=N] [--runs=N] [--verify=N]\n");
+            return 1;
+        }
+    }
+    if (secretSize < 1 || numOfSecrets < 1 || runs < 1 || numOfVerify < 0)
+    {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    if (!CryptoPrimitive::opensslLockSetup())
+    {
+        fprintf(stderr, "fail to set up OpenSSL locks\n");
+        return 1;
+    }
+
+    bool correct = verify(numOfVerify);
+    printf("rabin hashes of %d random buffers: %s\n", numOfVerify, correct ? "identical" : "MISMATCH");
+
+    mt19937_64 rng(139);
+    vector<unsigned char> secrets((size_t)numOfSecrets * secretSize);
+    for (size_t i = 0; i < secrets.size(); i++)
+    {
+        secrets[i] = (unsigned char)rng();
+    }
+
+    printf("%d secrets of %d bytes, best of %d runs\n", numOfSecrets, secretSize, runs);
+    unsigned char hash[32];
+    for (const keyHash_t &keyHash : keyHashes)
+    {
+        CryptoPrimitive crypto(keyHash.cryptoType);
+        double best = 0;
+        for (int r = 0; r < runs; r++)
+        {
+            double begin = timerNow();
+            for (int i = 0; i < numOfSecrets; i++)
+            {
+                keyHash.hash(&crypto, &secrets[(size_t)i * secretSize], secretSize, hash);
+            }
+            double elapsed = timerNow() - begin;
+            if (r == 0 || elapsed < best)
+            {
+                best = elapsed;
+            }
+        }
+        printf("%-24s %10.0f ns/secret %10.2f MB/s\n", keyHash.name, best / numOfSecrets * 1e9,
+               (double)secretSize * numOfSecrets / best / (1 << 20));
+    }
+
+    /* the secrets cut into shares, fingerprinted in batches */
+    int shareSize = secretSize / BENCH_SHARES_PER_SECRET;
+    int numOfShares = numOfSecrets * BENCH_SHARES_PER_SECRET;
+    if (shareSize < 1)
+    {
+        shareSize = secretSize;
+        numOfShares = numOfSecrets;
+    }
+    vector<unsigned char *> shareBuffers(numOfShares), expectedFPs(numOfShares), actualFPs(numOfShares);
+    vector<int> shareSizes(numOfShares);
+    vector<unsigned char> expected((size_t)numOfShares * 32), actual(expected.size());
+    for (int i = 0; i < numOfShares; i++)
+    {
+        /* the last shares of the buffer are cut shorter, to mix sizes in a batch */
+        shareBuffers[i] = &secrets[(size_t)i * shareSize];
+        shareSizes[i] = shareSize - (i % BENCH_SHARES_PER_SECRET) * (int)(rng() % 64);
+        if (shareSizes[i] < 0)
+        {
+            shareSizes[i] = 0;
+        }
+        expectedFPs[i] = &expected[(size_t)i * 32];
+        actualFPs[i] = &actual[(size_t)i * 32];
+    }
+
+    printf("%d shares of up to %d bytes, SHA-256 in batches of %d\n", numOfShares, shareSize, BENCH_FP_BATCH);
+    CryptoPrimitive fpCrypto(SHA256_TYPE);
+    double best = 0;
+    for (int r = 0; r < runs; r++)
+    {
+        double begin = timerNow();
+        for (int i = 0; i < numOfShares; i++)
+        {
+            fpCrypto.generateHash(shareBuffers[i], shareSizes[i], expectedFPs[i]);
+        }
+        double elapsed = timerNow() - begin;
+        if (r == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+    long long totalSize = 0;
+    for (int i = 0; i < numOfShares; i++)
+    {
+        totalSize += shareSizes[i];
+    }
+    printf("%-24s %10.0f ns/share  %10.2f MB/s\n", "generateHash", best / numOfShares * 1e9,
+           totalSize / best / (1 << 20));
+
+    for (const hashKernel_t &hashKernel : hashKernels)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "generateHashBatch %s", hashKernel.name);
+        if (!fpCrypto.setHashKernelMode(hashKernel.mode))
+        {
+            printf("%-24s not supported\n", name);
+            continue;
+        }
+        memset(actual.data(), 0, actual.size());
+        for (int r = 0; r < runs; r++)
+        {
+            double begin = timerNow();
+            for (int i = 0; i < numOfShares; i += BENCH_FP_BATCH)
+            {
+                int num = (numOfShares - i < BENCH_FP_BATCH) ? numOfShares - i : BENCH_FP_BATCH;
+                fpCrypto.generateHashBatch(num, &shareBuffers[i], &shareSizes[i], &actualFPs[i]);
+            }
+            double elapsed = timerNow() - begin;
+            if (r == 0 || elapsed < best)
+            {
+                best = elapsed;
+            }
+        }
+        if (memcmp(actual.data(), expected.data(), expected.size()) != 0)
+        {
+            fprintf(stderr, "fingerprint mismatch: kernel %s\n", hashKernel.name);
+            correct = false;
+        }
+        printf("%-24s %10.0f ns/share  %10.2f MB/s\n", name, best / numOfShares * 1e9, totalSize / best / (1 << 20));
+    }
+
+    CryptoPrimitive::opensslLockCleanup();
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+/*
+ * queue_bench.cc
+ *
+ * microbenchmark of the ring buffers between the pipeline threads: the mutex-based ring buffer,
+ * and the lock-free SPSC and MPMC ones, with small objects and with share-descriptor-sized objects.
+ * every consumer checks that the objects of each producer come in order and none is lost
+ *
+ * usage: ./queue_bench [--items=N] [--size=N] [--runs=N]
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "BasicRingBuffer.hh"
+#include "LockFreeRingBuffer.hh"
+
+using namespace std;
+
+/* objects passed in a batch */
+#define BENCH_BATCH_SIZE 32
+
+/* max number of producer or consumer threads */
+#define BENCH_MAX_THREADS 8
+
+/* the sequence number that tells a consumer to stop */
+#define END_SEQ UINT64_MAX
+
+/* a small object */
+typedef struct {
+    uint64_t seq;
+} smallItem_t;
+
+/* an object as large as the share descriptor passed to the uploader */
+typedef struct {
+    uint64_t seq;
+    unsigned char payload[120];
+} descriptorItem_t;
+
+double timerNow()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+}
+
+/* the producer of an object is in the high bits of its sequence number */
+static inline uint64_t makeSeq(int producer, uint64_t i) { return ((uint64_t)producer << 48) | i; }
+
+template <class Queue, class T> struct benchParam_t {
+    Queue* queue;
+    int index;
+    long items;
+    int numOfProducers;
+    bool batch;
+    /* results of a consumer */
+    long received;
+    long errors;
+};
+
+template <class Queue, class T> void* producer(void* arg)
+{
+    benchParam_t<Queue, T>* param = (benchParam_t<Queue, T>*)arg;
+    T item;
+    memset(&item, 0, sizeof(item));
+    for (long i = 0; i < param->items; i++) {
+        item.seq = makeSeq(param->index, i);
+        param->queue->Insert(&item, sizeof(item));
+    }
+    return NULL;
+}
+
+template <class Queue, class T> void* consumer(void* arg)
+{
+    benchParam_t<Queue, T>* param = (benchParam_t<Queue, T>*)arg;
+    uint64_t next[BENCH_MAX_THREADS];
+    memset(next, 0, sizeof(next));
+    T item;
+    while (true) {
+        param->queue->Extract(&item);
+        if (item.seq == END_SEQ) break;
+        int from = (int)(item.seq >> 48);
+        uint64_t i = item.seq & ((1ULL << 48) - 1);
+        /* objects of one producer may be taken by other consumers, but never reordered */
+        if (from >= param->numOfProducers || i < next[from]) {
+            param->errors++;
+        } else {
+            next[from] = i + 1;
+        }
+        param->received++;
+    }
+    return NULL;
+}
+
+template <class T> void* batchProducer(void* arg)
+{
+    benchParam_t<SPSCRingBuffer<T>, T>* param = (benchParam_t<SPSCRingBuffer<T>, T>*)arg;
+    T items[BENCH_BATCH_SIZE];
+    memset(items, 0, sizeof(items));
+    for (long i = 0; i < param->items; i += BENCH_BATCH_SIZE) {
+        int num = (param->items - i < BENCH_BATCH_SIZE) ? (int)(param->items - i) : BENCH_BATCH_SIZE;
+        for (int j = 0; j < num; j++) {
+            items[j].seq = makeSeq(0, i + j);
+        }
+        param->queue->InsertBatch(items, num);
+    }
+    return NULL;
+}
+
+template <class T> void* batchConsumer(void* arg)
+{
+    benchParam_t<SPSCRingBuffer<T>, T>* param = (benchParam_t<SPSCRingBuffer<T>, T>*)arg;
+    T items[BENCH_BATCH_SIZE];
+    uint64_t next = 0;
+    while (true) {
+        int num = param->queue->ExtractBatch(items, BENCH_BATCH_SIZE);
+        for (int j = 0; j < num; j++) {
+            if (items[j].seq == END_SEQ) return NULL;
+            if (items[j].seq != next) {
+                param->errors++;
+            }
+            next = items[j].seq + 1;
+            param->received++;
+        }
+    }
+}
+
+/*
+ * run producers and consumers on a queue, and report the throughput of the best run
+ *
+ * @return whether every object was received in order
+ */
+template <class Queue, class T>
+bool run(const char* name, int numOfProducers, int numOfConsumers, long items, int size, int runs, bool batch)
+{
+    double best = 0;
+    bool correct = true;
+    for (int r = 0; r < runs; r++) {
+        Queue* queue = new Queue(size);
+        benchParam_t<Queue, T> producers[BENCH_MAX_THREADS], consumers[BENCH_MAX_THREADS];
+        pthread_t producerTid[BENCH_MAX_THREADS], consumerTid[BENCH_MAX_THREADS];
+
+        double begin = timerNow();
+        for (int i = 0; i < numOfConsumers; i++) {
+            consumers[i] = {queue, i, 0, numOfProducers, batch, 0, 0};
+            pthread_create(&consumerTid[i], NULL, batch ? (void* (*)(void*))batchConsumer<T> : consumer<Queue, T>,
+                           &consumers[i]);
+        }
+        for (int i = 0; i < numOfProducers; i++) {
+            producers[i] = {queue, i, items / numOfProducers, numOfProducers, batch, 0, 0};
+            pthread_create(&producerTid[i], NULL, batch ? (void* (*)(void*))batchProducer<T> : producer<Queue, T>,
+                           &producers[i]);
+        }
+        for (int i = 0; i < numOfProducers; i++) {
+            pthread_join(producerTid[i], NULL);
+        }
+        /* one end object for each consumer */
+        T end;
+        memset(&end, 0, sizeof(end));
+        end.seq = END_SEQ;
+        for (int i = 0; i < numOfConsumers; i++) {
+            queue->Insert(&end, sizeof(end));
+        }
+        long received = 0, errors = 0;
+        for (int i = 0; i < numOfConsumers; i++) {
+            pthread_join(consumerTid[i], NULL);
+            received += consumers[i].received;
+            errors += consumers[i].errors;
+        }
+        double elapsed = timerNow() - begin;
+        delete queue;
+
+        if (received != items / numOfProducers * numOfProducers || errors != 0) {
+            fprintf(stderr, "%s: received %ld of %ld objects, %ld out of order\n", name, received,
+                    items / numOfProducers * numOfProducers, errors);
+            correct = false;
+        }
+        if (r == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf("%-22s %4d B  %dP%dC  %8.2f Mops/s\n", name, (int)sizeof(T), numOfProducers, numOfConsumers,
+           items / best / 1e6);
+    return correct;
+}
+
+/* the mutex-based ring buffer, with the lock-free ones' constructor */
+template <class T> class MutexRingBuffer : public RingBuffer<T> {
+public:
+    MutexRingBuffer(int size) : RingBuffer<T>(size, true, 1) {}
+};
+
+template <class T> bool benchItem(long items, int size, int runs)
+{
+    bool correct = true;
+    correct &= run<MutexRingBuffer<T>, T>("mutex", 1, 1, items, size, runs, false);
+    correct &= run<SPSCRingBuffer<T>, T>("spsc", 1, 1, items, size, runs, false);
+    correct &= run<SPSCRingBuffer<T>, T>("spsc batch", 1, 1, items, size, runs, true);
+    correct &= run<MPMCRingBuffer<T>, T>("mpmc", 1, 1, items, size, runs, false);
+    correct &= run<MPMCRingBuffer<T>, T>("mpmc", 2, 2, items, size, runs, false);
+    correct &= run<MPMCRingBuffer<T>, T>("mpmc", 4, 4, items, size, runs, false);
+    return correct;
+}
+
+int main(int argc, char* argv[])
+{
+    long items = 4000000;
+    int size = 1024, runs = 3;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--items=", 8) == 0) {
+            items = atol(argv[i] + 8);
+        } else if (strncmp(argv[i], "--size=", 7) == 0) {
+            size = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--runs=", 7) == 0) {
+            runs = atoi(argv[i] + 7);
+        } else {
+            printf("usage: ./queue_bench [--items=N] [--size=N] [--runs=N]\n");
+            return 1;
+        }
+    }
+    if (items < 1 || size < 2 || runs < 1) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("%ld objects through a ring buffer of %d slots, best of %d runs\n", items, size, runs);
+    bool correct = benchItem<smallItem_t>(items, size, runs);
+    correct &= benchItem<descriptorItem_t>(items, size, runs);
+    return correct ? 0 : 1;
+}
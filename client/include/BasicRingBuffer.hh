@@ -49,7 +49,7 @@ public:
 
 	int Insert(T* data, int len) {
 		pthread_mutex_lock(&mAccess);
-		if (count == max) {
+		while (count == max) {
 			pthread_cond_wait(&cvFull, &mAccess);
 		}
         buffer[writeIndex].len = len;
@@ -63,7 +63,7 @@ public:
 
 	int Extract(T* data) {
 		pthread_mutex_lock(&mAccess);
-		if (count == 0) {
+		while (count == 0) {
 			if (!blockOnEmpty) {
 				pthread_cond_signal(&cvFull);
 				pthread_mutex_unlock(&mAccess);
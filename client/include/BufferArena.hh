@@ -0,0 +1,79 @@
+/*
+ * BufferArena.hh
+ * - a pool of fixed-size buffer blocks with reference counts,
+ *   so that the pipeline stages pass slices of the blocks instead of copying the payloads
+ */
+
+#ifndef __BUFFER_ARENA_HH__
+#define __BUFFER_ARENA_HH__
+
+#include <pthread.h>
+#include <stdlib.h>
+
+using namespace std;
+
+class BufferArena{
+    private:
+        /* size of each block */
+        int blockSize_;
+
+        /* total number of blocks */
+        int numOfBlocks_;
+
+        /* memory of all the blocks */
+        unsigned char* blocks_;
+
+        /* reference count of each block */
+        int* refCount_;
+
+        /* stack of free block indices */
+        int* freeList_;
+
+        /* number of free blocks */
+        int numOfFree_;
+
+        /* lock and condition variable of the free list */
+        pthread_mutex_t mAccess_;
+        pthread_cond_t cvFree_;
+
+    public:
+        /* slice of a block, which is a descriptor small enough to be passed through the ringbuffers */
+        typedef struct{
+            unsigned char* data;  // start of the slice
+            int size;             // size of the slice
+            int block;            // index of the block
+            BufferArena* arena;   // arena owning the block
+        }Slice_t;
+
+        /*
+         * constructor
+         *
+         * @param blockSize - size of each block
+         * @param numOfBlocks - total number of blocks
+         */
+        BufferArena(int blockSize, int numOfBlocks);
+
+        /*
+         * destructor
+         */
+        ~BufferArena();
+
+        /*
+         * get a free block, and wait if all the blocks are in use
+         *
+         * @param slice - the slice of the whole block <return>
+         * @param refs - number of releases before the block is free again
+         */
+        void acquire(Slice_t* slice, int refs);
+
+        /*
+         * release a reference to the block of a slice, and free the block on the last release
+         *
+         * @param slice - a slice of the block
+         */
+        static void release(Slice_t* slice);
+
+        inline int getBlockSize() { return blockSize_; }
+};
+
+#endif
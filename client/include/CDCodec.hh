@@ -29,9 +29,22 @@ extern "C"
 #define CAONT_RS_TYPE 3
 
 #define NONE_ENCRPT 4
+/*macro for the type of CAONT-RS masking the secret with an AES-CTR keystream, which is decoded the same way*/
+#define CAONT_RS_CTR_TYPE 5
 
 #define MAX_SECRET_SIZE (64 << 10)
 
+/*macro for the kernels generating the parity shares*/
+/*region multiplications of gf-complete, one call per data share*/
+#define GF_KERNEL_GFCOMPLETE 0
+/*split 4-bit lookup tables in SSSE3 lanes (PSHUFB)*/
+#define GF_KERNEL_SSSE3 1
+/*split 4-bit lookup tables in AVX2 lanes*/
+#define GF_KERNEL_AVX2 2
+
+/*max number of data shares for the SIMD kernels, whose lookup tables stay in registers*/
+#define GF_KERNEL_MAX_K 8
+
 using namespace std;
 
 class CDCodec
@@ -76,6 +89,13 @@ private:
     /*a constant block of size alignedSecretBufferSize_ specially in CAONT-RS*/
     unsigned char *alignedSizeConstant_;
 
+    /*the hash generating the key of a CAONT package (KEY_HASH_RABIN, KEY_HASH_XXH3 or KEY_HASH_DIGEST)*/
+    int keyHashType_;
+
+    /*whether the CAONT package masks the secret with an AES-CTR keystream of the key (CAONT_RS_CTR_TYPE),
+      instead of the AES-CBC ciphertext of alignedSizeConstant_*/
+    bool ctrMasking_;
+
     /*a buffer for storing the data before erasure coding and its size*/
     int erasureCodingDataSize_;
     unsigned char *erasureCodingData_;
@@ -92,6 +112,33 @@ private:
     int *squareMatrix_;
     int *inverseMatrix_;
 
+    /*the kernel generating the parity shares (GF_KERNEL_GFCOMPLETE, GF_KERNEL_SSSE3 or GF_KERNEL_AVX2)*/
+    int gfKernelMode_;
+
+    /*the split lookup tables of the last m rows of the distribution matrix, 32 bytes per coefficient:*/
+    /*the products of the coefficient with the 16 low nibbles, and then with the 16 high nibbles      */
+    unsigned char *parityTables_;
+
+    /*
+     * generate the parity shares of a batch of secrets with one of the SIMD kernels
+     *
+     * @param num - the number of secrets
+     * @param shareBuffers - the n shares of each secret, whose first k shares are given <return>
+     * @param shareSizes - the share size of each secret
+     */
+    void parityBatchSSSE3(int num, unsigned char **shareBuffers, int *shareSizes);
+    void parityBatchAVX2(int num, unsigned char **shareBuffers, int *shareSizes);
+
+    /*
+     * generate the parity bytes of a share from the bytes at the same offsets of the k data shares
+     *
+     * @param row - the parity share
+     * @param dataShares - the first k shares
+     * @param shareSize - the size of each share
+     * @param from - the first offset
+     */
+    void parityTail(int row, unsigned char *dataShares, int shareSize, int from);
+
     /*
      * invert the square matrix squareMatrix_ into inverseMatrix_ in GF
      *
@@ -114,7 +161,7 @@ private:
     /*
      * decode the secret from k = n - m shares using CRSSS
      *
-     * @param shareBuffer - a buffer that stores the k shares
+     * @param shares - the k shares
      * @param kShareIDList - a list that stores the IDs of the k shares
      * @param shareSize - the size of each share
      * @param secretSize - the size of the secret
@@ -122,7 +169,7 @@ private:
      *
      * @return - a boolean value that indicates if the decoding succeeds
      */
-    bool crsssDecoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize, int secretSize, unsigned char *secretBuffer);
+    bool crsssDecoding(unsigned char **shares, int *kShareIDList, int shareSize, int secretSize, unsigned char *secretBuffer);
 
     /*
      * encode a secret into n shares using AONT-RS (proposed by Jason K. Resch and James S. Plank)
@@ -140,7 +187,7 @@ private:
     /*
      * decode the secret from k = n - m shares using AONT-RS (proposed by Jason K. Resch and James S. Plank)
      *
-     * @param shareBuffer - a buffer that stores the k shares
+     * @param shares - the k shares
      * @param kShareIDList - a list that stores the IDs of the k shares
      * @param shareSize - the size of each share
      * @param secretSize - the size of the secret
@@ -148,7 +195,7 @@ private:
      *
      * @return - a boolean value that indicates if the decoding succeeds
      */
-    bool aontRSDecoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize,
+    bool aontRSDecoding(unsigned char **shares, int *kShareIDList, int shareSize,
                         int secretSize, unsigned char *secretBuffer);
 
     /*
@@ -169,7 +216,7 @@ private:
     /*
      * decode the secret from k = n - m shares using old CAONT-RS (proposed in the HotStorage '14 paper)
      *
-     * @param shareBuffer - a buffer that stores the k shares
+     * @param shares - the k shares
      * @param kShareIDList - a list that stores the IDs of the k shares
      * @param shareSize - the size of each share
      * @param secretSize - the size of the secret
@@ -177,7 +224,30 @@ private:
      *
      * @return - a boolean value that indicates if the decoding succeeds
      */
-    bool caontRSOldDecoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize, int secretSize, unsigned char *secretBuffer);
+    bool caontRSOldDecoding(unsigned char **shares, int *kShareIDList, int shareSize, int secretSize, unsigned char *secretBuffer);
+
+    /*
+     * generate the hash of a buffer with the key hash of the codec, whose size is the key size
+     *
+     * @param dataBuffer - the buffer
+     * @param dataSize - the size of the buffer
+     * @param hash - the generated hash <return>
+     *
+     * @return - a boolean value that indicates if the hash generation succeeds
+     */
+    bool keyHashing(unsigned char *dataBuffer, int dataSize, unsigned char *hash);
+
+    /*
+     * XOR a buffer with the mask of key_, which turns an aligned secret into the main part of
+     * its CAONT package, and the main part back into the aligned secret
+     *
+     * @param input - the buffer
+     * @param size - the size of the buffer
+     * @param output - the masked buffer, which is not input <return>
+     *
+     * @return - a boolean value that indicates if the masking succeeds
+     */
+    bool caontMasking(unsigned char *input, int size, unsigned char *output);
 
     /*
      * encode a secret into n shares using CAONT-RS
@@ -190,11 +260,27 @@ private:
      * @return - a boolean value that indicates if the encoding succeeds
      */
     bool caontRSEncoding(unsigned char *secretBuffer, int secretSize, unsigned char *shareBuffer, int *shareSize);
+
+    /*
+     * encode a batch of secrets using CAONT-RS, which builds the CAONT packages of all the secrets
+     * as their first k shares, and then generates the parity shares of the whole batch
+     *
+     * @param num - the number of secrets
+     * @param secretBuffers - the secrets
+     * @param secretSizes - the size of each secret
+     * @param shareBuffers - a buffer for storing the n shares of each secret <return>
+     * @param shareSizes - the share size of each secret <return>
+     *
+     * @return - a boolean value that indicates if the encoding succeeds
+     */
+    bool caontRSEncodingBatch(int num, unsigned char **secretBuffers, int *secretSizes,
+                              unsigned char **shareBuffers, int *shareSizes);
+
     bool caontRSEncodingFileName(unsigned char *secretBuffer, int secretSize, unsigned char *shareBuffer, int *shareSize);
     /*
      * decode the secret from k = n - m shares using CAONT-RS
      *
-     * @param shareBuffer - a buffer that stores the k shares
+     * @param shares - the k shares
      * @param kShareIDList - a list that stores the IDs of the k shares
      * @param shareSize - the size of each share
      * @param secretSize - the size of the secret
@@ -202,7 +288,7 @@ private:
      *
      * @return - a boolean value that indicates if the decoding succeeds
      */
-    bool caontRSDecoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize, int secretSize, unsigned char *secretBuffer);
+    bool caontRSDecoding(unsigned char **shares, int *kShareIDList, int shareSize, int secretSize, unsigned char *secretBuffer);
 
 public:
     /*
@@ -213,12 +299,15 @@ public:
      * @param m - reliability degree (i.e. maximum number of lost shares that can be tolerated)
      * @param r - confidentiality degree (i.e. maximum number of shares from which nothing can be derived)
      * @param cryptoObj - the CryptoPrimitive instance for hash generation and data encryption
+     * @param keyHashType - the hash generating the key of a CAONT package in CAONT-RS, which has to be
+     *                      the same for encoding and decoding a secret
      */
     CDCodec(int CDType = CAONT_RS_TYPE,
             int n = 4,
             int m = 1,
             int r = 2,
-            CryptoPrimitive *cryptoObj = new CryptoPrimitive(HIGH_SEC_PAIR_TYPE));
+            CryptoPrimitive *cryptoObj = new CryptoPrimitive(HIGH_SEC_PAIR_TYPE),
+            int keyHashType = KEY_HASH_RABIN);
 
     /*
      * destructor of CDCodec
@@ -237,6 +326,41 @@ public:
      */
     bool encoding(unsigned char *secretBuffer, int secretSize, unsigned char *shareBuffer, int *shareSize);
 
+    /*
+     * encode a batch of secrets into n shares each, which gives the same shares as encoding() one by one
+     *
+     * @param num - the number of secrets
+     * @param secretBuffers - the secrets
+     * @param secretSizes - the size of each secret
+     * @param shareBuffers - a buffer for storing the n shares of each secret <return>
+     * @param shareSizes - the share size of each secret <return>
+     *
+     * @return - a boolean value that indicates if the encoding succeeds
+     */
+    bool encodingBatch(int num, unsigned char **secretBuffers, int *secretSizes,
+                       unsigned char **shareBuffers, int *shareSizes);
+
+    /*
+     * generate the last m shares of a batch of secrets from their first k shares, with the selected kernel
+     *
+     * @param num - the number of secrets
+     * @param shareBuffers - the n shares of each secret, whose first k shares are given <return>
+     * @param shareSizes - the share size of each secret
+     *
+     * NOTE: only for the codecs based on systematic RS code (AONT-RS, old CAONT-RS and CAONT-RS)
+     */
+    void parityBatch(int num, unsigned char **shareBuffers, int *shareSizes);
+
+    /*
+     * select the kernel generating the parity shares
+     *
+     * @param gfKernelMode - GF_KERNEL_GFCOMPLETE, GF_KERNEL_SSSE3 or GF_KERNEL_AVX2
+     * @return whether the kernel is supported by the CPU and the code parameters
+     *
+     * NOTE: every kernel gives the same shares, the fastest supported one is selected by default
+     */
+    bool setGFKernelMode(int gfKernelMode);
+
     /*
      * decode the secret from k = n - m shares
      *
@@ -250,6 +374,19 @@ public:
      */
     bool decoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize, int secretSize, unsigned char *secretBuffer);
 
+    /*
+     * decode the secret from k = n - m shares
+     *
+     * @param shares - the k shares, which may be anywhere in memory
+     * @param kShareIDList - a list that stores the IDs of the k shares
+     * @param shareSize - the size of each share
+     * @param secretSize - the size of the secret
+     * @param secretBuffer - a buffer for storing the secret <return>
+     *
+     * @return - a boolean value that indicates if the decoding succeeds
+     */
+    bool decoding(unsigned char **shares, int *kShareIDList, int shareSize, int secretSize, unsigned char *secretBuffer);
+
     bool encodingFileName(unsigned char *secretBuffer, int secretSize, unsigned char *shareBuffer, int *shareSize);
 };
 
@@ -29,6 +29,22 @@
 /*macro for the type of a SHA-1 hash generation*/
 #define SHA1_TYPE 3
 
+/*macro for the hash generating the key of a CAONT package*/
+/*the 23-bit rabin fingerprint replicated in the key, for the shares uploaded by earlier versions*/
+#define KEY_HASH_RABIN 0
+/*the 128-bit XXH3 hash (two of them with different seeds for a 256-bit key)*/
+#define KEY_HASH_XXH3 1
+/*the hash of the pair (MD5 or SHA-256)*/
+#define KEY_HASH_DIGEST 2
+
+/*macro for the kernel generating the SHA-256 hashes of a batch*/
+/*one by one with OpenSSL*/
+#define SHA256_KERNEL_OPENSSL 0
+/*with the SHA extensions, two hashes at a time*/
+#define SHA256_KERNEL_SHANI 1
+/*eight hashes at a time in AVX2 lanes*/
+#define SHA256_KERNEL_AVX2 2
+
 using namespace std;
 
 typedef struct {
@@ -46,12 +62,18 @@ class CryptoPrimitive{
 		const EVP_MD *md_;
 		/*the size of the generated hash*/
 		int hashSize_;
+		/*the kernel generating the SHA-256 hashes of a batch*/
+		int hashKernelMode_;
 
 		/*variables used in encryption*/
 		EVP_CIPHER_CTX cipherctx_;
 		const EVP_CIPHER *cipher_;
 		unsigned char *iv_;
 
+		/*variables used in CTR-mode encryption, whose context is set up once and only re-keyed*/
+		EVP_CIPHER_CTX ctrctx_;
+		const EVP_CIPHER *ctrCipher_;
+
 		/*the size of the key for encryption*/
 		int keySize_;
 		/*the size of the encryption block unit*/
@@ -130,7 +152,54 @@ class CryptoPrimitive{
 		 * @return - a boolean value that indicates if the hash generation succeeds
 		 */
 		bool generateHash(unsigned char *dataBuffer, const int &dataSize, unsigned char *hash);
-        static bool generateHash_rabin(unsigned char *dataBuffer, const int &dataSize, unsigned char *hash);
+
+		/*
+		 * generate the rabin fingerprint for the data stored in a buffer, i.e. the max fingerprint of its 
+		 * 48-byte windows, which is replicated to fill 16 bytes
+		 *
+		 * @param dataBuffer - the buffer that stores the data
+		 * @param dataSize - the size of the data
+		 * @param hash - the generated 16-byte hash <return>
+		 *
+		 * @return - a boolean value that indicates if the hash generation succeeds
+		 */
+		static bool generateHash_rabin(unsigned char *dataBuffer, const int &dataSize, unsigned char *hash);
+
+		/*
+		 * generate the XXH3 hash for the data stored in a buffer, 128 bits at a time up to the hash size
+		 *
+		 * @param dataBuffer - the buffer that stores the data
+		 * @param dataSize - the size of the data
+		 * @param hash - the generated hash <return>
+		 *
+		 * @return - a boolean value that indicates if the hash generation succeeds
+		 */
+		bool generateHash_xxh3(unsigned char *dataBuffer, const int &dataSize, unsigned char *hash);
+
+		/*
+		 * generate the hashes for a batch of data buffers, with the selected kernel for SHA-256 and one by 
+		 * one otherwise
+		 *
+		 * @param num - the number of buffers
+		 * @param dataBuffers - the buffers that store the data
+		 * @param dataSizes - the sizes of the data
+		 * @param hashes - the generated hashes <return>
+		 *
+		 * @return - a boolean value that indicates if the hash generation succeeds
+		 */
+		bool generateHashBatch(int num, unsigned char **dataBuffers, const int *dataSizes, unsigned char **hashes);
+
+		/*
+		 * select the kernel generating the SHA-256 hashes of a batch
+		 *
+		 * @param hashKernelMode - SHA256_KERNEL_OPENSSL, SHA256_KERNEL_SHANI or SHA256_KERNEL_AVX2
+		 *
+		 * @return - a boolean value that indicates if the kernel is supported by the CPU
+		 *
+		 * NOTE: every kernel gives the same hashes, SHA-NI is selected by default if supported and OpenSSL otherwise,
+		 *       as the AVX2 kernel is slower than OpenSSL on the CPUs measured, and is only selected explicitly
+		 */
+		bool setHashKernelMode(int hashKernelMode);
 
 		/*
 		 * encrypt the data stored in a buffer with a key
@@ -144,6 +213,20 @@ class CryptoPrimitive{
 		 */
 		bool encryptWithKey(unsigned char *dataBuffer, const int &dataSize, unsigned char *key, 
 				unsigned char *ciphertext);
+
+		/*
+		 * encrypt the data stored in a buffer with a key in CTR mode from a zero counter block, i.e. XOR 
+		 * the data with the keystream of the key, which also decrypts the ciphertext
+		 *
+		 * @param dataBuffer - the buffer that stores the data
+		 * @param dataSize - the size of the data
+		 * @param key - the key used to encrypt the data
+		 * @param ciphertext - the generated ciphertext, which may be dataBuffer itself <return>
+		 *
+		 * @return - a boolean value that indicates if the encryption succeeds
+		 */
+		bool encryptWithKeyCTR(unsigned char *dataBuffer, const int &dataSize, unsigned char *key, 
+				unsigned char *ciphertext);
 };
 
 #endif
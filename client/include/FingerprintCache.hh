@@ -0,0 +1,107 @@
+/*
+ * FingerprintCache.hh
+ * - a persistent set of the share fingerprints uploaded to a server by a user,
+ *   kept in a memory-mapped file, so that the shares known to be stored are not checked with the server again
+ */
+
+#ifndef __FINGERPRINT_CACHE_HH__
+#define __FINGERPRINT_CACHE_HH__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* size of a cached fingerprint */
+#define FP_CACHE_KEY_SIZE 32
+
+/* the smallest number of slots of a cache */
+#define FP_CACHE_MIN_SLOTS 1024
+
+/* the cache is cleared when its slots are filled beyond this per cent */
+#define FP_CACHE_MAX_LOAD 75
+
+using namespace std;
+
+class FingerprintCache{
+    private:
+        /* header at the start of the cache file */
+        typedef struct{
+            char magic[8];
+            uint64_t numOfSlots;
+            uint64_t numOfKeys;
+        }cacheHead_t;
+
+        /* descriptor of the cache file, which holds an exclusive lock on the file */
+        int fd_;
+
+        /* size of the mapping */
+        size_t mapSize_;
+
+        /* mapped cache file */
+        cacheHead_t* head_;
+
+        /* open-addressing slots of fingerprints after the header, an all-zero slot is empty */
+        unsigned char* slots_;
+
+        /* number of slots minus one, as the number of slots is a power of two */
+        uint64_t mask_;
+
+        /*
+         * find the slot of a fingerprint, or the empty slot ending its probe sequence
+         *
+         * @param fp - the fingerprint
+         *
+         * @return the slot
+         */
+        unsigned char* probe(const unsigned char* fp);
+
+    public:
+        /*
+         * constructor, which maps the cache file and creates it if it does not exist,
+         * and the cache is left disabled if the file cannot be mapped or is used by another client
+         *
+         * @param path - path of the cache file
+         * @param budget - the largest size of the cache file
+         */
+        FingerprintCache(const char* path, long budget);
+
+        /*
+         * destructor
+         */
+        ~FingerprintCache();
+
+        /*
+         * whether the cache file is mapped
+         */
+        inline bool isEnabled() { return head_ != NULL; }
+
+        /*
+         * look up a fingerprint
+         *
+         * @param fp - the fingerprint
+         *
+         * @return whether the fingerprint is cached
+         */
+        bool lookup(const unsigned char* fp);
+
+        /*
+         * insert a fingerprint, and the cache is cleared first if it is full
+         *
+         * @param fp - the fingerprint
+         */
+        void insert(const unsigned char* fp);
+
+        /*
+         * remove all the fingerprints
+         */
+        void clear();
+};
+
+#endif
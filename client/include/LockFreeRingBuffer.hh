@@ -0,0 +1,392 @@
+/*
+ * LockFreeRingBuffer.hh
+ * - lock-free bounded ring buffers for passing objects between the pipeline threads
+ *   SPSCRingBuffer: a single producer and a single consumer
+ *   MPMCRingBuffer: multiple producers and consumers, based on Dmitry Vyukov's bounded MPMC queue
+ *   a blocked thread spins for a while, then yields, and finally sleeps on a futex until woken up
+ */
+
+#ifndef __LockFreeRingBuffer_hh__
+#define __LockFreeRingBuffer_hh__
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* cache line size for padding the indices written by different threads */
+#define RING_CACHE_LINE_SIZE 64
+
+/* number of spins before yielding, and number of yields before sleeping */
+#define RING_SPIN_LIMIT 256
+#define RING_YIELD_LIMIT 16
+
+/*
+ * wait queue of the threads blocked on a ring buffer condition (not empty, or not full)
+ */
+class RingWaiter {
+    /* bumped on every wake-up, which is the futex word */
+    uint32_t seq_ __attribute__((aligned(RING_CACHE_LINE_SIZE)));
+    /* number of threads that may be sleeping */
+    uint32_t sleepers_;
+
+    static inline void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    /* spinning only pays off when the other side runs on another cpu */
+    static inline bool spinning() {
+        static const bool multicore = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+        return multicore;
+    }
+
+public:
+    RingWaiter() : seq_(0), sleepers_(0) {}
+
+    /*
+     * block until a condition holds
+     *
+     * @param ready - the condition, which is checked again after the waker changes the ring buffer
+     */
+    template <class Ready> void wait(Ready ready) {
+        int i;
+        if (spinning()) {
+            for (i = 0; i < RING_SPIN_LIMIT; i++) {
+                if (ready()) return;
+                pause();
+            }
+        }
+        for (i = 0; i < RING_YIELD_LIMIT; i++) {
+            if (ready()) return;
+            sched_yield();
+        }
+        while (true) {
+            uint32_t seq = __atomic_load_n(&seq_, __ATOMIC_ACQUIRE);
+            /* announce the sleep before the last check, which pairs with the fence in notify() */
+            __atomic_fetch_add(&sleepers_, 1, __ATOMIC_SEQ_CST);
+            if (ready()) {
+                __atomic_fetch_sub(&sleepers_, 1, __ATOMIC_RELAXED);
+                return;
+            }
+            syscall(SYS_futex, &seq_, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+            __atomic_fetch_sub(&sleepers_, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    /*
+     * wake up the sleeping threads after changing the ring buffer, which costs no syscall if none sleeps
+     */
+    inline void notify() {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&sleepers_, __ATOMIC_RELAXED) == 0) return;
+        __atomic_fetch_add(&seq_, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &seq_, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+};
+
+/*
+ * ring buffer for a single producer thread and a single consumer thread
+ * each side keeps a private copy of the other side's index, and only reads the shared one when
+ * the copy says the buffer is full (or empty), so the two cache lines rarely bounce
+ */
+template <class T> class SPSCRingBuffer {
+    typedef struct {
+        int len;
+        T data;
+    } Buffer_t;
+
+    Buffer_t* buffer_;
+    uint32_t mask_;
+    bool blockOnEmpty_;
+
+    /* producer side */
+    uint32_t writeIndex_ __attribute__((aligned(RING_CACHE_LINE_SIZE)));
+    uint32_t cachedReadIndex_;
+
+    /* consumer side */
+    uint32_t readIndex_ __attribute__((aligned(RING_CACHE_LINE_SIZE)));
+    uint32_t cachedWriteIndex_;
+
+    RingWaiter notEmpty_;
+    RingWaiter notFull_;
+
+    /* wait for a free slot, and return the number of free slots */
+    uint32_t waitFree(uint32_t write) {
+        uint32_t capacity = mask_ + 1;
+        if (write - cachedReadIndex_ == capacity) {
+            cachedReadIndex_ = __atomic_load_n(&readIndex_, __ATOMIC_ACQUIRE);
+            if (write - cachedReadIndex_ == capacity) {
+                notFull_.wait([&]() {
+                    cachedReadIndex_ = __atomic_load_n(&readIndex_, __ATOMIC_ACQUIRE);
+                    return write - cachedReadIndex_ != capacity;
+                });
+            }
+        }
+        return capacity - (write - cachedReadIndex_);
+    }
+
+    /* wait for an object, and return the number of ready objects, or 0 if empty and not blocking */
+    uint32_t waitReady(uint32_t read) {
+        if (read == cachedWriteIndex_) {
+            cachedWriteIndex_ = __atomic_load_n(&writeIndex_, __ATOMIC_ACQUIRE);
+            if (read == cachedWriteIndex_) {
+                if (!blockOnEmpty_) return 0;
+                notEmpty_.wait([&]() {
+                    cachedWriteIndex_ = __atomic_load_n(&writeIndex_, __ATOMIC_ACQUIRE);
+                    return read != cachedWriteIndex_;
+                });
+            }
+        }
+        return cachedWriteIndex_ - read;
+    }
+
+public:
+    /*
+     * constructor
+     *
+     * @param size - the min capacity, which is rounded up to a power of 2
+     * @param block - whether Extract() waits on an empty buffer
+     */
+    SPSCRingBuffer(int size, bool block = true) {
+        uint32_t capacity = 2;
+        while ((int)capacity < size) capacity <<= 1;
+        buffer_ = new Buffer_t[capacity];
+        mask_ = capacity - 1;
+        blockOnEmpty_ = block;
+        writeIndex_ = 0;
+        cachedReadIndex_ = 0;
+        readIndex_ = 0;
+        cachedWriteIndex_ = 0;
+    }
+
+    ~SPSCRingBuffer() { delete[] buffer_; }
+
+    /*
+     * insert an object, and wait if the buffer is full
+     *
+     * @param data - the object
+     * @param len - the number of bytes of the object to copy
+     */
+    int Insert(T* data, int len) {
+        uint32_t write = writeIndex_;
+        waitFree(write);
+        Buffer_t* slot = &buffer_[write & mask_];
+        slot->len = len;
+        memcpy(&(slot->data), data, len);
+        __atomic_store_n(&writeIndex_, write + 1, __ATOMIC_RELEASE);
+        notEmpty_.notify();
+        return 0;
+    }
+
+    /*
+     * insert a batch of whole objects, which are published together as the free slots allow
+     *
+     * @param data - the objects
+     * @param num - the number of objects
+     */
+    int InsertBatch(T* data, int num) {
+        uint32_t write = writeIndex_;
+        while (num > 0) {
+            uint32_t n = waitFree(write);
+            if (n > (uint32_t)num) n = num;
+            for (uint32_t i = 0; i < n; i++) {
+                Buffer_t* slot = &buffer_[(write + i) & mask_];
+                slot->len = sizeof(T);
+                memcpy(&(slot->data), data + i, sizeof(T));
+            }
+            write += n;
+            data += n;
+            num -= n;
+            __atomic_store_n(&writeIndex_, write, __ATOMIC_RELEASE);
+            notEmpty_.notify();
+        }
+        return 0;
+    }
+
+    /*
+     * extract an object
+     *
+     * @param data - the object <return>
+     * @return 0, or -1 if the buffer is empty and does not block
+     */
+    int Extract(T* data) {
+        uint32_t read = readIndex_;
+        if (waitReady(read) == 0) return -1;
+        Buffer_t* slot = &buffer_[read & mask_];
+        memcpy(data, &(slot->data), slot->len);
+        __atomic_store_n(&readIndex_, read + 1, __ATOMIC_RELEASE);
+        notFull_.notify();
+        return 0;
+    }
+
+    /*
+     * extract all the ready objects up to a max number, and wait for at least one
+     *
+     * @param data - the objects <return>
+     * @param max - the max number of objects
+     * @return the number of objects, or 0 if the buffer is empty and does not block
+     */
+    int ExtractBatch(T* data, int max) {
+        uint32_t read = readIndex_;
+        uint32_t n = waitReady(read);
+        if (n > (uint32_t)max) n = max;
+        for (uint32_t i = 0; i < n; i++) {
+            Buffer_t* slot = &buffer_[(read + i) & mask_];
+            memcpy(data + i, &(slot->data), slot->len);
+        }
+        if (n > 0) {
+            __atomic_store_n(&readIndex_, read + n, __ATOMIC_RELEASE);
+            notFull_.notify();
+        }
+        return n;
+    }
+};
+
+/*
+ * ring buffer for any number of producer and consumer threads
+ * each slot has a sequence number telling whether it is free for the producer of a round,
+ * or ready for the consumer, so threads only contend on the position they claim
+ */
+template <class T> class MPMCRingBuffer {
+    typedef struct {
+        uint32_t seq;
+        int len;
+        T data;
+    } Buffer_t;
+
+    Buffer_t* buffer_;
+    uint32_t mask_;
+    bool blockOnEmpty_;
+
+    uint32_t enqueueIndex_ __attribute__((aligned(RING_CACHE_LINE_SIZE)));
+    uint32_t dequeueIndex_ __attribute__((aligned(RING_CACHE_LINE_SIZE)));
+
+    RingWaiter notEmpty_;
+    RingWaiter notFull_;
+
+    /* claim a slot to write, or return NULL if full */
+    Buffer_t* claimWrite() {
+        uint32_t pos = __atomic_load_n(&enqueueIndex_, __ATOMIC_RELAXED);
+        while (true) {
+            Buffer_t* slot = &buffer_[pos & mask_];
+            int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&enqueueIndex_, &pos, pos + 1, true, __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED)) {
+                    return slot;
+                }
+            } else if (diff < 0) {
+                return NULL;
+            } else {
+                pos = __atomic_load_n(&enqueueIndex_, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    /* claim a slot to read, or return NULL if empty */
+    Buffer_t* claimRead(uint32_t* claimed) {
+        uint32_t pos = __atomic_load_n(&dequeueIndex_, __ATOMIC_RELAXED);
+        while (true) {
+            Buffer_t* slot = &buffer_[pos & mask_];
+            int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&dequeueIndex_, &pos, pos + 1, true, __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED)) {
+                    *claimed = pos;
+                    return slot;
+                }
+            } else if (diff < 0) {
+                return NULL;
+            } else {
+                pos = __atomic_load_n(&dequeueIndex_, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+public:
+    /*
+     * constructor
+     *
+     * @param size - the min capacity, which is rounded up to a power of 2
+     * @param block - whether Extract() waits on an empty buffer
+     */
+    MPMCRingBuffer(int size, bool block = true) {
+        uint32_t capacity = 2;
+        while ((int)capacity < size) capacity <<= 1;
+        buffer_ = new Buffer_t[capacity];
+        for (uint32_t i = 0; i < capacity; i++) {
+            buffer_[i].seq = i;
+        }
+        mask_ = capacity - 1;
+        blockOnEmpty_ = block;
+        enqueueIndex_ = 0;
+        dequeueIndex_ = 0;
+    }
+
+    ~MPMCRingBuffer() { delete[] buffer_; }
+
+    /*
+     * insert an object, and wait if the buffer is full
+     *
+     * @param data - the object
+     * @param len - the number of bytes of the object to copy
+     */
+    int Insert(T* data, int len) {
+        Buffer_t* slot = claimWrite();
+        if (slot == NULL) {
+            notFull_.wait([&]() { return (slot = claimWrite()) != NULL; });
+        }
+        slot->len = len;
+        memcpy(&(slot->data), data, len);
+        /* the slot is ready for the consumer of this round */
+        __atomic_store_n(&slot->seq, __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+        notEmpty_.notify();
+        return 0;
+    }
+
+    /*
+     * extract an object
+     *
+     * @param data - the object <return>
+     * @return 0, or -1 if the buffer is empty and does not block
+     */
+    int Extract(T* data) {
+        uint32_t pos;
+        Buffer_t* slot = claimRead(&pos);
+        if (slot == NULL) {
+            if (!blockOnEmpty_) return -1;
+            notEmpty_.wait([&]() { return (slot = claimRead(&pos)) != NULL; });
+        }
+        memcpy(data, &(slot->data), slot->len);
+        /* the slot is free for the producer of the next round */
+        __atomic_store_n(&slot->seq, pos + mask_ + 1, __ATOMIC_RELEASE);
+        notFull_.notify();
+        return 0;
+    }
+
+    /*
+     * try to extract an object without waiting
+     *
+     * @param data - the object <return>
+     * @return 0, or -1 if the buffer is empty
+     */
+    int TryExtract(T* data) {
+        uint32_t pos;
+        Buffer_t* slot = claimRead(&pos);
+        if (slot == NULL) return -1;
+        memcpy(data, &(slot->data), slot->len);
+        __atomic_store_n(&slot->seq, pos + mask_ + 1, __ATOMIC_RELEASE);
+        notFull_.notify();
+        return 0;
+    }
+};
+
+#endif
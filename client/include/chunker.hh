@@ -13,13 +13,29 @@
 #define FIX_SIZE_TYPE 0
 /*macro for the type of variable-size chunker*/
 #define VAR_SIZE_TYPE 1
+/*macro for the type of FastCDC chunker (gear hash with normalized chunking)*/
+#define FASTCDC_TYPE 2
+
+/*macro for scanning the gear hash byte by byte*/
+#define GEAR_SCAN_SCALAR 0
+/*macro for scanning the gear hash in interleaved stripes (portable)*/
+#define GEAR_SCAN_STRIPED 1
+/*macro for scanning the gear hash in stripes with AVX2*/
+#define GEAR_SCAN_AVX2 2
+
+/*number of stripes scanned in parallel*/
+#define GEAR_SCAN_LANES 4
+/*max length of a stripe*/
+#define GEAR_SCAN_STRIPE 512
+/*min length of a stripe, which should amortize the warm-up of the previous 63 bytes*/
+#define GEAR_SCAN_MIN_STRIPE 128
 
 using namespace std;
 
 class Chunker{
     private:
-        /*chunker type (FIX_SIZE_TYPE or VAR_SIZE_TYPE)*/
-        bool chunkerType_; 
+        /*chunker type (FIX_SIZE_TYPE, VAR_SIZE_TYPE or FASTCDC_TYPE)*/
+        int chunkerType_; 
 
         /*average chunk size*/
         int avgChunkSize_; 
@@ -48,39 +64,106 @@ class Chunker{
         /*the value for determining an anchor*/
         uint32_t anchorValue_; 
 
+        /*the lookup table mapping a byte to a random 64-bit value in gear hash*/
+        uint64_t *gearLUT_; 
+        /*the stricter mask (more bits) used before a chunk reaches avgChunkSize_*/
+        uint64_t gearMaskS_; 
+        /*the looser mask (fewer bits) used after a chunk reaches avgChunkSize_*/
+        uint64_t gearMaskL_; 
+        /*the method for scanning the gear hash (GEAR_SCAN_SCALAR, GEAR_SCAN_STRIPED or GEAR_SCAN_AVX2)*/
+        int gearScanMode_; 
+
+        /*the buffers for the unfinished tail chunk carried across the parts of a stream, one of which*/
+        /*keeps the head of the last returned chunk valid while the other carries the new tail       */
+        unsigned char *carryBuffer_[2]; 
+        /*the capacity of each carry buffer, i.e. the max chunk size*/
+        int carryCapacity_; 
+        /*the index of the carry buffer in use*/
+        int carryIndex_; 
+        /*the number of carried bytes*/
+        int carrySize_; 
+
         /*
-         * divide a buffer into a number of fixed-size chunks
+         * calculate the gear hash at a position
          *
-         * @param buffer - a buffer to be chunked
-         * @param bufferSize - the size of the buffer
-         * @param chunkEndIndexList - a list for returning the end index of each chunk <return>
-         * @param numOfChunks - the number of chunks <return>
+         * @param base - the start of a chunk
+         * @param hashStart - the position where the hash starts, whose previous bytes are excluded
+         * @param pos - the position
+         * @return the gear hash of the bytes in [hashStart, pos] (only the last 64 bytes count)
          */
-        void fixSizeChunking(unsigned char *buffer, int bufferSize, int *chunkEndIndexList, int *numOfChunks);
+        uint64_t gearHash(unsigned char *base, int hashStart, int pos);
 
         /*
-         * divide a buffer into a number of variable-size chunks
+         * find the first position whose gear hash matches a mask, scanning GEAR_SCAN_LANES stripes at a time
          *
-         * @param buffer - a buffer to be chunked
-         * @param bufferSize - the size of the buffer
-         * @param chunkEndIndexList - a list for returning the end index of each chunk <return>
-         * @param numOfChunks - the number of chunks <return>
+         * @param base - the start of a chunk
+         * @param hashStart - the position where the hash starts, whose previous bytes are excluded
+         * @param from - the first position to check
+         * @param to - the position after the last one to check
+         * @param mask - the mask of the highest bits, matched if (hash & mask) == 0
+         * @return the first matched position in [from, to), or to if none
          */
-        void varSizeChunking(unsigned char *buffer, int bufferSize, int *chunkEndIndexList, int *numOfChunks);
+        int gearScanStriped(unsigned char *base, int hashStart, int from, int to, uint64_t mask);
+
+        /*
+         * the same as gearScanStriped, with the stripes in AVX2 lanes
+         */
+        int gearScanAVX2(unsigned char *base, int hashStart, int from, int to, uint64_t mask);
+
+        /*
+         * find the end of a fixed-size chunk
+         *
+         * @param chunk - the start of a chunk
+         * @param size - the number of available bytes from the start
+         * @param isEnd - whether the available bytes end the stream
+         * @return the chunk size, or 0 if the chunk does not end in the available bytes
+         */
+        int fixSizeCut(unsigned char *chunk, int size, bool isEnd);
+
+        /*
+         * find the end of a variable-size chunk
+         *
+         * @param chunk - the start of a chunk
+         * @param size - the number of available bytes from the start
+         * @param isEnd - whether the available bytes end the stream
+         * @return the chunk size, or 0 if the chunk does not end in the available bytes
+         */
+        int varSizeCut(unsigned char *chunk, int size, bool isEnd);
+
+        /*
+         * find the end of a FastCDC chunk
+         *
+         * @param chunk - the start of a chunk
+         * @param size - the number of available bytes from the start
+         * @param isEnd - whether the available bytes end the stream
+         * @return the chunk size, or 0 if the chunk does not end in the available bytes
+         */
+        int fastCDCCut(unsigned char *chunk, int size, bool isEnd);
+
+        /*
+         * find the end of a chunk with the chunker type
+         *
+         * @param chunk - the start of a chunk
+         * @param size - the number of available bytes from the start
+         * @param isEnd - whether the available bytes end the stream
+         * @return the chunk size, or 0 if the chunk does not end in the available bytes
+         */
+        int cut(unsigned char *chunk, int size, bool isEnd);
 
     public:
         /*
          * constructor of Chunker
          *
-         * @param chunkerType - chunker type (FIX_SIZE_TYPE or VAR_SIZE_TYPE)
+         * @param chunkerType - chunker type (FIX_SIZE_TYPE, VAR_SIZE_TYPE or FASTCDC_TYPE)
          * @param avgChunkSize - average chunk size
          * @param minChunkSize - minimum chunk size
          * @param maxChunkSize - maximum chunk size
          * @param slidingWinSize - sliding window size
          *
-         * NOTE: if chunkerType = FIX_SIZE_TYPE, only input avgChunkSize
+         * NOTE: if chunkerType = FIX_SIZE_TYPE, only input avgChunkSize;
+         *       if chunkerType = FASTCDC_TYPE, slidingWinSize is unused (the gear hash window is 64 bytes)
          */
-        Chunker(bool chunkerType = VAR_SIZE_TYPE, 
+        Chunker(int chunkerType = VAR_SIZE_TYPE, 
                 int avgChunkSize = (8<<10), 
                 int minChunkSize = (2<<10), 
                 int maxChunkSize = (16<<10), 
@@ -100,6 +183,39 @@ class Chunker{
          * @param numOfChunks - the number of chunks <return>
          */
         void chunking(unsigned char *buffer, int bufferSize, int *chunkEndIndexList, int *numOfChunks);
+
+        /*
+         * divide a stream into a number of chunks part by part, where the unfinished tail chunk of a part is carried
+         * by the chunker, so that the chunks are the same as if the whole stream were in one buffer
+         *
+         * @param buffer - the next part of the stream
+         * @param bufferSize - the size of the part
+         * @param isEnd - whether the part ends the stream
+         * @param chunkEndIndexList - a list for returning the end index in the part of each chunk ended in it <return>
+         * @param numOfChunks - the number of chunks ended in the part <return>
+         * @param headData - the carried bytes of the first chunk, which precede the part <return>
+         * @param headSize - the number of carried bytes of the first chunk <return>
+         *
+         * NOTE: the first chunk consists of headData[0..headSize) and buffer[0..chunkEndIndexList[0]], where
+         *       chunkEndIndexList[0] is -1 if the whole chunk was carried; headData is valid until the next call
+         */
+        void streamChunking(unsigned char *buffer, int bufferSize, bool isEnd, int *chunkEndIndexList, int *numOfChunks,
+                            unsigned char **headData, int *headSize);
+
+        /*
+         * drop the carried chunk, and start a new stream
+         */
+        void resetStream();
+
+        /*
+         * select the method for scanning the gear hash of the FastCDC chunker
+         *
+         * @param gearScanMode - GEAR_SCAN_SCALAR, GEAR_SCAN_STRIPED or GEAR_SCAN_AVX2
+         * @return whether the method is supported by the CPU
+         *
+         * NOTE: every method gives the same chunk boundaries, the fastest supported one is selected by default
+         */
+        bool setGearScanMode(int gearScanMode);
 };
 
 #endif
@@ -7,6 +7,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+#include "CDCodec.hh"
 
 using namespace std;
 
@@ -35,12 +38,31 @@ private:
   /* share buffer size */
   int shareBufferSize_;
 
-  /* buffer size */
+  /* buffer size, i.e. the size of a part of the file chunked at a time */
   int bufferSize_;
 
   /* chunk end list size */
   int chunkEndIndexListSize_;
 
+  /* number of encoder threads */
+  int encodeThreadNum_;
+
+  /* number of decoder threads */
+  int decodeThreadNum_;
+
+  /* convergent dispersal type, which has to be the same for uploading and downloading a file */
+  int codecType_;
+
+  /* hash type of the CAONT package keys, which has to be the same for uploading and downloading a file */
+  int keyHashType_;
+
+  /* size budget of the fingerprint cache file of each server, 0 for uploading without the cache */
+  long fpCacheSize_;
+
+  /* number of clouds a file is downloaded from, k for reading the first k clouds in full,
+     or up to n for decoding each secret from the first k of its shares to arrive */
+  int downloadCloudNum_;
+
 public:
   /* constructor */
   Configuration()
@@ -51,8 +73,18 @@ public:
     r_ = k_ - 1;
     secretBufferSize_ = 16 * 1024;
     shareBufferSize_ = 16 * 1024 * n_;
-    bufferSize_ = 128 * 1024 * 1024;
+    bufferSize_ = 8 * 1024 * 1024;
     chunkEndIndexListSize_ = 1024 * 1024;
+    /* one encoder thread per core */
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    encodeThreadNum_ = cores > 0 ? (int)cores : 1;
+    decodeThreadNum_ = encodeThreadNum_;
+    /* CAONT_RS_TYPE, or CAONT_RS_CTR_TYPE for generating the CAONT package with AES-CTR */
+    codecType_ = CAONT_RS_TYPE;
+    /* KEY_HASH_RABIN, or KEY_HASH_XXH3 / KEY_HASH_DIGEST for keys of the full key size */
+    keyHashType_ = KEY_HASH_RABIN;
+    fpCacheSize_ = 64L * 1024 * 1024;
+    downloadCloudNum_ = n_;
   }
 
   inline int getN() { return n_; }
@@ -70,6 +102,18 @@ public:
   inline int getBufferSize() { return bufferSize_; }
 
   inline int getListSize() { return chunkEndIndexListSize_; }
+
+  inline int getEncodeThreadNum() { return encodeThreadNum_; }
+
+  inline void setEncodeThreadNum(int num) { encodeThreadNum_ = num; }
+  inline int getDecodeThreadNum() { return decodeThreadNum_; }
+
+  inline int getCodecType() { return codecType_; }
+
+  inline int getKeyHashType() { return keyHashType_; }
+
+  inline long getFpCacheSize() { return fpCacheSize_; }
+  inline int getDownloadCloudNum() { return downloadCloudNum_; }
 };
 
 #endif
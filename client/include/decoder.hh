@@ -1,28 +1,27 @@
 /*
- *  encoder.hh 
+ *  encoder.hh
  */
 
 #ifndef __DECODER_HH__
 #define __DECODER_HH__
 
+#include <unistd.h>
+#include <errno.h>
 #include "CDCodec.hh"
-#include "BasicRingBuffer.hh"
+#include "LockFreeRingBuffer.hh"
 #include "CryptoPrimitive.hh"
 
-/* num of decoder threads */
-#define DECODE_NUM_THREADS 2
+/* ringbuffer size of each decoder thread */
+#define DECODE_RB_SIZE (128)
 
-/* ringbuffer size */
-#define DECODE_RB_SIZE (2)
+/* max number of secrets a decoder thread takes and decodes at a time */
+#define DECODE_BATCH_SIZE (8)
 
 /* max secret size */
 #define SECRET_SIZE (16*1024)
 
-/* max share buffer size */
-#define SHARE_BUFFER_SIZE (4*16*1024)
-
-/* max write buffer size */
-#define FWRITE_BUFFER_SIZE (4*1024*1024)
+/* max number of shares to decode a secret from */
+#define MAX_DECODE_SHARES 16
 
 using namespace std;
 
@@ -34,45 +33,69 @@ class Decoder{
             Decoder* obj; // decoder object pointer
         }param_decoder;
 
-        /* secret metadata structure */
+        /*
+         * a buffer whose shares are decoded where they are, which can be reused once
+         * the shares handed to the decoder from it are all decoded
+         */
         typedef struct{
-            char data[SECRET_SIZE];
-            int secretSize;
-        }Secret_t;
+            int pending;
+            RingWaiter released;
+        }ShareHolder_t;
 
-        /* share metadata structure */
+        /*
+         * share metadata structure, with the k shares and their IDs in the same order,
+         * the buffers holding the shares, and the offset of the secret in the file
+         */
         typedef struct{
-            char data[SHARE_BUFFER_SIZE];
+            long offset;
             int secretSize;
             int shareSize;
+            int shareIDList[MAX_DECODE_SHARES];
+            unsigned char* shares[MAX_DECODE_SHARES];
+            ShareHolder_t* holders[MAX_DECODE_SHARES];
         }ShareChunk_t;
 
-        /* input share buffer */
-        RingBuffer<ShareChunk_t>** inputbuffer_;
+        /* input share buffer of each thread, which the idle threads steal from */
+        MPMCRingBuffer<ShareChunk_t>** inputbuffer_;
+
+        /* wait queue of the idle decoder threads */
+        RingWaiter inputReady_;
 
-        /* output secret buffer */
-        RingBuffer<Secret_t>** outputbuffer_;
+        /* wait queue of the thread waiting for the end of decoding */
+        RingWaiter decodeDone_;
 
         /* thread id array */
-        pthread_t tid_[DECODE_NUM_THREADS+1];
+        pthread_t* tid_;
+
+        /* number of decoder threads */
+        int numOfThreads_;
+
+        /* index of the input buffer of the next share object */
+        int nextAddIndex_;
 
         /* total number of secrets */
         int totalSecrets_;
 
+        /* number of secrets written to the file */
+        int decodedSecrets_;
+
+        /* set when the decoder threads have to quit */
+        bool stop_;
+
         /* total number of clouds */
         int n_;
 
-        /* output file pointer */
-        FILE* fw_;
+        /* k = n - m, the number of shares to decode a secret from */
+        int k_;
 
-        /* share ID list pointer */
-        int* kShareIDList_;
+        /* output file descriptor */
+        int fd_;
 
         /* crypto object array */
         CryptoPrimitive** cryptoObj_;
 
         /* decode object array */
-        CDCodec* decodeObj_[DECODE_NUM_THREADS];
+        CDCodec** decodeObj_;
 
         /*
          * decoder constructor
@@ -82,12 +105,16 @@ class Decoder{
          * @param m - reliability degree
          * @param r - confidentiality degree
          * @param securetype - encryption and hash type
+         * @param keyHashType - hash type of the CAONT package keys
+         * @param numOfThreads - number of decoder threads
          */
-        Decoder(int type, 
-                int n, 
-                int m, 
-                int r, 
-                int securetype);
+        Decoder(int type,
+                int n,
+                int m,
+                int r,
+                int securetype,
+                int keyHashType,
+                int numOfThreads);
 
         /*
          * destructor of decoder
@@ -102,26 +129,19 @@ class Decoder{
         int setTotal(int totalSecrets);
 
         /*
-         * set the file output pointer
+         * set the file output pointer, whose secrets are written at their offsets without its buffer
          *
          * @param fp - the output file pointer
          */
         int setFilePointer(FILE* fp);
 
         /*
-         * set the k shareID list
-         *
-         * @param list - the given kShareIDList
-         */
-        int setShareIDList(int* list);
-
-        /*
-         * add a share into particular ringbuffer
+         * add a share object, in any thread's ringbuffer since idle threads steal
          *
-         * @param item - the share object item
-         * @param index - the index of targeting ringbuffer
+         * @param item - the share object item, whose offset is the sum of the sizes of the secrets before it,
+         *               and the pending count of each holder of its shares is released once it is decoded
          */
-        int add(ShareChunk_t* item, int index);
+        int add(ShareChunk_t* item);
 
         /*
          * test if it's the end of decoding a file
@@ -131,18 +151,21 @@ class Decoder{
         int indicateEnd();
 
         /*
-         * thread handler for decode shares into secret
+         * take a share object from a thread's own input buffer, or steal one from the other threads
          *
-         * @param param - input parameters for decode thread
+         * @param index - the thread number
+         * @param item - the share object <return>
+         *
+         * @return whether an object is taken
          */
-        static void* thread_handler(void* param);
+        bool takeShares(int index, ShareChunk_t* item);
 
         /*
-         * collect thread for getting secret in order
+         * thread handler for decode shares into secret, and write the secrets to the file at their offsets
          *
-         * @param param - input parameters for collect thread
+         * @param param - input parameters for decode thread
          */
-        static void* collect(void* param);
+        static void* thread_handler(void* param);
 };
 
 #endif
@@ -24,12 +24,12 @@
 /* downloader ringbuffer size */
 #define DOWNLOAD_RB_SIZE 2048
 
-/* downloader ringbuffer data max size */
-#define RING_BUFFER_DATA_SIZE (16*1024)
-
 /* downloader buffer size */
 #define DOWNLOAD_BUFFER_SIZE (4*1024*1024)
 
+/* number of containers of each cloud, so that a container is received while the shares of the other are decoded */
+#define DOWNLOAD_CONTAINER_NUM 2
+
 /* length of hash 256 */
 #define HASH_LENGTH 32
 
@@ -38,11 +38,11 @@
 
 #define MAX_NUMBER_OF_CLOUDS 16
 
-/* number of download threads */
-#define DOWNLOAD_NUM_THREADS 3
+/* number of secrets whose shares are collected at a time, the clouds ahead wait for the k-th fastest one */
+#define DOWNLOAD_WINDOW_SIZE 512
 
 
-#include "BasicRingBuffer.hh"
+#include "LockFreeRingBuffer.hh"
 #include "socket.hh"
 #include "decoder.hh"
 #include "CryptoPrimitive.hh"
@@ -74,6 +74,7 @@ public:
         long sizeOfPastSecrets;
         int numOfComingSecrets;
         long sizeOfComingSecrets;
+        uint64_t contentDigest;
     } fileShareMDHead_t;
     
     /* share metadata header structure */
@@ -97,28 +98,16 @@ public:
         int shareSize;
     } shareEntry_t;
     
-    /* file header object structure for ringbuffer */
-    typedef struct {
-        shareFileHead_t file_header;
-        char data[RING_BUFFER_DATA_SIZE];
-    } fileHeaderObj_t;
-    
-    /* share header object structure for ringbuffer */
-    typedef struct {
-        shareEntry_t share_header;
-        char data[RING_BUFFER_DATA_SIZE];
-    } shareHeaderObj_t;
-    
-    /* union of objects for unifying ringbuffer objects */
+    /*
+     * shares of a secret collected from the clouds, where the first k shares to arrive
+     * are placed in the package in the order they arrive
+     */
     typedef struct {
-        int type;
-        union {
-            fileHeaderObj_t fileObj;
-            shareHeaderObj_t shareObj;
-        };
-    } Item_t;
+        int arrived;
+        Decoder::ShareChunk_t package;
+    } secretSlot_t;
     
-    /* init object for initiating download */
+    /* init object for initiating download, type 0 for a cloud that is not downloaded from */
     typedef struct {
         int type;
         char *filename;
@@ -140,9 +129,12 @@ public:
     /* metadata buffer */
     char **downloadMetaBuffer_;
     
-    /* container buffer */
+    /* containers of each cloud, whose shares are decoded where they are received */
     char **downloadContainer_;
     
+    /* holder of each container, which counts the shares of the container not decoded yet */
+    Decoder::ShareHolder_t *holders_;
+    
     /* size of file header */
     int fileMDHeadSize_;
     
@@ -150,16 +142,69 @@ public:
     int shareMDEntrySize_;
     
     /* thread id array */
-    pthread_t tid_[DOWNLOAD_NUM_THREADS];
+    pthread_t tid_[MAX_NUMBER_OF_CLOUDS];
     
     /* decoder object pointer */
     Decoder *decodeObj_;
     
     /* signal buffer */
-    RingBuffer<init_t> **signalBuffer_;
+    SPSCRingBuffer<init_t> **signalBuffer_;
+    
+    /* window of the secrets being collected, where secret i is in slot i % DOWNLOAD_WINDOW_SIZE */
+    secretSlot_t *window_;
+    
+    /* the first secret in the window, which is the next one to be decoded */
+    int windowBase_;
+    
+    /* number of secrets of the file, -1 until a header arrives */
+    int numOfSecrets_;
+    
+    /* number of clouds downloaded from */
+    int numOfClouds_;
+    
+    /* number of clouds that fail before sending all their shares */
+    int numOfFailed_;
+    
+    /* whether all the secrets are collected, so that the clouds still sending are cancelled, guarded by windowLock_ */
+    bool complete_;
+    
+    /* whether each cloud has sent all its shares or failed */
+    bool finished_[MAX_NUMBER_OF_CLOUDS];
+    
+    /* number of shares of each cloud that are decoded */
+    long long usedShares_[MAX_NUMBER_OF_CLOUDS];
     
-    /* download ringbuffer */
-    RingBuffer<Item_t> **ringBuffer_;
+    /* number of clouds cancelled before sending all their shares */
+    int numOfCancelled_;
+    
+    /* lock of the window and the counters above */
+    pthread_mutex_t windowLock_;
+    
+    /* signalled when the window moves on */
+    pthread_cond_t spaceCond_;
+    
+    /* signalled when a header arrives, a secret is collected or a cloud fails */
+    pthread_cond_t readyCond_;
+    
+    /*
+     * place a share into the window, or drop it if k shares of the secret have arrived
+     *
+     * @param cloudIndex - the cloud sending the share
+     * @param secretIndex - the index of the secret in the file
+     * @param entry - the share header
+     * @param data - the share data, which is decoded where it is
+     * @param holder - the holder of the container of the share
+     */
+    void collectShare(int cloudIndex, int secretIndex, shareEntry_t *entry, char *data, Decoder::ShareHolder_t *holder);
+    
+    /*
+     * record that a cloud fails, and wake the main procedure if the file cannot be decoded any more
+     *
+     * @param cloudIndex - the failed cloud
+     *
+     * NOTE: a cloud cancelled after all the secrets are collected does not fail
+     */
+    void failCloud(int cloudIndex);
     
     
     /*
@@ -185,15 +230,26 @@ public:
     int indicateEnd();
     
     /*
-     * main procedure for downloading a file
+     * main procedure for downloading a file, which requests the file from numOfCloud clouds and decodes
+     * each secret from the first k of its shares to arrive, and the clouds still sending
+     * after all the secrets are collected are cancelled
      *
      * @param filename - targeting filename
      * @param namesize - size of filename
-     * @param numOfCloud - number of clouds that we download data
+     * @param numOfCloud - number of clouds that we download data, from k to n
      *
      */
     int downloadFile(char *filename, int namesize, int numOfCloud);
     
+    /*
+     * get the number of shares of each cloud that are decoded
+     *
+     * @param usedShares - the numbers of shares of the total clouds <return>
+     *
+     * @return the number of clouds cancelled before sending all their shares
+     */
+    int getShareStats(long long *usedShares);
+    
     /*
      * downloader thread handler
      *
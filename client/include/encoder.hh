@@ -6,27 +6,40 @@
 #define __ENCODER_HH__
 
 #include "CDCodec.hh"
-#include "BasicRingBuffer.hh"
+#include "LockFreeRingBuffer.hh"
+#include "BufferArena.hh"
 #include "CryptoPrimitive.hh"
 #include "uploader.hh"
 
-/* num of encoder threads */
-#define NUM_THREADS 2
-
 /* ringbuffer size */
 #define RB_SIZE (1024)
 
+/* max number of secrets an encoder thread takes and encodes at a time */
+#define ENCODE_BATCH_SIZE (8)
+
 /* max secret size */
 #define SECRET_SIZE (16*1024)
 
 /* max share buffer size */
 #define SHARE_BUFFER_SIZE (4*16*1024)
 
+/* arena block size, a block holds a secret followed by its shares */
+#define ARENA_BLOCK_SIZE (SECRET_SIZE+SHARE_BUFFER_SIZE)
+
+/* number of arena blocks, i.e. the max number of secrets in the pipeline */
+#define ARENA_BLOCK_NUM (512)
+
+/* reorder buffer size, no less than the max number of secrets in the pipeline */
+#define REORDER_SIZE ARENA_BLOCK_NUM
+
 /* object type indicators */
+#define SECRET_OBJECT 0
 #define FILE_OBJECT 1
+#define SESSION_END_OBJECT 2
 #define FILE_HEADER (-9)
 #define SHARE_OBJECT (-8)
 #define SHARE_END (-27)
+#define SESSION_END (-28)
 
 using namespace std;
 
@@ -38,28 +51,33 @@ class Encoder{
             Encoder* obj; // encoder object pointer
         }param_encoder;
 
-        /* file head structure */
+        /* file head structure, the slice holds the full file name, and then its shares once encoded */
         typedef struct{
-            unsigned char data[SECRET_SIZE];
-            int fullNameSize;
-            int fileSize;
+            BufferArena::Slice_t name;
+            long fileSize;
+            uint32_t numOfShares;   // number of shares of the file, i.e. the number of its secrets
+            int numOfPastSecrets;   // number of the first secrets accepted by every cloud before, which are not added
+            long sizeOfPastSecrets; // size of these secrets
+            int numOfAccepted[UPLOAD_NUM_THREADS];  // number of the first secrets accepted by each cloud before
+            int nameShareSize;
+            uint64_t contentDigest; // digest of the file content, by which an interrupted upload is resumed
         }fileHead_t;
 
-        /* secret metadata structure */
+        /* secret metadata structure, the slice holds the secret */
         typedef struct{
-            unsigned char data[SECRET_SIZE];
+            BufferArena::Slice_t secret;
             int secretID;
-            int secretSize;
             int end;
         }Secret_t;
 
-        /* share metadata structure */
+        /* share metadata structure, the slice holds the shares one after another */
         typedef struct{
-            unsigned char data[SHARE_BUFFER_SIZE];
+            BufferArena::Slice_t shares;
             int secretID;
             int secretSize;
             int shareSize;
             int end;
+            unsigned char shareFP[UPLOAD_NUM_THREADS][FP_SIZE];  // SHA-256 fingerprint of each share
         }ShareChunk_t;
 
         /* union header for secret ringbuffer */
@@ -69,6 +87,7 @@ class Encoder{
                 fileHead_t file_header;
             };
             int type;
+            long seq;  // position of the object in the pipeline, set by add()
         }Secret_Item_t;
 
         /* union header for share ringbuffer */
@@ -80,23 +99,47 @@ class Encoder{
             int type;
         }ShareChunk_Item_t;
 
-        /* the input secret ringbuffer */
-        RingBuffer<Secret_Item_t>** inputbuffer_;
+        /* reorder buffer slot, which is ready for the collect thread once seq is the object's position */
+        typedef struct{
+            long seq;
+            ShareChunk_Item_t item;
+        } __attribute__((aligned(RING_CACHE_LINE_SIZE))) Reorder_Slot_t;
+
+        /* number of encoder threads */
+        int numOfThreads_;
 
-        /* the output share ringbuffer */
-        RingBuffer<ShareChunk_Item_t>** outputbuffer_;
+        /* the input secret queue of each encoder thread, from which the other threads steal when idle */
+        MPMCRingBuffer<Secret_Item_t>** inputbuffer_;
 
-        /* thread id array */
-        pthread_t tid_[NUM_THREADS+1];
+        /* encoder threads wait here when all the input queues are empty */
+        RingWaiter inputReady_;
+
+        /* indicate the encoder threads to exit once the input queues are empty */
+        bool stop_;
+
+        /* indicate the collect thread has been joined */
+        bool collectJoined_;
+
+        /* the encoded objects by their position in the pipeline */
+        Reorder_Slot_t* reorder_;
+
+        /* the collect thread waits here for the next object in order */
+        RingWaiter reorderReady_;
+
+        /* thread id array, the collect thread comes last */
+        pthread_t* tid_;
 
         /* the total number of clouds */
         int n_;
 
-        /* index for sequencially adding object */
+        /* index for adding object to each input queue in turn */
         int nextAddIndex_;
 
+        /* position of the next object added */
+        long nextSeq_;
+
         /* coding object array */
-        CDCodec* encodeObj_[NUM_THREADS];
+        CDCodec** encodeObj_;
 
         /* uploader object */
         Uploader* uploadObj_;
@@ -104,6 +147,16 @@ class Encoder{
         /* crypto object array */
         CryptoPrimitive** cryptoObj_;
 
+        /* crypto object array for the share fingerprints */
+        CryptoPrimitive** fpObj_;
+
+        /* the bytes fingerprinted and the time spent by each encoder thread */
+        long long* fpBytes_;
+        double* fpTime_;
+
+        /* arena of the secret and share buffers, whose blocks are released by the uploader */
+        BufferArena* arena_;
+
         /*
          * constructor of encoder
          *
@@ -113,7 +166,8 @@ class Encoder{
          * @param r - confidentiality degree
          * @param securetype - encryption and hash type
          * @param uploaderObj - pointer link to uploader object
-         *
+         * @param keyHashType - hash type of the CAONT package keys
+         * @param numOfThreads - number of encoder threads
          *
          */
         Encoder(int type, 
@@ -121,7 +175,9 @@ class Encoder{
                 int m, 
                 int r, 
                 int securetype, 
-                Uploader* uploaderObj);
+                int keyHashType,
+                Uploader* uploaderObj,
+                int numOfThreads);
 
         /*
          * destructor of encoder
@@ -129,17 +185,42 @@ class Encoder{
         ~Encoder();
 
         /*
-         * test if it's end of encoding a file
+         * test if it's end of encoding the session, after a SESSION_END_OBJECT is added behind its files
          */
         void indicateEnd();
 
+        /*
+         * get an arena block for a secret, or for a file name, to be added
+         *
+         * @param slice - the slice of the secret part of the block <return>
+         */
+        void newSecret(BufferArena::Slice_t* slice);
+
+        /*
+         * get the share fingerprinting statistics of all the encoder threads, after the end of encoding
+         *
+         * @param bytes - the total size of the shares fingerprinted <return>
+         * @param seconds - the total CPU time spent fingerprinting <return>
+         */
+        void getFingerprintStats(long long* bytes, double* seconds);
+
         /*
          * add function for sequencially add items to each encode buffer
          *
-         * @param item - input object
+         * @param item - input object, whose slice is from newSecret(), a file header followed by the secrets of
+         *               the file in turn, the last of which is marked as the end, or the end of the session
          */
         int add(Secret_Item_t* item);
 
+        /*
+         * take an object from a thread's own input queue, or steal one from the other threads
+         *
+         * @param index - the thread number
+         * @param item - the object <return>
+         * @return whether an object is taken
+         */
+        bool takeSecret(int index, Secret_Item_t* item);
+
         /*
          * thread handler for encoding secret into shares
          *
@@ -148,7 +229,7 @@ class Encoder{
         static void* thread_handler(void* param);
 
         /*
-         * collect thread for getting share objects in order
+         * collect thread for getting share objects in order from the reorder buffer
          *
          * @param param - parameters for collect thread
          */
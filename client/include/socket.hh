@@ -15,13 +15,21 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
 #include <pthread.h>
 
 /* action indicators */
 #define SEND_META (-1)
 #define SEND_DATA (-2)
 #define GET_STAT (-3)
+#define SEND_META_CACHED (-4)
+#define GET_STAT_STALE (-6)
 #define INIT_DOWNLOAD (-7)
+#define SEND_META_BATCH (-12)
+#define SEND_META_BATCH_CACHED (-13)
+#define GET_UPLOAD_PROGRESS (-19)
+#define RESP_UPLOAD_PROGRESS (-20)
 
 using namespace std;
 
@@ -38,8 +46,31 @@ private:
     
     /* host socket */
     int hostSock_;
+    
+    /* whether the connection is shut down by the client, when the errors are expected */
+    volatile bool cancelled_;
 
 public:
+    /* header of a metadata message */
+    typedef struct {
+        int userID;
+        int indicator;
+        uint32_t size;
+        uint32_t sharenum;
+    } metaHead_t;
+    
+    /* header of a data message */
+    typedef struct {
+        int userID;
+        int indicator;
+        uint32_t size;
+    } dataHead_t;
+    
+    /* header of a message from the server, and of a download request */
+    typedef struct {
+        int indicator;
+        uint32_t size;
+    } respHead_t;
     
     /*
      * constructor: initialize sock structure and connect
@@ -62,14 +93,78 @@ public:
      */
     int genericSend(char *raw, uint32_t rawSize);
     
+    /*
+     * scatter-gather send function, which sends IOV_MAX buffers at a time
+     *
+     * @param iov - the buffers, which are consumed as they are sent
+     * @param iovcnt - the number of buffers
+     */
+    int genericSendv(struct iovec *iov, int iovcnt);
+
+    /*
+     * make the socket non-blocking, so that an event loop drives it with trySendv and tryRecv
+     */
+    int setNonBlocking();
+
+    /*
+     * get the socket descriptor, for registering it with an event loop
+     */
+    inline int getSock() { return hostSock_; }
+
+    /*
+     * shut down the connection, so that a thread blocked on it returns, without reporting the error
+     */
+    void cancel();
+
+    /*
+     * non-blocking scatter-gather send function, which sends until the buffers are sent or the socket is full
+     *
+     * @param iov - the buffers, which are advanced past the data sent <return>
+     * @param iovcnt - the number of buffers left <return>
+     *
+     * @return 1 if all the buffers are sent, 0 if the socket is full, or -1 on error
+     */
+    int trySendv(struct iovec **iov, int *iovcnt);
+
+    /*
+     * non-blocking receive function, which receives until the buffer is full or no data is ready
+     *
+     * @param raw - the buffer
+     * @param rawSize - the size of the data to be received
+     * @param received - the size of the data received so far <return>
+     *
+     * @return 1 if all the data is received, 0 if no more data is ready, or -1 on error or a closed connection
+     */
+    int tryRecv(char *raw, uint32_t rawSize, uint32_t *received);
+
+    /*
+     * set the header of a metadata message
+     *
+     * @param head - the header <return>
+     * @param rawSize - size of the metadata
+     * @param indicator - SEND_META or SEND_META_CACHED, or SEND_META_BATCH or SEND_META_BATCH_CACHED
+     *                    for the metadata of several files, where sharenum is the number of files
+     */
+    static void setMetaHead(metaHead_t *head, int rawSize, int userID, uint32_t sharenum, int indicator);
+
+    /*
+     * set the header of a data message
+     *
+     * @param head - the header <return>
+     * @param rawSize - size of the data
+     */
+    static void setDataHead(dataHead_t *head, size_t rawSize, int userID);
+
     /*
      * metadata send function
      *
      * @param raw - raw data buffer_
      * @param rawSize - size of raw data
+     * @param indicator - SEND_META, or SEND_META_CACHED for shares all uploaded before,
+     *                    which are followed by neither the status list nor the data
      *
      */
-    int sendMeta(char *raw, int rawSize, int userID, uint32_t sharenum);
+    int sendMeta(char *raw, int rawSize, int userID, uint32_t sharenum, int indicator = SEND_META);
     
     /*
      * data send function
@@ -80,6 +175,15 @@ public:
      */
     int sendData(char *raw, int rawSize, int userID);
     
+    /*
+     * data send function, which sends the data from where it is without copying it together
+     *
+     * @param iov - the buffers of the data, which are consumed as they are sent
+     * @param iovcnt - the number of buffers
+     *
+     */
+    int sendDataV(struct iovec *iov, int iovcnt, int userID);
+
     /*
      * status recv function
      *
@@ -87,6 +191,7 @@ public:
      * @param num - num of returned indicator
      *
      * @return statusList
+     * @return 0 on success, 1 if the server reports that some cached shares sent before are not stored, or -1 on error
      */
     int getStatus(bool *statusList, int *numOfShare);
     
@@ -100,6 +205,22 @@ public:
      */
     int initDownload(char *filename, int namesize);
     
+    /*
+     * receive the header of a chunk of data, so that the data can be received as it arrives
+     *
+     * @param retSize - the size of the data of the chunk, 0 if the server has closed the connection <return>
+     */
+    int downloadHead(int *retSize);
+    
+    /*
+     * receive the part of the data of a chunk that has arrived, and wait if none has
+     *
+     * @param raw - the buffer
+     * @param rawSize - the size of the data left in the chunk
+     * @param received - the size of the data received <return>
+     */
+    int downloadPart(char *raw, uint32_t rawSize, uint32_t *received);
+    
     /*
      * download a chunk of data
      *
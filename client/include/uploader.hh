@@ -20,21 +20,31 @@
 #include <openssl/evp.h>
 #include <cstring>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
-#include "BasicRingBuffer.hh"
+#include "LockFreeRingBuffer.hh"
+#include "BufferArena.hh"
 #include "socket.hh"
 #include "CDCodec.hh"
 #include "CryptoPrimitive.hh"
+#include "FingerprintCache.hh"
 
 /* upload ringbuffer size */
 #define UPLOAD_RB_SIZE 2048
 
+/* max number of objects taken from the upload ringbuffer at a time */
+#define UPLOAD_BATCH_SIZE 32
+
 /* data buffer size for each object in ringbuffer */
 #define RING_BUFFER_DATA_SIZE (16*1024)
 
 /* upload buffer size */
 #define UPLOAD_BUFFER_SIZE (4*1024*1024)
 
+/* max metadata size of a container buffer, which the default meta buffer of the servers holds */
+#define UPLOAD_META_LIMIT (1024*1024)
+
 /* max file full path name size */
 #define DIR_MAX_SIZE 255
 
@@ -50,13 +60,23 @@
 /* minimum ring buffer item size */
 #define MINIMUN_ITEM_SIZE 32
 
-/* num of upload threads */
+/* max num of clouds, which are all driven by a single upload thread */
 #define UPLOAD_NUM_THREADS 4
 
+/* transport states of a cloud connection */
+#define UPLOAD_FILLING 0
+#define UPLOAD_SENDING_META 1
+#define UPLOAD_RECEIVING_STAT 2
+#define UPLOAD_SENDING_DATA 3
+#define UPLOAD_DONE 4
+#define UPLOAD_SENDING_QUERY 5
+#define UPLOAD_RECEIVING_PROGRESS 6
+
 /* object type indicators */
 #define FILE_HEADER (-9)
 #define SHARE_OBJECT (-8)
 #define SHARE_END (-27)
+#define SESSION_END (-28)
 
 using namespace std;
 
@@ -85,6 +105,7 @@ class Uploader{
             long sizeOfPastSecrets;
             int numOfComingSecrets;
             long sizeOfComingSecrets;
+            uint64_t contentDigest;     // digest of the file content, 0 if the upload is never resumed
         }fileShareMDHead_t;
 
         /* share metadata header structure */
@@ -95,16 +116,18 @@ class Uploader{
             int shareSize;
         } shareMDEntry_t;
 
-        /* file header object struct for ringbuffer */
+        /* file header object struct for ringbuffer, the slice holds the file name share */
         typedef struct{
             fileShareMDHead_t file_header;
-            unsigned char data[RING_BUFFER_DATA_SIZE];
+            uint32_t numOfShares;   // total number of shares of the file
+            int numOfAccepted;      // number of secrets of the file the cloud has accepted before, whose shares are skipped
+            BufferArena::Slice_t data;
         }fileHeaderObj_t;
 
-        /* share header object struct for ringbuffer */
+        /* share header object struct for ringbuffer, the slice holds the share */
         typedef struct{
             shareMDEntry_t share_header;
-            unsigned char data[RING_BUFFER_DATA_SIZE];
+            BufferArena::Slice_t data;
         }shareHeaderObj_t;
 
         /* union of objects for unifying ringbuffer objects */
@@ -118,19 +141,59 @@ class Uploader{
 
         /* thread parameter structure */
         typedef struct{
-            int cloudIndex;
             int userID;
-            uint32_t sharenum;
             Uploader* obj;
         }param_t;
 
+        /* transport state of a cloud connection, which the upload thread moves on as the socket allows */
+        typedef struct{
+            int state;                          // one of the UPLOAD_* states
+            bool last;                          // whether the container buffer is the last one of the session
+            int numOfFiles;                     // number of files in the metadata buffer
+            int fileOffset;                     // offset of the metadata of the current file in the metadata buffer
+            bool fileOpen;                      // whether more shares of the current file are to come
+            int numOfAccepted;                  // shares of the current file below this secret ID are skipped
+            bool queryPending;                  // whether the progress request is to be sent once the connection is idle
+            Socket::dataHead_t queryHead;       // header of the progress request
+            struct iovec queryIov[2];           // buffers of the progress request
+            char progress[sizeof(Socket::respHead_t) + sizeof(int)];    // answer to the progress request
+            Item_t batch[UPLOAD_BATCH_SIZE];    // objects taken from the ringbuffer
+            int batchIndex;                     // the next object of the batch to buffer
+            int batchSize;                      // number of objects in the batch
+            Socket::metaHead_t metaHead;        // header of the metadata message
+            Socket::dataHead_t dataHead;        // header of the data message
+            struct iovec* iovList;              // buffers of the message being sent
+            struct iovec* iov;                  // the first buffer not sent yet
+            int iovcnt;                         // number of buffers not sent yet
+            char* statBuffer;                   // status list with its header
+            uint32_t statSize;                  // size of the status list with its header
+            uint32_t statReceived;              // size received so far
+            bool blocked;                       // whether the socket is waited for until epoll reports it ready
+            uint32_t events;                    // events of the socket registered with epoll
+        }cloudState_t;
+
         /* file header pointer array for modifying header */
         fileShareMDHead_t ** headerArray_;
 
         /* socket array */
         Socket** socketArray_;
 
-        /* metadata buffer */
+        /*
+         * requests asking the upload progress of a file, one per cloud, and the answers,
+         * which the upload thread sends and receives between the uploads of each cloud
+         */
+        char* progressRequest_;
+        int progressRequestSize_;
+        int progressAccepted_[UPLOAD_NUM_THREADS];
+
+        /* number of clouds yet to answer the progress request, which the asking thread waits for */
+        int pendingQueries_;
+        RingWaiter queryDone_;
+
+        /*
+         * metadata buffer, which holds the metadata of each file with shares in the container buffer in turn:
+         * [total number of shares of the file + file header + file name share + share headers]
+         */
         char ** uploadMetaBuffer_;
 
         /* container buffer */
@@ -145,6 +208,12 @@ class Uploader{
         /* indicate the number of shares in a buffer */
         int* numOfShares_;
 
+        /* indicate the number of shares in a buffer found in the fingerprint cache */
+        int* numOfCached_;
+
+        /* fingerprint cache of each cloud, NULL if uploading without the cache */
+        FingerprintCache** fpCache_;
+
         /* array for record each share size */
         int** shareSizeArray_;	
 
@@ -154,8 +223,20 @@ class Uploader{
         /* size of share metadata header */
         int shareMDEntrySize_;
 
-        /* thread id array */
-        pthread_t tid_[UPLOAD_NUM_THREADS];
+        /* transport state of each cloud */
+        cloudState_t* cloudState_;
+
+        /* epoll instance watching the sockets and the event fd */
+        int epollFd_;
+
+        /* event fd signalled by add() when the upload thread sleeps */
+        int eventFd_;
+
+        /* indicate the upload thread may be sleeping in epoll_wait */
+        int sleeping_;
+
+        /* id of the upload thread */
+        pthread_t tid_;
 
         /* record accumulated processed data */
         long long accuData_[UPLOAD_NUM_THREADS];
@@ -163,19 +244,33 @@ class Uploader{
         /* record accumulated unique data */
         long long accuUnique_[UPLOAD_NUM_THREADS];
 
+        /* record accumulated data copied into the container buffer */
+        long long accuCopied_[UPLOAD_NUM_THREADS];
+
+        /* record accumulated number of uploads, and those sent without waiting for the status list */
+        long long accuUploads_[UPLOAD_NUM_THREADS];
+        long long accuCachedUploads_[UPLOAD_NUM_THREADS];
+
+        /* record accumulated data of the uploads sent without waiting for the status list, which is not sent */
+        long long accuCachedData_[UPLOAD_NUM_THREADS];
+
+        /* indicate the server reports cached shares that are not stored */
+        bool staleCache_[UPLOAD_NUM_THREADS];
+
         /* uploader ringbuffer array */
-        RingBuffer<Item_t>** ringBuffer_;
+        SPSCRingBuffer<Item_t>** ringBuffer_;
 
 
         /*
-         * constructor
+         * constructor, the uploader uploads the files added until the end of the session over the same connections
          *
          * @param p - input large prime number
          * @param total - input total number of clouds
          * @param subset - input number of clouds to be chosen
+         * @param fpCacheSize - size budget of the fingerprint cache of each cloud, 0 for no cache
          *
          */
-        Uploader(int total, int subset, int userID,uint32_t sharenum);
+        Uploader(int total, int subset, int userID, long fpCacheSize);
 
         /*
          * destructor
@@ -184,24 +279,109 @@ class Uploader{
 
 
         /*
-         * Initiate upload
+         * Initiate upload, by preparing the metadata message of the container buffer
          *
          * @param cloudIndex - indicate targeting cloud
+         * @param last - whether this is the last upload of the session, which always waits for the status list
          * 
          */
-        int performUpload(int cloudIndex,int userID,uint32_t sharenum);
+        int performUpload(int cloudIndex,int userID, bool last);
+
+        /*
+         * buffer the objects of a cloud from its ringbuffer, until it is empty or the container buffer is uploaded
+         *
+         * @param cloudIndex - indicate targeting cloud
+         *
+         * @return whether any object is buffered
+         */
+        bool fillContainer(int cloudIndex,int userID);
 
         /*
-         * indicate the end of uploading a file
+         * move the upload of a container buffer on, until the socket is full, or has no data ready
+         *
+         * @param cloudIndex - indicate targeting cloud
+         *
+         * @return whether the upload has moved on
+         */
+        bool progressUpload(int cloudIndex,int userID);
+
+        /*
+         * move the progress request of a cloud on, which is sent between two uploads over the same connection
+         *
+         * @param cloudIndex - indicate targeting cloud
+         *
+         * @return whether the request has moved on
+         */
+        bool progressQuery(int cloudIndex);
+
+        /*
+         * the server has got the container buffer, so the next one is filled
+         *
+         * @param cloudIndex - indicate targeting cloud
+         *
+         */
+        void finishUpload(int cloudIndex);
+
+        /*
+         * register the events of the socket of a cloud that its state waits for, if it is blocked
+         *
+         * @param cloudIndex - indicate targeting cloud
+         *
+         */
+        void watchSocket(int cloudIndex);
+
+        /*
+         * ask each cloud how many secrets of a file it has accepted in an unfinished upload before,
+         * so that the upload is resumed from there
+         *
+         * @param nameShares - the shares of the file name, one after another
+         * @param nameShareSize - the size of a share of the file name
+         * @param fileSize - the size of the file
+         * @param numOfShares - the total number of shares of the file
+         * @param contentDigest - the digest of the file content, which must match that of the unfinished upload
+         * @param accepted - the number of accepted secrets of each cloud, 0 to upload the file from the start <return>
+         *
+         */
+        void queryProgress(unsigned char* nameShares, int nameShareSize, long fileSize, uint32_t numOfShares,
+                           uint64_t contentDigest, int userID, int* accepted);
+
+        /*
+         * wake up the upload thread if it sleeps, once per sleep
+         */
+        void wakeUp();
+
+        /*
+         * indicate the end of uploading the session
          * 
-         * @return total - total amount of data that input to uploader
+         * @return total - total amount of data that input to uploader, except that of the cached uploads
          * @return uniq - the amount of unique data that transferred in network
          *
          */
         int indicateEnd(long long *total, long long *uniq);
 
         /*
-         * interface for adding object to ringbuffer
+         * get the amount of share data copied by the upload thread, after the end of uploading
+         *
+         * @return copied - the amount of data copied into the container buffers sent with their status lists
+         *
+         */
+        int getCopyStats(long long *copied);
+
+        /*
+         * get the uploads sent without waiting for the status list, after the end of uploading
+         *
+         * @return uploads - the number of uploads
+         * @return cached - the number of uploads whose shares are all found in the fingerprint caches
+         * @return cachedData - the amount of share data of those uploads, which is not sent
+         *
+         * @return 0 if the servers stored the files, or -1 if a server reports cached shares that are not stored,
+         *         whose cache is then cleared for uploading the files again
+         */
+        int getCacheStats(long long *uploads, long long *cached, long long *cachedData);
+
+        /*
+         * interface for adding object to ringbuffer,
+         * and the uploader releases the slice of the object once it is buffered
          *
          * @param item - the object to be added
          * @param size - the size of the object
@@ -211,7 +391,8 @@ class Uploader{
         int add(Item_t* item, int size, int index);
 
         /*
-         * procedure for update headers when upload finished
+         * procedure for update headers when upload finished, where the metadata of a file with
+         * more shares to come is carried to the next container buffer
          * 
          * @param cloudIndex - indicating targeting cloud
          *
@@ -221,7 +402,7 @@ class Uploader{
         int updateHeader(int cloudIndex);
 
         /*
-         * uploader thread handler
+         * uploader thread handler, which drives the connections of all the clouds
          *
          * @param param - input structure
          *
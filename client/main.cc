@@ -4,7 +4,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <ftw.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <xxhash.h>
 
 #include "chunker.hh"
 #include "encoder.hh"
@@ -46,33 +53,481 @@ double timerSplit(const double *t)
 
 void usage(char *s)
 {
-    printf("usage: ./CLIENT [filename] [userID] [action] [secutiyType]\n- [filename]: full path of the file;\n- [userID]: use ID of current client;\n- [action]: [-u] upload; [-d] download;\n- [securityType]: [HIGH] AES-256 & SHA-256; [LOW] AES-128 & SHA-1\n");
+    printf("usage: ./CLIENT [filename] [userID] [action] [secutiyType] ([chunkerType] [encoderThreads])\n- [filename]: full path of the file;\n- [userID]: use ID of current client;\n- [action]: [-u] upload; [-d] download; [-s] upload the files under a directory, or listed in a file one per line, in one session;\n- [securityType]: [HIGH] AES-256 & SHA-256; [LOW] AES-128 & SHA-1\n- [chunkerType]: [FIX] 8KB fixed-size (default); [VAR] Rabin variable-size; [FASTCDC] FastCDC variable-size\n- [encoderThreads]: number of encoder threads, the number of cores by default\n");
     exit(1);
 }
 
-int main(int argc, char *argv[])
+/*
+ * input of a file, which is mapped for sequential reading, or read part by part if the mapping fails
+ */
+struct FileInput
 {
-    /* argument test */
-    //    if (argc != 5) usage(NULL);
+    FILE *fin;
+    long size;
+    /* offset of the next part */
+    long offset;
+    /* the mapped file, or NULL if not mapped */
+    unsigned char *map;
+    /* buffer of partSize bytes for reading a part if not mapped */
+    unsigned char *buffer;
+    int partSize;
+};
 
-    /* get options */
-    char *fileName = argv[1];
-    int userID = atoi(argv[2]);
-    char *opt = argv[3];
-    char *securesetting = argv[4];
+/*
+ * open the input of a file
+ *
+ * @param input - the input <return>
+ * @param fin - the file
+ * @param size - the file size
+ * @param buffer - a buffer for reading a part if the file cannot be mapped
+ * @param partSize - the size of the buffer, i.e. the size of a part
+ */
+void openInput(FileInput *input, FILE *fin, long size, unsigned char *buffer, int partSize)
+{
+    input->fin = fin;
+    input->size = size;
+    input->offset = 0;
+    input->map = NULL;
+    input->buffer = buffer;
+    input->partSize = partSize;
+
+    if (size > 0)
+    {
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fin), 0);
+        if (map != MAP_FAILED)
+        {
+            /* let the kernel read ahead aggressively, so that reading overlaps chunking and encoding */
+            madvise(map, size, MADV_SEQUENTIAL);
+            input->map = (unsigned char *)map;
+        }
+    }
+}
+
+/*
+ * get the next part of a file
+ *
+ * @param input - the input
+ * @param part - the part <return>
+ * @return the size of the part, 0 at the end of the file, or -1 on error
+ */
+int readPart(FileInput *input, unsigned char **part)
+{
+    long remain = input->size - input->offset;
+    int partSize = remain < input->partSize ? (int)remain : input->partSize;
+    if (partSize == 0)
+    {
+        return 0;
+    }
+
+    if (input->map != NULL)
+    {
+        *part = input->map + input->offset;
+        /* drop the pages of the previous part, whose chunks have been copied */
+        if (input->offset >= input->partSize)
+        {
+            madvise(input->map + input->offset - input->partSize, input->partSize, MADV_DONTNEED);
+        }
+        /* start reading the next part */
+        if (input->offset + partSize < input->size)
+        {
+            long nextSize = input->size - input->offset - partSize;
+            madvise(input->map + input->offset + partSize, nextSize < input->partSize ? nextSize : input->partSize, MADV_WILLNEED);
+        }
+    }
+    else
+    {
+        if ((int)fread(input->buffer, 1, partSize, input->fin) != partSize)
+        {
+            return -1;
+        }
+        *part = input->buffer;
+    }
+    input->offset += partSize;
+    return partSize;
+}
+
+/*
+ * go back to the start of a file
+ *
+ * @param input - the input
+ */
+void rewindInput(FileInput *input)
+{
+    input->offset = 0;
+    if (input->map == NULL)
+    {
+        fseek(input->fin, 0, SEEK_SET);
+    }
+}
+
+/*
+ * close the input of a file
+ *
+ * @param input - the input
+ */
+void closeInput(FileInput *input)
+{
+    if (input->map != NULL)
+    {
+        munmap(input->map, input->size);
+        input->map = NULL;
+    }
+}
+
+/*
+ * count the chunks of a file, as the server needs the total number of shares before the first upload
+ *
+ * @param input - the input of the file, which is rewound after counting
+ * @param chunker - the chunker for uploading
+ * @param chunkEndIndexList - a list for the end index of each chunk
+ * @param digest - the state for digesting the file content in the same pass, or NULL
+ * @return the number of chunks, or 0 on error
+ */
+uint32_t countChunks(FileInput *input, Chunker *chunker, int *chunkEndIndexList, XXH3_state_t *digest)
+{
+    uint32_t count = 0;
+    int numOfChunks, headSize;
+    unsigned char *part, *head;
+    long total = 0;
+    while (total < input->size)
+    {
+        int ret = readPart(input, &part);
+        if (ret <= 0)
+        {
+            count = 0;
+            break;
+        }
+        total += ret;
+        if (digest != NULL)
+        {
+            XXH3_64bits_update(digest, part, ret);
+        }
+        chunker->streamChunking(part, ret, total == input->size, chunkEndIndexList, &numOfChunks, &head, &headSize);
+        count += numOfChunks;
+    }
+    chunker->resetStream();
+    rewindInput(input);
+    return count;
+}
 
-    /* read file */
+/*
+ * digest the content of a file, by which the servers tell whether the file has changed since an interrupted upload
+ *
+ * @param input - the input of the file, which is rewound after digesting
+ * @param digest - the state for digesting the file content
+ * @return 1 on success, or 0 on error
+ */
+int digestInput(FileInput *input, XXH3_state_t *digest)
+{
+    unsigned char *part;
+    long total = 0;
+    while (total < input->size)
+    {
+        int ret = readPart(input, &part);
+        if (ret <= 0)
+        {
+            rewindInput(input);
+            return 0;
+        }
+        total += ret;
+        XXH3_64bits_update(digest, part, ret);
+    }
+    rewindInput(input);
+    return 1;
+}
+
+/*
+ * add a file to the encoder, a file header followed by its chunks, the last of which ends the file,
+ * where the first chunks that every cloud has accepted in an interrupted upload before are not added
+ *
+ * @param fileName - full path of the file, by which the file is recorded
+ * @param userID - the user ID
+ * @param chunkerType - chunker type
+ * @param buffer - a buffer for reading a part if the file cannot be mapped
+ * @param bufferSize - the size of the buffer, i.e. the size of a part
+ * @param chunkEndIndexList - a list for the end index of each chunk
+ * @param zeroChunk - a chunk of zeros of the max secret size
+ * @param nameShares - a buffer for the shares of the file name
+ * @param readTime - the time spent reading the file <return>
+ * @param zero - the size of the chunks of zeros <return>
+ * @param resumed - the size of the chunks not added, as every cloud has accepted them before <return>
+ * @return the size of the file, or -1 if it cannot be opened
+ */
+long uploadFile(char *fileName, int userID, int chunkerType, unsigned char *buffer, int bufferSize, int *chunkEndIndexList,
+                unsigned char *zeroChunk, unsigned char *nameShares, double *readTime, long *zero, long *resumed)
+{
     FILE *fin = fopen(fileName, "r");
+    if (fin == NULL)
+    {
+        return -1;
+    }
 
     /* get file size */
     fseek(fin, 0, SEEK_END);
     long size = ftell(fin);
     fseek(fin, 0, SEEK_SET);
     uint32_t sharenum = (size + (8 << 10) - 1) / (8 << 10);
+    int namesize = strlen(fileName) + 1;
+    double timer;
+
+    FileInput fileInput;
+    openInput(&fileInput, fin, size, buffer, bufferSize);
+
+    /* a file larger than a container buffer may have been partly accepted by an upload interrupted before,
+     * which is resumed only if the digest of its content is the same */
+    XXH3_state_t *digest = NULL;
+    if (size > UPLOAD_BUFFER_SIZE)
+    {
+        digest = XXH3_createState();
+        XXH3_64bits_reset(digest);
+    }
+    if (chunkerType != FIX_SIZE_TYPE)
+    {
+        sharenum = countChunks(&fileInput, chunkerObj, chunkEndIndexList, digest);
+        if (sharenum == 0 && size > 0)
+        {
+            fprintf(stderr, "fail to read %s\n", fileName);
+            exit(1);
+        }
+    }
+    else if (digest != NULL && !digestInput(&fileInput, digest))
+    {
+        fprintf(stderr, "fail to read %s\n", fileName);
+        exit(1);
+    }
+
+    int n = confObj->getN();
+    int numOfPast = 0;
+    Encoder::Secret_Item_t header;
+    memset(header.file_header.numOfAccepted, 0, sizeof(header.file_header.numOfAccepted));
+    header.file_header.contentDigest = 0;
+    if (digest != NULL)
+    {
+        header.file_header.contentDigest = XXH3_64bits_digest(digest);
+        XXH3_freeState(digest);
+        int nameShareSize;
+        cdCodecObj->encodingFileName((unsigned char *)fileName, namesize, nameShares, &nameShareSize);
+        uploaderObj->queryProgress(nameShares, nameShareSize, size, sharenum, header.file_header.contentDigest, userID,
+                                   header.file_header.numOfAccepted);
+        numOfPast = *min_element(header.file_header.numOfAccepted, header.file_header.numOfAccepted + n);
+    }
+
+    // chunking
+    //
+    header.type = FILE_OBJECT;
+    encoderObj->newSecret(&header.file_header.name);
+    memcpy(header.file_header.name.data, fileName, namesize);
+    header.file_header.name.size = namesize;
+    header.file_header.fileSize = size;
+    header.file_header.numOfShares = sharenum;
+    header.file_header.numOfPastSecrets = numOfPast;
+    header.file_header.sizeOfPastSecrets = 0;
+
+    // do encode, and the header of a resumed upload follows the chunks not added
+    if (numOfPast == 0)
+    {
+        encoderObj->add(&header);
+    }
+
+    long total = 0;
+    int totalChunks = 0;
+    int numOfChunks;
+    unsigned char *part, *head;
+    int headSize;
+    while (total < size)
+    {
+        timerStart(&timer);
+        int ret = readPart(&fileInput, &part);
+        *readTime += timerSplit(&timer);
+        if (ret <= 0)
+        {
+            fprintf(stderr, "fail to read %s\n", fileName);
+            exit(1);
+        }
+        total += ret;
+        // chunks may cross the parts, the carried head of the first chunk precedes the part
+        chunkerObj->streamChunking(part, ret, total == size, chunkEndIndexList, &numOfChunks, &head, &headSize);
+
+        int count = 0;
+        int preEnd = -1;
+        while (count < numOfChunks)
+        {
+            /* the chunks accepted by every cloud are only counted */
+            if (totalChunks < numOfPast)
+            {
+                int chunkSize = chunkEndIndexList[count] - preEnd;
+                if (count == 0)
+                {
+                    chunkSize += headSize;
+                }
+                header.file_header.sizeOfPastSecrets += chunkSize;
+                if (totalChunks + 1 == numOfPast)
+                {
+                    *resumed += header.file_header.sizeOfPastSecrets;
+                    encoderObj->add(&header);
+                }
+                totalChunks++;
+                preEnd = chunkEndIndexList[count];
+                count++;
+                continue;
+            }
+
+            Encoder::Secret_Item_t input;
+            input.type = SECRET_OBJECT;
+            input.secret.secretID = totalChunks;
+            // the chunk is copied once into an arena block, and later stages only pass slices of the block
+            BufferArena::Slice_t *secret = &input.secret.secret;
+            encoderObj->newSecret(secret);
+            secret->size = chunkEndIndexList[count] - preEnd;
+            if (count == 0 && headSize > 0)
+            {
+                memcpy(secret->data, head, headSize);
+                memcpy(secret->data + headSize, part, secret->size);
+                secret->size += headSize;
+            }
+            else
+            {
+                memcpy(secret->data, part + preEnd + 1, secret->size);
+            }
+            // zero仅仅起记录作用，不会影响secret的生成
+            if (memcmp(secret->data, zeroChunk, secret->size) == 0)
+            {
+                *zero += secret->size;
+            }
+
+            input.secret.end = 0;
+            if (total == size && count + 1 == numOfChunks)
+            {
+                input.secret.end = 1;
+            }
+            encoderObj->add(&input);
+            totalChunks++;
+            preEnd = chunkEndIndexList[count];
+            count++;
+        }
+    }
+    closeInput(&fileInput);
+    fclose(fin);
+    return size;
+}
+
+/* files found by walking the directory of an upload session */
+static vector<string> walkedFiles;
+
+/*
+ * collect a regular file found by walking a directory
+ */
+static int collectFile(const char *path, const struct stat *sb, int type, struct FTW * /*ftwbuf*/)
+{
+    if (type == FTW_F && S_ISREG(sb->st_mode))
+    {
+        walkedFiles.push_back(path);
+    }
+    return 0;
+}
+
+/*
+ * list the files of an upload session
+ *
+ * @param target - a directory, whose regular files are listed recursively, or a file listing a path per line
+ * @param files - the files <return>
+ */
+void listSessionFiles(char *target, vector<string> *files)
+{
+    struct stat sb;
+    if (stat(target, &sb) == -1)
+    {
+        fprintf(stderr, "fail to open %s\n", target);
+        exit(1);
+    }
+
+    if (S_ISDIR(sb.st_mode))
+    {
+        /* a trailing slash would be doubled in the recorded paths */
+        string dir = target;
+        while (dir.size() > 1 && dir[dir.size() - 1] == '/')
+        {
+            dir.erase(dir.size() - 1);
+        }
+        walkedFiles.clear();
+        if (nftw(dir.c_str(), collectFile, 64, FTW_PHYS) == -1)
+        {
+            fprintf(stderr, "fail to walk %s\n", target);
+            exit(1);
+        }
+        /* in the same order in every session, whatever the order of the directory entries */
+        sort(walkedFiles.begin(), walkedFiles.end());
+        *files = walkedFiles;
+        return;
+    }
+
+    FILE *list = fopen(target, "r");
+    if (list == NULL)
+    {
+        fprintf(stderr, "fail to open %s\n", target);
+        exit(1);
+    }
+    char *line = NULL;
+    size_t lineSize = 0;
+    ssize_t len;
+    while ((len = getline(&line, &lineSize, list)) != -1)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        {
+            line[--len] = '\0';
+        }
+        if (len > 0)
+        {
+            files->push_back(line);
+        }
+    }
+    free(line);
+    fclose(list);
+}
+
+int main(int argc, char *argv[])
+{
+    /* argument test */
+    if (argc < 4)
+        usage(NULL);
+
+    /* get options */
+    char *fileName = argv[1];
+    int userID = atoi(argv[2]);
+    char *opt = argv[3];
+    int chunkerType = FIX_SIZE_TYPE;
+    if (argc > 5)
+    {
+        if (strcmp(argv[5], "FIX") == 0)
+        {
+            chunkerType = FIX_SIZE_TYPE;
+        }
+        else if (strcmp(argv[5], "VAR") == 0)
+        {
+            chunkerType = VAR_SIZE_TYPE;
+        }
+        else if (strcmp(argv[5], "FASTCDC") == 0)
+        {
+            chunkerType = FASTCDC_TYPE;
+        }
+        else
+        {
+            usage(NULL);
+        }
+    }
+    int encodeThreadNum = 0;
+    if (argc > 6)
+    {
+        encodeThreadNum = atoi(argv[6]);
+        if (encodeThreadNum <= 0)
+        {
+            usage(NULL);
+        }
+    }
+
     unsigned char *buffer;
     int *chunkEndIndexList;
-    int numOfChunks;
-    int n, m, k, r, *kShareIDList;
+    int n, m, k, r;
 
     int i;
 
@@ -90,6 +545,10 @@ int main(int argc, char *argv[])
     m = confObj->getM();
     k = confObj->getK();
     r = confObj->getR();
+    if (encodeThreadNum > 0)
+    {
+        confObj->setEncodeThreadNum(encodeThreadNum);
+    }
 
     /* initialize buffers */
     int bufferSize = confObj->getBufferSize();
@@ -106,13 +565,6 @@ int main(int argc, char *argv[])
     secretBuffer = (unsigned char *)malloc(sizeof(unsigned char) * secretBufferSize);
     shareBuffer = (unsigned char *)malloc(sizeof(unsigned char) * shareBufferSize);
 
-    /* initialize share ID list */
-    kShareIDList = (int *)malloc(sizeof(int) * k);
-    for (i = 0; i < k; i++)
-    {
-        kShareIDList[i] = i;
-    }
-
     /* full file name process */
     int namesize = strlen(fileName);
     namesize++;
@@ -124,91 +576,129 @@ int main(int argc, char *argv[])
     /* parse secure parameters */
     int securetype = LOW_SEC_PAIR_TYPE;
 
-    if (strncmp(opt, "-u", 2) == 0)
+    /* a file is uploaded as a session of one file, and the files of a session share the pipeline and the connections */
+    if (strncmp(opt, "-u", 2) == 0 || strncmp(opt, "-s", 2) == 0)
     {
-        uploaderObj = new Uploader(n, n, userID, sharenum);
-        encoderObj = new Encoder(CAONT_RS_TYPE, n, m, r, securetype, uploaderObj);
-        chunkerObj = new Chunker(FIX_SIZE_TYPE);
-        double timer, split, bw, timer2, split2;
+        vector<string> files;
+        if (strncmp(opt, "-s", 2) == 0)
+        {
+            listSessionFiles(fileName, &files);
+        }
+        else
+        {
+            files.push_back(fileName);
+        }
+
+        chunkerObj = new Chunker(chunkerType);
+        uploaderObj = new Uploader(n, n, userID, confObj->getFpCacheSize());
+        encoderObj = new Encoder(confObj->getCodecType(), n, m, r, securetype, confObj->getKeyHashType(), uploaderObj, confObj->getEncodeThreadNum());
+        double timer2, split2, bw;
         double total_t = 0;
-        timerStart(&timer2);
-        // chunking
-        //
-        Encoder::Secret_Item_t header;
-        header.type = 1;
-        memcpy(header.file_header.data, fileName, namesize);
-        header.file_header.fullNameSize = namesize;
-        header.file_header.fileSize = size;
-
-        // do encode
-        encoderObj->add(&header);
-        // uploaderObj->generateMDHead(0,size,(unsigned char*) argv[1],namesize,n,0,0,0,0);
+        long size = 0, resumed = 0;
+        int numOfFiles = 0;
 
-        long total = 0;
-        int totalChunks = 0;
-        while (total < size)
+        /* the file names are encoded apart from the encoder threads, for asking the upload progress */
+        cryptoObj = new CryptoPrimitive(securetype);
+        cdCodecObj = new CDCodec(confObj->getCodecType(), n, m, r, cryptoObj, confObj->getKeyHashType());
+        timerStart(&timer2);
+        for (size_t j = 0; j < files.size(); j++)
         {
-            timerStart(&timer);
-            int ret = fread(buffer, 1, bufferSize, fin);
-            split = timerSplit(&timer);
-            total_t += split;
-            chunkerObj->chunking(buffer, ret, chunkEndIndexList, &numOfChunks);
-
-            int count = 0;
-            int preEnd = -1;
-            while (count < numOfChunks)
+            long ret = uploadFile((char *)files[j].c_str(), userID, chunkerType, buffer, bufferSize, chunkEndIndexList, tmp, shareBuffer, &total_t, &zero, &resumed);
+            if (ret == -1)
             {
-                Encoder::Secret_Item_t input;
-                input.type = 0;
-                input.secret.secretID = totalChunks;
-                input.secret.secretSize = chunkEndIndexList[count] - preEnd;
-                memcpy(input.secret.data, buffer + preEnd + 1, input.secret.secretSize);
-                // zero仅仅起记录作用，不会影响secret的生成
-                if (memcmp(input.secret.data, tmp, input.secret.secretSize) == 0)
-                {
-                    zero += input.secret.secretSize;
-                }
-
-                input.secret.end = 0;
-                if (total + ret == size && count + 1 == numOfChunks)
-                {
-                    input.secret.end = 1;
-                }
-                encoderObj->add(&input);
-                totalChunks++;
-                preEnd = chunkEndIndexList[count];
-                count++;
+                fprintf(stderr, "fail to open %s, skipped\n", files[j].c_str());
+                continue;
             }
-            total += ret;
+            size += ret;
+            numOfFiles++;
         }
+
+        /* the end of the session follows the last file */
+        Encoder::Secret_Item_t end;
+        end.type = SESSION_END_OBJECT;
+        encoderObj->add(&end);
+
         long long tt = 0, unique = 0;
         uploaderObj->indicateEnd(&tt, &unique);
         split2 = timerSplit(&timer2);
 
         bw = size / 1024 / 1024 / (split2 - total_t);
         printf("%lf\t%lld\t%lld\t%ld\n", bw, tt, unique, zero);
+
+        /* the SHA-256 fingerprinting speed of the shares, per core of the encoder threads */
+        long long fpBytes;
+        double fpSeconds;
+        encoderObj->getFingerprintStats(&fpBytes, &fpSeconds);
+        if (fpSeconds > 0)
+            printf("fingerprint\t%lf MB/s per core\n", fpBytes / 1024.0 / 1024.0 / fpSeconds);
+
+        /* the share data copied by the uploader for each byte sent */
+        long long copied;
+        uploaderObj->getCopyStats(&copied);
+        if (unique > 0)
+            printf("copy\t%lf bytes per uploaded byte\n", (double) copied / unique);
+
+        /* the uploads skipping the status list and the data, as their shares are in the fingerprint caches,
+           whose data is counted here rather than on the first line */
+        long long uploads, cachedUploads, cachedData;
+        int stale = uploaderObj->getCacheStats(&uploads, &cachedUploads, &cachedData);
+        printf("cached\t%lld of %lld uploads without round trip\t%lld bytes\n", cachedUploads, uploads, cachedData);
+
+        /* the files of a session */
+        if (strncmp(opt, "-s", 2) == 0)
+            printf("files\t%d of %zu files uploaded\n", numOfFiles, files.size());
+
+        /* the data of interrupted uploads accepted before */
+        if (resumed > 0)
+            printf("resumed\t%ld bytes accepted before\n", resumed);
+        if (stale != 0)
+        {
+            fprintf(stderr, "the fingerprint cache is stale, upload %s again\n", fileName);
+            exit(1);
+        }
         delete uploaderObj;
         delete chunkerObj;
         delete encoderObj;
+        delete cdCodecObj;
+        delete cryptoObj;
     }
 
     if (strncmp(opt, "-d", 2) == 0)
     {
+        /* get file size */
+        FILE *fin = fopen(fileName, "r");
+        if (fin == NULL)
+        {
+            fprintf(stderr, "fail to open %s\n", fileName);
+            exit(1);
+        }
+        fseek(fin, 0, SEEK_END);
+        long size = ftell(fin);
+        fclose(fin);
+
         // cdCodecObj = new CDCodec(CAONT_RS_TYPE, n, m, r, cryptoObj);
-        decoderObj = new Decoder(CAONT_RS_TYPE, n, m, r, securetype);
-        downloaderObj = new Downloader(k, k, userID, decoderObj);
+        decoderObj = new Decoder(confObj->getCodecType(), n, m, r, securetype, confObj->getKeyHashType(), confObj->getDecodeThreadNum());
+        downloaderObj = new Downloader(n, k, userID, decoderObj);
         double timer, split, bw;
         FILE *fw = fopen((std::string(fileName) + ".decode").c_str(), "wb");
 
         decoderObj->setFilePointer(fw);
-        decoderObj->setShareIDList(kShareIDList);
 
         timerStart(&timer);
-        downloaderObj->downloadFile(fileName, namesize, k);
+        downloaderObj->downloadFile(fileName, namesize, confObj->getDownloadCloudNum());
         decoderObj->indicateEnd();
         split = timerSplit(&timer);
         bw = size / 1024 / 1024 / split;
         printf("%lf\n", bw);
+        downloaderObj->indicateEnd();
+
+        /* the shares decoded from each cloud, and the clouds cancelled as the slowest */
+        long long usedShares[MAX_NUMBER_OF_CLOUDS];
+        int cancelled = downloaderObj->getShareStats(usedShares);
+        printf("shares");
+        for (i = 0; i < n; i++)
+            printf("\t%lld", usedShares[i]);
+        printf("\tcancelled %d\n", cancelled);
 
         fclose(fw);
         delete downloaderObj;
@@ -219,9 +709,7 @@ int main(int argc, char *argv[])
     free(chunkEndIndexList);
     free(secretBuffer);
     free(shareBuffer);
-    free(kShareIDList);
     CryptoPrimitive::opensslLockCleanup();
 
-    fclose(fin);
     return 0;
 }
@@ -0,0 +1,80 @@
+/*
+ * BufferArena.cc
+ */
+
+#include "BufferArena.hh"
+
+using namespace std;
+
+/*
+ * constructor
+ *
+ * @param blockSize - size of each block
+ * @param numOfBlocks - total number of blocks
+ */
+BufferArena::BufferArena(int blockSize, int numOfBlocks){
+    blockSize_ = blockSize;
+    numOfBlocks_ = numOfBlocks;
+    blocks_ = (unsigned char*)malloc((size_t)blockSize_*numOfBlocks_);
+    refCount_ = (int*)malloc(sizeof(int)*numOfBlocks_);
+    freeList_ = (int*)malloc(sizeof(int)*numOfBlocks_);
+
+    /* all the blocks are free, the lower ones on top */
+    for(int i = 0; i < numOfBlocks_; i++){
+        refCount_[i] = 0;
+        freeList_[i] = numOfBlocks_-1-i;
+    }
+    numOfFree_ = numOfBlocks_;
+    pthread_mutex_init(&mAccess_, NULL);
+    pthread_cond_init(&cvFree_, NULL);
+}
+
+/*
+ * destructor
+ */
+BufferArena::~BufferArena(){
+    pthread_mutex_destroy(&mAccess_);
+    pthread_cond_destroy(&cvFree_);
+    free(blocks_);
+    free(refCount_);
+    free(freeList_);
+}
+
+/*
+ * get a free block, and wait if all the blocks are in use
+ *
+ * @param slice - the slice of the whole block <return>
+ * @param refs - number of releases before the block is free again
+ */
+void BufferArena::acquire(Slice_t* slice, int refs){
+    pthread_mutex_lock(&mAccess_);
+    while(numOfFree_ == 0){
+        pthread_cond_wait(&cvFree_, &mAccess_);
+    }
+    int block = freeList_[--numOfFree_];
+    pthread_mutex_unlock(&mAccess_);
+
+    __atomic_store_n(&refCount_[block], refs, __ATOMIC_RELAXED);
+    slice->data = blocks_+(size_t)block*blockSize_;
+    slice->size = blockSize_;
+    slice->block = block;
+    slice->arena = this;
+}
+
+/*
+ * release a reference to the block of a slice, and free the block on the last release
+ *
+ * @param slice - a slice of the block
+ */
+void BufferArena::release(Slice_t* slice){
+    BufferArena* arena = slice->arena;
+
+    /* the last holder frees the block, after all the others are done with it */
+    if(__atomic_sub_fetch(&arena->refCount_[slice->block], 1, __ATOMIC_ACQ_REL) != 0){
+        return;
+    }
+    pthread_mutex_lock(&arena->mAccess_);
+    arena->freeList_[arena->numOfFree_++] = slice->block;
+    pthread_cond_signal(&arena->cvFree_);
+    pthread_mutex_unlock(&arena->mAccess_);
+}
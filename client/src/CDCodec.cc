@@ -4,6 +4,10 @@
 
 #include "CDCodec.hh"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 /*
@@ -14,13 +18,20 @@ using namespace std;
  * @param m - reliability degree (i.e. maximum number of lost shares that can be tolerated)
  * @param r - confidentiality degree (i.e. maximum number of shares from which nothing can be derived)
  * @param cryptoObj - the CryptoPrimitive instance for hash generation and data encryption
+ * @param keyHashType - the hash generating the key of a CAONT package in CAONT-RS, which has to be
+ *                      the same for encoding and decoding a secret
  */
-CDCodec::CDCodec(int CDType, int n, int m, int r, CryptoPrimitive *cryptoObj)
+CDCodec::CDCodec(int CDType, int n, int m, int r, CryptoPrimitive *cryptoObj, int keyHashType)
 {
     int i, j, sum;
 
-    CDType_ = CDType;
+    /*CAONT-RS with the CTR mask only differs from CAONT-RS in caontMasking()*/
+    ctrMasking_ = (CDType == CAONT_RS_CTR_TYPE);
+    CDType_ = ctrMasking_ ? CAONT_RS_TYPE : CDType;
     cryptoObj_ = cryptoObj;
+    keyHashType_ = keyHashType;
+    gfKernelMode_ = GF_KERNEL_GFCOMPLETE;
+    parityTables_ = NULL;
 
     if (cryptoObj_ == NULL)
     {
@@ -223,6 +234,29 @@ CDCodec::CDCodec(int CDType, int n, int m, int r, CryptoPrimitive *cryptoObj)
         /*allocate two k * k matrices for decoding*/
         squareMatrix_ = (int *)malloc(sizeof(int) * k_ * k_);
         inverseMatrix_ = (int *)malloc(sizeof(int) * k_ * k_);
+
+        /*initialize the split lookup tables of the Cauchy matrix for the SIMD kernels*/
+        parityTables_ = (unsigned char *)malloc(sizeof(unsigned char) * 32 * m_ * k_);
+        for (i = 0; i < m_; i++)
+        {
+            for (j = 0; j < k_; j++)
+            {
+                unsigned char *tables = parityTables_ + 32 * (k_ * i + j);
+                int coef = distributionMatrix_[k_ * (k_ + i) + j];
+                for (int x = 0; x < 16; x++)
+                {
+                    tables[x] = gfObj_.multiply.w32(&gfObj_, coef, x);
+                    tables[16 + x] = gfObj_.multiply.w32(&gfObj_, coef, x << 4);
+                }
+            }
+        }
+
+        /*select the fastest supported kernel for generating the parity shares*/
+        if (!setGFKernelMode(GF_KERNEL_AVX2) && !setGFKernelMode(GF_KERNEL_SSSE3))
+        {
+            setGFKernelMode(GF_KERNEL_GFCOMPLETE);
+        }
+
         if (CDType_ == AONT_RS_TYPE)
         {
             fprintf(stderr, "\nA CDCodec based on AONT-RS has been constructed! \n");
@@ -307,6 +341,8 @@ CDCodec::~CDCodec()
 
         free(squareMatrix_);
         free(inverseMatrix_);
+
+        free(parityTables_);
         if (CDType_ == AONT_RS_TYPE)
         {
             fprintf(stderr, "\nThe CDCodec based on AONT-RS has been destructed! \n");
@@ -596,7 +632,7 @@ bool CDCodec::crsssEncoding(unsigned char *secretBuffer, int secretSize, unsigne
 /*
  * decode the secret from k = n - m shares using CRSSS
  *
- * @param shareBuffer - a buffer that stores the k shares
+ * @param shares - the k shares
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share
  * @param secretSize - the size of the secret
@@ -604,7 +640,7 @@ bool CDCodec::crsssEncoding(unsigned char *secretBuffer, int secretSize, unsigne
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::crsssDecoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize,
+bool CDCodec::crsssDecoding(unsigned char **shares, int *kShareIDList, int shareSize,
                             int secretSize, unsigned char *secretBuffer)
 {
     int numOfGroups, alignedSecretSize;
@@ -665,12 +701,12 @@ bool CDCodec::crsssDecoding(unsigned char *shareBuffer, int *kShareIDList, int s
             coef = inverseMatrix_[k_ * i + j];
             if (j == 0)
             {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
+                gfObj_.multiply_region.w32(&gfObj_, shares[j],
                                            erasureCodingData_ + shareSize * i, coef, shareSize, 0);
             }
             else
             {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
+                gfObj_.multiply_region.w32(&gfObj_, shares[j],
                                            erasureCodingData_ + shareSize * i, coef, shareSize, 1);
             }
         }
@@ -841,7 +877,7 @@ bool CDCodec::aontRSEncoding(unsigned char *secretBuffer, int secretSize,
 /*
  * decode the secret from k = n - m shares using AONT-RS (proposed by Jason K. Resch and James S. Plank)
  *
- * @param shareBuffer - a buffer that stores the k shares
+ * @param shares - the k shares
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share
  * @param secretSize - the size of the secret
@@ -849,7 +885,7 @@ bool CDCodec::aontRSEncoding(unsigned char *secretBuffer, int secretSize,
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::aontRSDecoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize,
+bool CDCodec::aontRSDecoding(unsigned char **shares, int *kShareIDList, int shareSize,
                              int secretSize, unsigned char *secretBuffer)
 {
     int alignedSecretSize, numOfSecretWords;
@@ -910,12 +946,12 @@ bool CDCodec::aontRSDecoding(unsigned char *shareBuffer, int *kShareIDList, int
             coef = inverseMatrix_[k_ * i + j];
             if (j == 0)
             {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
+                gfObj_.multiply_region.w32(&gfObj_, shares[j],
                                            erasureCodingData_ + shareSize * i, coef, shareSize, 0);
             }
             else
             {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
+                gfObj_.multiply_region.w32(&gfObj_, shares[j],
                                            erasureCodingData_ + shareSize * i, coef, shareSize, 1);
             }
         }
@@ -1087,7 +1123,7 @@ bool CDCodec::caontRSOldEncoding(unsigned char *secretBuffer, int secretSize,
 /*
  * decode the secret from k = n - m shares using old CAONT-RS (proposed in the HotStorage '14 paper)
  *
- * @param shareBuffer - a buffer that stores the k shares
+ * @param shares - the k shares
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share
  * @param secretSize - the size of the secret
@@ -1095,7 +1131,7 @@ bool CDCodec::caontRSOldEncoding(unsigned char *secretBuffer, int secretSize,
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::caontRSOldDecoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize,
+bool CDCodec::caontRSOldDecoding(unsigned char **shares, int *kShareIDList, int shareSize,
                                  int secretSize, unsigned char *secretBuffer)
 {
     int alignedSecretSize, numOfSecretWords;
@@ -1156,12 +1192,12 @@ bool CDCodec::caontRSOldDecoding(unsigned char *shareBuffer, int *kShareIDList,
             coef = inverseMatrix_[k_ * i + j];
             if (j == 0)
             {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
+                gfObj_.multiply_region.w32(&gfObj_, shares[j],
                                            erasureCodingData_ + shareSize * i, coef, shareSize, 0);
             }
             else
             {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
+                gfObj_.multiply_region.w32(&gfObj_, shares[j],
                                            erasureCodingData_ + shareSize * i, coef, shareSize, 1);
             }
         }
@@ -1223,6 +1259,64 @@ bool CDCodec::caontRSOldDecoding(unsigned char *shareBuffer, int *kShareIDList,
     return 1;
 }
 
+/*
+ * generate the hash of a buffer with the key hash of the codec, whose size is the key size
+ *
+ * @param dataBuffer - the buffer
+ * @param dataSize - the size of the buffer
+ * @param hash - the generated hash <return>
+ *
+ * @return - a boolean value that indicates if the hash generation succeeds
+ */
+bool CDCodec::keyHashing(unsigned char *dataBuffer, int dataSize, unsigned char *hash)
+{
+    if (keyHashType_ == KEY_HASH_XXH3)
+    {
+        return cryptoObj_->generateHash_xxh3(dataBuffer, dataSize, hash);
+    }
+    if (keyHashType_ == KEY_HASH_DIGEST)
+    {
+        return cryptoObj_->generateHash(dataBuffer, dataSize, hash);
+    }
+
+    /*the 16-byte rabin hash is replicated again to fill a longer key, which is otherwise left uninitialized*/
+    CryptoPrimitive::generateHash_rabin(dataBuffer, dataSize, hash);
+    for (int i = 16; i < bytesPerSecretWord_; i++)
+    {
+        hash[i] = hash[i % 16];
+    }
+
+    return 1;
+}
+
+/*
+ * XOR a buffer with the mask of key_, which turns an aligned secret into the main part of
+ * its CAONT package, and the main part back into the aligned secret
+ *
+ * @param input - the buffer
+ * @param size - the size of the buffer
+ * @param output - the masked buffer, which is not input <return>
+ *
+ * @return - a boolean value that indicates if the masking succeeds
+ */
+bool CDCodec::caontMasking(unsigned char *input, int size, unsigned char *output)
+{
+    /*the CTR keystream is XORed into the buffer while it is generated, in a single pass*/
+    if (ctrMasking_)
+    {
+        return cryptoObj_->encryptWithKeyCTR(input, size, key_, output);
+    }
+
+    /*otherwise the mask is the ciphertext of alignedSizeConstant_, which is generated first*/
+    if (!cryptoObj_->encryptWithKey(alignedSizeConstant_, size, key_, output))
+    {
+        return 0;
+    }
+    gfObj_.multiply_region.w32(&gfObj_, input, output, 1, size, 1);
+
+    return 1;
+}
+
 /*
  * encode a secret into n shares using CAONT-RS
  *
@@ -1274,30 +1368,25 @@ bool CDCodec::caontRSEncoding(unsigned char *secretBuffer, int secretSize,
 
     /*generate a hash key from the aligned secret*/
 
-    if (!cryptoObj_->generateHash_rabin(alignedSecretBuffer_, alignedSecretSize, key_))
+    if (!keyHashing(alignedSecretBuffer_, alignedSecretSize, key_))
     {
         fprintf(stderr, "Error: fail in the hash calculation!\n");
 
         return 0;
     }
 
-    /*encrypt alignedSizeConstant_ of size alignedSecretSize with the hash key, and
-      temporarily store the ciphertext into erasureCodingData_*/
-    if (!cryptoObj_->encryptWithKey(alignedSizeConstant_, alignedSecretSize, key_, erasureCodingData_))
+    /*the main part of the CAONT package is obtained by masking the aligned secret with the hash key*/
+    if (!caontMasking(alignedSecretBuffer_, alignedSecretSize, erasureCodingData_))
     {
         fprintf(stderr, "Error: fail in the data encryption!\n");
 
         return 0;
     }
 
-    /*the main part of the CAONT package is obtained by XORing the ciphertext with the aligned secret*/
-    coef = 1;
-    gfObj_.multiply_region.w32(&gfObj_, alignedSecretBuffer_, erasureCodingData_, coef, alignedSecretSize, 1);
-
     /*+b) generate the tail part of the CAONT package, and store it into erasureCodingData_*/
 
     /*generate a hash from the main part of the CAONT package, and temporarily store it into erasureCodingData_*/
-    if (!cryptoObj_->generateHash_rabin(erasureCodingData_, alignedSecretSize, erasureCodingData_ + alignedSecretSize))
+    if (!keyHashing(erasureCodingData_, alignedSecretSize, erasureCodingData_ + alignedSecretSize))
     {
         fprintf(stderr, "Error: fail in the hash calculation!\n");
 
@@ -1335,10 +1424,95 @@ bool CDCodec::caontRSEncoding(unsigned char *secretBuffer, int secretSize,
     return 1;
 }
 
+/*
+ * encode a batch of secrets using CAONT-RS, which builds the CAONT packages of all the secrets
+ * as their first k shares, and then generates the parity shares of the whole batch
+ *
+ * @param num - the number of secrets
+ * @param secretBuffers - the secrets
+ * @param secretSizes - the size of each secret
+ * @param shareBuffers - a buffer for storing the n shares of each secret <return>
+ * @param shareSizes - the share size of each secret <return>
+ *
+ * @return - a boolean value that indicates if the encoding succeeds
+ */
+bool CDCodec::caontRSEncodingBatch(int num, unsigned char **secretBuffers, int *secretSizes,
+                                   unsigned char **shareBuffers, int *shareSizes)
+{
+    int alignedSecretSize, secretSize;
+    unsigned char *package;
+    int b;
+
+    /*Step 1: generate the CAONT package of each secret directly as its first k shares*/
+    for (b = 0; b < num; b++)
+    {
+        secretSize = secretSizes[b];
+        package = shareBuffers[b];
+
+        /*align the secret size into alignedSecretSize*/
+        if (((secretSize + bytesPerSecretWord_) % (bytesPerSecretWord_ * k_)) == 0)
+        {
+            alignedSecretSize = secretSize;
+        }
+        else
+        {
+            alignedSecretSize = (bytesPerSecretWord_ * k_) *
+                                    (((secretSize + bytesPerSecretWord_) / (bytesPerSecretWord_ * k_)) + 1) -
+                                bytesPerSecretWord_;
+        }
+        if (alignedSecretBufferSize_ < alignedSecretSize)
+        {
+            fprintf(stderr, "Error: please use an internal alignedSecretBuffer_[] of size >= %d bytes!\n", alignedSecretSize);
+
+            return 0;
+        }
+
+        /*deduce the share size, the package fills the first k shares*/
+        shareSizes[b] = bytesPerSecretWord_ * (((alignedSecretSize / bytesPerSecretWord_) + 1) / k_);
+
+        /*copy the secret to alignedSecretBuffer_*/
+        memcpy(alignedSecretBuffer_, secretBuffers[b], secretSize);
+        if (alignedSecretSize != secretSize)
+        {
+            memset(alignedSecretBuffer_ + secretSize, 0, alignedSecretSize - secretSize);
+        }
+
+        /*generate a hash key from the aligned secret*/
+        if (!keyHashing(alignedSecretBuffer_, alignedSecretSize, key_))
+        {
+            fprintf(stderr, "Error: fail in the hash calculation!\n");
+
+            return 0;
+        }
+
+        /*the main part of the package is the aligned secret masked with the key*/
+        if (!caontMasking(alignedSecretBuffer_, alignedSecretSize, package))
+        {
+            fprintf(stderr, "Error: fail in the data encryption!\n");
+
+            return 0;
+        }
+
+        /*the tail part of the package is the hash of the main part XORed with the key*/
+        if (!keyHashing(package, alignedSecretSize, package + alignedSecretSize))
+        {
+            fprintf(stderr, "Error: fail in the hash calculation!\n");
+
+            return 0;
+        }
+        gfObj_.multiply_region.w32(&gfObj_, key_, package + alignedSecretSize, 1, bytesPerSecretWord_, 1);
+    }
+
+    /*Step 2: generate the last m shares of the whole batch*/
+    parityBatch(num, shareBuffers, shareSizes);
+
+    return 1;
+}
+
 /*
  * decode the secret from k = n - m shares using CAONT-RS
  *
- * @param shareBuffer - a buffer that stores the k shares
+ * @param shares - the k shares
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share
  * @param secretSize - the size of the secret
@@ -1346,7 +1520,7 @@ bool CDCodec::caontRSEncoding(unsigned char *secretBuffer, int secretSize,
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::caontRSDecoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize,
+bool CDCodec::caontRSDecoding(unsigned char **shares, int *kShareIDList, int shareSize,
                               int secretSize, unsigned char *secretBuffer)
 {
     int alignedSecretSize;
@@ -1406,19 +1580,19 @@ bool CDCodec::caontRSDecoding(unsigned char *shareBuffer, int *kShareIDList, int
             coef = inverseMatrix_[k_ * i + j];
             if (j == 0)
             {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
+                gfObj_.multiply_region.w32(&gfObj_, shares[j],
                                            erasureCodingData_ + shareSize * i, coef, shareSize, 0);
             }
             else
             {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
+                gfObj_.multiply_region.w32(&gfObj_, shares[j],
                                            erasureCodingData_ + shareSize * i, coef, shareSize, 1);
             }
         }
     }
 
     /*generate a hash from the main part of the CAONT package, and temporarily store it into key_*/
-    if (!cryptoObj_->generateHash_rabin(erasureCodingData_, alignedSecretSize, key_))
+    if (!keyHashing(erasureCodingData_, alignedSecretSize, key_))
     {
         fprintf(stderr, "Error: fail in the hash calculation!\n");
 
@@ -1429,21 +1603,16 @@ bool CDCodec::caontRSDecoding(unsigned char *shareBuffer, int *kShareIDList, int
     coef = 1;
     gfObj_.multiply_region.w32(&gfObj_, erasureCodingData_ + alignedSecretSize, key_, coef, bytesPerSecretWord_, 1);
 
-    /*encrypt alignedSizeConstant_ of size alignedSecretSize with the key, and
-      temporarily store the ciphertext into alignedSecretBuffer_*/
-    if (!cryptoObj_->encryptWithKey(alignedSizeConstant_, alignedSecretSize, key_, alignedSecretBuffer_))
+    /*the aligned secret is obtained by unmasking the main part of the CAONT package stored in erasureCodingData_*/
+    if (!caontMasking(erasureCodingData_, alignedSecretSize, alignedSecretBuffer_))
     {
         fprintf(stderr, "Error: fail in the data encryption!\n");
 
         return 0;
     }
 
-    /*the aligned secret is obtained by XORing the ciphertext with the main part of the CAONT package stored in erasureCodingData_*/
-    coef = 1;
-    gfObj_.multiply_region.w32(&gfObj_, erasureCodingData_, alignedSecretBuffer_, coef, alignedSecretSize, 1);
-
     /*generate a hash from the aligned secret, and temporarily store it in the front end of erasureCodingData_*/
-    if (!cryptoObj_->generateHash_rabin(alignedSecretBuffer_, alignedSecretSize, erasureCodingData_))
+    if (!keyHashing(alignedSecretBuffer_, alignedSecretSize, erasureCodingData_))
     {
         fprintf(stderr, "Error: fail in the hash calculation!\n");
 
@@ -1677,10 +1846,263 @@ bool CDCodec::encoding(unsigned char *secretBuffer, int secretSize, unsigned cha
     return success;
 }
 
+/*
+ * encode a batch of secrets into n shares each, which gives the same shares as encoding() one by one
+ *
+ * @param num - the number of secrets
+ * @param secretBuffers - the secrets
+ * @param secretSizes - the size of each secret
+ * @param shareBuffers - a buffer for storing the n shares of each secret <return>
+ * @param shareSizes - the share size of each secret <return>
+ *
+ * @return - a boolean value that indicates if the encoding succeeds
+ */
+bool CDCodec::encodingBatch(int num, unsigned char **secretBuffers, int *secretSizes,
+                            unsigned char **shareBuffers, int *shareSizes)
+{
+    if (CDType_ == CAONT_RS_TYPE)
+    { /*CDCodec based on CAONT-RS*/
+        return caontRSEncodingBatch(num, secretBuffers, secretSizes, shareBuffers, shareSizes);
+    }
+
+    for (int b = 0; b < num; b++)
+    {
+        if (!encoding(secretBuffers[b], secretSizes[b], shareBuffers[b], &shareSizes[b]))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * generate the last m shares of a batch of secrets from their first k shares, with the selected kernel
+ *
+ * @param num - the number of secrets
+ * @param shareBuffers - the n shares of each secret, whose first k shares are given <return>
+ * @param shareSizes - the share size of each secret
+ *
+ * NOTE: only for the codecs based on systematic RS code (AONT-RS, old CAONT-RS and CAONT-RS)
+ */
+void CDCodec::parityBatch(int num, unsigned char **shareBuffers, int *shareSizes)
+{
+    int coef;
+    int b, i, j, shareSize;
+
+    if (gfKernelMode_ == GF_KERNEL_AVX2)
+    {
+        parityBatchAVX2(num, shareBuffers, shareSizes);
+        return;
+    }
+    if (gfKernelMode_ == GF_KERNEL_SSSE3)
+    {
+        parityBatchSSSE3(num, shareBuffers, shareSizes);
+        return;
+    }
+
+    for (b = 0; b < num; b++)
+    {
+        shareSize = shareSizes[b];
+        for (i = 0; i < m_; i++)
+        {
+            for (j = 0; j < k_; j++)
+            {
+                coef = distributionMatrix_[k_ * (k_ + i) + j];
+                gfObj_.multiply_region.w32(&gfObj_, shareBuffers[b] + shareSize * j,
+                                           shareBuffers[b] + shareSize * (k_ + i), coef, shareSize, (j == 0) ? 0 : 1);
+            }
+        }
+    }
+}
+
+/*
+ * generate the parity bytes of a share from the bytes at the same offsets of the k data shares
+ *
+ * @param row - the parity share
+ * @param dataShares - the first k shares
+ * @param shareSize - the size of each share
+ * @param from - the first offset
+ */
+void CDCodec::parityTail(int row, unsigned char *dataShares, int shareSize, int from)
+{
+    unsigned char *tables = parityTables_ + 32 * k_ * row;
+    unsigned char *parity = dataShares + shareSize * (k_ + row);
+    unsigned char x, p;
+    int offset, j;
+
+    for (offset = from; offset < shareSize; offset++)
+    {
+        p = 0;
+        for (j = 0; j < k_; j++)
+        {
+            x = dataShares[shareSize * j + offset];
+            p ^= tables[32 * j + (x & 0x0f)] ^ tables[32 * j + 16 + (x >> 4)];
+        }
+        parity[offset] = p;
+    }
+}
+
+/*
+ * generate the parity shares of a batch of secrets in SSSE3 lanes: a GF(2^8) product c * x is
+ * the XOR of two 16-entry table lookups by the low and the high nibbles of x, i.e. two PSHUFB,
+ * and the tables of a row are loaded once for the whole batch
+ *
+ * @param num - the number of secrets
+ * @param shareBuffers - the n shares of each secret, whose first k shares are given <return>
+ * @param shareSizes - the share size of each secret
+ */
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("ssse3")))
+void CDCodec::parityBatchSSSE3(int num, unsigned char **shareBuffers, int *shareSizes)
+{
+    const __m128i vNibbleMask = _mm_set1_epi8(0x0f);
+    __m128i vLow[GF_KERNEL_MAX_K], vHigh[GF_KERNEL_MAX_K];
+    __m128i vData, vParity;
+    unsigned char *tables, *data, *parity;
+    int row, b, j, offset, shareSize;
+
+    for (row = 0; row < m_; row++)
+    {
+        tables = parityTables_ + 32 * k_ * row;
+        for (j = 0; j < k_; j++)
+        {
+            vLow[j] = _mm_loadu_si128((__m128i *)(tables + 32 * j));
+            vHigh[j] = _mm_loadu_si128((__m128i *)(tables + 32 * j + 16));
+        }
+
+        for (b = 0; b < num; b++)
+        {
+            shareSize = shareSizes[b];
+            data = shareBuffers[b];
+            parity = data + shareSize * (k_ + row);
+            for (offset = 0; offset + 16 <= shareSize; offset += 16)
+            {
+                vParity = _mm_setzero_si128();
+                for (j = 0; j < k_; j++)
+                {
+                    vData = _mm_loadu_si128((__m128i *)(data + shareSize * j + offset));
+                    vParity = _mm_xor_si128(vParity, _mm_shuffle_epi8(vLow[j], _mm_and_si128(vData, vNibbleMask)));
+                    vParity = _mm_xor_si128(vParity, _mm_shuffle_epi8(vHigh[j], _mm_and_si128(_mm_srli_epi64(vData, 4), vNibbleMask)));
+                }
+                _mm_storeu_si128((__m128i *)(parity + offset), vParity);
+            }
+            parityTail(row, data, shareSize, offset);
+        }
+    }
+}
+
+/*
+ * the same as parityBatchSSSE3, in AVX2 lanes with 64 bytes of each share per iteration
+ */
+__attribute__((target("avx2")))
+void CDCodec::parityBatchAVX2(int num, unsigned char **shareBuffers, int *shareSizes)
+{
+    const __m256i vNibbleMask = _mm256_set1_epi8(0x0f);
+    __m256i vLow[GF_KERNEL_MAX_K], vHigh[GF_KERNEL_MAX_K];
+    __m256i vData0, vData1, vParity0, vParity1;
+    unsigned char *tables, *data, *src, *parity;
+    int row, b, j, offset, shareSize;
+
+    for (row = 0; row < m_; row++)
+    {
+        tables = parityTables_ + 32 * k_ * row;
+        for (j = 0; j < k_; j++)
+        {
+            vLow[j] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)(tables + 32 * j)));
+            vHigh[j] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)(tables + 32 * j + 16)));
+        }
+
+        for (b = 0; b < num; b++)
+        {
+            shareSize = shareSizes[b];
+            data = shareBuffers[b];
+            parity = data + shareSize * (k_ + row);
+            offset = 0;
+            for (; offset + 64 <= shareSize; offset += 64)
+            {
+                vParity0 = _mm256_setzero_si256();
+                vParity1 = _mm256_setzero_si256();
+                for (j = 0; j < k_; j++)
+                {
+                    src = data + shareSize * j + offset;
+                    vData0 = _mm256_loadu_si256((__m256i *)src);
+                    vData1 = _mm256_loadu_si256((__m256i *)(src + 32));
+                    vParity0 = _mm256_xor_si256(vParity0, _mm256_shuffle_epi8(vLow[j], _mm256_and_si256(vData0, vNibbleMask)));
+                    vParity1 = _mm256_xor_si256(vParity1, _mm256_shuffle_epi8(vLow[j], _mm256_and_si256(vData1, vNibbleMask)));
+                    vParity0 = _mm256_xor_si256(vParity0, _mm256_shuffle_epi8(vHigh[j], _mm256_and_si256(_mm256_srli_epi64(vData0, 4), vNibbleMask)));
+                    vParity1 = _mm256_xor_si256(vParity1, _mm256_shuffle_epi8(vHigh[j], _mm256_and_si256(_mm256_srli_epi64(vData1, 4), vNibbleMask)));
+                }
+                _mm256_storeu_si256((__m256i *)(parity + offset), vParity0);
+                _mm256_storeu_si256((__m256i *)(parity + offset + 32), vParity1);
+            }
+            for (; offset + 32 <= shareSize; offset += 32)
+            {
+                vParity0 = _mm256_setzero_si256();
+                for (j = 0; j < k_; j++)
+                {
+                    vData0 = _mm256_loadu_si256((__m256i *)(data + shareSize * j + offset));
+                    vParity0 = _mm256_xor_si256(vParity0, _mm256_shuffle_epi8(vLow[j], _mm256_and_si256(vData0, vNibbleMask)));
+                    vParity0 = _mm256_xor_si256(vParity0, _mm256_shuffle_epi8(vHigh[j], _mm256_and_si256(_mm256_srli_epi64(vData0, 4), vNibbleMask)));
+                }
+                _mm256_storeu_si256((__m256i *)(parity + offset), vParity0);
+            }
+            parityTail(row, data, shareSize, offset);
+        }
+    }
+}
+#else
+void CDCodec::parityBatchSSSE3(int num, unsigned char **shareBuffers, int *shareSizes)
+{
+}
+
+void CDCodec::parityBatchAVX2(int num, unsigned char **shareBuffers, int *shareSizes)
+{
+}
+#endif
+
+/*
+ * select the kernel generating the parity shares
+ *
+ * @param gfKernelMode - GF_KERNEL_GFCOMPLETE, GF_KERNEL_SSSE3 or GF_KERNEL_AVX2
+ * @return whether the kernel is supported by the CPU and the code parameters
+ *
+ * NOTE: every kernel gives the same shares, the fastest supported one is selected by default
+ */
+bool CDCodec::setGFKernelMode(int gfKernelMode)
+{
+    if (gfKernelMode == GF_KERNEL_SSSE3 || gfKernelMode == GF_KERNEL_AVX2)
+    {
+        /*the SIMD kernels need the lookup tables, which are made with the distribution matrix*/
+        if (parityTables_ == NULL || k_ > GF_KERNEL_MAX_K)
+        {
+            return false;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        if (gfKernelMode == GF_KERNEL_AVX2 && !__builtin_cpu_supports("avx2"))
+        {
+            return false;
+        }
+        if (gfKernelMode == GF_KERNEL_SSSE3 && !__builtin_cpu_supports("ssse3"))
+        {
+            return false;
+        }
+#else
+        return false;
+#endif
+    }
+    else if (gfKernelMode != GF_KERNEL_GFCOMPLETE)
+    {
+        return false;
+    }
+    gfKernelMode_ = gfKernelMode;
+    return true;
+}
+
 /*
  * decode the secret from k = n - m shares
  *
- * @param shareBuffer - a buffer that stores the k shares
+ * @param shares - the k shares, which may be anywhere in memory
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share
  * @param secretSize - the size of the secret
@@ -1688,34 +2110,59 @@ bool CDCodec::encoding(unsigned char *secretBuffer, int secretSize, unsigned cha
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::decoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize,
+bool CDCodec::decoding(unsigned char **shares, int *kShareIDList, int shareSize,
                        int secretSize, unsigned char *secretBuffer)
 {
     bool success = 0;
 
     if (CDType_ == CRSSS_TYPE)
     { /*CDCodec based on CRSSS*/
-        success = crsssDecoding(shareBuffer, kShareIDList, shareSize, secretSize, secretBuffer);
+        success = crsssDecoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
     }
 
     if (CDType_ == AONT_RS_TYPE)
     { /*CDCodec based on AONT-RS*/
-        success = aontRSDecoding(shareBuffer, kShareIDList, shareSize, secretSize, secretBuffer);
+        success = aontRSDecoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
     }
 
     if (CDType_ == OLD_CAONT_RS_TYPE)
     { /*CDCodec based on old CAONT-RS*/
-        success = caontRSOldDecoding(shareBuffer, kShareIDList, shareSize, secretSize, secretBuffer);
+        success = caontRSOldDecoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
     }
 
     if (CDType_ == CAONT_RS_TYPE)
     { /*CDCodec based on CAONT-RS*/
-        success = caontRSDecoding(shareBuffer, kShareIDList, shareSize, secretSize, secretBuffer);
+        success = caontRSDecoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
     }
 
     return success;
 }
 
+/*
+ * decode the secret from k = n - m shares
+ *
+ * @param shareBuffer - a buffer that stores the k shares
+ * @param kShareIDList - a list that stores the IDs of the k shares
+ * @param shareSize - the size of each share
+ * @param secretSize - the size of the secret
+ * @param secretBuffer - a buffer for storing the secret <return>
+ *
+ * @return - a boolean value that indicates if the decoding succeeds
+ */
+bool CDCodec::decoding(unsigned char *shareBuffer, int *kShareIDList, int shareSize,
+                       int secretSize, unsigned char *secretBuffer)
+{
+    unsigned char *shares[k_];
+    int i;
+
+    for (i = 0; i < k_; i++)
+    {
+        shares[i] = shareBuffer + shareSize * i;
+    }
+
+    return decoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
+}
+
 bool CDCodec::encodingFileName(unsigned char *secretBuffer, int secretSize, unsigned char *shareBuffer, int *shareSize)
 {
     bool success = 0;
@@ -3,10 +3,452 @@
  */
 
 #include "CryptoPrimitive.hh"
-#include "rabin.cpp"
+
+#include <xxhash.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
+/*the window size, base and modulus of the rabin fingerprint in generateHash_rabin()*/
+/*the base and modulus were employed in open-vcdiff: "http://code.google.com/p/open-vcdiff/"*/
+#define RABIN_WINDOW_SIZE 48
+#define RABIN_POLY_BASE 257
+#define RABIN_POLY_MOD (1 << 23)
+
+/*the number of stripes of a buffer whose windows are rolled in AVX2 lanes*/
+#define RABIN_STRIPES 8
+
+/*the size of a SHA-256 block, and the number of messages hashed at a time in AVX2 lanes*/
+#define SHA256_BLOCK_SIZE 64
+#define SHA256_LANES 8
+
+/*the max number of messages prepared at a time for the SHA-256 kernels*/
+#define SHA256_BATCH_SIZE (4 * SHA256_LANES)
+
+/*the lookup tables for the rolling hash of the rabin fingerprint*/
+typedef struct {
+	/*power[i] = power(RABIN_POLY_BASE, i) mod RABIN_POLY_MOD*/
+	uint32_t power[RABIN_WINDOW_SIZE];
+	/*remove[i] = (- i * power[windowSize-1]) mod RABIN_POLY_MOD*/
+	uint32_t remove[256];
+} rabinLUT_t;
+
+/*
+ * initialize the lookup tables of the rabin fingerprint
+ *
+ * @param lut - the lookup tables <return>
+ * @param windowSize - the window size, no more than RABIN_WINDOW_SIZE
+ */
+static void rabinInitLUT(rabinLUT_t *lut, int windowSize) {
+	int i;
+
+	lut->power[0] = 1;
+	for (i = 1; i < windowSize; i++) {
+		lut->power[i] = (lut->power[i-1] * RABIN_POLY_BASE) & (RABIN_POLY_MOD - 1);
+	}
+	for (i = 0; i < 256; i++) {
+		lut->remove[i] = (i * lut->power[windowSize-1]) & (RABIN_POLY_MOD - 1);
+		if (lut->remove[i] != 0) lut->remove[i] = RABIN_POLY_MOD - lut->remove[i];
+	}
+}
+
+/*
+ * get the lookup tables of the full window, which are built once for all the threads
+ */
+static const rabinLUT_t *rabinDefaultLUT() {
+	static rabinLUT_t lut;
+	/*the initialization of a static local variable is thread-safe*/
+	static bool built = (rabinInitLUT(&lut, RABIN_WINDOW_SIZE), true);
+
+	(void) built;
+	return &lut;
+}
+
+/*
+ * calculate the fingerprint of a window directly
+ *
+ * @param window - the first byte of the window
+ * @param lut - the lookup tables of the window size
+ * @param windowSize - the window size
+ *
+ * @return - the fingerprint of the window
+ */
+static inline uint32_t rabinWindowFp(const unsigned char *window, const rabinLUT_t *lut, int windowSize) {
+	uint32_t winFp = 0;
+
+	for (int i = 0; i < windowSize; i++) {
+		winFp += (window[windowSize-1-i] * lut->power[i]) & (RABIN_POLY_MOD - 1);
+	}
+	return winFp & (RABIN_POLY_MOD - 1);
+}
+
+/*
+ * roll the windows of a buffer in RABIN_STRIPES stripes, one per AVX2 lane, which are independent
+ * since the fingerprint of a window only depends on its bytes
+ *
+ * @param dataBuffer - the buffer, with at least RABIN_STRIPES * RABIN_WINDOW_SIZE windows
+ * @param dataSize - the size of the buffer
+ * @param lut - the lookup tables of the full window
+ * @param winFp - the fingerprint of the last window rolled <return>
+ * @param maxWinFp - the max fingerprint of the windows rolled <return>
+ *
+ * @return - the index of the next byte to roll in, after the stripes
+ */
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static int rabinStripesAVX2(unsigned char *dataBuffer, int dataSize, const rabinLUT_t *lut, uint32_t *winFp, 
+		uint32_t *maxWinFp) {
+	int stripeLen = (dataSize - RABIN_WINDOW_SIZE + 1) / RABIN_STRIPES, s, i;
+	uint32_t stripeFp[RABIN_STRIPES], stripeMax[RABIN_STRIPES];
+
+	for (s = 0; s < RABIN_STRIPES; s++) {
+		stripeFp[s] = rabinWindowFp(dataBuffer + s * stripeLen, lut, RABIN_WINDOW_SIZE);
+	}
+	const __m256i vOffset = _mm256_setr_epi32(0, stripeLen, 2 * stripeLen, 3 * stripeLen, 4 * stripeLen, 
+			5 * stripeLen, 6 * stripeLen, 7 * stripeLen);
+	/*(- x * power[windowSize-1]) mod RABIN_POLY_MOD is the remove table in a multiplication*/
+	const __m256i vRemove = _mm256_set1_epi32(lut->power[RABIN_WINDOW_SIZE-1]);
+	const __m256i vBase = _mm256_set1_epi32(RABIN_POLY_BASE);
+	const __m256i vMod = _mm256_set1_epi32(RABIN_POLY_MOD - 1);
+	const __m256i vByte = _mm256_set1_epi32(255);
+	__m256i vFp = _mm256_loadu_si256((__m256i *) stripeFp), vMax = vFp, vOut, vIn;
+
+	for (i = 1; i < stripeLen; i++) {
+		/*note: the byte rolled in is the high byte of its gather, which keeps the last lane in the buffer*/
+		vOut = _mm256_and_si256(_mm256_i32gather_epi32((const int *) (dataBuffer + i - 1), vOffset, 1), vByte);
+		vIn = _mm256_srli_epi32(_mm256_i32gather_epi32((const int *) (dataBuffer + i + RABIN_WINDOW_SIZE - 4), 
+				vOffset, 1), 24);
+		vFp = _mm256_sub_epi32(vFp, _mm256_mullo_epi32(vOut, vRemove));
+		vFp = _mm256_and_si256(_mm256_add_epi32(_mm256_mullo_epi32(vFp, vBase), vIn), vMod);
+		vMax = _mm256_max_epu32(vMax, vFp);
+	}
+	_mm256_storeu_si256((__m256i *) stripeFp, vFp);
+	_mm256_storeu_si256((__m256i *) stripeMax, vMax);
+
+	/*the windows left after the stripes are rolled on from the last one*/
+	*winFp = stripeFp[RABIN_STRIPES-1];
+	*maxWinFp = stripeMax[0];
+	for (s = 1; s < RABIN_STRIPES; s++) {
+		if (stripeMax[s] > *maxWinFp) *maxWinFp = stripeMax[s];
+	}
+	return RABIN_STRIPES * stripeLen + RABIN_WINDOW_SIZE - 1;
+}
+#endif
+
+/*the SHA-256 round constants*/
+static const uint32_t sha256K[64] __attribute__((aligned(32))) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/*the SHA-256 initial hash value*/
+static const uint32_t sha256H0[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/*a message hashed by the SHA-256 kernels, as its whole blocks followed by the padded tail blocks*/
+typedef struct {
+	const unsigned char *data;
+	size_t numOfBlocks;
+	unsigned char tail[2 * SHA256_BLOCK_SIZE];
+	int numOfTailBlocks;
+} sha256Msg_t;
+
+/*
+ * split a message into its whole blocks and its padded tail blocks
+ *
+ * @param msg - the message <return>
+ * @param dataBuffer - the buffer that stores the data
+ * @param dataSize - the size of the data
+ */
+static void sha256Prepare(sha256Msg_t *msg, const unsigned char *dataBuffer, int dataSize) {
+	int remain = dataSize % SHA256_BLOCK_SIZE, i;
+	uint64_t bits = (uint64_t) dataSize * 8;
+
+	msg->data = dataBuffer;
+	msg->numOfBlocks = dataSize / SHA256_BLOCK_SIZE;
+	msg->numOfTailBlocks = (remain + 9 > SHA256_BLOCK_SIZE) ? 2 : 1;
+
+	/*the remaining bytes, a one bit, zeros and the big-endian bit length*/
+	memcpy(msg->tail, dataBuffer + msg->numOfBlocks * SHA256_BLOCK_SIZE, remain);
+	msg->tail[remain] = 0x80;
+	memset(msg->tail + remain + 1, 0, msg->numOfTailBlocks * SHA256_BLOCK_SIZE - remain - 1);
+	for (i = 0; i < 8; i++) {
+		msg->tail[msg->numOfTailBlocks * SHA256_BLOCK_SIZE - 1 - i] = (bits >> (8 * i)) & 255;
+	}
+}
+
+/*
+ * get a block of a message
+ *
+ * @param msg - the message
+ * @param block - the index of the block, whole blocks first
+ *
+ * @return - the block
+ */
+static inline const unsigned char *sha256Block(const sha256Msg_t *msg, size_t block) {
+	if (block < msg->numOfBlocks) return msg->data + block * SHA256_BLOCK_SIZE;
+	return msg->tail + (block - msg->numOfBlocks) * SHA256_BLOCK_SIZE;
+}
+
+/*
+ * write a SHA-256 state as a big-endian hash
+ *
+ * @param state - the state
+ * @param hash - the generated 32-byte hash <return>
+ */
+static void sha256Output(const uint32_t state[8], unsigned char *hash) {
+	for (int i = 0; i < 8; i++) {
+		hash[4*i] = state[i] >> 24;
+		hash[4*i+1] = (state[i] >> 16) & 255;
+		hash[4*i+2] = (state[i] >> 8) & 255;
+		hash[4*i+3] = state[i] & 255;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+ * check if the CPU has the SHA extensions, which not every compiler knows in __builtin_cpu_supports
+ *
+ * @return - a boolean value that indicates if the SHA extensions are supported
+ */
+static bool cpuSupportsShaNI() {
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return 0;
+	return (ebx >> 29) & 1;
+}
+
+/*
+ * compress a block into a SHA-256 state with the SHA extensions, whose state is kept in the
+ * ABEF/CDGH order of the instructions
+ *
+ * @param abef - the A, B, E and F words of the state <return>
+ * @param cdgh - the C, D, G and H words of the state <return>
+ * @param block - the 64-byte block
+ */
+__attribute__((target("sha,sse4.1"), always_inline))
+static inline void sha256BlockShaNI(__m128i *abef, __m128i *cdgh, const unsigned char *block) {
+	const __m128i vSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0 = *abef, state1 = *cdgh, msg, tmp, w[4];
+	int g;
+
+	/*each group of four rounds also schedules the message words of a later group*/
+#pragma GCC unroll 16
+	for (g = 0; g < 16; g++) {
+		if (g < 4) w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (block + 16 * g)), vSwap);
+		msg = _mm_add_epi32(w[g%4], _mm_load_si128((const __m128i *) &sha256K[4*g]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+		if (g >= 3 && g < 15) {
+			tmp = _mm_alignr_epi8(w[g%4], w[(g+3)%4], 4);
+			w[(g+1)%4] = _mm_sha256msg2_epu32(_mm_add_epi32(w[(g+1)%4], tmp), w[g%4]);
+		}
+		msg = _mm_shuffle_epi32(msg, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		if (g >= 1 && g < 13) w[(g-1)%4] = _mm_sha256msg1_epu32(w[(g-1)%4], w[g%4]);
+	}
+
+	*abef = _mm_add_epi32(*abef, state0);
+	*cdgh = _mm_add_epi32(*cdgh, state1);
+}
+
+/*
+ * hash messages with the SHA extensions, two at a time so that their rounds overlap
+ *
+ * @param msgs - the messages
+ * @param num - the number of messages
+ * @param hashes - the generated 32-byte hashes <return>
+ */
+__attribute__((target("sha,sse4.1")))
+static void sha256ShaNI(const sha256Msg_t *msgs, int num, unsigned char **hashes) {
+	__m128i abef[2], cdgh[2], tmp;
+	uint32_t state[8];
+	size_t blocks[2], common, b;
+	int i, j, count;
+
+	for (i = 0; i < num; i += 2) {
+		count = (num - i < 2) ? num - i : 2;
+		for (j = 0; j < count; j++) {
+			tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &sha256H0[0]), 0xb1);
+			cdgh[j] = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &sha256H0[4]), 0x1b);
+			abef[j] = _mm_alignr_epi8(tmp, cdgh[j], 8);
+			cdgh[j] = _mm_blend_epi16(cdgh[j], tmp, 0xf0);
+			blocks[j] = msgs[i+j].numOfBlocks + msgs[i+j].numOfTailBlocks;
+		}
+
+		/*the blocks both messages have are interleaved, and the rest are compressed one by one*/
+		common = (count == 2 && blocks[1] < blocks[0]) ? blocks[1] : blocks[0];
+		if (count == 1) common = 0;
+		for (b = 0; b < common; b++) {
+			sha256BlockShaNI(&abef[0], &cdgh[0], sha256Block(&msgs[i], b));
+			sha256BlockShaNI(&abef[1], &cdgh[1], sha256Block(&msgs[i+1], b));
+		}
+		for (j = 0; j < count; j++) {
+			for (b = common; b < blocks[j]; b++) {
+				sha256BlockShaNI(&abef[j], &cdgh[j], sha256Block(&msgs[i+j], b));
+			}
+			tmp = _mm_shuffle_epi32(abef[j], 0x1b);
+			cdgh[j] = _mm_shuffle_epi32(cdgh[j], 0xb1);
+			_mm_storeu_si128((__m128i *) &state[0], _mm_blend_epi16(tmp, cdgh[j], 0xf0));
+			_mm_storeu_si128((__m128i *) &state[4], _mm_alignr_epi8(cdgh[j], tmp, 8));
+			sha256Output(state, hashes[i+j]);
+		}
+	}
+}
+
+/*the SHA-256 functions on eight lanes of 32-bit words*/
+#define SHA256_ROTR8(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define SHA256_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+
+/*
+ * compress a block of each of eight messages into their SHA-256 states, one message per AVX2 lane
+ *
+ * @param state - the eight words of the states, each with a lane per message <return>
+ * @param blocks - the 64-byte block of each message
+ */
+__attribute__((target("avx2")))
+static void sha256Block8AVX2(__m256i state[8], const unsigned char *blocks[SHA256_LANES]) {
+	const __m256i vSwap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 
+			12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	__m256i w[64], r[8], t[8], u[8], s0, s1, t1, t2;
+	__m256i a = state[0], b = state[1], c = state[2], d = state[3];
+	__m256i e = state[4], f = state[5], g = state[6], h = state[7];
+	int i, half;
+
+	/*transpose the message words so that w[i] holds the i-th word of every message*/
+	for (half = 0; half < 2; half++) {
+		for (i = 0; i < SHA256_LANES; i++) {
+			r[i] = _mm256_loadu_si256((const __m256i *) (blocks[i] + 32 * half));
+		}
+		for (i = 0; i < SHA256_LANES; i += 2) {
+			t[i] = _mm256_unpacklo_epi32(r[i], r[i+1]);
+			t[i+1] = _mm256_unpackhi_epi32(r[i], r[i+1]);
+		}
+		for (i = 0; i < SHA256_LANES; i += 4) {
+			u[i] = _mm256_unpacklo_epi64(t[i], t[i+2]);
+			u[i+1] = _mm256_unpackhi_epi64(t[i], t[i+2]);
+			u[i+2] = _mm256_unpacklo_epi64(t[i+1], t[i+3]);
+			u[i+3] = _mm256_unpackhi_epi64(t[i+1], t[i+3]);
+		}
+		for (i = 0; i < 4; i++) {
+			w[8*half+i] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i+4], 0x20), vSwap);
+			w[8*half+i+4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i+4], 0x31), vSwap);
+		}
+	}
+	for (i = 16; i < 64; i++) {
+		s0 = SHA256_XOR3(SHA256_ROTR8(w[i-15], 7), SHA256_ROTR8(w[i-15], 18), _mm256_srli_epi32(w[i-15], 3));
+		s1 = SHA256_XOR3(SHA256_ROTR8(w[i-2], 17), SHA256_ROTR8(w[i-2], 19), _mm256_srli_epi32(w[i-2], 10));
+		w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i-16], s0), _mm256_add_epi32(w[i-7], s1));
+	}
+
+	for (i = 0; i < 64; i++) {
+		s1 = SHA256_XOR3(SHA256_ROTR8(e, 6), SHA256_ROTR8(e, 11), SHA256_ROTR8(e, 25));
+		t1 = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+		t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(t1, 
+				_mm256_add_epi32(w[i], _mm256_set1_epi32(sha256K[i]))));
+		s0 = SHA256_XOR3(SHA256_ROTR8(a, 2), SHA256_ROTR8(a, 13), SHA256_ROTR8(a, 22));
+		t2 = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+		t2 = _mm256_add_epi32(s0, t2);
+		h = g;
+		g = f;
+		f = e;
+		e = _mm256_add_epi32(d, t1);
+		d = c;
+		c = b;
+		b = a;
+		a = _mm256_add_epi32(t1, t2);
+	}
+
+	state[0] = _mm256_add_epi32(state[0], a);
+	state[1] = _mm256_add_epi32(state[1], b);
+	state[2] = _mm256_add_epi32(state[2], c);
+	state[3] = _mm256_add_epi32(state[3], d);
+	state[4] = _mm256_add_epi32(state[4], e);
+	state[5] = _mm256_add_epi32(state[5], f);
+	state[6] = _mm256_add_epi32(state[6], g);
+	state[7] = _mm256_add_epi32(state[7], h);
+}
+
+/*
+ * hash messages eight at a time in AVX2 lanes, where a lane takes the next message as soon as its
+ * message is done, and the lanes without a message compress a dummy block
+ *
+ * @param msgs - the messages
+ * @param num - the number of messages
+ * @param hashes - the generated 32-byte hashes <return>
+ */
+__attribute__((target("avx2")))
+static void sha256AVX2(const sha256Msg_t *msgs, int num, unsigned char **hashes) {
+	static const unsigned char dummy[SHA256_BLOCK_SIZE] = {0};
+	uint32_t words[8][SHA256_LANES] __attribute__((aligned(32)));
+	uint32_t state[8];
+	const unsigned char *blocks[SHA256_LANES];
+	__m256i vState[8];
+	int lane[SHA256_LANES], next = 0, active = 0, i, j;
+	size_t done[SHA256_LANES], total[SHA256_LANES], steps, s;
+
+	for (j = 0; j < SHA256_LANES; j++) {
+		lane[j] = -1;
+	}
+	while (true) {
+		/*give a new message to each free lane*/
+		for (j = 0; j < SHA256_LANES; j++) {
+			if (lane[j] < 0 && next < num) {
+				lane[j] = next++;
+				done[j] = 0;
+				total[j] = msgs[lane[j]].numOfBlocks + msgs[lane[j]].numOfTailBlocks;
+				for (i = 0; i < 8; i++) {
+					words[i][j] = sha256H0[i];
+				}
+				active++;
+			}
+		}
+		if (active == 0) break;
+
+		/*run until the first lane is done*/
+		steps = 0;
+		for (j = 0; j < SHA256_LANES; j++) {
+			if (lane[j] >= 0 && (steps == 0 || total[j] - done[j] < steps)) steps = total[j] - done[j];
+		}
+		for (i = 0; i < 8; i++) {
+			vState[i] = _mm256_load_si256((const __m256i *) words[i]);
+		}
+		for (s = 0; s < steps; s++) {
+			for (j = 0; j < SHA256_LANES; j++) {
+				blocks[j] = (lane[j] >= 0) ? sha256Block(&msgs[lane[j]], done[j] + s) : dummy;
+			}
+			sha256Block8AVX2(vState, blocks);
+		}
+		for (i = 0; i < 8; i++) {
+			_mm256_store_si256((__m256i *) words[i], vState[i]);
+		}
+
+		/*output the messages done, which frees their lanes*/
+		for (j = 0; j < SHA256_LANES; j++) {
+			if (lane[j] < 0) continue;
+			done[j] += steps;
+			if (done[j] == total[j]) {
+				for (i = 0; i < 8; i++) {
+					state[i] = words[i][j];
+				}
+				sha256Output(state, hashes[lane[j]]);
+				lane[j] = -1;
+				active--;
+			}
+		}
+	}
+}
+#endif
+
 /*initialize the static variable*/
 opensslLock_t *CryptoPrimitive::opensslLock_ = NULL;
 
@@ -140,6 +582,11 @@ CryptoPrimitive::CryptoPrimitive(int cryptoType){
 		iv_ = (unsigned char *) malloc(sizeof(unsigned char) * blockSize_);
 		memset(iv_, 0, blockSize_); 	
 
+		/*initializes the CTR-mode cipher context ctrctx_ with AES-256, which is re-keyed for each encryption*/
+		EVP_CIPHER_CTX_init(&ctrctx_);
+		ctrCipher_ = EVP_aes_256_ctr();
+		EVP_EncryptInit_ex(&ctrctx_, ctrCipher_, NULL, NULL, NULL);
+
 //		fprintf(stderr, "\nA CryptoPrimitive based on a pair of SHA-256 and AES-256 has been constructed! \n");
 //		fprintf(stderr, "Parameters: \n");
 //		fprintf(stderr, "      hashSize_: %d \n", hashSize_);
@@ -168,6 +615,11 @@ CryptoPrimitive::CryptoPrimitive(int cryptoType){
 		iv_ = (unsigned char *) malloc(sizeof(unsigned char) * blockSize_);
 		memset(iv_, 0, blockSize_); 	
 
+		/*initializes the CTR-mode cipher context ctrctx_ with AES-128, which is re-keyed for each encryption*/
+		EVP_CIPHER_CTX_init(&ctrctx_);
+		ctrCipher_ = EVP_aes_128_ctr();
+		EVP_EncryptInit_ex(&ctrctx_, ctrCipher_, NULL, NULL, NULL);
+
 //		fprintf(stderr, "\nA CryptoPrimitive based on a pair of MD5 and AES-128 has been constructed! \n");
 //		fprintf(stderr, "Parameters: \n");
 //		fprintf(stderr, "      hashSize_: %d \n", hashSize_);
@@ -210,6 +662,10 @@ CryptoPrimitive::CryptoPrimitive(int cryptoType){
 //		fprintf(stderr, "\n");
 	}	
 
+	/*hash batches with the SHA extensions if supported, or with OpenSSL, which outruns the AVX2 kernel*/
+	hashKernelMode_ = SHA256_KERNEL_OPENSSL;
+	setHashKernelMode(SHA256_KERNEL_SHANI);
+
 #else
 	fprintf(stderr, "Error: OpenSSL was not configured with thread support!\n");				
 	exit(1);
@@ -225,6 +681,7 @@ CryptoPrimitive::~CryptoPrimitive(){
 
 		/*clean up the cipher context cipherctx_ and free up the space allocated to it*/
 		EVP_CIPHER_CTX_cleanup(&cipherctx_);
+		EVP_CIPHER_CTX_cleanup(&ctrctx_);
 		free(iv_);	
 	}
 
@@ -290,18 +747,148 @@ bool CryptoPrimitive::generateHash(unsigned char *dataBuffer, const int &dataSiz
 	return 1;
 }
 
+/*
+ * generate the rabin fingerprint for the data stored in a buffer, i.e. the max fingerprint of its 
+ * 48-byte windows, which is replicated to fill 16 bytes
+ *
+ * @param dataBuffer - the buffer that stores the data
+ * @param dataSize - the size of the data
+ * @param hash - the generated 16-byte hash <return>
+ *
+ * @return - a boolean value that indicates if the hash generation succeeds
+ */
 bool CryptoPrimitive::generateHash_rabin(unsigned char *dataBuffer, const int &dataSize, unsigned char *hash) {
-    int rabinFP=rabin(dataBuffer,dataSize);
-    hash[0]=rabinFP&255;
-    hash[1]=(rabinFP>>8)&255;
-    hash[2]=(rabinFP>>16)&255;
-    hash[3]=(rabinFP>>24)&255;
-    for(int i=4;i<16;i++)
-        hash[i]=hash[i%4];
-    return true;
+	const rabinLUT_t *lut = rabinDefaultLUT();
+	rabinLUT_t smallLUT;
+	int windowSize = RABIN_WINDOW_SIZE, i;
+	uint32_t winFp, maxWinFp;
+
+	/*data shorter than a window is a single window, whose tables are built on the fly*/
+	if (dataSize < RABIN_WINDOW_SIZE) {
+		windowSize = dataSize;
+		if (windowSize > 0) {
+			rabinInitLUT(&smallLUT, windowSize);
+			lut = &smallLUT;
+		}
+	}
+
+	winFp = rabinWindowFp(dataBuffer, lut, windowSize);
+	maxWinFp = winFp;
+	i = windowSize;
+#if defined(__x86_64__) || defined(__i386__)
+	static bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2 && windowSize == RABIN_WINDOW_SIZE && dataSize - windowSize + 1 >= RABIN_STRIPES * RABIN_WINDOW_SIZE) {
+		i = rabinStripesAVX2(dataBuffer, dataSize, lut, &winFp, &maxWinFp);
+	}
+#endif
+
+	/*roll the window forward byte by byte, and keep the max fingerprint*/
+	for (; i < dataSize; i++) {
+		winFp = ((winFp + lut->remove[dataBuffer[i-windowSize]]) * RABIN_POLY_BASE + dataBuffer[i]) & (RABIN_POLY_MOD - 1);
+		if (winFp > maxWinFp) maxWinFp = winFp;
+	}
+
+	hash[0] = maxWinFp & 255;
+	hash[1] = (maxWinFp >> 8) & 255;
+	hash[2] = (maxWinFp >> 16) & 255;
+	hash[3] = (maxWinFp >> 24) & 255;
+	for (i = 4; i < 16; i++) {
+		hash[i] = hash[i%4];
+	}
+	return true;
+}
+
+/*
+ * generate the XXH3 hash for the data stored in a buffer, 128 bits at a time up to the hash size
+ *
+ * @param dataBuffer - the buffer that stores the data
+ * @param dataSize - the size of the data
+ * @param hash - the generated hash <return>
+ *
+ * @return - a boolean value that indicates if the hash generation succeeds
+ */
+bool CryptoPrimitive::generateHash_xxh3(unsigned char *dataBuffer, const int &dataSize, unsigned char *hash) {
+	XXH128_canonical_t canonical;
+	int offset;
+
+	/*the i-th 128 bits are hashed with seed i, in the canonical (big-endian) byte order*/
+	for (offset = 0; offset < hashSize_; offset += sizeof(canonical.digest)) {
+		XXH128_canonicalFromHash(&canonical, XXH3_128bits_withSeed(dataBuffer, dataSize, offset / sizeof(canonical.digest)));
+		memcpy(hash + offset, canonical.digest, 
+				(hashSize_ - offset < (int) sizeof(canonical.digest)) ? hashSize_ - offset : sizeof(canonical.digest));
+	}
+
+	return 1;
 }
 
 
+/*
+ * select the kernel generating the SHA-256 hashes of a batch
+ *
+ * @param hashKernelMode - SHA256_KERNEL_OPENSSL, SHA256_KERNEL_SHANI or SHA256_KERNEL_AVX2
+ *
+ * @return - a boolean value that indicates if the kernel is supported by the CPU
+ *
+ * NOTE: every kernel gives the same hashes, SHA-NI is selected by default if supported and OpenSSL otherwise,
+ *       as the AVX2 kernel is slower than OpenSSL on the CPUs measured, and is only selected explicitly
+ */
+bool CryptoPrimitive::setHashKernelMode(int hashKernelMode) {
+	if (hashKernelMode == SHA256_KERNEL_SHANI || hashKernelMode == SHA256_KERNEL_AVX2) {
+#if defined(__x86_64__) || defined(__i386__)
+		if (hashKernelMode == SHA256_KERNEL_SHANI && !(__builtin_cpu_supports("sse4.1") && cpuSupportsShaNI())) return 0;
+		if (hashKernelMode == SHA256_KERNEL_AVX2 && !__builtin_cpu_supports("avx2")) return 0;
+#else
+		return 0;
+#endif
+	} else if (hashKernelMode != SHA256_KERNEL_OPENSSL) {
+		return 0;
+	}
+
+	hashKernelMode_ = hashKernelMode;
+	return 1;
+}
+
+/*
+ * generate the hashes for a batch of data buffers, with the selected kernel for SHA-256 and one by 
+ * one otherwise
+ *
+ * @param num - the number of buffers
+ * @param dataBuffers - the buffers that store the data
+ * @param dataSizes - the sizes of the data
+ * @param hashes - the generated hashes <return>
+ *
+ * @return - a boolean value that indicates if the hash generation succeeds
+ */
+bool CryptoPrimitive::generateHashBatch(int num, unsigned char **dataBuffers, const int *dataSizes, 
+		unsigned char **hashes) {
+	int i;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if ((cryptoType_ == HIGH_SEC_PAIR_TYPE || cryptoType_ == SHA256_TYPE) && hashKernelMode_ != SHA256_KERNEL_OPENSSL) {
+		sha256Msg_t msgs[SHA256_BATCH_SIZE];
+		int count, j;
+
+		for (i = 0; i < num; i += count) {
+			count = (num - i < SHA256_BATCH_SIZE) ? num - i : SHA256_BATCH_SIZE;
+			for (j = 0; j < count; j++) {
+				sha256Prepare(&msgs[j], dataBuffers[i+j], dataSizes[i+j]);
+			}
+			if (hashKernelMode_ == SHA256_KERNEL_SHANI) {
+				sha256ShaNI(msgs, count, hashes + i);
+			} else {
+				sha256AVX2(msgs, count, hashes + i);
+			}
+		}
+		return 1;
+	}
+#endif
+
+	for (i = 0; i < num; i++) {
+		if (!generateHash(dataBuffers[i], dataSizes[i], hashes[i])) return 0;
+	}
+	return 1;
+}
+
 /*
  * encrypt the data stored in a buffer with a key
  *
@@ -339,3 +926,32 @@ bool CryptoPrimitive::encryptWithKey(unsigned char *dataBuffer, const int &dataS
 
 	return 1;
 }
+
+/*
+ * encrypt the data stored in a buffer with a key in CTR mode from a zero counter block, i.e. XOR 
+ * the data with the keystream of the key, which also decrypts the ciphertext
+ *
+ * @param dataBuffer - the buffer that stores the data
+ * @param dataSize - the size of the data
+ * @param key - the key used to encrypt the data
+ * @param ciphertext - the generated ciphertext, which may be dataBuffer itself <return>
+ *
+ * @return - a boolean value that indicates if the encryption succeeds
+ */
+bool CryptoPrimitive::encryptWithKeyCTR(unsigned char *dataBuffer, const int &dataSize, unsigned char *key, 
+		unsigned char *ciphertext) {
+	int ciphertextSize;	
+
+	/*only set the key and reset the counter, the cipher of the context is kept*/
+	EVP_EncryptInit_ex(&ctrctx_, NULL, NULL, key, iv_);
+	EVP_EncryptUpdate(&ctrctx_, ciphertext, &ciphertextSize, dataBuffer, dataSize);
+
+	if (ciphertextSize != dataSize) {
+		fprintf(stderr, "Error: the size of the cipher output (%d bytes) does not match with that of the input (%d bytes)!\n", 
+				ciphertextSize, dataSize);
+
+		return 0;
+	}	
+
+	return 1;
+}
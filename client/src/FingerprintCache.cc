@@ -0,0 +1,156 @@
+/*
+ * FingerprintCache.cc
+ */
+
+#include "FingerprintCache.hh"
+
+using namespace std;
+
+static const char cacheMagic[8] = {'F', 'P', 'C', 'A', 'C', 'H', 'E', '1'};
+
+static const unsigned char emptySlot[FP_CACHE_KEY_SIZE] = {0};
+
+/*
+ * constructor, which maps the cache file and creates it if it does not exist,
+ * and the cache is left disabled if the file cannot be mapped or is used by another client
+ *
+ * @param path - path of the cache file
+ * @param budget - the largest size of the cache file
+ */
+FingerprintCache::FingerprintCache(const char* path, long budget){
+    fd_ = -1;
+    mapSize_ = 0;
+    head_ = NULL;
+    slots_ = NULL;
+    mask_ = 0;
+
+    /* the largest power of two of slots within the budget */
+    uint64_t numOfSlots = FP_CACHE_MIN_SLOTS;
+    while(sizeof(cacheHead_t) + numOfSlots * 2 * FP_CACHE_KEY_SIZE <= (uint64_t)budget){
+        numOfSlots *= 2;
+    }
+    size_t size = sizeof(cacheHead_t) + numOfSlots * FP_CACHE_KEY_SIZE;
+
+    fd_ = open(path, O_RDWR | O_CREAT, 0600);
+    if(fd_ == -1){
+        fprintf(stderr, "fail to open fingerprint cache %s %d\n", path, errno);
+        return;
+    }
+
+    /* another client of the same user uploading to the same server holds the lock */
+    if(flock(fd_, LOCK_EX | LOCK_NB) == -1){
+        fprintf(stderr, "fingerprint cache %s is in use, uploading without it\n", path);
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+
+    /* a file of another format or budget is started over */
+    struct stat st;
+    bool fresh = (fstat(fd_, &st) == -1 || (size_t)st.st_size != size);
+    if(fresh && (ftruncate(fd_, 0) == -1 || ftruncate(fd_, size) == -1)){
+        fprintf(stderr, "fail to resize fingerprint cache %s %d\n", path, errno);
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(map == MAP_FAILED){
+        fprintf(stderr, "fail to map fingerprint cache %s %d\n", path, errno);
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    mapSize_ = size;
+    head_ = (cacheHead_t*)map;
+    slots_ = (unsigned char*)map + sizeof(cacheHead_t);
+    mask_ = numOfSlots - 1;
+
+    if(fresh || memcmp(head_->magic, cacheMagic, sizeof(cacheMagic)) != 0 || head_->numOfSlots != numOfSlots){
+        memcpy(head_->magic, cacheMagic, sizeof(cacheMagic));
+        head_->numOfSlots = numOfSlots;
+        clear();
+    }
+}
+
+/*
+ * destructor
+ */
+FingerprintCache::~FingerprintCache(){
+    if(head_ != NULL){
+        munmap(head_, mapSize_);
+    }
+    /* closing the file releases the lock */
+    if(fd_ != -1){
+        close(fd_);
+    }
+}
+
+/*
+ * find the slot of a fingerprint, or the empty slot ending its probe sequence
+ *
+ * @param fp - the fingerprint
+ *
+ * @return the slot
+ */
+unsigned char* FingerprintCache::probe(const unsigned char* fp){
+    /* the fingerprints are uniform, so their leading bytes serve as the hash */
+    uint64_t index;
+    memcpy(&index, fp, sizeof(index));
+    while(true){
+        unsigned char* slot = slots_ + (index & mask_) * FP_CACHE_KEY_SIZE;
+        if(memcmp(slot, fp, FP_CACHE_KEY_SIZE) == 0 || memcmp(slot, emptySlot, FP_CACHE_KEY_SIZE) == 0){
+            return slot;
+        }
+        index++;
+    }
+}
+
+/*
+ * look up a fingerprint
+ *
+ * @param fp - the fingerprint
+ *
+ * @return whether the fingerprint is cached
+ */
+bool FingerprintCache::lookup(const unsigned char* fp){
+    if(head_ == NULL || memcmp(fp, emptySlot, FP_CACHE_KEY_SIZE) == 0){
+        return false;
+    }
+    return memcmp(probe(fp), fp, FP_CACHE_KEY_SIZE) == 0;
+}
+
+/*
+ * insert a fingerprint, and the cache is cleared first if it is full
+ *
+ * @param fp - the fingerprint
+ */
+void FingerprintCache::insert(const unsigned char* fp){
+    if(head_ == NULL || memcmp(fp, emptySlot, FP_CACHE_KEY_SIZE) == 0){
+        return;
+    }
+    unsigned char* slot = probe(fp);
+    if(memcmp(slot, fp, FP_CACHE_KEY_SIZE) == 0){
+        return;
+    }
+
+    /* starting over keeps the probe sequences short, and the recent uploads fill the cache again */
+    if((head_->numOfKeys + 1) * 100 > head_->numOfSlots * FP_CACHE_MAX_LOAD){
+        clear();
+        slot = probe(fp);
+    }
+    memcpy(slot, fp, FP_CACHE_KEY_SIZE);
+    head_->numOfKeys++;
+}
+
+/*
+ * remove all the fingerprints
+ */
+void FingerprintCache::clear(){
+    if(head_ == NULL){
+        return;
+    }
+    memset(slots_, 0, (mask_ + 1) * FP_CACHE_KEY_SIZE);
+    head_->numOfKeys = 0;
+}
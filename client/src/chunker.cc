@@ -2,24 +2,36 @@
  * Chunker.cc
  */
 
+#include <string.h>
+
 #include "chunker.hh"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 /*
  * constructor of Chunker
  *
- * @param chunkerType - chunker type (FIX_SIZE_TYPE or VAR_SIZE_TYPE)
+ * @param chunkerType - chunker type (FIX_SIZE_TYPE, VAR_SIZE_TYPE or FASTCDC_TYPE)
  * @param avgChunkSize - average chunk size
  * @param minChunkSize - minimum chunk size
  * @param maxChunkSize - maximum chunk size
  * @param slidingWinSize - sliding window size
  *
- * NOTE: if chunkerType = FIX_SIZE_TYPE, only input avgChunkSize
+ * NOTE: if chunkerType = FIX_SIZE_TYPE, only input avgChunkSize;
+ *       if chunkerType = FASTCDC_TYPE, slidingWinSize is unused (the gear hash window is 64 bytes)
  */
-Chunker::Chunker(bool chunkerType, int avgChunkSize, int minChunkSize, int maxChunkSize, int slidingWinSize){
+Chunker::Chunker(int chunkerType, int avgChunkSize, int minChunkSize, int maxChunkSize, int slidingWinSize){
     chunkerType_ = chunkerType;
 
+    if (chunkerType_ != FIX_SIZE_TYPE && chunkerType_ != VAR_SIZE_TYPE && chunkerType_ != FASTCDC_TYPE) {
+        fprintf(stderr, "Error: unknown chunker type %d!\n", chunkerType_);
+        exit(1);
+    }
+
     if (chunkerType_ == FIX_SIZE_TYPE) { /*fixed-size chunker*/
         avgChunkSize_ = avgChunkSize;
 
@@ -91,12 +103,71 @@ Chunker::Chunker(bool chunkerType, int avgChunkSize, int minChunkSize, int maxCh
         fprintf(stderr, "      anchorValue_: 0x%x \n", anchorValue_);	
         fprintf(stderr, "\n");
     }	
+
+    if (chunkerType_ == FASTCDC_TYPE) { /*FastCDC chunker*/
+        int numOfMaskBits, i;
+        uint64_t seed;
+
+        if (minChunkSize >= avgChunkSize)  {
+            fprintf(stderr, "Error: minChunkSize should be smaller than avgChunkSize!\n");	
+            exit(1);
+        }
+        if (maxChunkSize <= avgChunkSize)  {
+            fprintf(stderr, "Error: maxChunkSize should be larger than avgChunkSize!\n");
+            exit(1);
+        }
+        avgChunkSize_ = avgChunkSize;
+        minChunkSize_ = minChunkSize;	
+        maxChunkSize_ = maxChunkSize;
+
+        /*initialize the gear table with splitmix64 from a fixed seed*/
+        /*note: the table must be identical on every client, or the chunk boundaries (and deduplication) break*/
+        gearLUT_ = (uint64_t *) malloc(sizeof(uint64_t) * 256); /*256 for unsigned char*/
+        seed = 0x6765617268617368ULL;
+        for (i = 0; i < 256; i++) {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            gearLUT_[i] = z ^ (z >> 31);
+        }
+
+        /*initialize the masks for normalized chunking (normalization level 2)*/
+        /*note: power(2, numOfMaskBits) = avgChunkSize_; the masks take the highest bits of the gear hash,*/
+        /*      since the low bits only depend on the last few bytes                                      */
+        numOfMaskBits = 1;		
+        while ((avgChunkSize_ >> numOfMaskBits) != 1) numOfMaskBits++;
+        gearMaskS_ = ((1ULL << (numOfMaskBits + 2)) - 1) << (64 - (numOfMaskBits + 2));
+        gearMaskL_ = ((1ULL << (numOfMaskBits - 2)) - 1) << (64 - (numOfMaskBits - 2));
+
+        /*select the fastest supported method for scanning the gear hash*/
+        if (!setGearScanMode(GEAR_SCAN_AVX2)) setGearScanMode(GEAR_SCAN_STRIPED);
+
+        fprintf(stderr, "\nA FastCDC chunker has been constructed! \n");
+        fprintf(stderr, "Parameters: \n");	
+        fprintf(stderr, "      avgChunkSize_: %d \n", avgChunkSize_);		
+        fprintf(stderr, "      minChunkSize_: %d \n", minChunkSize_);	
+        fprintf(stderr, "      maxChunkSize_: %d \n", maxChunkSize_);
+        fprintf(stderr, "      gearMaskS_: 0x%016llx \n", (unsigned long long) gearMaskS_);
+        fprintf(stderr, "      gearMaskL_: 0x%016llx \n", (unsigned long long) gearMaskL_);
+        fprintf(stderr, "      gearScanMode_: %d \n", gearScanMode_);
+        fprintf(stderr, "\n");
+    }
+
+    /*initialize the carry buffers for stream chunking*/
+    carryCapacity_ = (chunkerType_ == FIX_SIZE_TYPE) ? avgChunkSize_ : maxChunkSize_;
+    carryBuffer_[0] = (unsigned char *) malloc(sizeof(unsigned char) * carryCapacity_);
+    carryBuffer_[1] = (unsigned char *) malloc(sizeof(unsigned char) * carryCapacity_);
+    carryIndex_ = 0;
+    carrySize_ = 0;
 }
 
 /*
  * destructor of Chunker
  */
 Chunker::~Chunker(){
+    free(carryBuffer_[0]);
+    free(carryBuffer_[1]);
+
     if (chunkerType_ == VAR_SIZE_TYPE) { /*variable-size chunker*/
         free(powerLUT_);
         free(removeLUT_);
@@ -109,96 +180,317 @@ Chunker::~Chunker(){
         fprintf(stderr, "\nThe variable-size chunker has been destructed! \n");	
         fprintf(stderr, "\n");
     }
+
+    if (chunkerType_ == FASTCDC_TYPE) { /*FastCDC chunker*/
+        free(gearLUT_);
+
+        fprintf(stderr, "\nThe FastCDC chunker has been destructed! \n");	
+        fprintf(stderr, "\n");
+    }
 }
 
 /*
- * divide a buffer into a number of fixed-size chunks
+ * find the end of a fixed-size chunk
  *
- * @param buffer - a buffer to be chunked
- * @param bufferSize - the size of the buffer
- * @param chunkEndIndexList - a list for returning the end index of each chunk <return>
- * @param numOfChunks - the number of chunks <return>
+ * @param chunk - the start of a chunk
+ * @param size - the number of available bytes from the start
+ * @param isEnd - whether the available bytes end the stream
+ * @return the chunk size, or 0 if the chunk does not end in the available bytes
  */
-void Chunker::fixSizeChunking(unsigned char *buffer, int bufferSize, int *chunkEndIndexList, int *numOfChunks){
-    int chunkEndIndex;
+int Chunker::fixSizeCut(unsigned char * /*chunk*/, int size, bool isEnd){
+    if (size >= avgChunkSize_) return avgChunkSize_;
 
-    (*numOfChunks) = 0;
-    chunkEndIndex = -1 + avgChunkSize_;
-
-    /*divide the buffer into chunks*/
-    while (chunkEndIndex < bufferSize) {
-        /*record the end index of a chunk*/
-        chunkEndIndexList[(*numOfChunks)] = chunkEndIndex;
-
-        /*go on for the next chunk*/
-        chunkEndIndex = chunkEndIndexList[(*numOfChunks)] + avgChunkSize_;		
-        (*numOfChunks)++;
-    }	
-
-    /*deal with the tail of the buffer*/
-    if (((*numOfChunks) == 0) || (((*numOfChunks) > 0) && (chunkEndIndexList[(*numOfChunks)-1] != bufferSize -1))) { 
-        /*note: such a tail chunk has a size < avgChunkSize_*/
-        chunkEndIndexList[(*numOfChunks)] = bufferSize -1;		
-        (*numOfChunks)++;
-    }	
+    /*note: such a tail chunk has a size < avgChunkSize_*/
+    return isEnd ? size : 0;
 }
 
 /*
- * divide a buffer into a number of variable-size chunks
+ * find the end of a variable-size chunk
  *
- * @param buffer - a buffer to be chunked
- * @param bufferSize - the size of the buffer
- * @param chunkEndIndexList - a list for returning the end index of each chunk <return>
- * @param numOfChunks - the number of chunks <return>
+ * @param chunk - the start of a chunk
+ * @param size - the number of available bytes from the start
+ * @param isEnd - whether the available bytes end the stream
+ * @return the chunk size, or 0 if the chunk does not end in the available bytes
  */
-void Chunker::varSizeChunking(unsigned char *buffer, int bufferSize, int *chunkEndIndexList, int *numOfChunks){
+int Chunker::varSizeCut(unsigned char *chunk, int size, bool isEnd){
     int chunkEndIndex, chunkEndIndexLimit;
     uint32_t winFp; /*the fingerprint of a window*/
     int i;
 
     /*note: to improve performance, we use the optimization in open-vcdiff: "http://code.google.com/p/open-vcdiff/"*/
 
-    (*numOfChunks) = 0;
     chunkEndIndex = -1 + minChunkSize_;
     chunkEndIndexLimit = -1 + maxChunkSize_;
 
-    /*divide the buffer into chunks*/
-    while (chunkEndIndex < bufferSize) {	
-        if (chunkEndIndexLimit >= bufferSize) chunkEndIndexLimit = bufferSize - 1;		
+    /*note: such a tail chunk has a size < minChunkSize_*/
+    if (chunkEndIndex >= size) return isEnd ? size : 0;
+    if (chunkEndIndexLimit >= size) chunkEndIndexLimit = size - 1;		
+
+    /*calculate the fingerprint of the first window*/
+    winFp = 0;
+    for (i = 0; i < slidingWinSize_; i++) {
+        /*winFp = winFp + ((chunk[chunkEndIndex-i] * powerLUT_[i]) mod polyMOD_)*/
+        winFp = winFp + ((chunk[chunkEndIndex-i] * powerLUT_[i]) & (polyMOD_ - 1));
+    }
+    /*winFp = winFp mod polyMOD_*/
+    winFp = winFp & (polyMOD_ - 1);
+
+    while (((winFp & anchorMask_) != anchorValue_) && (chunkEndIndex < chunkEndIndexLimit)) {
+        /*move the window forward by 1 byte*/
+        chunkEndIndex++;
+
+        /*update the fingerprint based on rolling hash*/
+        /*winFp = ((winFp + removeLUT_[chunk[chunkEndIndex-slidingWinSize_]]) * polyBase_ + chunk[chunkEndIndex]) mod polyMOD_*/
+        winFp = ((winFp + removeLUT_[chunk[chunkEndIndex-slidingWinSize_]]) * polyBase_ + chunk[chunkEndIndex]) & (polyMOD_ - 1); 
+    }
+
+    /*no anchor before the available bytes run out, and the chunk may go on in the coming bytes*/
+    if (((winFp & anchorMask_) != anchorValue_) && (size < maxChunkSize_) && !isEnd) return 0;
+
+    return chunkEndIndex + 1;
+}
+
+/*
+ * find the end of a FastCDC chunk
+ *
+ * @param chunk - the start of a chunk
+ * @param size - the number of available bytes from the start
+ * @param isEnd - whether the available bytes end the stream
+ * @return the chunk size, or 0 if the chunk does not end in the available bytes
+ */
+int Chunker::fastCDCCut(unsigned char *chunk, int size, bool isEnd){
+    int normalSize, limitSize;
+    uint64_t fp; /*the gear hash of the bytes since the cut-point skipping*/
+    int i;
+
+    /*note: the techniques follow FastCDC (USENIX ATC'16):                                             */
+    /*      1) gear hash: one shift, one add and one lookup per byte, without removing the outgoing byte; */
+    /*      2) cut-point skipping: the first minChunkSize_ bytes of a chunk are never hashed;             */
+    /*      3) normalized chunking: a stricter mask before avgChunkSize_ and a looser one after it        */
+
+    /*note: such a tail chunk has a size <= minChunkSize_*/
+    if (size <= minChunkSize_) return isEnd ? size : 0;
+
+    normalSize = (size < avgChunkSize_) ? size : avgChunkSize_;
+    limitSize = (size < maxChunkSize_) ? size : maxChunkSize_;
+
+    if (gearScanMode_ == GEAR_SCAN_SCALAR) {
+        fp = 0;
+        for (i = minChunkSize_; i < normalSize; i++) {
+            fp = (fp << 1) + gearLUT_[chunk[i]];
+            if (!(fp & gearMaskS_)) break;
+        }
+        if (i == normalSize) {
+            for (; i < limitSize; i++) {
+                fp = (fp << 1) + gearLUT_[chunk[i]];
+                if (!(fp & gearMaskL_)) break;
+            }
+        }
+    } else if (gearScanMode_ == GEAR_SCAN_AVX2) {
+        i = gearScanAVX2(chunk, minChunkSize_, minChunkSize_, normalSize, gearMaskS_);
+        if (i == normalSize) {
+            i = gearScanAVX2(chunk, minChunkSize_, normalSize, limitSize, gearMaskL_);
+        }
+    } else {
+        i = gearScanStriped(chunk, minChunkSize_, minChunkSize_, normalSize, gearMaskS_);
+        if (i == normalSize) {
+            i = gearScanStriped(chunk, minChunkSize_, normalSize, limitSize, gearMaskL_);
+        }
+    }
+
+    if (i < limitSize) return i + 1;
+
+    /*no cut point before the available bytes run out, and the chunk may go on in the coming bytes*/
+    if ((size < maxChunkSize_) && !isEnd) return 0;
 
-        /*calculate the fingerprint of the first window*/
-        winFp = 0;
-        for (i = 0; i < slidingWinSize_; i++) {
-            /*winFp = winFp + ((buffer[chunkEndIndex-i] * powerLUT_[i]) mod polyMOD_)*/
-            winFp = winFp + ((buffer[chunkEndIndex-i] * powerLUT_[i]) & (polyMOD_ - 1));
+    return limitSize;
+}
+
+/*
+ * find the end of a chunk with the chunker type
+ *
+ * @param chunk - the start of a chunk
+ * @param size - the number of available bytes from the start
+ * @param isEnd - whether the available bytes end the stream
+ * @return the chunk size, or 0 if the chunk does not end in the available bytes
+ */
+int Chunker::cut(unsigned char *chunk, int size, bool isEnd){
+    if (chunkerType_ == FIX_SIZE_TYPE) { /*fixed-size chunker*/
+        return fixSizeCut(chunk, size, isEnd);
+    }
+
+    if (chunkerType_ == VAR_SIZE_TYPE) { /*variable-size chunker*/
+        return varSizeCut(chunk, size, isEnd);
+    }
+
+    /*FastCDC chunker*/
+    return fastCDCCut(chunk, size, isEnd);
+}
+
+/*
+ * calculate the gear hash at a position
+ *
+ * @param base - the start of a chunk
+ * @param hashStart - the position where the hash starts, whose previous bytes are excluded
+ * @param pos - the position
+ * @return the gear hash of the bytes in [hashStart, pos] (only the last 64 bytes count)
+ */
+uint64_t Chunker::gearHash(unsigned char *base, int hashStart, int pos){
+    uint64_t fp = 0;
+    int i;
+
+    /*note: a byte is shifted out of the 64-bit hash after 64 steps, so earlier bytes never count*/
+    for (i = (pos - 63 > hashStart) ? pos - 63 : hashStart; i <= pos; i++) {
+        fp = (fp << 1) + gearLUT_[base[i]];
+    }
+    return fp;
+}
+
+/*
+ * find the first position whose gear hash matches a mask, scanning GEAR_SCAN_LANES stripes at a time
+ *
+ * @param base - the start of a chunk
+ * @param hashStart - the position where the hash starts, whose previous bytes are excluded
+ * @param from - the first position to check
+ * @param to - the position after the last one to check
+ * @param mask - the mask of the highest bits, matched if (hash & mask) == 0
+ * @return the first matched position in [from, to), or to if none
+ */
+int Chunker::gearScanStriped(unsigned char *base, int hashStart, int from, int to, uint64_t mask){
+    uint64_t fp0, fp1, fp2, fp3, min01, min23;
+    unsigned char *lane0, *lane1, *lane2, *lane3;
+    int stripe, first[GEAR_SCAN_LANES], t, k;
+
+    /*note: the gear hash is a serial dependency chain, so the range is cut into stripes whose hashes  */
+    /*      are independent once warmed up by the previous 63 bytes, and the chains are interleaved    */
+    while (to - from >= GEAR_SCAN_LANES * GEAR_SCAN_MIN_STRIPE) {
+        stripe = (to - from) / GEAR_SCAN_LANES;
+        if (stripe > GEAR_SCAN_STRIPE) stripe = GEAR_SCAN_STRIPE;
+
+        lane0 = base + from;
+        lane1 = lane0 + stripe;
+        lane2 = lane1 + stripe;
+        lane3 = lane2 + stripe;
+        fp0 = gearHash(base, hashStart, from - 1);
+        fp1 = gearHash(base, hashStart, from + stripe - 1);
+        fp2 = gearHash(base, hashStart, from + 2 * stripe - 1);
+        fp3 = gearHash(base, hashStart, from + 3 * stripe - 1);
+        for (k = 0; k < GEAR_SCAN_LANES; k++) first[k] = stripe;
+
+        for (t = 0; t < stripe; t++) {
+            fp0 = (fp0 << 1) + gearLUT_[lane0[t]];
+            fp1 = (fp1 << 1) + gearLUT_[lane1[t]];
+            fp2 = (fp2 << 1) + gearLUT_[lane2[t]];
+            fp3 = (fp3 << 1) + gearLUT_[lane3[t]];
+            /*as the mask takes the highest bits, a hash matches iff hash <= ~mask, which is checked on the min*/
+            min01 = (fp0 < fp1) ? fp0 : fp1;
+            min23 = (fp2 < fp3) ? fp2 : fp3;
+            if (((min01 < min23) ? min01 : min23) <= ~mask) {
+                /*the first stripe holds the earliest positions, so a match there ends the scan*/
+                if (!(fp0 & mask)) return from + t;
+                if (!(fp1 & mask) && first[1] == stripe) first[1] = t;
+                if (!(fp2 & mask) && first[2] == stripe) first[2] = t;
+                if (!(fp3 & mask) && first[3] == stripe) first[3] = t;
+            }
         }
-        /*winFp = winFp mod polyMOD_*/
-        winFp = winFp & (polyMOD_ - 1);
 
-        while (((winFp & anchorMask_) != anchorValue_) && (chunkEndIndex < chunkEndIndexLimit)) {
-            /*move the window forward by 1 byte*/
-            chunkEndIndex++;
+        for (k = 1; k < GEAR_SCAN_LANES; k++) {
+            if (first[k] < stripe) return from + k * stripe + first[k];
+        }
+        from += GEAR_SCAN_LANES * stripe;
+    }
 
-            /*update the fingerprint based on rolling hash*/
-            /*winFp = ((winFp + removeLUT_[buffer[chunkEndIndex-slidingWinSize_]]) * polyBase_ + buffer[chunkEndIndex]) mod polyMOD_*/
-            winFp = ((winFp + removeLUT_[buffer[chunkEndIndex-slidingWinSize_]]) * polyBase_ + buffer[chunkEndIndex]) & (polyMOD_ - 1); 
+    /*scan the tail byte by byte*/
+    fp0 = gearHash(base, hashStart, from - 1);
+    for (; from < to; from++) {
+        fp0 = (fp0 << 1) + gearLUT_[base[from]];
+        if (!(fp0 & mask)) return from;
+    }
+    return to;
+}
+
+/*
+ * the same as gearScanStriped, with the stripes in AVX2 lanes
+ */
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+int Chunker::gearScanAVX2(unsigned char *base, int hashStart, int from, int to, uint64_t mask){
+    const __m256i vMask = _mm256_set1_epi64x((long long) mask);
+    const __m256i vZero = _mm256_setzero_si256();
+    __m256i vFp, vGear;
+    unsigned char *lane0, *lane1, *lane2, *lane3;
+    uint64_t fp;
+    int stripe, first[GEAR_SCAN_LANES], t, k, matched;
+
+    while (to - from >= GEAR_SCAN_LANES * GEAR_SCAN_MIN_STRIPE) {
+        stripe = (to - from) / GEAR_SCAN_LANES;
+        if (stripe > GEAR_SCAN_STRIPE) stripe = GEAR_SCAN_STRIPE;
+
+        lane0 = base + from;
+        lane1 = lane0 + stripe;
+        lane2 = lane1 + stripe;
+        lane3 = lane2 + stripe;
+        vFp = _mm256_set_epi64x((long long) gearHash(base, hashStart, from + 3 * stripe - 1),
+                                (long long) gearHash(base, hashStart, from + 2 * stripe - 1),
+                                (long long) gearHash(base, hashStart, from + stripe - 1),
+                                (long long) gearHash(base, hashStart, from - 1));
+        for (k = 0; k < GEAR_SCAN_LANES; k++) first[k] = stripe;
+
+        for (t = 0; t < stripe; t++) {
+            /*note: four table loads beat a 64-bit gather, whose latency is on the critical path*/
+            vGear = _mm256_set_epi64x((long long) gearLUT_[lane3[t]], (long long) gearLUT_[lane2[t]],
+                                      (long long) gearLUT_[lane1[t]], (long long) gearLUT_[lane0[t]]);
+            vFp = _mm256_add_epi64(_mm256_slli_epi64(vFp, 1), vGear);
+            matched = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(vFp, vMask), vZero)));
+            if (matched) {
+                /*the first stripe holds the earliest positions, so a match there ends the scan*/
+                if (matched & 1) return from + t;
+                for (k = 1; k < GEAR_SCAN_LANES; k++) {
+                    if ((matched & (1 << k)) && first[k] == stripe) first[k] = t;
+                }
+            }
         }
 
-        /*record the end index of a chunk*/
-        chunkEndIndexList[(*numOfChunks)] = chunkEndIndex;
+        for (k = 1; k < GEAR_SCAN_LANES; k++) {
+            if (first[k] < stripe) return from + k * stripe + first[k];
+        }
+        from += GEAR_SCAN_LANES * stripe;
+    }
 
-        /*go on for the next chunk*/
-        chunkEndIndex = chunkEndIndexList[(*numOfChunks)] + minChunkSize_;
-        chunkEndIndexLimit = chunkEndIndexList[(*numOfChunks)] + maxChunkSize_;
-        (*numOfChunks)++;
+    /*scan the tail byte by byte*/
+    fp = gearHash(base, hashStart, from - 1);
+    for (; from < to; from++) {
+        fp = (fp << 1) + gearLUT_[base[from]];
+        if (!(fp & mask)) return from;
     }
+    return to;
+}
+#else
+int Chunker::gearScanAVX2(unsigned char *base, int hashStart, int from, int to, uint64_t mask){
+    return gearScanStriped(base, hashStart, from, to, mask);
+}
+#endif
 
-    /*deal with the tail of the buffer*/
-    if (((*numOfChunks) == 0) || (((*numOfChunks) > 0) && (chunkEndIndexList[(*numOfChunks)-1] != bufferSize -1))) { 
-        /*note: such a tail chunk has a size < minChunkSize_*/
-        chunkEndIndexList[(*numOfChunks)] = bufferSize -1;		
-        (*numOfChunks)++;
+/*
+ * select the method for scanning the gear hash of the FastCDC chunker
+ *
+ * @param gearScanMode - GEAR_SCAN_SCALAR, GEAR_SCAN_STRIPED or GEAR_SCAN_AVX2
+ * @return whether the method is supported by the CPU
+ *
+ * NOTE: every method gives the same chunk boundaries, the fastest supported one is selected by default
+ */
+bool Chunker::setGearScanMode(int gearScanMode){
+    if (gearScanMode == GEAR_SCAN_AVX2) {
+#if defined(__x86_64__) || defined(__i386__)
+        if (!__builtin_cpu_supports("avx2")) return false;
+#else
+        return false;
+#endif
+    } else if (gearScanMode != GEAR_SCAN_SCALAR && gearScanMode != GEAR_SCAN_STRIPED) {
+        return false;
     }
+    gearScanMode_ = gearScanMode;
+    return true;
 }
 
 /*
@@ -210,12 +502,86 @@ void Chunker::varSizeChunking(unsigned char *buffer, int bufferSize, int *chunkE
  * @param numOfChunks - the number of chunks <return>
  */
 void Chunker::chunking(unsigned char *buffer, int bufferSize, int *chunkEndIndexList, int *numOfChunks){
-    if (chunkerType_ == FIX_SIZE_TYPE) { /*fixed-size chunker*/
-        fixSizeChunking(buffer, bufferSize, chunkEndIndexList, numOfChunks);
+    int chunkStart;
+
+    (*numOfChunks) = 0;
+    chunkStart = 0;
+
+    /*divide the buffer into chunks, the last of which ends at the end of the buffer*/
+    while (chunkStart < bufferSize) {
+        chunkEndIndexList[(*numOfChunks)] = chunkStart + cut(buffer + chunkStart, bufferSize - chunkStart, true) - 1;
+        chunkStart = chunkEndIndexList[(*numOfChunks)] + 1;
+        (*numOfChunks)++;
     }
+}
 
-    if (chunkerType_ == VAR_SIZE_TYPE) { /*variable-size chunker*/
-        varSizeChunking(buffer, bufferSize, chunkEndIndexList, numOfChunks);
-    }	
+/*
+ * divide a stream into a number of chunks part by part, where the unfinished tail chunk of a part is carried
+ * by the chunker, so that the chunks are the same as if the whole stream were in one buffer
+ *
+ * @param buffer - the next part of the stream
+ * @param bufferSize - the size of the part
+ * @param isEnd - whether the part ends the stream
+ * @param chunkEndIndexList - a list for returning the end index in the part of each chunk ended in it <return>
+ * @param numOfChunks - the number of chunks ended in the part <return>
+ * @param headData - the carried bytes of the first chunk, which precede the part <return>
+ * @param headSize - the number of carried bytes of the first chunk <return>
+ *
+ * NOTE: the first chunk consists of headData[0..headSize) and buffer[0..chunkEndIndexList[0]], where
+ *       chunkEndIndexList[0] is -1 if the whole chunk was carried; headData is valid until the next call
+ */
+void Chunker::streamChunking(unsigned char *buffer, int bufferSize, bool isEnd, int *chunkEndIndexList, int *numOfChunks,
+                             unsigned char **headData, int *headSize){
+    int chunkStart, chunkSize, appendSize;
+
+    (*numOfChunks) = 0;
+    (*headData) = carryBuffer_[carryIndex_];
+    (*headSize) = 0;
+    chunkStart = 0;
+
+    /*finish the carried chunk*/
+    if (carrySize_ > 0) {
+        /*note: a chunk never exceeds the carry buffer, so the appended bytes are enough to find its end*/
+        appendSize = (bufferSize < carryCapacity_ - carrySize_) ? bufferSize : carryCapacity_ - carrySize_;
+        memcpy(carryBuffer_[carryIndex_] + carrySize_, buffer, appendSize);
+        chunkSize = cut(carryBuffer_[carryIndex_], carrySize_ + appendSize, isEnd && (appendSize == bufferSize));
+
+        if (chunkSize == 0) { /*the whole part goes on with the carried chunk*/
+            carrySize_ += appendSize;
+            return;
+        }
+
+        /*the carried bytes are not enough to end a chunk, so it always ends in the part*/
+        chunkEndIndexList[(*numOfChunks)] = chunkSize - carrySize_ - 1;
+        chunkStart = chunkEndIndexList[(*numOfChunks)] + 1;
+        (*numOfChunks)++;
+        (*headSize) = carrySize_;
+
+        /*keep the head valid, and carry the new tail in the other buffer*/
+        carryIndex_ ^= 1;
+        carrySize_ = 0;
+    }
+
+    /*divide the rest of the part into chunks*/
+    while (chunkStart < bufferSize) {
+        chunkSize = cut(buffer + chunkStart, bufferSize - chunkStart, isEnd);
+        if (chunkSize == 0) break;
+
+        chunkEndIndexList[(*numOfChunks)] = chunkStart + chunkSize - 1;
+        chunkStart += chunkSize;
+        (*numOfChunks)++;
+    }
+
+    /*carry the unfinished tail chunk*/
+    if (chunkStart < bufferSize) {
+        carrySize_ = bufferSize - chunkStart;
+        memcpy(carryBuffer_[carryIndex_], buffer + chunkStart, carrySize_);
+    }
 }
 
+/*
+ * drop the carried chunk, and start a new stream
+ */
+void Chunker::resetStream(){
+    carrySize_ = 0;
+}
@@ -8,81 +8,102 @@
 using namespace std;
 
 /*
- * thread handler for decode shares into secret
- *
+ * write a run of secrets to the file at its offset
  *
+ * @param fd - the output file descriptor
+ * @param buf - the secrets
+ * @param size - the size of the secrets
+ * @param offset - the offset of the first secret in the file
  */
-void* Decoder::thread_handler(void* param){
-
-    /* parse parameters */
-    int index = ((param_decoder*)param)->index;
-    Decoder* obj = ((param_decoder*)param)->obj;
-    free(param);
-    int i = 0;
-
-    /* main loop for decode shares into secret */
-    while(true){
-        ShareChunk_t temp;
-        Secret_t input;
-
-        /* get share objects */
-        obj->inputbuffer_[index]->Extract(&temp);
-
-        /* decode shares */
-        input.secretSize = temp.secretSize;
-        obj->decodeObj_[index]->decoding((unsigned char*)temp.data, obj->kShareIDList_, temp.shareSize, temp.secretSize, (unsigned char*)input.data);
-
-        /* add secret into output buffer */
-        obj->outputbuffer_[index]->Insert(&input,sizeof(input));
-        i++;
+static void writeAt(int fd, char* buf, long size, long offset){
+    while(size > 0){
+        ssize_t ret = pwrite(fd, buf, size, offset);
+        if(ret == -1){
+            if(errno == EINTR) continue;
+            fprintf(stderr, "fail to write the decoded file %d\n", errno);
+            exit(1);
+        }
+        buf += ret;
+        size -= ret;
+        offset += ret;
     }
-    return NULL;
 }
 
 /*
- * collect thread for sequencially get secrets
+ * thread handler for decode shares into secret, and write the secrets to the file at their offsets
  *
+ * @param param - input parameters for decode thread
  */
-void* Decoder::collect(void* param){
+void* Decoder::thread_handler(void* param){
 
     /* parse parameters */
-    char* buf = (char*)malloc(FWRITE_BUFFER_SIZE);
-    Decoder* obj = (Decoder*)param;
-    int count = 0;
-    int i;
-    int out_index = 0;
+    int index = ((param_decoder*)param)->index;
+    Decoder* obj = ((param_decoder*)param)->obj;
+    free(param);
+
+    /* the share objects of a batch, and the secrets of the batch that are next to each other in the file */
+    ShareChunk_t* temp = (ShareChunk_t*)malloc(sizeof(ShareChunk_t)*DECODE_BATCH_SIZE);
+    char* run = (char*)malloc(SECRET_SIZE*DECODE_BATCH_SIZE);
+    long runOffset = 0;
+    long runSize = 0;
+    int i, j, num;
 
-    /* main loop for get secrets */
+    /* main loop for decode shares into secret */
     while(true){
 
-        /* according to thread sequence */
-        for(i = 0; i < DECODE_NUM_THREADS; i++){
-            Secret_t temp;
+        /* get an object from the own input buffer or another thread's, and wait if there is none */
+        bool taken = false;
+        obj->inputReady_.wait([&]() {
+            taken = obj->takeShares(index, &temp[0]);
+            return taken || __atomic_load_n(&(obj->stop_), __ATOMIC_ACQUIRE);
+        });
+        if(!taken){
+            break;
+        }
 
-            /* extract secret object */
-            obj->outputbuffer_[i]->Extract(&temp);
+        /* take more objects as long as some are ready */
+        num = 1;
+        while(num < DECODE_BATCH_SIZE && obj->takeShares(index, &temp[num])){
+            num++;
+        }
 
-            /* if write buffer full then write to file */
-            if(out_index + temp.secretSize > FWRITE_BUFFER_SIZE){
-                fwrite(buf, out_index,1,obj->fw_);
-                out_index = 0;
+        for(i = 0; i < num; i++){
+            /* a secret not following the run starts a new run */
+            if(runSize > 0 && temp[i].offset != runOffset + runSize){
+                writeAt(obj->fd_, run, runSize, runOffset);
+                runSize = 0;
+            }
+            if(runSize == 0){
+                runOffset = temp[i].offset;
             }
 
-            /* copy secret to write buffer */
-            memcpy(buf+out_index, temp.data, temp.secretSize);
-            out_index += temp.secretSize;
+            /* decode shares from where they are received right into the run */
+            if(!obj->decodeObj_[index]->decoding(temp[i].shares, temp[i].shareIDList, temp[i].shareSize, temp[i].secretSize, (unsigned char*)run + runSize)){
+                fprintf(stderr, "fail to decode the secret at offset %ld\n", temp[i].offset);
+                exit(1);
+            }
+            runSize += temp[i].secretSize;
 
-            /* if this is the last secret, write to file and  exit the collect */
-            count++;
-            if(count == obj->totalSecrets_) {
-                if(out_index > 0){
-                    fwrite(buf, out_index, 1, obj->fw_);
+            /* the buffers of the shares can be reused once all their shares are decoded */
+            for(j = 0; j < obj->k_; j++){
+                ShareHolder_t* holder = temp[i].holders[j];
+                if(__atomic_sub_fetch(&(holder->pending), 1, __ATOMIC_ACQ_REL) == 0){
+                    holder->released.notify();
                 }
-                free(buf);
-                pthread_exit(NULL);
             }
         }
+        if(runSize > 0){
+            writeAt(obj->fd_, run, runSize, runOffset);
+            runSize = 0;
+        }
+
+        /* the last secret written ends the file */
+        if(__atomic_add_fetch(&(obj->decodedSecrets_), num, __ATOMIC_ACQ_REL) == obj->totalSecrets_){
+            obj->decodeDone_.notify();
+        }
     }
+    free(temp);
+    free(run);
     return NULL;
 }
 
@@ -94,41 +115,49 @@ void* Decoder::collect(void* param){
  * @param m - reliability degree
  * @param r - confidentiality degree
  * @param securetype - encryption and hash type
+ * @param keyHashType - hash type of the CAONT package keys
+ * @param numOfThreads - number of decoder threads
  */
-Decoder::Decoder(int type, int n, int m, int r, int securetype){
+Decoder::Decoder(int type, int n, int m, int r, int securetype, int keyHashType, int numOfThreads){
     int i;
     n_ = n;
+    k_ = n - m;
+    numOfThreads_ = numOfThreads;
+    nextAddIndex_ = 0;
+    totalSecrets_ = 0;
+    decodedSecrets_ = 0;
+    stop_ = false;
+    fd_ = -1;
 
     /* initialization */
-    cryptoObj_ = (CryptoPrimitive**)malloc(sizeof(CryptoPrimitive*)*n_);
-    inputbuffer_ = (RingBuffer<ShareChunk_t>**)malloc(sizeof(RingBuffer<ShareChunk_t>*)*DECODE_NUM_THREADS);
-    outputbuffer_ = (RingBuffer<Secret_t>**)malloc(sizeof(RingBuffer<Secret_t>*)*DECODE_NUM_THREADS);
+    cryptoObj_ = (CryptoPrimitive**)malloc(sizeof(CryptoPrimitive*)*numOfThreads_);
+    decodeObj_ = (CDCodec**)malloc(sizeof(CDCodec*)*numOfThreads_);
+    tid_ = (pthread_t*)malloc(sizeof(pthread_t)*numOfThreads_);
+    inputbuffer_ = (MPMCRingBuffer<ShareChunk_t>**)malloc(sizeof(MPMCRingBuffer<ShareChunk_t>*)*numOfThreads_);
 
     /* initialization for variables of each thread */
-    for (i = 0; i < DECODE_NUM_THREADS; i++){
-        inputbuffer_[i] = new RingBuffer<ShareChunk_t>(DECODE_RB_SIZE, true, 1);
-        outputbuffer_[i] = new RingBuffer<Secret_t>(DECODE_RB_SIZE, true, 1);
+    for (i = 0; i < numOfThreads_; i++){
+        inputbuffer_[i] = new MPMCRingBuffer<ShareChunk_t>(DECODE_RB_SIZE, false);
         cryptoObj_[i]  = new CryptoPrimitive(securetype);
-        decodeObj_[i] = new CDCodec(type,n,m,r,cryptoObj_[i]);
+        decodeObj_[i] = new CDCodec(type,n,m,r,cryptoObj_[i],keyHashType);
+    }
+
+    /* create decode threads, after all the buffers they steal from are ready */
+    for (i = 0; i < numOfThreads_; i++){
         param_decoder* temp = (param_decoder*)malloc(sizeof(param_decoder));
         temp->index = i;
         temp->obj = this;
-
-        /* create decode threads */
         pthread_create(&tid_[i],0,&thread_handler,(void*)temp);
     }
-
-    /* create collect thread */
-    pthread_create(&tid_[DECODE_NUM_THREADS],0,&collect,(void*)this);
-
-
 }
 
-/* 
- * test whether the decode thread returned
+/*
+ * wait until all the secrets are written to the file
  */
 int Decoder::indicateEnd(){
-    pthread_join(tid_[DECODE_NUM_THREADS], NULL);
+    decodeDone_.wait([&]() {
+        return __atomic_load_n(&decodedSecrets_, __ATOMIC_ACQUIRE) == totalSecrets_;
+    });
     return 1;
 }
 
@@ -136,47 +165,63 @@ int Decoder::indicateEnd(){
  * decoder destructor
  */
 Decoder::~Decoder(){
-    for (int i = 0; i < DECODE_NUM_THREADS; i++){
+    /* the threads are stopped before their buffers are freed */
+    __atomic_store_n(&stop_, true, __ATOMIC_RELEASE);
+    inputReady_.notify();
+    for (int i = 0; i < numOfThreads_; i++){
+        pthread_join(tid_[i], NULL);
+    }
+    for (int i = 0; i < numOfThreads_; i++){
         delete(decodeObj_[i]);
         delete(cryptoObj_[i]);
         delete(inputbuffer_[i]);
-        delete(outputbuffer_[i]);
     }
     free(inputbuffer_);
-    free(outputbuffer_);
+    free(decodeObj_);
     free(cryptoObj_);
+    free(tid_);
 }
 
 /*
  * add interface for add item into decode input buffer
  *
- * @param item - the input object
- * @param index - the index of thread
+ * @param item - the input object, whose offset is the sum of the sizes of the secrets before it,
+ *               and the pending count of each holder of its shares is released once it is decoded
  *
  */
-int Decoder::add(ShareChunk_t* item, int index){
-    inputbuffer_[index]->Insert(item, sizeof(ShareChunk_t));
+int Decoder::add(ShareChunk_t* item){
+    inputbuffer_[nextAddIndex_]->Insert(item, sizeof(ShareChunk_t));
+    inputReady_.notify();
+
+    /* increment the index */
+    nextAddIndex_ = (nextAddIndex_+1)%numOfThreads_;
     return 1;
 }
 
 /*
- * set the file pointer
+ * take a share object from a thread's own input buffer, or steal one from the other threads
  *
- * @param fp - the output file pointer
+ * @param index - the thread number
+ * @param item - the share object <return>
+ *
+ * @return whether an object is taken
  */
-int Decoder::setFilePointer(FILE* fp){
-    fw_ = fp;
-    return 1;
+bool Decoder::takeShares(int index, ShareChunk_t* item){
+    for (int i = 0; i < numOfThreads_; i++){
+        if (inputbuffer_[(index+i)%numOfThreads_]->TryExtract(item) == 0){
+            return true;
+        }
+    }
+    return false;
 }
 
-
 /*
- * set the share list
+ * set the file pointer
  *
- * @param list - the share ID list indicate the shares come from which clouds
+ * @param fp - the output file pointer
  */
-int Decoder::setShareIDList(int* list){
-    kShareIDList_ = list;
+int Decoder::setFilePointer(FILE* fp){
+    fd_ = fileno(fp);
     return 1;
 }
 
@@ -188,9 +233,6 @@ int Decoder::setShareIDList(int* list){
  */
 int Decoder::setTotal(int totalSecrets){
     totalSecrets_ = totalSecrets;
+    decodedSecrets_ = 0;
     return 1;
 }
-
-
-
-
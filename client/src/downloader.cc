@@ -24,63 +24,146 @@ void *Downloader::thread_handler(void *param) {
     /* get the download initiate signal */
     init_t signal;
     obj->signalBuffer_[cloudIndex]->Extract(&signal);
+    if (signal.type == 0) {
+        return NULL;
+    }
     
     /* get filename & name size*/
     char *filename = signal.filename;
     int namesize = signal.namesize;
     int retSize;
-    int index = 0;
+    Socket *sock = obj->socketArray_[cloudIndex];
     
     /* initiate download request */
-    obj->socketArray_[cloudIndex]->initDownload(filename, namesize);
-    
-    /* start to download data into container */
-    obj->socketArray_[cloudIndex]->downloadChunk(obj->downloadContainer_[cloudIndex], &retSize);
-    
-    /* get the header */
-    shareFileHead_t *header = (shareFileHead_t *) obj->downloadContainer_[cloudIndex];
-    index = sizeof(shareFileHead_t);
-    
-    /* parse the header object */
-    Item_t headerObj;
-    headerObj.type = 0;
-    memcpy(&(headerObj.fileObj.file_header), header, sizeof(shareFileHead_t));
-    
-    /* add the header object into ringbuffer */
-    obj->ringBuffer_[cloudIndex]->Insert(&headerObj, sizeof(headerObj));
+    if (sock->initDownload(filename, namesize) == -1) {
+        obj->failCloud(cloudIndex);
+        return NULL;
+    }
     
-    /* main loop to get data */
-    while (true) {
+    /* main loop to get data, a container after another */
+    int numOfShares = -1;
+    int count = 0;
+    int current = 0;
+    bool failed = false;
+    while (count != numOfShares && !failed) {
+        char *container = obj->downloadContainer_[cloudIndex] + (long) current * DOWNLOAD_BUFFER_SIZE;
+        Decoder::ShareHolder_t *holder = &obj->holders_[cloudIndex * DOWNLOAD_CONTAINER_NUM + current];
+        current = (current + 1) % DOWNLOAD_CONTAINER_NUM;
+        
+        /* the container is reused once the shares placed from it are decoded */
+        holder->released.wait([&]() {
+            return __atomic_load_n(&(holder->pending), __ATOMIC_ACQUIRE) == 0;
+        });
         
-        /* if the current comtainer has been proceed, download next container */
-        if (index == retSize) {
-            obj->socketArray_[cloudIndex]->downloadChunk(obj->downloadContainer_[cloudIndex], &retSize);
-            if (retSize == 0) {
-                // all data are processed
+        /* the server closes the connection after the last container */
+        if (sock->downloadHead(&retSize) == -1 || retSize == 0 || retSize > DOWNLOAD_BUFFER_SIZE) {
+            break;
+        }
+        
+        /* place each share as soon as it is received in full */
+        uint32_t received = 0;
+        uint32_t index = 0;
+        while (index < (uint32_t) retSize) {
+            uint32_t part;
+            if (received == (uint32_t) retSize || sock->downloadPart(container + received, retSize - received, &part) == -1) {
+                failed = true;
                 break;
             }
-            index = 0;
+            received += part;
+            
+            /* the header of the file comes first, and the first header to arrive tells the number of secrets */
+            if (numOfShares < 0) {
+                if (received < sizeof(shareFileHead_t)) {
+                    continue;
+                }
+                numOfShares = ((shareFileHead_t *) container)->numOfShares;
+                index = sizeof(shareFileHead_t);
+                pthread_mutex_lock(&obj->windowLock_);
+                if (obj->numOfSecrets_ < 0) {
+                    obj->numOfSecrets_ = numOfShares;
+                    pthread_cond_broadcast(&obj->readyCond_);
+                }
+                pthread_mutex_unlock(&obj->windowLock_);
+            }
+            
+            while (index + sizeof(shareEntry_t) <= received) {
+                shareEntry_t *entry = (shareEntry_t *) (container + index);
+                if (index + sizeof(shareEntry_t) + entry->shareSize > received) {
+                    break;
+                }
+                obj->collectShare(cloudIndex, count, entry, container + index + sizeof(shareEntry_t), holder);
+                index += sizeof(shareEntry_t) + entry->shareSize;
+                count++;
+            }
         }
-        
-        /* get the share object */
-        shareEntry_t *temp = (shareEntry_t *) (obj->downloadContainer_[cloudIndex] + index);
-        int shareSize = temp->shareSize;
-        index += sizeof(shareEntry_t);
-        
-        /* parse the share object */
-        Item_t output;
-        output.type = 1;
-        memcpy(&(output.shareObj.share_header), temp, sizeof(shareEntry_t));
-        memcpy(output.shareObj.data, obj->downloadContainer_[cloudIndex] + index, shareSize);
-        
-        index += shareSize;
-        
-        /* add the share object to ringbuffer */
-        obj->ringBuffer_[cloudIndex]->Insert(&output, sizeof(output));
     }
+    
+    if (count != numOfShares) {
+        obj->failCloud(cloudIndex);
+        return NULL;
+    }
+    pthread_mutex_lock(&obj->windowLock_);
+    obj->finished_[cloudIndex] = true;
+    pthread_mutex_unlock(&obj->windowLock_);
     return NULL;
 }
 
+/*
+ * place a share into the window, or drop it if k shares of the secret have arrived
+ *
+ * @param cloudIndex - the cloud sending the share
+ * @param secretIndex - the index of the secret in the file
+ * @param entry - the share header
+ * @param data - the share data, which is decoded where it is
+ * @param holder - the holder of the container of the share
+ */
+void Downloader::collectShare(int cloudIndex, int secretIndex, shareEntry_t *entry, char *data, Decoder::ShareHolder_t *holder) {
+    pthread_mutex_lock(&windowLock_);
+    
+    /* a cloud ahead of the window waits for the others */
+    while (secretIndex >= windowBase_ + DOWNLOAD_WINDOW_SIZE) {
+        pthread_cond_wait(&spaceCond_, &windowLock_);
+    }
+    
+    /* the secret is decoded already, or k shares of it have arrived */
+    secretSlot_t *slot = &window_[secretIndex % DOWNLOAD_WINDOW_SIZE];
+    if (secretIndex < windowBase_ || slot->arrived == subset_) {
+        pthread_mutex_unlock(&windowLock_);
+        return;
+    }
+    
+    /* the container of the share is held until the share is decoded */
+    __atomic_add_fetch(&(holder->pending), 1, __ATOMIC_RELAXED);
+    int pos = slot->arrived++;
+    slot->package.secretSize = entry->secretSize;
+    slot->package.shareSize = entry->shareSize;
+    slot->package.shareIDList[pos] = cloudIndex;
+    slot->package.shares[pos] = (unsigned char *) data;
+    slot->package.holders[pos] = holder;
+    if (slot->arrived == subset_ && secretIndex == windowBase_) {
+        pthread_cond_signal(&readyCond_);
+    }
+    pthread_mutex_unlock(&windowLock_);
+}
+
+/*
+ * record that a cloud fails, and wake the main procedure if the file cannot be decoded any more
+ *
+ * @param cloudIndex - the failed cloud
+ *
+ * NOTE: a cloud cancelled after all the secrets are collected does not fail
+ */
+void Downloader::failCloud(int cloudIndex) {
+    pthread_mutex_lock(&windowLock_);
+    if (!complete_) {
+        fprintf(stderr, "fail to download from cloud %d\n", cloudIndex);
+        finished_[cloudIndex] = true;
+        numOfFailed_++;
+        pthread_cond_signal(&readyCond_);
+    }
+    pthread_mutex_unlock(&windowLock_);
+}
+
 /*
  * constructor
  *
@@ -96,12 +179,28 @@ Downloader::Downloader(int total, int subset, int userID, Decoder *obj) {
     decodeObj_ = obj;
     
     /* initialization*/
-    ringBuffer_ = (RingBuffer<Item_t> **) malloc(sizeof(RingBuffer<Item_t> *) * total_);
-    signalBuffer_ = (RingBuffer<init_t> **) malloc(sizeof(RingBuffer<init_t> *) * total_);
+    signalBuffer_ = (SPSCRingBuffer<init_t> **) malloc(sizeof(SPSCRingBuffer<init_t> *) * total_);
     downloadMetaBuffer_ = (char **) malloc(sizeof(char *) * total_);
     downloadContainer_ = (char **) malloc(sizeof(char *) * total_);
     socketArray_ = (Socket **) malloc(sizeof(Socket *) * total_);
     headerArray_ = (fileShareMDHead_t **) malloc(sizeof(fileShareMDHead_t *) * total_);
+    window_ = (secretSlot_t *) malloc(sizeof(secretSlot_t) * DOWNLOAD_WINDOW_SIZE);
+    windowBase_ = 0;
+    numOfSecrets_ = -1;
+    numOfClouds_ = 0;
+    numOfFailed_ = 0;
+    numOfCancelled_ = 0;
+    complete_ = false;
+    for (int i = 0; i < DOWNLOAD_WINDOW_SIZE; i++) {
+        window_[i].arrived = 0;
+    }
+    holders_ = new Decoder::ShareHolder_t[total_ * DOWNLOAD_CONTAINER_NUM];
+    for (int i = 0; i < total_ * DOWNLOAD_CONTAINER_NUM; i++) {
+        holders_[i].pending = 0;
+    }
+    pthread_mutex_init(&windowLock_, NULL);
+    pthread_cond_init(&spaceCond_, NULL);
+    pthread_cond_init(&readyCond_, NULL);
     
     /* open config file */
     FILE *fp = fopen("./config", "rb");
@@ -110,10 +209,11 @@ Downloader::Downloader(int total, int subset, int userID, Decoder *obj) {
     
     /* initialization loop  */
     for (int i = 0; i < total_; i++) {
-        signalBuffer_[i] = new RingBuffer<init_t>(DOWNLOAD_RB_SIZE, true, 1);
-        ringBuffer_[i] = new RingBuffer<Item_t>(DOWNLOAD_RB_SIZE, true, 1);
+        signalBuffer_[i] = new SPSCRingBuffer<init_t>(DOWNLOAD_RB_SIZE, true);
+        finished_[i] = false;
+        usedShares_[i] = 0;
         downloadMetaBuffer_[i] = (char *) malloc(sizeof(char) * DOWNLOAD_BUFFER_SIZE);
-        downloadContainer_[i] = (char *) malloc(sizeof(char) * DOWNLOAD_BUFFER_SIZE);
+        downloadContainer_[i] = (char *) malloc(sizeof(char) * DOWNLOAD_BUFFER_SIZE * DOWNLOAD_CONTAINER_NUM);
         
         /* create threads */
         param_t *param = (param_t *) malloc(sizeof(param_t));      // thread's parameter
@@ -147,13 +247,16 @@ Downloader::~Downloader() {
     int i;
     for (i = 0; i < total_; i++) {
         delete (signalBuffer_[i]);
-        delete (ringBuffer_[i]);
         free(downloadMetaBuffer_[i]);
         free(downloadContainer_[i]);
         delete (socketArray_[i]);
     }
     free(signalBuffer_);
-    free(ringBuffer_);
+    free(window_);
+    delete[] holders_;
+    pthread_mutex_destroy(&windowLock_);
+    pthread_cond_destroy(&spaceCond_);
+    pthread_cond_destroy(&readyCond_);
     free(headerArray_);
     free(socketArray_);
     free(downloadContainer_);
@@ -161,19 +264,22 @@ Downloader::~Downloader() {
 }
 
 /*
- * main procedure for downloading a file
+ * main procedure for downloading a file, which requests the file from numOfCloud clouds and decodes
+ * each secret from the first k of its shares to arrive, and the clouds still sending
+ * after all the secrets are collected are cancelled
  *
  * @param filename - targeting filename
  * @param namesize - size of filename
- * @param numOfCloud - number of clouds that we download data
+ * @param numOfCloud - number of clouds that we download data, from k to n
  *
  */
 int Downloader::downloadFile(char *filename, int namesize, int numOfCloud) {
     int i;
     
-    /* temp share buffer for assemble the ring buffer data chunks*/
-    unsigned char *shareBuffer;
-    shareBuffer = (unsigned char *) malloc(sizeof(unsigned char) * RING_BUFFER_DATA_SIZE * MAX_NUMBER_OF_CLOUDS);
+    if (numOfCloud < subset_ || numOfCloud > total_) {
+        numOfCloud = total_;
+    }
+    numOfClouds_ = numOfCloud;
     
     unsigned char tmp[namesize * 32];
     int tmp_s;
@@ -181,10 +287,10 @@ int Downloader::downloadFile(char *filename, int namesize, int numOfCloud) {
     // encode the filepath into shares
     decodeObj_->decodeObj_[0]->encodingFileName((unsigned char *) filename, namesize, tmp, &(tmp_s));
     
-    /* add init object for download */
+    /* add init object for download, and release the threads of the clouds not downloaded from */
     init_t input;
-    for (i = 0; i < numOfCloud; i++) {
-        input.type = 1;
+    for (i = 0; i < total_; i++) {
+        input.type = i < numOfCloud ? 1 : 0;
         
         //copy the corresponding share as file name
         input.filename = (char *) (tmp + i * tmp_s);
@@ -193,45 +299,60 @@ int Downloader::downloadFile(char *filename, int namesize, int numOfCloud) {
         signalBuffer_[i]->Insert(&input, sizeof(init_t));
     }
     
-    /* get the header object from buffer */
-    Item_t headerObj;
-    for (i = 0; i < numOfCloud; i++) {
-        ringBuffer_[i]->Extract(&headerObj);
+    /* wait for the first header, and tell decoder the total number of secret */
+    pthread_mutex_lock(&windowLock_);
+    while (numOfSecrets_ < 0 && numOfFailed_ <= numOfClouds_ - subset_) {
+        pthread_cond_wait(&readyCond_, &windowLock_);
     }
-    
-    /* parse header object, tell decoder the total number of secret */
-    shareFileHead_t *header = &(headerObj.fileObj.file_header);
-    int numOfShares = header->numOfShares;
+    if (numOfSecrets_ < 0) {
+        fprintf(stderr, "fail to download %s from %d of %d clouds\n", filename, numOfFailed_, numOfClouds_);
+        exit(1);
+    }
+    int numOfShares = numOfSecrets_;
+    pthread_mutex_unlock(&windowLock_);
     decodeObj_->setTotal(numOfShares);
     
-    /* proceed each secret */
+    /* proceed each secret once k of its shares arrive, which is written at the sum of the sizes before it */
     int count = 0;
+    long offset = 0;
     while (count < numOfShares) {
-        int secretSize = 0;
-        int shareSize = 0;
-        
-        /* extract share object from each cloud's ringbuffer */
-        for (i = 0; i < numOfCloud; i++) {
-            Item_t output;
-            ringBuffer_[i]->Extract(&output);
-            shareEntry_t *temp = &(output.shareObj.share_header);
-            secretSize = temp->secretSize;
-            shareSize = temp->shareSize;
-            
-            /* place the share at the right position */
-            memcpy(shareBuffer + i * shareSize, output.shareObj.data, shareSize);
+        secretSlot_t *slot = &window_[count % DOWNLOAD_WINDOW_SIZE];
+        pthread_mutex_lock(&windowLock_);
+        while (slot->arrived < subset_ && numOfFailed_ <= numOfClouds_ - subset_) {
+            pthread_cond_wait(&readyCond_, &windowLock_);
         }
+        if (slot->arrived < subset_) {
+            fprintf(stderr, "fail to download %s from %d of %d clouds\n", filename, numOfFailed_, numOfClouds_);
+            exit(1);
+        }
+        for (i = 0; i < subset_; i++) {
+            usedShares_[slot->package.shareIDList[i]]++;
+        }
+        pthread_mutex_unlock(&windowLock_);
         
-        /* add the share buffer to the decoder ringbuffer */
-        Decoder::ShareChunk_t package;
-        package.secretSize = secretSize;
-        package.shareSize = shareSize;
-        memcpy(&(package.data), shareBuffer, numOfCloud * shareSize);
-        decodeObj_->add(&package, count % DECODE_NUM_THREADS);
+        /* add the shares to the decoder ringbuffer, and then move the window on */
+        slot->package.offset = offset;
+        offset += slot->package.secretSize;
+        decodeObj_->add(&(slot->package));
+        pthread_mutex_lock(&windowLock_);
+        slot->arrived = 0;
+        windowBase_++;
+        pthread_cond_broadcast(&spaceCond_);
+        pthread_mutex_unlock(&windowLock_);
         
         count++;
     }
-    free(shareBuffer);
+    
+    /* the clouds still sending are not waited for */
+    pthread_mutex_lock(&windowLock_);
+    complete_ = true;
+    for (i = 0; i < numOfCloud; i++) {
+        if (!finished_[i]) {
+            socketArray_[i]->cancel();
+            numOfCancelled_++;
+        }
+    }
+    pthread_mutex_unlock(&windowLock_);
     return 0;
 }
 
@@ -241,9 +362,23 @@ int Downloader::downloadFile(char *filename, int namesize, int numOfCloud) {
  */
 int Downloader::indicateEnd() {
     int i;
-    for (i = 0; i < DOWNLOAD_NUM_THREADS; i++) {
+    for (i = 0; i < total_; i++) {
         /* trying to join all threads */
         pthread_join(tid_[i], NULL);
     }
     return 1;
 }
+
+/*
+ * get the number of shares of each cloud that are decoded
+ *
+ * @param usedShares - the numbers of shares of the total clouds <return>
+ *
+ * @return the number of clouds cancelled before sending all their shares
+ */
+int Downloader::getShareStats(long long *usedShares) {
+    for (int i = 0; i < total_; i++) {
+        usedShares[i] = usedShares_[i];
+    }
+    return numOfCancelled_;
+}
@@ -5,8 +5,19 @@
 
 #include "encoder.hh"
 
+#include <time.h>
+
 using namespace std;
 
+/*
+ * get the CPU time of the calling thread in seconds, which does not count the time it is preempted
+ */
+static double threadTimeNow(){
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
 /*
  * thread handler for encoding each secret into shares
  *
@@ -19,45 +30,119 @@ void* Encoder::thread_handler(void* param){
     Encoder* obj = ((param_encoder*)param)->obj;
     free(param);
 
+    /* the secrets of a batch, which are encoded together */
+    Secret_Item_t temp[ENCODE_BATCH_SIZE];
+    ShareChunk_Item_t output[ENCODE_BATCH_SIZE];
+    unsigned char* secretBuffers[ENCODE_BATCH_SIZE];
+    unsigned char* shareBuffers[ENCODE_BATCH_SIZE];
+    int secretSizes[ENCODE_BATCH_SIZE];
+    int shareSizes[ENCODE_BATCH_SIZE];
+    int i, j, num, numOfSecrets;
+
+    /* the shares of a batch, which are fingerprinted together */
+    unsigned char* fpShares[ENCODE_BATCH_SIZE*UPLOAD_NUM_THREADS];
+    unsigned char* fpHashes[ENCODE_BATCH_SIZE*UPLOAD_NUM_THREADS];
+    int fpSizes[ENCODE_BATCH_SIZE*UPLOAD_NUM_THREADS];
+    int numOfFPs;
+    long long fpBytes;
+    double begin;
+
     /* main loop for getting secrets and encode them into shares*/
     while(true){
 
-        /* get an object from input buffer */
-        Secret_Item_t temp;
-        ShareChunk_Item_t input;
-        obj->inputbuffer_[index]->Extract(&temp);
+        /* get an object from the own input queue or another thread's, and wait if there is none */
+        bool taken = false;
+        obj->inputReady_.wait([&]() {
+            taken = obj->takeSecret(index, &temp[0]);
+            return taken || __atomic_load_n(&(obj->stop_), __ATOMIC_ACQUIRE);
+        });
+        if(!taken){
+            break;
+        }
 
-        /* get the object type */
-        int type = temp.type;
-        input.type = type;
+        /* take more objects as long as some are ready */
+        num = 1;
+        while(num < ENCODE_BATCH_SIZE && obj->takeSecret(index, &temp[num])){
+            num++;
+        }
 
-        /* copy content into input object */
-        if(type == FILE_OBJECT){
-            /* if it's file header */
-            memcpy(&input.file_header, &temp.file_header, sizeof(fileHead_t));
-        }else{
+        numOfSecrets = 0;
+        for(i = 0; i < num; i++){
+            ShareChunk_Item_t* input = &output[i];
+            input->type = temp[i].type;
+
+            if(temp[i].type == FILE_OBJECT){
+                /* if it's file header, encode pathname into shares for privacy, in the same block right after the name */
+                input->file_header = temp[i].file_header;
+                input->file_header.name.data += SECRET_SIZE;
+                obj->encodeObj_[index]->encodingFileName(temp[i].file_header.name.data, temp[i].file_header.name.size, input->file_header.name.data, &(input->file_header.nameShareSize));
+                input->file_header.name.size = input->file_header.nameShareSize*obj->n_;
+            }else if(temp[i].type == SECRET_OBJECT){
+
+                /* if it's share object, it's encoded with the batch into the same block right after the secret */
+                input->share_chunk.shares = temp[i].secret.secret;
+                input->share_chunk.shares.data += SECRET_SIZE;
+                input->share_chunk.secretID = temp[i].secret.secretID;
+                input->share_chunk.secretSize = temp[i].secret.secret.size;
+                input->share_chunk.end = temp[i].secret.end;
+                secretBuffers[numOfSecrets] = temp[i].secret.secret.data;
+                secretSizes[numOfSecrets] = temp[i].secret.secret.size;
+                shareBuffers[numOfSecrets] = input->share_chunk.shares.data;
+                numOfSecrets++;
+            }
+        }
 
-            /* if it's share object */
-            obj->encodeObj_[index]->encoding(temp.secret.data, temp.secret.secretSize, input.share_chunk.data, &(input.share_chunk.shareSize));
-            input.share_chunk.secretID = temp.secret.secretID;
-            input.share_chunk.secretSize = temp.secret.secretSize;
-            input.share_chunk.end = temp.secret.end;
+        /* encode the secrets of the batch at once */
+        obj->encodeObj_[index]->encodingBatch(numOfSecrets, secretBuffers, secretSizes, shareBuffers, shareSizes);
+
+        numOfSecrets = 0;
+        numOfFPs = 0;
+        fpBytes = 0;
+        for(i = 0; i < num; i++){
+            ShareChunk_Item_t* input = &output[i];
+            if(input->type == SECRET_OBJECT){
+                input->share_chunk.shareSize = shareSizes[numOfSecrets++];
+                input->share_chunk.shares.size = input->share_chunk.shareSize*obj->n_;
+                for(j = 0; j < obj->n_; j++){
+                    fpShares[numOfFPs] = input->share_chunk.shares.data + j*input->share_chunk.shareSize;
+                    fpSizes[numOfFPs] = input->share_chunk.shareSize;
+                    fpHashes[numOfFPs] = input->share_chunk.shareFP[j];
+                    numOfFPs++;
+                }
+                fpBytes += input->share_chunk.shares.size;
+            }
         }
 
-        /* add the object to output buffer */
-        obj->outputbuffer_[index]->Insert(&input,sizeof(input));
+        /* fingerprint the shares of the batch at once, while they are still in cache */
+        begin = threadTimeNow();
+        obj->fpObj_[index]->generateHashBatch(numOfFPs, fpShares, fpSizes, fpHashes);
+        obj->fpTime_[index] += threadTimeNow()-begin;
+        obj->fpBytes_[index] += fpBytes;
+
+        for(i = 0; i < num; i++){
+            ShareChunk_Item_t* input = &output[i];
+
+            /*
+             * put the object to its slot in the reorder buffer, which is free since the object 
+             * REORDER_SIZE before has been collected, otherwise its arena block would not be released yet
+             */
+            Reorder_Slot_t* slot = &(obj->reorder_[temp[i].seq%REORDER_SIZE]);
+            slot->item = *input;
+            __atomic_store_n(&(slot->seq), temp[i].seq, __ATOMIC_RELEASE);
+        }
+        obj->reorderReady_.notify();
     }
     return NULL;
 }
 
 /*
- * collect thread for getting share object in order
+ * collect thread for getting share object in order from the reorder buffer
  *
  * @param param - parameters for collect thread
  */
 void* Encoder::collect(void* param){
-    /* index for sequencially collect shares */
-    int nextBufferIndex = 0;
+    /* position of the next object to collect */
+    long nextSeq = 0;
 
     /* parse parameters */
     Encoder* obj = (Encoder*)param;
@@ -65,10 +150,11 @@ void* Encoder::collect(void* param){
     /* main loop for collecting shares */
     while(true){
 
-        /* extract an object from a certain ringbuffer */
-        ShareChunk_Item_t temp;
-        obj->outputbuffer_[nextBufferIndex]->Extract(&temp);
-        nextBufferIndex = (nextBufferIndex + 1)%NUM_THREADS;
+        /* wait until the next object is encoded, no matter how many objects after it are done */
+        Reorder_Slot_t* slot = &(obj->reorder_[nextSeq%REORDER_SIZE]);
+        obj->reorderReady_.wait([&]() { return __atomic_load_n(&(slot->seq), __ATOMIC_ACQUIRE) == nextSeq; });
+        ShareChunk_Item_t temp = slot->item;
+        nextSeq++;
 
         /* get the object type */
         int type = temp.type;
@@ -80,50 +166,62 @@ void* Encoder::collect(void* param){
             input.type = FILE_HEADER;
 
             /* copy file header information */
+            input.fileObj.numOfShares = temp.file_header.numOfShares;
             input.fileObj.file_header.fileSize = temp.file_header.fileSize;
-            input.fileObj.file_header.numOfPastSecrets = 0;
-            input.fileObj.file_header.sizeOfPastSecrets = 0;
+            input.fileObj.file_header.numOfPastSecrets = temp.file_header.numOfPastSecrets;
+            input.fileObj.file_header.sizeOfPastSecrets = temp.file_header.sizeOfPastSecrets;
             input.fileObj.file_header.numOfComingSecrets = 0;
             input.fileObj.file_header.sizeOfComingSecrets = 0;
+            input.fileObj.file_header.contentDigest = temp.file_header.contentDigest;
             
-            unsigned char tmp[temp.file_header.fullNameSize*32];
-            int tmp_s;
+            /* the pathname has been encoded into shares by the encode thread */
+            int nameShareSize = temp.file_header.nameShareSize;
+            input.fileObj.file_header.fullNameSize = nameShareSize;
 
-            //encode pathname into shares for privacy
-            obj->encodeObj_[0]->encodingFileName(temp.file_header.data, temp.file_header.fullNameSize, tmp, &(tmp_s));
-            
-            input.fileObj.file_header.fullNameSize = tmp_s;
+            /* add the object to each cloud's uploader buffer */
+            for(int i = 0; i < obj->n_; i++){
 
-            /* copy file name */
-            //memcpy(input.fileObj.data, temp.file_header.data, temp.file_header.fullNameSize);
+                //the corresponding share as file name
+                input.fileObj.data = temp.file_header.name;
+                input.fileObj.data.data += i*nameShareSize;
+                input.fileObj.data.size = nameShareSize;
+                input.fileObj.numOfAccepted = temp.file_header.numOfAccepted[i];
+#ifdef ENCODE_ONLY_MODE
+                BufferArena::release(&input.fileObj.data);
+#else
+                obj->uploadObj_->add(&input, sizeof(input), i);
+#endif
+            }
+        }else if(type == SESSION_END_OBJECT){
 
+            /* nothing follows the end of the session, after which each cloud's uploader uploads what is left */
+            input.type = SESSION_END;
 #ifndef ENCODE_ONLY_MODE
-            /* add the object to each cloud's uploader buffer */
             for(int i = 0; i < obj->n_; i++){
-
-                //copy the corresponding share as file name
-                memcpy(input.fileObj.data, tmp+i*tmp_s, input.fileObj.file_header.fullNameSize);
                 obj->uploadObj_->add(&input, sizeof(input), i);
             }
 #endif
+            break;
         }else{
 
             /* if it's share object */
             for(int i = 0; i < obj->n_; i++){
                 input.type = SHARE_OBJECT;
 
-                /* copy share info */	
+                /* share info, and the slice of the share in the block */
                 int shareSize = temp.share_chunk.shareSize;
                 input.shareObj.share_header.secretID = temp.share_chunk.secretID;
                 input.shareObj.share_header.secretSize = temp.share_chunk.secretSize;
                 input.shareObj.share_header.shareSize = shareSize;
-                memcpy(input.shareObj.data, temp.share_chunk.data+(i*shareSize), shareSize);
-#ifndef ENCODE_ONLY_MODE
-#endif
+                input.shareObj.data = temp.share_chunk.shares;
+                input.shareObj.data.data += i*shareSize;
+                input.shareObj.data.size = shareSize;
+                memcpy(input.shareObj.share_header.shareFP, temp.share_chunk.shareFP[i], FP_SIZE);
+
                 /* see if it's the last secret of a file */
                 if (temp.share_chunk.end == 1) input.type = SHARE_END;
 #ifdef ENCODE_ONLY_MODE
-                if (temp.share_chunk.end == 1) pthread_exit(NULL);
+                BufferArena::release(&input.shareObj.data);
 #else 
                 /* add the share object to targeting cloud uploader buffer */
                 obj->uploadObj_->add(&input, sizeof(input), i);
@@ -136,11 +234,12 @@ void* Encoder::collect(void* param){
 
 
 /*
- * see if it's end of encoding file
+ * see if it's end of encoding the session, after a SESSION_END_OBJECT is added behind its files
  *
  */
 void Encoder::indicateEnd(){
-    pthread_join(tid_[NUM_THREADS],NULL);
+    pthread_join(tid_[numOfThreads_],NULL);
+    collectJoined_ = true;
 }
 
 /*
@@ -152,36 +251,60 @@ void Encoder::indicateEnd(){
  * @param r - confidentiality degree
  * @param securetype - encryption and hash type
  * @param uploaderObj - pointer link to uploader object
+ * @param keyHashType - hash type of the CAONT package keys
+ * @param numOfThreads - number of encoder threads
  *
  */
-Encoder::Encoder(int type, int n, int m, int r, int securetype, Uploader* uploaderObj){
+Encoder::Encoder(int type, int n, int m, int r, int securetype, int keyHashType, Uploader* uploaderObj, int numOfThreads){
 
     /* initialization of variables */
     int i;
     n_ = n;
+    numOfThreads_ = numOfThreads;
     nextAddIndex_ = 0;
-    cryptoObj_ = (CryptoPrimitive**)malloc(sizeof(CryptoPrimitive*)*NUM_THREADS);
-    inputbuffer_ = (RingBuffer<Secret_Item_t>**)malloc(sizeof(RingBuffer<Secret_Item_t>*)*NUM_THREADS);
-    outputbuffer_ = (RingBuffer<ShareChunk_Item_t>**)malloc(sizeof(RingBuffer<ShareChunk_Item_t>*)*NUM_THREADS);
+    nextSeq_ = 0;
+    stop_ = false;
+    collectJoined_ = false;
+    cryptoObj_ = (CryptoPrimitive**)malloc(sizeof(CryptoPrimitive*)*numOfThreads_);
+    fpObj_ = (CryptoPrimitive**)malloc(sizeof(CryptoPrimitive*)*numOfThreads_);
+    fpBytes_ = (long long*)malloc(sizeof(long long)*numOfThreads_);
+    fpTime_ = (double*)malloc(sizeof(double)*numOfThreads_);
+    encodeObj_ = (CDCodec**)malloc(sizeof(CDCodec*)*numOfThreads_);
+    tid_ = (pthread_t*)malloc(sizeof(pthread_t)*(numOfThreads_+1));
+    arena_ = new BufferArena(ARENA_BLOCK_SIZE, ARENA_BLOCK_NUM);
+    inputbuffer_ = (MPMCRingBuffer<Secret_Item_t>**)malloc(sizeof(MPMCRingBuffer<Secret_Item_t>*)*numOfThreads_);
+
+    /* no slot of the reorder buffer is ready */
+    if(posix_memalign((void**)&reorder_, RING_CACHE_LINE_SIZE, sizeof(Reorder_Slot_t)*REORDER_SIZE) != 0){
+        fprintf(stderr, "fail to allocate the reorder buffer\n");
+        exit(1);
+    }
+    for (i = 0; i < REORDER_SIZE; i++){
+        reorder_[i].seq = -1;
+    }
 
     /* initialization of objects */
-    for (i = 0; i < NUM_THREADS; i++){
-        inputbuffer_[i] = new RingBuffer<Secret_Item_t>(RB_SIZE, true, 1);
-        outputbuffer_[i] = new RingBuffer<ShareChunk_Item_t>(RB_SIZE, true, 1);
+    for (i = 0; i < numOfThreads_; i++){
+        inputbuffer_[i] = new MPMCRingBuffer<Secret_Item_t>(RB_SIZE, false);
         cryptoObj_[i] = new CryptoPrimitive(securetype);
-        encodeObj_[i] = new CDCodec(type,n,m,r, cryptoObj_[i]);
+        fpObj_[i] = new CryptoPrimitive(SHA256_TYPE);
+        fpBytes_[i] = 0;
+        fpTime_[i] = 0;
+        encodeObj_[i] = new CDCodec(type,n,m,r, cryptoObj_[i], keyHashType);
+    }
+
+    uploadObj_ = uploaderObj;
+
+    /* create encoding threads, after all the queues they steal from are ready */
+    for (i = 0; i < numOfThreads_; i++){
         param_encoder* temp = (param_encoder*)malloc(sizeof(param_encoder));
         temp->index = i;
         temp->obj = this;
-
-        /* create encoding threads */
         pthread_create(&tid_[i],0,&thread_handler,(void*)temp);
     }
 
-    uploadObj_ = uploaderObj;
-
     /* create collect thread */
-    pthread_create(&tid_[NUM_THREADS],0,&collect,(void*)this);
+    pthread_create(&tid_[numOfThreads_],0,&collect,(void*)this);
 }
 
 /*
@@ -189,30 +312,94 @@ Encoder::Encoder(int type, int n, int m, int r, int securetype, Uploader* upload
  *
  */
 Encoder::~Encoder(){
-    for (int i = 0; i < NUM_THREADS; i++){
+    /* the threads are stopped before their queues are freed */
+    __atomic_store_n(&stop_, true, __ATOMIC_RELEASE);
+    inputReady_.notify();
+    for (int i = 0; i < numOfThreads_; i++){
+        pthread_join(tid_[i], NULL);
+    }
+    if (!collectJoined_){
+        pthread_join(tid_[numOfThreads_], NULL);
+    }
+    for (int i = 0; i < numOfThreads_; i++){
         delete(cryptoObj_[i]);
+        delete(fpObj_[i]);
         delete(encodeObj_[i]);
         delete(inputbuffer_[i]);
-        delete(outputbuffer_[i]);
     }
     free(inputbuffer_);
-    free(outputbuffer_);
+    free(reorder_);
     free(cryptoObj_);
+    free(fpObj_);
+    free(fpBytes_);
+    free(fpTime_);
+    free(encodeObj_);
+    free(tid_);
+    delete(arena_);
+}
+
+/*
+ * get an arena block for a secret, or for a file name, to be added
+ *
+ * @param slice - the slice of the secret part of the block <return>
+ *
+ */
+void Encoder::newSecret(BufferArena::Slice_t* slice){
+    /* each cloud's uploader releases the block once */
+    arena_->acquire(slice, n_);
+    slice->size = SECRET_SIZE;
 }
 
 /*
  * add function for sequencially add items to each encode buffer
  *
- * @param item - input object
+ * @param item - input object, whose slice is from newSecret()
  *
  */
 int Encoder::add(Secret_Item_t* item){
-    /* add item */
+    /* add item, in any thread's queue since idle threads steal */
+    item->seq = nextSeq_++;
     inputbuffer_[nextAddIndex_]->Insert(item, sizeof(Secret_Item_t));
+    inputReady_.notify();
 
     /* increment the index */
-    nextAddIndex_ = (nextAddIndex_+1)%NUM_THREADS;
+    nextAddIndex_ = (nextAddIndex_+1)%numOfThreads_;
     return 1;
 }
 
+/*
+ * get the share fingerprinting statistics of all the encoder threads, after the end of encoding
+ *
+ * @param bytes - the total size of the shares fingerprinted <return>
+ * @param seconds - the total CPU time spent fingerprinting <return>
+ *
+ * NOTE: the statistics of a batch are updated before its objects are put to the reorder buffer,
+ * so they are all visible once the collect thread is done
+ */
+void Encoder::getFingerprintStats(long long* bytes, double* seconds){
+    *bytes = 0;
+    *seconds = 0;
+    for (int i = 0; i < numOfThreads_; i++){
+        *bytes += fpBytes_[i];
+        *seconds += fpTime_[i];
+    }
+}
+
+/*
+ * take an object from a thread's own input queue, or steal one from the other threads
+ *
+ * @param index - the thread number
+ * @param item - the object <return>
+ *
+ * @return whether an object is taken
+ */
+bool Encoder::takeSecret(int index, Secret_Item_t* item){
+    for (int i = 0; i < numOfThreads_; i++){
+        if (inputbuffer_[(index+i)%numOfThreads_]->TryExtract(item) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
 
@@ -4,6 +4,25 @@
 
 using namespace std;
 
+/*
+ * skip the buffers sent, and advance into the one partially sent
+ *
+ * @param iov - the buffers <return>
+ * @param iovcnt - the number of buffers <return>
+ * @param bytecount - the number of bytes sent
+ */
+static void consumeIov(struct iovec **iov, int *iovcnt, size_t bytecount) {
+    while (*iovcnt > 0 && bytecount >= (*iov)->iov_len) {
+        bytecount -= (*iov)->iov_len;
+        (*iov)++;
+        (*iovcnt)--;
+    }
+    if (*iovcnt > 0) {
+        (*iov)->iov_base = (char *) (*iov)->iov_base + bytecount;
+        (*iov)->iov_len -= bytecount;
+    }
+}
+
 /*
  * constructor: initialize sock structure and connect
  *
@@ -15,6 +34,7 @@ Socket::Socket(char *ip, int port, int userID, int flag) {
     /* get port and ip */
     hostPort_ = port;
     hostName_ = ip;
+    cancelled_ = false;
     int err;
     
     /* initializing socket object */
@@ -49,7 +69,7 @@ Socket::Socket(char *ip, int port, int userID, int flag) {
     /* prepare user ID and send it to server */
     if (flag == 1) {
         int bytecount;
-        if ((bytecount = send(hostSock_, &userID, sizeof(int), 0)) == -1) {
+        if ((bytecount = send(hostSock_, &userID, sizeof(int), MSG_NOSIGNAL)) == -1) {
             fprintf(stderr, "Error sending userID %d\n", errno);
         }
     }
@@ -62,6 +82,14 @@ Socket::~Socket() {
     close(hostSock_);
 }
 
+/*
+ * shut down the connection, so that a thread blocked on it returns, without reporting the error
+ */
+void Socket::cancel() {
+    cancelled_ = true;
+    shutdown(hostSock_, SHUT_RDWR);
+}
+
 /*
  * basic send function
  * 
@@ -73,7 +101,7 @@ int Socket::genericSend(char *raw, uint32_t rawSize) {
     int bytecount;
     uint32_t total = 0;
     while (total < rawSize) {
-        if ((bytecount = send(hostSock_, raw + total, rawSize - total, 0)) == -1) {
+        if ((bytecount = send(hostSock_, raw + total, rawSize - total, MSG_NOSIGNAL)) == -1) {
             fprintf(stderr, "Error sending data %d\n", errno);
             return -1;
         }
@@ -83,40 +111,151 @@ int Socket::genericSend(char *raw, uint32_t rawSize) {
 }
 
 /*
- * metadata send function
- *
- * @param raw - raw data buffer_
- * @param rawSize - size of raw data
+ * scatter-gather send function, which sends IOV_MAX buffers at a time
  *
+ * @param iov - the buffers, which are consumed as they are sent
+ * @param iovcnt - the number of buffers
  */
-int Socket::sendMeta(char *raw, int rawSize, int userID, uint32_t sharenum) {
-    int indicator = SEND_META;
+int Socket::genericSendv(struct iovec *iov, int iovcnt) {
     
-    int bytecount;
-    if ((bytecount = send(hostSock_, &userID, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error sending userID %d\n", errno);
-        return -1;
+    ssize_t bytecount;
+    long total = 0;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    while (iovcnt > 0) {
+        /* a connection closed by the server is reported as an error instead of raising SIGPIPE */
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (iovcnt < IOV_MAX) ? iovcnt : IOV_MAX;
+        if ((bytecount = sendmsg(hostSock_, &msg, MSG_NOSIGNAL)) == -1) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error sending data %d\n", errno);
+            return -1;
+        }
+        total += bytecount;
+        consumeIov(&iov, &iovcnt, bytecount);
     }
-    //先发送 将要发送的数据的类型
-    if ((bytecount = send(hostSock_, &indicator, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
+    return total;
+}
+
+/*
+ * make the socket non-blocking, so that an event loop drives it with trySendv and tryRecv
+ */
+int Socket::setNonBlocking() {
+    int flags = fcntl(hostSock_, F_GETFL, 0);
+    if (flags == -1 || fcntl(hostSock_, F_SETFL, flags | O_NONBLOCK) == -1) {
+        fprintf(stderr, "Error setting socket options %d\n", errno);
         return -1;
     }
-    //再发送 将要发送的数据的大小
-    uint32_t size = boost::numeric_cast<uint32_t>(rawSize + sizeof(sharenum));
-    if ((bytecount = send(hostSock_, &size, sizeof(size), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
-        return -1;
+    return 0;
+}
+
+/*
+ * non-blocking scatter-gather send function, which sends until the buffers are sent or the socket is full
+ *
+ * @param iov - the buffers, which are advanced past the data sent <return>
+ * @param iovcnt - the number of buffers left <return>
+ *
+ * @return 1 if all the buffers are sent, 0 if the socket is full, or -1 on error
+ */
+int Socket::trySendv(struct iovec **iov, int *iovcnt) {
+    
+    ssize_t bytecount;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    while (*iovcnt > 0) {
+        msg.msg_iov = *iov;
+        msg.msg_iovlen = (*iovcnt < IOV_MAX) ? *iovcnt : IOV_MAX;
+        /* a closed connection is reported as an error instead of raising SIGPIPE */
+        if ((bytecount = sendmsg(hostSock_, &msg, MSG_NOSIGNAL)) == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            fprintf(stderr, "Error sending data %d\n", errno);
+            return -1;
+        }
+        consumeIov(iov, iovcnt, bytecount);
+    }
+    return 1;
+}
+
+/*
+ * non-blocking receive function, which receives until the buffer is full or no data is ready
+ *
+ * @param raw - the buffer
+ * @param rawSize - the size of the data to be received
+ * @param received - the size of the data received so far <return>
+ *
+ * @return 1 if all the data is received, 0 if no more data is ready, or -1 on error or a closed connection
+ */
+int Socket::tryRecv(char *raw, uint32_t rawSize, uint32_t *received) {
+    
+    ssize_t bytecount;
+    while (*received < rawSize) {
+        if ((bytecount = recv(hostSock_, raw + *received, rawSize - *received, 0)) == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            fprintf(stderr, "Error receiving data %d\n", errno);
+            return -1;
+        }
+        if (bytecount == 0) {
+            fprintf(stderr, "Connection closed by the server\n");
+            return -1;
+        }
+        *received += bytecount;
     }
-    if ((bytecount = send(hostSock_, &sharenum, sizeof(uint32_t), 0)) == -1) {
-        fprintf(stderr, "Error sending sharenum %d\n", errno);
+    return 1;
+}
+
+/*
+ * metadata send function
+ *
+ * @param raw - raw data buffer_
+ * @param rawSize - size of raw data
+ * @param indicator - SEND_META, or SEND_META_CACHED for shares all uploaded before,
+ *                    which are followed by neither the status list nor the data
+ *
+ */
+int Socket::sendMeta(char *raw, int rawSize, int userID, uint32_t sharenum, int indicator) {
+    //依次发送 userID、数据类型、数据大小、share数量和数据，合并为一次调用
+    metaHead_t head;
+    setMetaHead(&head, rawSize, userID, sharenum, indicator);
+    struct iovec iov[2];
+    iov[0].iov_base = &head;
+    iov[0].iov_len = sizeof(head);
+    iov[1].iov_base = raw;
+    iov[1].iov_len = rawSize;
+    if (genericSendv(iov, 2) == -1) {
         return -1;
     }
-    //最后发送 数据
-    genericSend(raw, boost::numeric_cast<uint32_t>(rawSize));
     return 0;
 }
 
+/*
+ * set the header of a metadata message
+ *
+ * @param head - the header <return>
+ * @param rawSize - size of the metadata
+ * @param indicator - SEND_META or SEND_META_CACHED, or SEND_META_BATCH or SEND_META_BATCH_CACHED
+ *                    for the metadata of several files, where sharenum is the number of files
+ */
+void Socket::setMetaHead(metaHead_t *head, int rawSize, int userID, uint32_t sharenum, int indicator) {
+    head->userID = userID;
+    head->indicator = indicator;
+    head->size = boost::numeric_cast<uint32_t>(rawSize + sizeof(sharenum));
+    head->sharenum = sharenum;
+}
+
+/*
+ * set the header of a data message
+ *
+ * @param head - the header <return>
+ * @param rawSize - size of the data
+ */
+void Socket::setDataHead(dataHead_t *head, size_t rawSize, int userID) {
+    head->userID = userID;
+    head->indicator = SEND_DATA;
+    head->size = boost::numeric_cast<uint32_t>(rawSize);
+}
+
 /*
  * data send function
  *
@@ -125,26 +264,35 @@ int Socket::sendMeta(char *raw, int rawSize, int userID, uint32_t sharenum) {
  *
  */
 int Socket::sendData(char *raw, int rawSize, int userID) {
-    int indicator = SEND_DATA;
-    
-    int bytecount;
-    if ((bytecount = send(hostSock_, &userID, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error sending userID %d\n", errno);
-        return -1;
-    }
-    if ((bytecount = send(hostSock_, &indicator, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
-        return -1;
-    }
-    
-    uint32_t sendSize = boost::numeric_cast<uint32_t>(rawSize);
-    if ((bytecount = send(hostSock_, &sendSize, sizeof(sendSize), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
-        return -1;
+    struct iovec iov;
+    iov.iov_base = raw;
+    iov.iov_len = rawSize;
+    return sendDataV(&iov, 1, userID);
+}
+
+/*
+ * data send function, which sends the data from where it is without copying it together
+ *
+ * @param iov - the buffers of the data, which are consumed as they are sent
+ * @param iovcnt - the number of buffers
+ *
+ */
+int Socket::sendDataV(struct iovec *iov, int iovcnt, int userID) {
+    size_t rawSize = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        rawSize += iov[i].iov_len;
     }
     
-    genericSend(raw, sendSize);
-    return 0;
+    /* the header goes with the data in a single call, from a copy of the buffer list */
+    dataHead_t head;
+    setDataHead(&head, rawSize, userID);
+    struct iovec *all = (struct iovec *) malloc(sizeof(struct iovec) * (iovcnt + 1));
+    all[0].iov_base = &head;
+    all[0].iov_len = sizeof(head);
+    memcpy(all + 1, iov, sizeof(struct iovec) * iovcnt);
+    int ret = genericSendv(all, iovcnt + 1);
+    free(all);
+    return ret == -1 ? -1 : 0;
 }
 
 /*
@@ -160,7 +308,12 @@ int Socket::genericDownload(char *raw, uint32_t rawSize) {
     uint32_t total = 0;
     while (total < rawSize) {
         if ((bytecount = recv(hostSock_, raw + total, rawSize - total, 0)) == -1) {
-            fprintf(stderr, "Error sending data %d\n", errno);
+            if (errno == EINTR) continue;
+            if (!cancelled_) fprintf(stderr, "Error receiving data %d\n", errno);
+            return -1;
+        }
+        if (bytecount == 0) {
+            if (!cancelled_) fprintf(stderr, "Connection closed by the server\n");
             return -1;
         }
         total += bytecount;
@@ -175,30 +328,25 @@ int Socket::genericDownload(char *raw, uint32_t rawSize) {
  * @param num - num of returned indicator
  *
  * @return statusList
+ * @return 0 on success, 1 if the server reports that some cached shares sent before are not stored, or -1 on error
  */
 int Socket::getStatus(bool *statusList, int *num) {
     
-    int bytecount;
-    int indicator = 0;
-    
-    if ((bytecount = recv(hostSock_, &indicator, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
+    /* the header may arrive in pieces */
+    respHead_t head;
+    if (genericDownload((char *) &head, sizeof(head)) == -1) {
         return -1;
     }
-    if (indicator != GET_STAT) {
-        fprintf(stderr, "Status wrong %d\n", errno);
+    if (head.indicator != GET_STAT && head.indicator != GET_STAT_STALE) {
+        fprintf(stderr, "Status wrong %d\n", head.indicator);
         return -1;
     }
+    *num = boost::numeric_cast<int>(head.size);
     
-    uint32_t readSize;
-    if ((bytecount = recv(hostSock_, &readSize, sizeof(readSize), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
+    if (genericDownload((char *) statusList, sizeof(bool) * (*num)) == -1) {
         return -1;
     }
-    *num = boost::numeric_cast<int>(readSize);
-    
-    genericDownload((char *) statusList, sizeof(bool) * (*num));
-    return 0;
+    return head.indicator == GET_STAT_STALE ? 1 : 0;
 }
 
 /*
@@ -210,25 +358,69 @@ int Socket::getStatus(bool *statusList, int *num) {
  *
  */
 int Socket::initDownload(char *filename, int namesize) {
-    int indicator = INIT_DOWNLOAD;
+    respHead_t head;
+    head.indicator = INIT_DOWNLOAD;
+    head.size = boost::numeric_cast<uint32_t>(namesize);
     
-    int bytecount;
-    if ((bytecount = send(hostSock_, &indicator, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
+    struct iovec iov[2];
+    iov[0].iov_base = &head;
+    iov[0].iov_len = sizeof(head);
+    iov[1].iov_base = filename;
+    iov[1].iov_len = namesize;
+    if (genericSendv(iov, 2) == -1) {
         return -1;
     }
+    return 0;
+}
+
+/*
+ * receive the header of a chunk of data, so that the data can be received as it arrives
+ *
+ * @param retSize - the size of the data of the chunk, 0 if the server has closed the connection <return>
+ */
+int Socket::downloadHead(int *retSize) {
+    respHead_t head;
+    
+    int bytecount;
     
-    uint32_t sendSize = boost::numeric_cast<uint32_t>(namesize);
-    if ((bytecount = send(hostSock_, &sendSize, sizeof(sendSize), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
+    /* the server closes the connection after the last chunk */
+    while ((bytecount = recv(hostSock_, &head, sizeof(head), 0)) == -1 && errno == EINTR);
+    if (bytecount == -1) {
+        if (!cancelled_) fprintf(stderr, "Error receiving data %d\n", errno);
         return -1;
     }
+    if (bytecount == 0) {
+        *retSize = 0;
+        return 0;
+    }
     
-    if ((bytecount = send(hostSock_, filename, namesize, 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
+    /* the rest of the header may arrive later */
+    if (genericDownload((char *) &head + bytecount, sizeof(head) - bytecount) == -1) {
         return -1;
     }
-    
+    *retSize = boost::numeric_cast<int>(head.size);
+    return 0;
+}
+
+/*
+ * receive the part of the data of a chunk that has arrived, and wait if none has
+ *
+ * @param raw - the buffer
+ * @param rawSize - the size of the data left in the chunk
+ * @param received - the size of the data received <return>
+ */
+int Socket::downloadPart(char *raw, uint32_t rawSize, uint32_t *received) {
+    int bytecount;
+    while ((bytecount = recv(hostSock_, raw, rawSize, 0)) == -1 && errno == EINTR);
+    if (bytecount == -1) {
+        if (!cancelled_) fprintf(stderr, "Error receiving data %d\n", errno);
+        return -1;
+    }
+    if (bytecount == 0) {
+        if (!cancelled_) fprintf(stderr, "Connection closed by the server\n");
+        return -1;
+    }
+    *received = bytecount;
     return 0;
 }
 
@@ -241,28 +433,11 @@ int Socket::initDownload(char *filename, int namesize) {
  * @return retSize
  */
 int Socket::downloadChunk(char *raw, int *retSize) {
-    int indicator;
-    
-    int bytecount;
-    
-    if ((bytecount = recv(hostSock_, &indicator, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error receiving data %d\n", errno);
+    if (downloadHead(retSize) == -1) {
         return -1;
     }
-    
-    if (bytecount == 0) {
-        *retSize = 0;
-        return 0;
-    }
-    
-    uint32_t readSize;
-    if ((bytecount = recv(hostSock_, &readSize, sizeof(readSize), 0)) == -1) {
-        fprintf(stderr, "Error receiving data %d\n", errno);
+    if (genericDownload(raw, *retSize) == -1) {
         return -1;
     }
-    *retSize = boost::numeric_cast<int>(readSize);
-    
-    genericDownload(raw, readSize);
-    
     return 0;
 }
@@ -8,7 +8,7 @@
 using namespace std;
 
 /*
- * uploader thread handler
+ * uploader thread handler, which drives the connections of all the clouds
  *
  * @param param - input structure
  *
@@ -16,117 +16,251 @@ using namespace std;
 void *Uploader::thread_handler(void *param) {
     /* get input parameters */
     param_t *temp = (param_t *) param;
-    int cloudIndex = temp->cloudIndex;
     Uploader *obj = temp->obj;
     int userID = temp->userID;
-    uint32_t sharenum = temp->sharenum;
     free(temp);
     
-    Item_t output;
-    /* initialize hash object */
-    CryptoPrimitive *hashobj = new CryptoPrimitive(SHA256_TYPE);
+    struct epoll_event events[UPLOAD_NUM_THREADS + 1];
+    int numOfDone = 0;
     
-    /* main loop for uploader, end when indicator recv.ed */
-    while (true) {
-        /* get object from ringbuffer */
-        obj->ringBuffer_[cloudIndex]->Extract(&output);
+    /* main loop for uploader, end when every cloud has got the last share of the session */
+    while (numOfDone < obj->total_) {
+        bool progress = false, blocked = false;
+        numOfDone = 0;
+        for (int i = 0; i < obj->total_; i++) {
+            cloudState_t *cloud = &obj->cloudState_[i];
+            
+            /* the progress request goes between two uploads, before the file asked for is buffered */
+            if (cloud->state == UPLOAD_FILLING && __atomic_load_n(&cloud->queryPending, __ATOMIC_ACQUIRE)) {
+                cloud->queryPending = false;
+                cloud->iov = cloud->queryIov;
+                cloud->iovcnt = 2;
+                cloud->state = UPLOAD_SENDING_QUERY;
+            }
+            if (cloud->state == UPLOAD_FILLING) {
+                progress |= obj->fillContainer(i, userID);
+            }
+            if (cloud->state != UPLOAD_FILLING && cloud->state != UPLOAD_DONE && !cloud->blocked) {
+                progress |= obj->progressUpload(i, userID);
+            }
+            if (cloud->state == UPLOAD_DONE) {
+                numOfDone++;
+            }
+            blocked |= cloud->blocked;
+        }
+        if (numOfDone == obj->total_) {
+            break;
+        }
+        if (progress && !blocked) {
+            continue;
+        }
+        
+        /* a blocked socket is only tried again once it is ready, which is polled while there is other work to do */
+        for (int i = 0; i < obj->total_; i++) {
+            obj->watchSocket(i);
+        }
+        int timeout = 0;
+        if (!progress) {
+            /* nothing to do, so sleep until a socket is ready or an object is added */
+            __atomic_store_n(&obj->sleeping_, 1, __ATOMIC_SEQ_CST);
+            
+            /* an object added before the flag is set is taken here, and after it add() signals the event fd */
+            for (int i = 0; i < obj->total_; i++) {
+                if (obj->cloudState_[i].state == UPLOAD_FILLING) {
+                    progress |= __atomic_load_n(&obj->cloudState_[i].queryPending, __ATOMIC_ACQUIRE);
+                    progress |= obj->fillContainer(i, userID);
+                }
+            }
+            if (!progress) {
+                timeout = -1;
+            }
+        }
+        int num = epoll_wait(obj->epollFd_, events, obj->total_ + 1, timeout);
+        if (num == -1) {
+            if (errno != EINTR) {
+                fprintf(stderr, "Error waiting for events %d\n", errno);
+                exit(1);
+            }
+            num = 0;
+        }
+        __atomic_store_n(&obj->sleeping_, 0, __ATOMIC_SEQ_CST);
+        
+        for (int i = 0; i < num; i++) {
+            if (events[i].data.u32 < (uint32_t) obj->total_) {
+                obj->cloudState_[events[i].data.u32].blocked = false;
+                continue;
+            }
+            
+            /* reset the event fd signalled by add() */
+            uint64_t count;
+            if (read(obj->eventFd_, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+                fprintf(stderr, "Error reading event fd %d\n", errno);
+            }
+        }
+    }
+    pthread_exit(NULL);
+}
+
+/*
+ * buffer the objects of a cloud from its ringbuffer, until it is empty or the container buffer is uploaded
+ *
+ * @param cloudIndex - indicate targeting cloud
+ *
+ * @return whether any object is buffered
+ */
+bool Uploader::fillContainer(int cloudIndex, int userID) {
+    cloudState_t *cloud = &cloudState_[cloudIndex];
+    bool progress = false;
+    
+    while (cloud->state == UPLOAD_FILLING) {
+        /* get objects from ringbuffer a batch at a time, without waiting */
+        if (cloud->batchIndex == cloud->batchSize) {
+            cloud->batchSize = ringBuffer_[cloudIndex]->ExtractBatch(cloud->batch, UPLOAD_BATCH_SIZE);
+            cloud->batchIndex = 0;
+            if (cloud->batchSize == 0) {
+                break;
+            }
+        }
+        Item_t &output = cloud->batch[cloud->batchIndex];
+        progress = true;
         
         /* IF this is a file header object.. */
         if (output.type == FILE_HEADER) {
             
+            /* see if the metadata buffer can hold the coming file, if not then perform upload, and buffer the file after it */
+            if (metaWP_[cloudIndex] + (int) sizeof(uint32_t) + fileMDHeadSize_ + output.fileObj.file_header.fullNameSize > UPLOAD_META_LIMIT) {
+                performUpload(cloudIndex, userID, false);
+                break;
+            }
+            
+            /* the metadata of the file starts with the total number of its shares, and follows that of the previous file */
+            cloud->fileOffset = metaWP_[cloudIndex];
+            cloud->fileOpen = output.fileObj.numOfShares > 0;
+            cloud->numOfAccepted = output.fileObj.numOfAccepted;
+            cloud->numOfFiles++;
+            memcpy(uploadMetaBuffer_[cloudIndex] + metaWP_[cloudIndex], &(output.fileObj.numOfShares), sizeof(uint32_t));
+            metaWP_[cloudIndex] += sizeof(uint32_t);
+            
             /* copy object content into metabuffer */
-            memcpy(obj->uploadMetaBuffer_[cloudIndex] + obj->metaWP_[cloudIndex],
+            memcpy(uploadMetaBuffer_[cloudIndex] + metaWP_[cloudIndex],
                    &(output.fileObj.file_header),
-                   obj->fileMDHeadSize_);
+                   fileMDHeadSize_);
             
             /* head array point to new file header */
-            //obj->uploadMetaBuffer_[cloudIndex]+obj->metaWP_[cloudIndex] 用来定位所需要的数据的地址，后面share的结构地址也是这样定义
+            //uploadMetaBuffer_[cloudIndex]+metaWP_[cloudIndex] 用来定位所需要的数据的地址，后面share的结构地址也是这样定义
             //metaWP_[cloudIndex] 仅用来记录读到了哪儿
-            obj->headerArray_[cloudIndex] =
-                    (fileShareMDHead_t *) (obj->uploadMetaBuffer_[cloudIndex] + obj->metaWP_[cloudIndex]);
+            headerArray_[cloudIndex] =
+                    (fileShareMDHead_t *) (uploadMetaBuffer_[cloudIndex] + metaWP_[cloudIndex]);
             
             /* meta index update */
-            obj->metaWP_[cloudIndex] += obj->fileMDHeadSize_;
+            metaWP_[cloudIndex] += fileMDHeadSize_;
             
             /* copy file full path name */
-            memcpy(obj->uploadMetaBuffer_[cloudIndex] + obj->metaWP_[cloudIndex],
-                   output.fileObj.data,
+            memcpy(uploadMetaBuffer_[cloudIndex] + metaWP_[cloudIndex],
+                   output.fileObj.data.data,
                    output.fileObj.file_header.fullNameSize);
+            BufferArena::release(&output.fileObj.data);
             
             /* meta index update */
-            obj->metaWP_[cloudIndex] += obj->headerArray_[cloudIndex]->fullNameSize;
+            metaWP_[cloudIndex] += headerArray_[cloudIndex]->fullNameSize;
             
         } else if (output.type == SHARE_OBJECT || output.type == SHARE_END) {
             /* IF this is share object */
             int shareSize = output.shareObj.share_header.shareSize;
             
-            /* see if the container buffer can hold the coming share, if not then perform upload */
-            if (shareSize + obj->containerWP_[cloudIndex] > UPLOAD_BUFFER_SIZE) {
-                obj->performUpload(cloudIndex, userID, sharenum);
-                obj->updateHeader(cloudIndex);
+            /* a share the cloud has accepted in an unfinished upload before is only counted as past */
+            if (output.shareObj.share_header.secretID < cloud->numOfAccepted) {
+                headerArray_[cloudIndex]->numOfPastSecrets += 1;
+                headerArray_[cloudIndex]->sizeOfPastSecrets += output.shareObj.share_header.secretSize;
+                BufferArena::release(&output.shareObj.data);
+                cloud->batchIndex++;
+                continue;
             }
             
-            /* generate SHA256 fingerprint */
-            hashobj->generateHash((unsigned char *) output.shareObj.data,
-                                  shareSize,
-                                  output.shareObj.share_header.shareFP);
-
-            /* generate rabin fingerprint */
-//            hashobj->generateHash_rabin((unsigned char *) output.shareObj.data,
-//                                  shareSize,
-//                                  output.shareObj.share_header.shareFP);
+            /* see if the buffers can hold the coming share, if not then perform upload, and buffer the share after it */
+            if (shareSize + containerWP_[cloudIndex] > UPLOAD_BUFFER_SIZE ||
+                metaWP_[cloudIndex] + shareMDEntrySize_ > UPLOAD_META_LIMIT) {
+                performUpload(cloudIndex, userID, false);
+                break;
+            }
             
-            /* copy share header into metabuffer */
-            memcpy(obj->uploadMetaBuffer_[cloudIndex] + obj->metaWP_[cloudIndex],
+            /* copy share header into metabuffer, with the SHA256 fingerprint generated by the encoder */
+            memcpy(uploadMetaBuffer_[cloudIndex] + metaWP_[cloudIndex],
                    &(output.shareObj.share_header),
-                   obj->shareMDEntrySize_);
-            obj->metaWP_[cloudIndex] += obj->shareMDEntrySize_;
+                   shareMDEntrySize_);
+            metaWP_[cloudIndex] += shareMDEntrySize_;
+            if (fpCache_[cloudIndex] != NULL && fpCache_[cloudIndex]->lookup(output.shareObj.share_header.shareFP)) {
+                numOfCached_[cloudIndex]++;
+            }
             
-            /* copy share data into container buffer */
-            memcpy(obj->uploadContainer_[cloudIndex] + obj->containerWP_[cloudIndex], output.shareObj.data, shareSize);
-            obj->containerWP_[cloudIndex] += shareSize;
+            /* copy share data into container buffer, which is the only copy of the share */
+            memcpy(uploadContainer_[cloudIndex] + containerWP_[cloudIndex], output.shareObj.data.data, shareSize);
+            containerWP_[cloudIndex] += shareSize;
+            accuCopied_[cloudIndex] += shareSize;
+            BufferArena::release(&output.shareObj.data);
             
             /* record share size */
-            obj->shareSizeArray_[cloudIndex][obj->numOfShares_[cloudIndex]] = shareSize;
-            obj->numOfShares_[cloudIndex]++;
+            shareSizeArray_[cloudIndex][numOfShares_[cloudIndex]] = shareSize;
+            numOfShares_[cloudIndex]++;
             
             /* update file header pointer */
-            obj->headerArray_[cloudIndex]->numOfComingSecrets += 1;
-            obj->headerArray_[cloudIndex]->sizeOfComingSecrets += output.shareObj.share_header.secretSize;
+            headerArray_[cloudIndex]->numOfComingSecrets += 1;
+            headerArray_[cloudIndex]->sizeOfComingSecrets += output.shareObj.share_header.secretSize;
             
-            /* IF this is the last share object, perform upload and exit thread */
+            /* IF this is the last share object of the file, the next file is buffered after it */
             if (output.type == SHARE_END) {
-                obj->performUpload(cloudIndex, userID, sharenum);
-                delete hashobj;
-                pthread_exit(NULL);
+                cloud->fileOpen = false;
+            }
+        } else if (output.type == SESSION_END) {
+            /* IF this is the end of the session, perform upload of what is left */
+            if (cloud->numOfFiles > 0) {
+                performUpload(cloudIndex, userID, true);
+            } else {
+                cloud->state = UPLOAD_DONE;
             }
         }
+        cloud->batchIndex++;
     }
+    return progress;
 }
 
 /*
- * constructor
+ * constructor, the uploader uploads the files added until the end of the session over the same connections
  *
  * @param p - input large prime number
  * @param total - input total number of clouds
  * @param subset - input number of clouds to be chosen
+ * @param fpCacheSize - size budget of the fingerprint cache of each cloud, 0 for no cache
  *
  */
-Uploader::Uploader(int total, int subset, int userID, uint32_t sharenum) {
+Uploader::Uploader(int total, int subset, int userID, long fpCacheSize) {
     total_ = total;
     subset_ = subset;
     
     /* initialization */
-    ringBuffer_ = (RingBuffer<Item_t> **) malloc(sizeof(RingBuffer<Item_t> *) * total_);
+    ringBuffer_ = (SPSCRingBuffer<Item_t> **) malloc(sizeof(SPSCRingBuffer<Item_t> *) * total_);
     uploadMetaBuffer_ = (char **) malloc(sizeof(char *) * total_);
     uploadContainer_ = (char **) malloc(sizeof(char *) * total_);
     containerWP_ = (int *) malloc(sizeof(int) * total_);
     metaWP_ = (int *) malloc(sizeof(int) * total_);
     numOfShares_ = (int *) malloc(sizeof(int) * total_);
+    numOfCached_ = (int *) malloc(sizeof(int) * total_);
+    fpCache_ = (FingerprintCache **) malloc(sizeof(FingerprintCache *) * total_);
     socketArray_ = (Socket **) malloc(sizeof(Socket *) * total_);
+    progressRequest_ = NULL;
+    progressRequestSize_ = 0;
+    pendingQueries_ = 0;
     headerArray_ = (fileShareMDHead_t **) malloc(sizeof(fileShareMDHead_t *) * total_);
     shareSizeArray_ = (int **) malloc(sizeof(int *) * total_);
+    cloudState_ = (cloudState_t *) malloc(sizeof(cloudState_t) * total_);
     
+    /* the event fd is registered after the sockets, as the index following the clouds */
+    epollFd_ = epoll_create1(0);
+    eventFd_ = eventfd(0, EFD_NONBLOCK);
+    sleeping_ = 0;
+    if (epollFd_ == -1 || eventFd_ == -1) {
+        fprintf(stderr, "Error creating event fds %d\n", errno);
+    }
     
     /* read server ip & port from config file */
     FILE *fp = fopen("./config", "rb");
@@ -134,20 +268,14 @@ Uploader::Uploader(int total, int subset, int userID, uint32_t sharenum) {
     const char ch[2] = ":";
     
     for (int i = 0; i < total_; i++) {
-        ringBuffer_[i] = new RingBuffer<Item_t>(UPLOAD_RB_SIZE, true, 1);
+        ringBuffer_[i] = new SPSCRingBuffer<Item_t>(UPLOAD_RB_SIZE, false);
         shareSizeArray_[i] = (int *) malloc(sizeof(int) * UPLOAD_BUFFER_SIZE);
         uploadMetaBuffer_[i] = (char *) malloc(sizeof(char) * UPLOAD_BUFFER_SIZE);
         uploadContainer_[i] = (char *) malloc(sizeof(char) * UPLOAD_BUFFER_SIZE);
         containerWP_[i] = 0;
         metaWP_[i] = 0;
         numOfShares_[i] = 0;
-        
-        param_t *param = (param_t *) malloc(sizeof(param_t));      // thread's parameter
-        param->sharenum = sharenum;
-        param->cloudIndex = i;
-        param->obj = this;
-        param->userID = userID;
-        pthread_create(&tid_[i], 0, &thread_handler, (void *) param);
+        numOfCached_[i] = 0;
         
         /* line by line read config file*/
         int ret = fscanf(fp, "%s", line);
@@ -158,16 +286,54 @@ Uploader::Uploader(int total, int subset, int userID, uint32_t sharenum) {
         token = strtok(NULL, ch);
         int port = atoi(token);
         
-        /* set sockets */
+        /* the fingerprint cache of the user on this server */
+        fpCache_[i] = NULL;
+        if (fpCacheSize > 0) {
+            char cachePath[DIR_MAX_SIZE];
+            snprintf(cachePath, sizeof(cachePath), "./fpcache_%d_%s_%d", userID, ip, port);
+            fpCache_[i] = new FingerprintCache(cachePath, fpCacheSize);
+            if (!fpCache_[i]->isEnabled()) {
+                delete fpCache_[i];
+                fpCache_[i] = NULL;
+            }
+        }
+        
+        /* set sockets, which are connected before being driven without blocking by the upload thread */
         socketArray_[i] = new Socket(ip, port, userID, 0);
+        socketArray_[i]->setNonBlocking();
+        struct epoll_event event;
+        event.events = 0;
+        event.data.u32 = i;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, socketArray_[i]->getSock(), &event) == -1) {
+            fprintf(stderr, "Error watching socket %d\n", errno);
+        }
+        memset(&cloudState_[i], 0, sizeof(cloudState_t));
+        cloudState_[i].state = UPLOAD_FILLING;
         accuData_[i] = 0;
         accuUnique_[i] = 0;
+        accuCopied_[i] = 0;
+        accuUploads_[i] = 0;
+        accuCachedUploads_[i] = 0;
+        accuCachedData_[i] = 0;
+        staleCache_[i] = false;
     }
     
     fclose(fp);
     fileMDHeadSize_ = sizeof(fileShareMDHead_t);
     shareMDEntrySize_ = sizeof(shareMDEntry_t);
     
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = total_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, eventFd_, &event) == -1) {
+        fprintf(stderr, "Error watching event fd %d\n", errno);
+    }
+    
+    /* a single thread uploads to all the clouds */
+    param_t *param = (param_t *) malloc(sizeof(param_t));      // thread's parameter
+    param->obj = this;
+    param->userID = userID;
+    pthread_create(&tid_, 0, &thread_handler, (void *) param);
 }
 
 /*
@@ -181,12 +347,19 @@ Uploader::~Uploader() {
         free(uploadMetaBuffer_[i]);
         free(uploadContainer_[i]);
         delete (socketArray_[i]);
+        delete (fpCache_[i]);
     }
     free(ringBuffer_);
     free(shareSizeArray_);
     free(headerArray_);
     free(socketArray_);
+    free(progressRequest_);
     free(numOfShares_);
+    free(numOfCached_);
+    free(fpCache_);
+    free(cloudState_);
+    close(epollFd_);
+    close(eventFd_);
     free(metaWP_);
     free(containerWP_);
     free(uploadContainer_);
@@ -194,31 +367,127 @@ Uploader::~Uploader() {
 }
 
 /*
- * Initiate upload
+ * Initiate upload, by preparing the metadata message of the container buffer
  *
  * @param cloudIndex - indicate targeting cloud
+ * @param last - whether this is the last upload of the session, which always waits for the status list
  *
  */
-int Uploader::performUpload(int cloudIndex, int userID, uint32_t sharenum) {
-    /* 1st send metadata */
+int Uploader::performUpload(int cloudIndex, int userID, bool last) {
+    cloudState_t *cloud = &cloudState_[cloudIndex];
+    cloud->last = last;
+    accuUploads_[cloudIndex]++;
+    
+    /* shares all uploaded before are only recorded by the server, which verifies them and reports on the last status list */
+    int indicator = SEND_META_BATCH;
+    if (!last && numOfShares_[cloudIndex] > 0 && numOfCached_[cloudIndex] == numOfShares_[cloudIndex]) {
+        indicator = SEND_META_BATCH_CACHED;
+        accuCachedData_[cloudIndex] += containerWP_[cloudIndex];
+        accuCachedUploads_[cloudIndex]++;
+    }
+    
+    /* a file whose first share does not fit is left to the next container buffer */
+    int metaSize = metaWP_[cloudIndex];
+    int numOfFiles = cloud->numOfFiles;
+    if (cloud->fileOpen && headerArray_[cloudIndex]->numOfComingSecrets == 0) {
+        metaSize = cloud->fileOffset;
+        numOfFiles--;
+    }
+    
+    /* 1st send metadata of all the files in the container buffer, with its header in the same call */
     //包括文件header和share的header
-    socketArray_[cloudIndex]->sendMeta(uploadMetaBuffer_[cloudIndex], metaWP_[cloudIndex], userID, sharenum);
+    Socket::setMetaHead(&cloud->metaHead, metaSize, userID, numOfFiles, indicator);
+    cloud->iovList = (struct iovec *) malloc(sizeof(struct iovec) * (numOfShares_[cloudIndex] + 2));
+    cloud->iovList[0].iov_base = &cloud->metaHead;
+    cloud->iovList[0].iov_len = sizeof(cloud->metaHead);
+    cloud->iovList[1].iov_base = uploadMetaBuffer_[cloudIndex];
+    cloud->iovList[1].iov_len = metaSize;
+    cloud->iov = cloud->iovList;
+    cloud->iovcnt = 2;
+    cloud->state = UPLOAD_SENDING_META;
+    return 0;
+}
+
+/*
+ * move the upload of a container buffer on, until the socket is full, or has no data ready
+ *
+ * @param cloudIndex - indicate targeting cloud
+ *
+ * @return whether the upload has moved on
+ */
+bool Uploader::progressUpload(int cloudIndex, int userID) {
+    cloudState_t *cloud = &cloudState_[cloudIndex];
+    int ret;
+    
+    if (cloud->state == UPLOAD_SENDING_QUERY || cloud->state == UPLOAD_RECEIVING_PROGRESS) {
+        return progressQuery(cloudIndex);
+    }
+    
+    if (cloud->state == UPLOAD_SENDING_META || cloud->state == UPLOAD_SENDING_DATA) {
+        if ((ret = socketArray_[cloudIndex]->trySendv(&cloud->iov, &cloud->iovcnt)) == -1) {
+            fprintf(stderr, "fail to upload to cloud %d\n", cloudIndex);
+            exit(1);
+        }
+        if (ret == 0) {
+            cloud->blocked = true;
+            return false;
+        }
+        
+        /* the cached shares are not followed by a status list */
+        if (cloud->state == UPLOAD_SENDING_DATA || cloud->metaHead.indicator == SEND_META_BATCH_CACHED) {
+            finishUpload(cloudIndex);
+            return true;
+        }
+        
+        /* 2nd get back the status list, which may arrive in pieces */
+        cloud->statSize = sizeof(Socket::respHead_t) + sizeof(bool) * numOfShares_[cloudIndex];
+        cloud->statBuffer = (char *) malloc(cloud->statSize);
+        cloud->statReceived = 0;
+        cloud->state = UPLOAD_RECEIVING_STAT;
+        
+        /* the server answers after looking up the shares, so the socket is not tried until it is ready */
+        cloud->blocked = true;
+        return true;
+    }
     
-    /* 2nd get back the status list */
-    int numOfshares;
-    bool *statusList = (bool *) malloc(sizeof(bool) * (numOfShares_[cloudIndex] + 1));
-    socketArray_[cloudIndex]->getStatus(statusList, &numOfshares);
+    if ((ret = socketArray_[cloudIndex]->tryRecv(cloud->statBuffer, cloud->statSize, &cloud->statReceived)) == -1) {
+        fprintf(stderr, "fail to upload to cloud %d\n", cloudIndex);
+        exit(1);
+    }
+    if (ret == 0) {
+        cloud->blocked = true;
+        return false;
+    }
+    Socket::respHead_t *head = (Socket::respHead_t *) cloud->statBuffer;
+    if ((head->indicator != GET_STAT && head->indicator != GET_STAT_STALE) || head->size != (uint32_t) numOfShares_[cloudIndex]) {
+        fprintf(stderr, "Status wrong %d from cloud %d\n", head->indicator, cloudIndex);
+        exit(1);
+    }
+    if (head->indicator == GET_STAT_STALE && fpCache_[cloudIndex] != NULL && !staleCache_[cloudIndex]) {
+        fprintf(stderr, "cloud %d does not store some shares in the fingerprint cache, the cache is cleared\n", cloudIndex);
+        staleCache_[cloudIndex] = true;
+        fpCache_[cloudIndex]->clear();
+    }
+    bool *statusList = (bool *) (cloud->statBuffer + sizeof(Socket::respHead_t));
     
-    /* 3rd according to status list, reconstruct the container buffer */
-    char temp[RING_BUFFER_DATA_SIZE];
+    /* 3rd according to status list, gather the unique shares where they are in the container buffer */
+    struct iovec *iov = cloud->iovList + 1;
+    int numOfIov = 0;
     int indexCount = 0;
     int containerIndex = 0;
     int currentSize = 0;
-    for (int i = 0; i < numOfshares; i++) {
+    for (int i = 0; i < numOfShares_[cloudIndex]; i++) {
         currentSize = shareSizeArray_[cloudIndex][i];
         if (statusList[i] == 0) {
-            memcpy(temp, uploadContainer_[cloudIndex] + containerIndex, currentSize);
-            memcpy(uploadContainer_[cloudIndex] + indexCount, temp, currentSize);
+            /* unique shares next to each other are sent as one buffer */
+            if (numOfIov > 0 &&
+                (char *) iov[numOfIov - 1].iov_base + iov[numOfIov - 1].iov_len == uploadContainer_[cloudIndex] + containerIndex) {
+                iov[numOfIov - 1].iov_len += currentSize;
+            } else {
+                iov[numOfIov].iov_base = uploadContainer_[cloudIndex] + containerIndex;
+                iov[numOfIov].iov_len = currentSize;
+                numOfIov++;
+            }
             indexCount += currentSize;
         }
         containerIndex += currentSize;
@@ -228,15 +497,83 @@ int Uploader::performUpload(int cloudIndex, int userID, uint32_t sharenum) {
     accuData_[cloudIndex] += containerIndex;
     accuUnique_[cloudIndex] += indexCount;
     
-    /* finally send the unique data to the cloud */
-    socketArray_[cloudIndex]->sendData(uploadContainer_[cloudIndex], indexCount, userID);
+    /* finally send the unique data to the cloud, with its header in the same call */
+    Socket::setDataHead(&cloud->dataHead, indexCount, userID);
+    cloud->iovList[0].iov_base = &cloud->dataHead;
+    cloud->iovList[0].iov_len = sizeof(cloud->dataHead);
+    cloud->iov = cloud->iovList;
+    cloud->iovcnt = numOfIov + 1;
+    cloud->state = UPLOAD_SENDING_DATA;
+    progressUpload(cloudIndex, userID);
+    return true;
+}
+
+/*
+ * the server has got the container buffer, so the next one is filled
+ *
+ * @param cloudIndex - indicate targeting cloud
+ *
+ */
+void Uploader::finishUpload(int cloudIndex) {
+    cloudState_t *cloud = &cloudState_[cloudIndex];
     
-    free(statusList);
-    return 0;
+    /* the server stores all the shares now, unless it has lost some of the cached ones */
+    if (cloud->metaHead.indicator == SEND_META_BATCH && fpCache_[cloudIndex] != NULL && !staleCache_[cloudIndex]) {
+        char *fileMeta = uploadMetaBuffer_[cloudIndex];
+        for (uint32_t i = 0; i < cloud->metaHead.sharenum; i++) {
+            fileShareMDHead_t *header = (fileShareMDHead_t *) (fileMeta + sizeof(uint32_t));
+            shareMDEntry_t *entry = (shareMDEntry_t *) (fileMeta + sizeof(uint32_t) + fileMDHeadSize_ + header->fullNameSize);
+            for (int j = 0; j < header->numOfComingSecrets; j++) {
+                fpCache_[cloudIndex]->insert(entry[j].shareFP);
+            }
+            fileMeta = (char *) (entry + header->numOfComingSecrets);
+        }
+    }
+    
+    free(cloud->iovList);
+    free(cloud->statBuffer);
+    cloud->iovList = NULL;
+    cloud->statBuffer = NULL;
+    
+    if (cloud->last) {
+        cloud->state = UPLOAD_DONE;
+    } else {
+        updateHeader(cloudIndex);
+        cloud->state = UPLOAD_FILLING;
+    }
 }
 
 /*
- * procedure for update headers when upload finished
+ * register the events of the socket of a cloud that its state waits for, if it is blocked
+ *
+ * @param cloudIndex - indicate targeting cloud
+ *
+ */
+void Uploader::watchSocket(int cloudIndex) {
+    cloudState_t *cloud = &cloudState_[cloudIndex];
+    uint32_t events = 0;
+    if (cloud->blocked && (cloud->state == UPLOAD_SENDING_META || cloud->state == UPLOAD_SENDING_DATA ||
+                           cloud->state == UPLOAD_SENDING_QUERY)) {
+        events = EPOLLOUT;
+    } else if (cloud->blocked && (cloud->state == UPLOAD_RECEIVING_STAT || cloud->state == UPLOAD_RECEIVING_PROGRESS)) {
+        events = EPOLLIN;
+    }
+    if (events == cloud->events) {
+        return;
+    }
+    
+    struct epoll_event event;
+    event.events = events;
+    event.data.u32 = cloudIndex;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, socketArray_[cloudIndex]->getSock(), &event) == -1) {
+        fprintf(stderr, "Error watching socket %d\n", errno);
+    }
+    cloud->events = events;
+}
+
+/*
+ * procedure for update headers when upload finished, where the metadata of a file with
+ * more shares to come is carried to the next container buffer
  *
  * @param cloudIndex - indicating targeting cloud
  *
@@ -244,6 +581,20 @@ int Uploader::performUpload(int cloudIndex, int userID, uint32_t sharenum) {
  *
  */
 int Uploader::updateHeader(int cloudIndex) {
+    cloudState_t *cloud = &cloudState_[cloudIndex];
+    
+    /* reset all index (means buffers are empty) */
+    containerWP_[cloudIndex] = 0;
+    metaWP_[cloudIndex] = 0;
+    numOfShares_[cloudIndex] = 0;
+    numOfCached_[cloudIndex] = 0;
+    cloud->numOfFiles = 0;
+    
+    /* a complete file is not carried */
+    if (!cloud->fileOpen) {
+        return 1;
+    }
+    
     /* get the file name size */
     int offset = headerArray_[cloudIndex]->fullNameSize;
     
@@ -255,20 +606,120 @@ int Uploader::updateHeader(int cloudIndex) {
     headerArray_[cloudIndex]->numOfComingSecrets = 0;
     headerArray_[cloudIndex]->sizeOfComingSecrets = 0;
     
-    /* reset all index (means buffers are empty) */
-    containerWP_[cloudIndex] = 0;
-    metaWP_[cloudIndex] = 0;
-    numOfShares_[cloudIndex] = 0;
-    
-    /* copy the header into metabuffer */
-    memcpy(uploadMetaBuffer_[cloudIndex], headerArray_[cloudIndex], fileMDHeadSize_ + offset);
-    metaWP_[cloudIndex] += fileMDHeadSize_ + offset;
+    /* move the metadata of the file, with the total number of its shares, to the front of metabuffer */
+    memmove(uploadMetaBuffer_[cloudIndex], uploadMetaBuffer_[cloudIndex] + cloud->fileOffset, sizeof(uint32_t) + fileMDHeadSize_ + offset);
+    headerArray_[cloudIndex] = (fileShareMDHead_t *) (uploadMetaBuffer_[cloudIndex] + sizeof(uint32_t));
+    metaWP_[cloudIndex] += sizeof(uint32_t) + fileMDHeadSize_ + offset;
+    cloud->fileOffset = 0;
+    cloud->numOfFiles = 1;
     
     return 1;
 }
 
 /*
- * interface for adding object to ringbuffer
+ * ask each cloud how many secrets of a file it has accepted in an unfinished upload before,
+ * so that the upload is resumed from there
+ *
+ * @param nameShares - the shares of the file name, one after another
+ * @param nameShareSize - the size of a share of the file name
+ * @param fileSize - the size of the file
+ * @param numOfShares - the total number of shares of the file
+ * @param contentDigest - the digest of the file content, which must match that of the unfinished upload
+ * @param accepted - the number of accepted secrets of each cloud, 0 to upload the file from the start <return>
+ *
+ */
+void Uploader::queryProgress(unsigned char *nameShares, int nameShareSize, long fileSize, uint32_t numOfShares,
+                             uint64_t contentDigest, int userID, int *accepted) {
+    /* a request is the metadata of the file without shares: [total number of shares + file header + file name share] */
+    int requestSize = sizeof(uint32_t) + fileMDHeadSize_ + nameShareSize;
+    if (requestSize * total_ > progressRequestSize_) {
+        progressRequestSize_ = requestSize * total_;
+        progressRequest_ = (char *) realloc(progressRequest_, progressRequestSize_);
+    }
+    fileShareMDHead_t header;
+    memset(&header, 0, sizeof(header));
+    header.fullNameSize = nameShareSize;
+    header.fileSize = fileSize;
+    header.contentDigest = contentDigest;
+    
+    __atomic_store_n(&pendingQueries_, total_, __ATOMIC_RELAXED);
+    for (int i = 0; i < total_; i++) {
+        cloudState_t *cloud = &cloudState_[i];
+        char *request = progressRequest_ + i * requestSize;
+        memcpy(request, &numOfShares, sizeof(uint32_t));
+        memcpy(request + sizeof(uint32_t), &header, fileMDHeadSize_);
+        memcpy(request + sizeof(uint32_t) + fileMDHeadSize_, nameShares + i * nameShareSize, nameShareSize);
+        
+        cloud->queryHead.userID = userID;
+        cloud->queryHead.indicator = GET_UPLOAD_PROGRESS;
+        cloud->queryHead.size = requestSize;
+        cloud->queryIov[0].iov_base = &cloud->queryHead;
+        cloud->queryIov[0].iov_len = sizeof(cloud->queryHead);
+        cloud->queryIov[1].iov_base = request;
+        cloud->queryIov[1].iov_len = requestSize;
+        __atomic_store_n(&cloud->queryPending, true, __ATOMIC_RELEASE);
+    }
+    wakeUp();
+    queryDone_.wait([&]() { return __atomic_load_n(&pendingQueries_, __ATOMIC_ACQUIRE) == 0; });
+    
+    /* a cloud may be asked for a file it has finished, or has never seen */
+    for (int i = 0; i < total_; i++) {
+        accepted[i] = progressAccepted_[i];
+        if (accepted[i] < 0 || accepted[i] >= (int) numOfShares) {
+            accepted[i] = 0;
+        }
+    }
+}
+
+/*
+ * move the progress request of a cloud on, which is sent between two uploads over the same connection
+ *
+ * @param cloudIndex - indicate targeting cloud
+ *
+ * @return whether the request has moved on
+ */
+bool Uploader::progressQuery(int cloudIndex) {
+    cloudState_t *cloud = &cloudState_[cloudIndex];
+    int ret;
+    
+    if (cloud->state == UPLOAD_SENDING_QUERY) {
+        if ((ret = socketArray_[cloudIndex]->trySendv(&cloud->iov, &cloud->iovcnt)) == -1) {
+            fprintf(stderr, "fail to ask cloud %d for the upload progress\n", cloudIndex);
+            exit(1);
+        }
+        if (ret == 0) {
+            cloud->blocked = true;
+            return false;
+        }
+        cloud->statReceived = 0;
+        cloud->state = UPLOAD_RECEIVING_PROGRESS;
+        cloud->blocked = true;
+        return true;
+    }
+    
+    if ((ret = socketArray_[cloudIndex]->tryRecv(cloud->progress, sizeof(cloud->progress), &cloud->statReceived)) == -1) {
+        fprintf(stderr, "fail to ask cloud %d for the upload progress\n", cloudIndex);
+        exit(1);
+    }
+    if (ret == 0) {
+        cloud->blocked = true;
+        return false;
+    }
+    Socket::respHead_t *head = (Socket::respHead_t *) cloud->progress;
+    if (head->indicator != RESP_UPLOAD_PROGRESS || head->size != sizeof(int)) {
+        fprintf(stderr, "Progress wrong %d from cloud %d\n", head->indicator, cloudIndex);
+        exit(1);
+    }
+    memcpy(&progressAccepted_[cloudIndex], cloud->progress + sizeof(Socket::respHead_t), sizeof(int));
+    cloud->state = UPLOAD_FILLING;
+    __atomic_fetch_sub(&pendingQueries_, 1, __ATOMIC_RELEASE);
+    queryDone_.notify();
+    return true;
+}
+
+/*
+ * interface for adding object to ringbuffer,
+ * and the uploader releases the slice of the object once it is buffered
  *
  * @param item - the object to be added
  * @param size - the size of the object
@@ -277,20 +728,74 @@ int Uploader::updateHeader(int cloudIndex) {
  */
 int Uploader::add(Item_t *item, int size, int index) {
     ringBuffer_[index]->Insert(item, size);
+    wakeUp();
+    return 1;
+}
+
+/*
+ * wake up the upload thread if it sleeps, once per sleep
+ */
+void Uploader::wakeUp() {
+    if (__atomic_load_n(&sleeping_, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&sleeping_, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (write(eventFd_, &one, sizeof(one)) == -1) {
+            fprintf(stderr, "Error signalling event fd %d\n", errno);
+        }
+    }
+}
+
+/*
+ * get the amount of share data copied by the upload thread, after the end of uploading
+ *
+ * @return copied - the amount of data copied into the container buffers sent with their status lists
+ *
+ */
+int Uploader::getCopyStats(long long *copied) {
+    *copied = 0;
+    for (int i = 0; i < total_; i++) {
+        /* the data of a cached upload is copied into its container buffer but not sent */
+        *copied += accuCopied_[i] - accuCachedData_[i];
+    }
     return 1;
 }
 
 /*
- * indicate the end of uploading a file
+ * get the uploads sent without waiting for the status list, after the end of uploading
  *
- * @return total - total amount of data that input to uploader
+ * @return uploads - the number of uploads
+ * @return cached - the number of uploads whose shares are all found in the fingerprint caches
+ * @return cachedData - the amount of share data of those uploads, which is not sent
+ *
+ * @return 0 if the servers stored the files, or -1 if a server reports cached shares that are not stored,
+ *         whose cache is then cleared for uploading the files again
+ */
+int Uploader::getCacheStats(long long *uploads, long long *cached, long long *cachedData) {
+    int ret = 0;
+    *uploads = 0;
+    *cached = 0;
+    *cachedData = 0;
+    for (int i = 0; i < total_; i++) {
+        *uploads += accuUploads_[i];
+        *cached += accuCachedUploads_[i];
+        *cachedData += accuCachedData_[i];
+        if (staleCache_[i]) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/*
+ * indicate the end of uploading the session
+ *
+ * @return total - total amount of data that input to uploader, except that of the cached uploads
  * @return uniq - the amount of unique data that transferred in network
  *
  */
 int Uploader::indicateEnd(long long *total, long long *uniq) {
     int i;
-    for (i = 0; i < UPLOAD_NUM_THREADS; i++) {
-        pthread_join(tid_[i], NULL);
+    pthread_join(tid_, NULL);
+    for (i = 0; i < total_; i++) {
         *total += accuData_[i];
         *uniq += accuUnique_[i];
     }
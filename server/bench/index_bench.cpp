@@ -0,0 +1,242 @@
+/**
+ * @brief micro benchmark for the share index engines, in the manner of LevelDB's db_bench. \n
+ * Keys are share-index-shaped (a SHARE_INDEX prefix followed by a random 32-byte fingerprint),
+ * and values are a share index head with a single user reference entry.
+ * The hash table engine is also reopened from a crash image, whose slots are newer than the heap tail in its head,
+ * and every entry is checked after new entries are put into the reopened table.
+ * usage: index_bench [--engine=leveldb|hash table|all] [--num=N] [--dir=DIR]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "backend/backend_facade.hpp"
+#include "backend/hash_table_engine.hpp"
+#include "backend/index_engine.hpp"
+#include "backend/leveldb_engine.hpp"
+#include "def/config.hpp"
+#include "def/struct.hpp"
+
+namespace {
+using namespace dedup;
+using clock_t_ = std::chrono::steady_clock;
+using value_t = std::array<std::byte, SHARE_INDEX_HEAD_SIZE + SHARE_USER_REF_ENTRY_SIZE>;
+
+struct benchOption_t {
+    std::vector<std::string> engines{"leveldb", "hash table"};
+    std::size_t num{1000000};
+    std::string dir{"./index-bench/"};
+};
+
+std::vector<dedup::key_t> GenerateKeys(std::size_t num, std::mt19937_64 &rng) {
+    std::vector<dedup::key_t> keys(num);
+    for (auto &key : keys) {
+        key[0] = static_cast<std::byte>(BackendFacade::IndexPrefix::SHARE_INDEX);
+        for (std::size_t i = 1; i < key.size(); i += sizeof(uint64_t)) {
+            auto r = rng();
+            std::memcpy(key.data() + i, &r, std::min(sizeof(r), key.size() - i));
+        }
+    }
+    return keys;
+}
+
+std::unique_ptr<IndexEngine> OpenEngine(const std::string &name, const std::string &dir) {
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    if (name == "leveldb") {
+        return std::make_unique<LevelDBEngine>(dir);
+    } else if (name == "hash table") {
+        return std::make_unique<HashTableEngine>(dir, config::GetHashTableInitCapacity(), config::GetHashTableWalLimit());
+    }
+    throw std::invalid_argument{"unknown engine: " + name};
+}
+
+/**
+ * @brief run an operation for every key, and report the throughput and the latency percentiles
+ */
+template <typename Op>
+void Run(const std::string &engine, const std::string &name, const std::vector<dedup::key_t> &keys, Op &&op) {
+    std::vector<uint64_t> latencies(keys.size());
+    auto begin = clock_t_::now();
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        auto opBegin = clock_t_::now();
+        op(i, bytes_view{keys[i].data(), keys[i].size()});
+        latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t_::now() - opBegin).count();
+    }
+    auto total = std::chrono::duration<double, std::micro>(clock_t_::now() - begin).count();
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return static_cast<double>(latencies[static_cast<std::size_t>(p * static_cast<double>(latencies.size() - 1))]) /
+               1000;
+    };
+    std::cout << std::left << std::setw(12) << engine << std::setw(14) << name << std::right << std::fixed
+              << std::setprecision(3) << std::setw(10) << total / static_cast<double>(keys.size()) << " micros/op"
+              << std::setprecision(0) << std::setw(12) << static_cast<double>(keys.size()) * 1e6 / total << " ops/s"
+              << std::setprecision(3) << "  p50 " << percentile(0.5) << " us  p99 " << percentile(0.99) << " us"
+              << std::endl;
+}
+
+void Bench(const std::string &engineName, const benchOption_t &option) {
+    std::mt19937_64 rng{301};
+    auto keys = GenerateKeys(option.num, rng);
+    auto missingKeys = GenerateKeys(option.num, rng);
+    auto engine = OpenEngine(engineName, option.dir);
+
+    const auto kBatchSize = boost::numeric_cast<std::size_t>(config::GetBatchSize());
+    value_t value{};
+    auto &head = *reinterpret_cast<shareIndexHead_t *>(value.data());
+    head.numOfUsers = 1;
+    // flush in the same batch granularity as the dedup path does
+    Run(engineName, "fillrandom", keys, [&](std::size_t i, const bytes_view &key) {
+        head.shareSize = static_cast<decltype(head.shareSize)>(i);
+        engine->put(key, {value.data(), value.size()});
+        if (kBatchSize > 0 && (i + 1) % kBatchSize == 0) {
+            engine->flush();
+        }
+    });
+    engine->flush();
+
+    auto shuffled = keys;
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+    std::size_t found{0};
+    Run(engineName, "readrandom", shuffled, [&](std::size_t, const bytes_view &key) {
+        found += engine->get(key).has_value();
+    });
+    Run(engineName, "readmissing", missingKeys, [&](std::size_t, const bytes_view &key) {
+        found += engine->get(key).has_value();
+    });
+    if (found != keys.size()) {
+        std::cerr << "unexpected number of found keys: " << found << " (expected " << keys.size() << ")" << std::endl;
+    }
+    // update every entry, as appending a user reference does on the dedup path
+    Run(engineName, "overwrite", shuffled, [&](std::size_t i, const bytes_view &key) {
+        engine->put(key, {value.data(), value.size()});
+        if (kBatchSize > 0 && (i + 1) % kBatchSize == 0) {
+            engine->flush();
+        }
+    });
+    engine->flush();
+
+    engine.reset();
+    std::filesystem::remove_all(option.dir);
+}
+/**
+ * @brief reopen a hash table from a crash image taken after a flush, whose head is the one synced by the last
+ * checkpoint with the clean flag cleared, but whose slots and heap hold the entries put since, and check that the
+ * entries put after the reopen do not overwrite them
+ * @return whether all the entries are intact
+ */
+bool Recover(const benchOption_t &option) {
+    // layout of the head of the slot table file: magic, capacity, size, heap tail, clean flag
+    using table_head_t = std::array<uint64_t, 5>;
+    constexpr std::size_t kCleanField{4};
+    const std::string kTableFile{"index.tbl"};
+    const auto kCrashDir = option.dir + "crash/";
+    const auto kNum = std::max<std::size_t>(option.num / 4, 1);
+    std::mt19937_64 rng{302};
+    auto keys = GenerateKeys(kNum * 3, rng);
+
+    value_t value{};
+    auto &head = *reinterpret_cast<shareIndexHead_t *>(value.data());
+    head.numOfUsers = 1;
+    auto putRange = [&](IndexEngine &engine, std::size_t first, std::size_t last) {
+        for (auto i = first; i < last; ++i) {
+            head.shareSize = static_cast<decltype(head.shareSize)>(i);
+            engine.put({keys[i].data(), keys[i].size()}, {value.data(), value.size()});
+        }
+        engine.flush();
+    };
+    auto readHead = [](const std::string &path) {
+        table_head_t tableHead{};
+        std::ifstream{path, std::ios::binary}.read(reinterpret_cast<char *>(tableHead.data()), sizeof(tableHead));
+        return tableHead;
+    };
+
+    // the first entries are synced by the checkpoint on open, and the next ones only by the log
+    auto engine = OpenEngine("hash table", option.dir);
+    putRange(*engine, 0, kNum);
+    engine.reset();
+    engine = std::make_unique<HashTableEngine>(option.dir, config::GetHashTableInitCapacity(),
+                                               config::GetHashTableWalLimit());
+    auto checkpointHead = readHead(option.dir + kTableFile);
+    putRange(*engine, kNum, kNum * 2);
+    std::filesystem::create_directories(kCrashDir);
+    for (const auto &entry : std::filesystem::directory_iterator{option.dir}) {
+        if (entry.is_regular_file()) {
+            std::filesystem::copy_file(entry.path(), kCrashDir + entry.path().filename().string());
+        }
+    }
+    engine.reset();
+    // the engine syncs the cleared clean flag before it changes the slots and the heap
+    checkpointHead[kCleanField] = 0;
+    std::fstream{kCrashDir + kTableFile, std::ios::binary | std::ios::in | std::ios::out}.write(
+        reinterpret_cast<const char *>(checkpointHead.data()), sizeof(checkpointHead));
+
+    auto begin = clock_t_::now();
+    HashTableEngine recovered{kCrashDir, config::GetHashTableInitCapacity(), config::GetHashTableWalLimit()};
+    auto total = std::chrono::duration<double, std::milli>(clock_t_::now() - begin).count();
+    putRange(recovered, kNum * 2, kNum * 3);
+    std::size_t numOfBad{0};
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        auto valueOpt = recovered.get({keys[i].data(), keys[i].size()});
+        if (!valueOpt || valueOpt->size() != value.size() ||
+            reinterpret_cast<const shareIndexHead_t *>(valueOpt->data())->shareSize !=
+                static_cast<decltype(head.shareSize)>(i)) {
+            numOfBad++;
+        }
+    }
+    std::cout << std::left << std::setw(12) << "hash table" << std::setw(14) << "recover" << std::right << std::fixed
+              << std::setprecision(3) << std::setw(10) << total << " millis" << std::setw(12) << numOfBad
+              << " bad entries" << std::endl;
+    std::filesystem::remove_all(option.dir);
+    return numOfBad == 0;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    benchOption_t option{};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg{argv[i]};
+        if (arg.rfind("--engine=", 0) == 0) {
+            auto engine = arg.substr(std::string{"--engine="}.size());
+            if (engine != "all") {
+                option.engines = {engine};
+            }
+        } else if (arg.rfind("--num=", 0) == 0) {
+            option.num = std::stoul(arg.substr(std::string{"--num="}.size()));
+        } else if (arg.rfind("--dir=", 0) == 0) {
+            option.dir = arg.substr(std::string{"--dir="}.size());
+            if (option.dir.back() != '/') {
+                option.dir.push_back('/');
+            }
+        } else {
+            std::cout << "usage: index_bench [--engine=leveldb|hash table|all] [--num=N] [--dir=DIR]" << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << "keys: " << option.num << ", key size: " << KEY_SIZE << " bytes, value size: " << sizeof(value_t)
+              << " bytes, batch size: " << config::GetBatchSize() << '\n'
+              << std::string(80, '-') << std::endl;
+    try {
+        for (const auto &engine : option.engines) {
+            Bench(engine, option);
+            if (engine == "hash table" && !Recover(option)) {
+                std::cerr << "the hash table is corrupted after the recovery" << std::endl;
+                return -1;
+            }
+        }
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
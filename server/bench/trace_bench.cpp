@@ -0,0 +1,464 @@
+/**
+ * @brief offline trace-replay benchmark for DedupCore. \n
+ * A trace is a sequence of share records, each of which is one of
+ * - a unique share with random content,
+ * - a duplicate of a previous share, or
+ * - a similar share, which is a previous unique share with a few mutated bytes (a delta compression candidate). \n
+ * The trace is grouped into files owned by a number of users, and replayed in-process through firstStageDedup,
+ * secondStageDedup and restoreShareFile, the same way the services drive DedupCore.
+ * Only the time spent in DedupCore is counted in the throughput, i.e. share generation and fingerprinting,
+ * which the client does in a real deployment, are excluded.
+ * usage: trace_bench [options], see Usage() for the options
+ */
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dedup/dedup_core.hpp"
+#include "def/benchmark.hpp"
+#include "def/config.hpp"
+#include "def/struct.hpp"
+#include "def/util.hpp"
+#include "third_party/crypto_primitive.hpp"
+
+namespace {
+using namespace dedup;
+using clock_t_ = std::chrono::steady_clock;
+
+enum class share_type_e : uint8_t {
+    UNIQUE = 0,
+    DUPLICATE = 1,
+    SIMILAR = 2,
+};
+
+/// a share in the trace, whose content is generated from the seed (and the referred share)
+struct traceRecord_t {
+    share_type_e type;
+    uint32_t size;
+    uint64_t seed;
+    /// index of the referred share for DUPLICATE and SIMILAR shares, which is never a DUPLICATE share
+    uint64_t ref;
+};
+
+struct traceHead_t {
+    uint64_t magic;
+    uint64_t numOfShares;
+    uint32_t numOfUsers;
+    uint32_t sharesPerFile;
+};
+
+constexpr uint64_t TRACE_MAGIC{0x6563617274707564}; // "duptrace"
+
+struct benchOption_t {
+    std::string config{"./config.json"};
+    std::size_t numOfShares{100000};
+    uint32_t numOfUsers{4};
+    uint32_t sharesPerFile{1024};
+    /// number of shares in a file share fragment, i.e. a firstStageDedup/secondStageDedup call
+    uint32_t batch{256};
+    double dupRatio{0.3};
+    double similarRatio{0.2};
+    /// ratio of the mutated bytes in a similar share
+    double mutationRatio{0.01};
+    /// share size distribution: fixed:<size>, uniform:<min>:<max> or normal:<mean>:<stddev>
+    std::string sizeDist{"fixed:8192"};
+    uint64_t seed{301};
+    bool restore{true};
+    std::string loadTrace{};
+    std::string saveTrace{};
+};
+
+void Usage() {
+    std::cout << "usage: trace_bench [options]\n"
+                 "\t--config=FILE         server config file, whose directories are used (default ./config.json)\n"
+                 "\t--shares=N            number of shares in the trace (default 100000)\n"
+                 "\t--users=N             number of users (default 4)\n"
+                 "\t--shares-per-file=N   number of shares in a file (default 1024)\n"
+                 "\t--batch=N             number of shares in a file share fragment (default 256)\n"
+                 "\t--dup-ratio=R         ratio of the duplicate shares (default 0.3)\n"
+                 "\t--similar-ratio=R     ratio of the similar shares (default 0.2)\n"
+                 "\t--mutation-ratio=R    ratio of the mutated bytes in a similar share (default 0.01)\n"
+                 "\t--size=DIST           share size distribution, fixed:S, uniform:MIN:MAX or normal:MEAN:STDDEV\n"
+                 "\t                      (default fixed:8192)\n"
+                 "\t--seed=N              random seed (default 301)\n"
+                 "\t--no-restore          skip restoring the files\n"
+                 "\t--load-trace=FILE     replay a saved trace instead of generating one\n"
+                 "\t--save-trace=FILE     save the generated trace"
+              << std::endl;
+}
+
+class Trace {
+private:
+    traceHead_t head_{};
+    std::vector<traceRecord_t> records_{};
+
+    /// fill the buffer with random content generated from the seed
+    static void Fill(uint64_t seed, mutable_bytes_view data) {
+        std::mt19937_64 rng{seed};
+        for (std::size_t i = 0; i < data.size(); i += sizeof(uint64_t)) {
+            auto r = rng();
+            std::memcpy(data.data() + i, &r, std::min(sizeof(r), data.size() - i));
+        }
+    }
+
+public:
+    static Trace Generate(const benchOption_t &option) {
+        Trace trace{};
+        trace.head_ = {TRACE_MAGIC, option.numOfShares, option.numOfUsers, option.sharesPerFile};
+        trace.records_.reserve(option.numOfShares);
+
+        std::mt19937_64 rng{option.seed};
+        std::uniform_real_distribution<double> ratioDist{0, 1};
+        // parse the size distribution
+        std::vector<std::string> sizeArgs{};
+        std::stringstream sizeStream{option.sizeDist};
+        for (std::string arg{}; std::getline(sizeStream, arg, ':');) {
+            sizeArgs.push_back(arg);
+        }
+        std::function<uint32_t()> sizeGen{};
+        if (sizeArgs.size() == 2 && sizeArgs[0] == "fixed") {
+            sizeGen = [size = std::stoul(sizeArgs[1])]() { return size; };
+        } else if (sizeArgs.size() == 3 && sizeArgs[0] == "uniform") {
+            sizeGen = [&rng, dist = std::uniform_int_distribution<uint32_t>(std::stoul(sizeArgs[1]),
+                                                                            std::stoul(sizeArgs[2]))]() mutable {
+                return dist(rng);
+            };
+        } else if (sizeArgs.size() == 3 && sizeArgs[0] == "normal") {
+            sizeGen = [&rng, dist = std::normal_distribution<double>(std::stod(sizeArgs[1]),
+                                                                     std::stod(sizeArgs[2]))]() mutable {
+                return static_cast<uint32_t>(std::clamp(dist(rng), 64.0, 1.0 * (1 << 20)));
+            };
+        } else {
+            throw std::invalid_argument{"invalid share size distribution: " + option.sizeDist};
+        }
+
+        std::vector<uint64_t> uniqueShares{};
+        for (uint64_t i = 0; i < option.numOfShares; ++i) {
+            auto p = ratioDist(rng);
+            traceRecord_t record{share_type_e::UNIQUE, 0, rng(), 0};
+            if (!uniqueShares.empty() && p < option.dupRatio) {
+                // duplicate of any previous share, referring to its content source
+                record.type = share_type_e::DUPLICATE;
+                auto &refRecord = trace.records_[std::uniform_int_distribution<uint64_t>(0, i - 1)(rng)];
+                record.ref = refRecord.type == share_type_e::DUPLICATE
+                                 ? refRecord.ref
+                                 : static_cast<uint64_t>(&refRecord - trace.records_.data());
+                record.size = trace.records_[record.ref].size;
+            } else if (!uniqueShares.empty() && p < option.dupRatio + option.similarRatio) {
+                record.type = share_type_e::SIMILAR;
+                record.ref = uniqueShares[std::uniform_int_distribution<std::size_t>(0, uniqueShares.size() - 1)(rng)];
+                record.size = trace.records_[record.ref].size;
+            } else {
+                record.size = sizeGen();
+                uniqueShares.push_back(i);
+            }
+            trace.records_.push_back(record);
+        }
+        return trace;
+    }
+
+    static Trace Load(const std::string &fileName) {
+        std::ifstream file{fileName, std::ios::binary};
+        Trace trace{};
+        file.read(reinterpret_cast<char *>(&trace.head_), sizeof(trace.head_));
+        if (!file || trace.head_.magic != TRACE_MAGIC) {
+            throw std::invalid_argument{"invalid trace file: " + fileName};
+        }
+        trace.records_.resize(trace.head_.numOfShares);
+        file.read(reinterpret_cast<char *>(trace.records_.data()),
+                  boost::numeric_cast<std::streamsize>(trace.records_.size() * sizeof(traceRecord_t)));
+        if (!file) {
+            throw std::invalid_argument{"truncated trace file: " + fileName};
+        }
+        return trace;
+    }
+
+    void save(const std::string &fileName) const {
+        std::ofstream file{fileName, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<const char *>(&head_), sizeof(head_));
+        file.write(reinterpret_cast<const char *>(records_.data()),
+                   boost::numeric_cast<std::streamsize>(records_.size() * sizeof(traceRecord_t)));
+    }
+
+    [[nodiscard]] const traceHead_t &head() const {
+        return head_;
+    }
+
+    [[nodiscard]] const traceRecord_t &record(std::size_t index) const {
+        return records_[index];
+    }
+
+    /**
+     * @brief generate the content of a share
+     */
+    void content(std::size_t index, std::vector<std::byte> &data, double mutationRatio) const {
+        const auto &record = records_[index];
+        data.resize(record.size);
+        switch (record.type) {
+        case share_type_e::UNIQUE:
+            Fill(record.seed, data);
+            break;
+        case share_type_e::DUPLICATE:
+            content(record.ref, data, mutationRatio);
+            break;
+        case share_type_e::SIMILAR: {
+            Fill(records_[record.ref].seed, data);
+            // mutate a few short runs of bytes
+            std::mt19937_64 rng{record.seed};
+            auto mutations = std::max<std::size_t>(1, static_cast<std::size_t>(record.size * mutationRatio));
+            for (std::size_t done = 0; done < mutations;) {
+                auto offset = std::uniform_int_distribution<std::size_t>(0, record.size - 1)(rng);
+                auto len = std::min<std::size_t>({8, record.size - offset, mutations - done});
+                for (std::size_t i = 0; i < len; ++i) {
+                    data[offset + i] = static_cast<std::byte>(rng());
+                }
+                done += len;
+            }
+            break;
+        }
+        }
+    }
+};
+
+/**
+ * @brief look up a benchmark counter by its exported name
+ */
+double Sample(std::string_view name) {
+    for (const auto &sample : Benchmark::MetricSamples()) {
+        if (sample.name == name) {
+            return sample.value;
+        }
+    }
+    return 0;
+}
+
+std::string FileName(std::size_t fileIndex) {
+    return "/trace/file-" + std::to_string(fileIndex);
+}
+
+double ToMBps(uint64_t bytes, clock_t_::duration duration) {
+    auto seconds = std::chrono::duration<double>(duration).count();
+    return seconds == 0 ? 0 : static_cast<double>(bytes) / (1 << 20) / seconds;
+}
+
+/**
+ * @brief upload every file in the trace
+ * @return logical bytes uploaded and time spent in DedupCore
+ */
+std::pair<uint64_t, clock_t_::duration> Upload(DedupCore &core, const Trace &trace, const benchOption_t &option) {
+    const auto &head = trace.head();
+    uint64_t logicalBytes{0};
+    clock_t_::duration coreTime{0};
+    std::vector<std::byte> content{};
+    std::vector<std::byte> metaBuffer{};
+    std::vector<std::byte> dataBuffer{};
+    std::unique_ptr<bool[]> dupStat{std::make_unique<bool[]>(option.batch)};
+    std::vector<std::vector<std::byte>> contents(option.batch);
+
+    for (std::size_t fileBegin = 0, fileIndex = 0; fileBegin < head.numOfShares;
+         fileBegin += head.sharesPerFile, ++fileIndex) {
+        const auto kFileEnd = std::min<std::size_t>(fileBegin + head.sharesPerFile, head.numOfShares);
+        const auto kUserID = boost::numeric_cast<user_id_t>(fileIndex % head.numOfUsers);
+        const auto kFileName = FileName(fileIndex);
+        long fileSize{0};
+        for (auto i = fileBegin; i < kFileEnd; ++i) {
+            fileSize += trace.record(i).size;
+        }
+
+        long sizeOfPastSecrets{0};
+        for (auto fragBegin = fileBegin; fragBegin < kFileEnd; fragBegin += option.batch) {
+            const auto kFragEnd = std::min<std::size_t>(fragBegin + option.batch, kFileEnd);
+            const auto kNumOfShares = kFragEnd - fragBegin;
+
+            // build the file share meta: [head + file name + share meta entries]
+            metaBuffer.resize(FILE_SHARE_META_HEAD_SIZE + kFileName.size() + SHARE_META_ENTRY_SIZE * kNumOfShares);
+            auto &metaHead = *reinterpret_cast<fileShareMetaHead_t *>(metaBuffer.data());
+            metaHead.fullNameSize = boost::numeric_cast<int>(kFileName.size());
+            metaHead.fileSize = fileSize;
+            metaHead.numOfPastSecrets = boost::numeric_cast<int>(fragBegin - fileBegin);
+            metaHead.sizeOfPastSecrets = sizeOfPastSecrets;
+            metaHead.numOfComingSecrets = boost::numeric_cast<int>(kNumOfShares);
+            metaHead.sizeOfComingSecrets = 0;
+            metaHead.contentDigest = 0;
+            std::copy(kFileName.begin(), kFileName.end(),
+                      reinterpret_cast<char *>(metaBuffer.data() + FILE_SHARE_META_HEAD_SIZE));
+            auto entries = reinterpret_cast<shareMetaEntry_t *>(metaBuffer.data() + FILE_SHARE_META_HEAD_SIZE +
+                                                                 kFileName.size());
+            for (std::size_t i = 0; i < kNumOfShares; ++i) {
+                trace.content(fragBegin + i, contents[i], option.mutationRatio);
+                entries[i].shareFP = ToFP(contents[i]);
+                entries[i].secretID = boost::numeric_cast<int>(fragBegin - fileBegin + i);
+                entries[i].secretSize = boost::numeric_cast<int>(contents[i].size());
+                entries[i].shareSize = boost::numeric_cast<int>(contents[i].size());
+                metaHead.sizeOfComingSecrets += entries[i].secretSize;
+            }
+            sizeOfPastSecrets += metaHead.sizeOfComingSecrets;
+            logicalBytes += metaHead.sizeOfComingSecrets;
+
+            // first stage
+            auto begin = clock_t_::now();
+            core.firstStageDedup(kUserID, metaBuffer, {dupStat.get(), kNumOfShares});
+            coreTime += clock_t_::now() - begin;
+
+            // send the shares which are not duplicates for this user
+            dataBuffer.clear();
+            for (std::size_t i = 0; i < kNumOfShares; ++i) {
+                if (!dupStat[i]) {
+                    dataBuffer.insert(dataBuffer.end(), contents[i].begin(), contents[i].end());
+                }
+            }
+
+            // second stage
+            begin = clock_t_::now();
+            core.secondStageDedup(kUserID, metaBuffer, dataBuffer, {dupStat.get(), kNumOfShares},
+                                  kFileEnd - fileBegin);
+            coreTime += clock_t_::now() - begin;
+        }
+    }
+    return {logicalBytes, coreTime};
+}
+
+/**
+ * @brief restore every file in the trace and verify the content
+ * @return restored bytes and time spent in DedupCore
+ */
+std::pair<uint64_t, clock_t_::duration> Restore(DedupCore &core, const Trace &trace, const benchOption_t &option) {
+    const auto &head = trace.head();
+    uint64_t restoredBytes{0};
+    clock_t_::duration flushTime{0};
+    std::vector<std::byte> expected{};
+    auto buffer = std::make_unique<std::byte[]>(config::GetShareFileBufferLen());
+
+    auto begin = clock_t_::now();
+    for (std::size_t fileBegin = 0, fileIndex = 0; fileBegin < head.numOfShares;
+         fileBegin += head.sharesPerFile, ++fileIndex) {
+        const auto kUserID = boost::numeric_cast<user_id_t>(fileIndex % head.numOfUsers);
+        auto nextShare = fileBegin;
+        bool firstFlush{true};
+        core.restoreShareFile(
+            kUserID, FileName(fileIndex), {buffer.get(), config::GetShareFileBufferLen()},
+            [&](std::size_t size) {
+                auto flushBegin = clock_t_::now();
+                // the share entries never straddle two flushes
+                std::size_t offset = firstFlush ? SHARE_FILE_HEAD_SIZE : 0;
+                firstFlush = false;
+                while (offset < size) {
+                    auto &entry = *reinterpret_cast<const shareEntry_t *>(buffer.get() + offset);
+                    offset += SHARE_ENTRY_SIZE;
+                    trace.content(nextShare, expected, option.mutationRatio);
+                    if (entry.shareSize != static_cast<int>(expected.size()) ||
+                        !std::equal(expected.begin(), expected.end(), buffer.get() + offset)) {
+                        throw std::runtime_error{"restored share mismatch: file " + std::to_string(fileIndex) +
+                                                 ", share " + std::to_string(nextShare - fileBegin)};
+                    }
+                    offset += entry.shareSize;
+                    restoredBytes += entry.shareSize;
+                    ++nextShare;
+                }
+                flushTime += clock_t_::now() - flushBegin;
+            });
+    }
+    return {restoredBytes, clock_t_::now() - begin - flushTime};
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    benchOption_t option{};
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg{argv[i]};
+            auto value = arg.substr(arg.find('=') + 1);
+            if (arg.rfind("--config=", 0) == 0) {
+                option.config = value;
+            } else if (arg.rfind("--shares=", 0) == 0) {
+                option.numOfShares = std::stoul(value);
+            } else if (arg.rfind("--users=", 0) == 0) {
+                option.numOfUsers = std::stoul(value);
+            } else if (arg.rfind("--shares-per-file=", 0) == 0) {
+                option.sharesPerFile = std::stoul(value);
+            } else if (arg.rfind("--batch=", 0) == 0) {
+                option.batch = std::stoul(value);
+            } else if (arg.rfind("--dup-ratio=", 0) == 0) {
+                option.dupRatio = std::stod(value);
+            } else if (arg.rfind("--similar-ratio=", 0) == 0) {
+                option.similarRatio = std::stod(value);
+            } else if (arg.rfind("--mutation-ratio=", 0) == 0) {
+                option.mutationRatio = std::stod(value);
+            } else if (arg.rfind("--size=", 0) == 0) {
+                option.sizeDist = value;
+            } else if (arg.rfind("--seed=", 0) == 0) {
+                option.seed = std::stoull(value);
+            } else if (arg == "--no-restore") {
+                option.restore = false;
+            } else if (arg.rfind("--load-trace=", 0) == 0) {
+                option.loadTrace = value;
+            } else if (arg.rfind("--save-trace=", 0) == 0) {
+                option.saveTrace = value;
+            } else {
+                Usage();
+                return -1;
+            }
+        }
+        if (option.numOfUsers == 0 || option.sharesPerFile == 0 || option.batch == 0) {
+            throw std::invalid_argument{"the number of users, shares per file and batch should be positive"};
+        }
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        Usage();
+        return -1;
+    }
+
+    try {
+        // initialize as the server does, except for the interactive benchmark threads
+        config::Load(option.config, 1);
+        DirInit(config::GetDirClear());
+        DataBase::Init();
+        Delta::Init();
+        crypto_primitive::CryptoPrimitive::OpensslLockSetup();
+
+        auto trace = option.loadTrace.empty() ? Trace::Generate(option) : Trace::Load(option.loadTrace);
+        if (!option.saveTrace.empty()) {
+            trace.save(option.saveTrace);
+        }
+        const auto &head = trace.head();
+        std::cout << "trace: " << head.numOfShares << " shares, " << head.numOfUsers << " users, "
+                  << head.sharesPerFile << " shares per file, batch " << option.batch << std::endl;
+
+        DedupCore core{};
+        auto [logicalBytes, uploadTime] = Upload(core, trace, option);
+
+        auto uniqueCnt = Sample("unique_shares_total");
+        auto duplicateCnt = Sample("duplicate_shares_total");
+        auto deltaCnt = Sample("delta_compressed_shares_total");
+        auto storedBytes = Sample("share_bytes_total");
+        auto totalCnt = uniqueCnt + duplicateCnt + deltaCnt;
+        std::cout << std::fixed << std::setprecision(2) << "[Upload]\n"
+                  << "\tlogical size: " << static_cast<double>(logicalBytes) / (1 << 20) << " MB\n"
+                  << "\tstored size: " << storedBytes / (1 << 20) << " MB\n"
+                  << "\tthroughput: " << ToMBps(logicalBytes, uploadTime) << " MB/s\n"
+                  << "\tdedup ratio: " << (storedBytes == 0 ? 0 : static_cast<double>(logicalBytes) / storedBytes)
+                  << '\n'
+                  << "\tduplicate shares: " << (totalCnt == 0 ? 0 : duplicateCnt * 100 / totalCnt) << "%\n"
+                  << "\tdelta compressed shares: " << (totalCnt == 0 ? 0 : deltaCnt * 100 / totalCnt) << "%\n"
+                  << "\tdelta saved size: " << Sample("delta_compressed_bytes_total") / (1 << 20) << " MB\n"
+                  << Benchmark::Result() << std::endl;
+
+        if (option.restore) {
+            auto [restoredBytes, restoreTime] = Restore(core, trace, option);
+            std::cout << "[Restore]\n"
+                      << "\trestored size: " << static_cast<double>(restoredBytes) / (1 << 20) << " MB (verified)\n"
+                      << "\tthroughput: " << ToMBps(restoredBytes, restoreTime) << " MB/s\n"
+                      << Benchmark::RestoreBenchmarkResult() << std::endl;
+        }
+        crypto_primitive::CryptoPrimitive::OpensslLockCleanup();
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
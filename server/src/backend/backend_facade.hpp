@@ -5,10 +5,17 @@
 #ifndef DEDUP_SERVER_BACKEND_FACADE_HPP
 #define DEDUP_SERVER_BACKEND_FACADE_HPP
 
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <random>
 #include <unordered_map>
 #include <fstream>
+#include <vector>
 
 #include <boost/compute/detail/lru_cache.hpp>
 #include <boost/numeric/conversion/cast.hpp>
@@ -16,6 +23,8 @@
 #include "backend/container.hpp"
 #include "backend/db_wrapper.hpp"
 #include "backend/name_dispenser.hpp"
+#include "backend/recipe_store.hpp"
+#include "def/benchmark.hpp"
 #include "def/exception.hpp"
 #include "def/span.hpp"
 #include "def/struct.hpp"
@@ -24,13 +33,49 @@
 namespace dedup {
 class BackendFacade {
 private:
+    /**
+     * @brief an unfinished recipe file, whose accepted entries are written out in recipe chunks as soon as a chunk is
+     * full, so that only the entries after them are held, which are also checkpointed in its journal
+     */
+    struct unfinishedRecipeFile_t {
+        /// head of the recipe file, with the number of the accepted secrets
+        fileRecipeHead_t head;
+        /// total number of shares for this recipe
+        std::size_t totalNumOfShares;
+        /// generation of the recipe chunks of this upload
+        uint64_t generation;
+        /// number of the entries in the recipe chunks written out, which is a multiple of the chunk size
+        std::size_t numOfSealedShares;
+        /// digest of the content of the file being uploaded, which a resumed upload must match
+        uint64_t contentDigest;
+        /// the accepted entries after the ones in the recipe chunks
+        std::vector<fileRecipeEntry_t> pendingEntries;
+        /// time of the last access, for dropping the abandoned ones
+        std::chrono::steady_clock::time_point lastAccess;
+    };
+
     /**
      * @brief Cache for the unfinished recipe file.
      * The key is the index key for the recipe file.
-     * The value is a pair of the cache buffer and the total number of shares for this recipe, which also indicates the buffer size
      */
-    std::unordered_map<key_t, std::pair<std::unique_ptr<std::byte[]>, std::size_t>> unfinishedRecipeFileCache_;
+    std::unordered_map<key_t, unfinishedRecipeFile_t> unfinishedRecipeFileCache_;
     std::mutex unfinishedRecipeFileCacheMtx_{};
+    /// time of the last sweep of the abandoned unfinished recipe files
+    std::chrono::steady_clock::time_point lastRecipeSweep_{std::chrono::steady_clock::now()};
+    /// source of the generations of the recipe chunks, which is guarded by the unfinished recipe file cache lock
+    std::mt19937_64 recipeGenerationEngine_{std::random_device{}()};
+
+    /// the restores reading a generation of the recipe chunks of a finished recipe file
+    struct recipeGenerationReaders_t {
+        std::size_t numOfReaders;
+        /// whether a new version of the file has replaced this generation, which is erased after the last restore
+        bool retired;
+        /// number of the recipe chunks of this generation
+        std::size_t numOfChunks;
+    };
+    /// the generations being read by the restores, by the keys of the recipe files and the generations, which is
+    /// guarded by the unfinished recipe file cache lock
+    std::map<std::pair<key_t, uint64_t>, recipeGenerationReaders_t> recipeGenerationReaders_{};
 
     NameDispenser containerNameDispenser_{};
     MutableContainer shareContainer_{};
@@ -39,16 +84,17 @@ private:
     std::mutex shareContainerMtx_{};
 
     using caontainer_cache_t = boost::compute::detail::lru_cache<internal_file_name_t, std::shared_ptr<Container>>;
-    caontainer_cache_t readContainerCache_{config::CONTAINER_CACHE_SIZE};
+    caontainer_cache_t readContainerCache_{config::GetContainerCacheSize()};
     std::mutex readContainerCacheMtx_{};
 
-    using recipe_cache_t =
-        boost::compute::detail::lru_cache<key_t, std::pair<std::shared_ptr<std::byte[]>, std::size_t>>;
-    recipe_cache_t recipeCache_{config::RECIPE_CACHE_SIZE};
-    std::mutex recipeCacheMtx_{};
+    /// store of the roots and the recipe chunks of the finished recipe files
+    RecipeStore recipeStore_{static_cast<std::byte>(IndexPrefix::RECIPE_SEGMENT)};
 
     void createShareContainer_() {
-        shareContainerName_ = containerNameDispenser_.get();
+        // the containers of a previous run are kept when the directories are not cleared
+        do {
+            shareContainerName_ = containerNameDispenser_.get();
+        } while (std::filesystem::exists(config::GetContianerDir() + to_string(shareContainerName_)));
         shareContainer_.create(config::GetContianerDir(), shareContainerName_);
         shareContainerOffset_ = 0;
     }
@@ -59,6 +105,291 @@ private:
         return recipeFileName;
     }
 
+    std::string formatRecipeJournalName(const key_t &key) {
+        return config::GetRecipeJournalDir() + ToHexDump(key) + ".rj";
+    }
+
+    /**
+     * @brief load an unfinished recipe file from its journal, with the entries of the secrets accepted before
+     * @param key index key for the recipe file
+     * @return iterator to the loaded unfinished recipe file, or the end iterator if there is no valid journal
+     * @note the unfinished recipe file cache lock should be held
+     */
+    decltype(unfinishedRecipeFileCache_)::iterator loadRecipeJournal_(const key_t &key) {
+        std::ifstream journal{formatRecipeJournalName(key), std::ios::binary | std::ios::ate};
+        if (!journal.is_open()) {
+            return unfinishedRecipeFileCache_.end();
+        }
+        const auto kJournalSize = static_cast<std::size_t>(journal.tellg());
+        recipeJournalHead_t journalHead{};
+        journal.seekg(0);
+        if (kJournalSize < RECIPE_JOURNAL_HEAD_SIZE ||
+            !journal.read(reinterpret_cast<char *>(&journalHead), RECIPE_JOURNAL_HEAD_SIZE) ||
+            journalHead.numOfSealedShares > journalHead.totalNumOfShares) {
+            return unfinishedRecipeFileCache_.end();
+        }
+        // a torn entry at the end was not accepted
+        const auto kNumOfPendingShares =
+            std::min<std::size_t>((kJournalSize - RECIPE_JOURNAL_HEAD_SIZE) / FILE_RECIPE_ENTRY_SIZE,
+                                  journalHead.totalNumOfShares - journalHead.numOfSealedShares);
+        std::vector<fileRecipeEntry_t> pendingEntries(kNumOfPendingShares);
+        if (!journal.read(reinterpret_cast<char *>(pendingEntries.data()),
+                          boost::numeric_cast<std::streamsize>(FILE_RECIPE_ENTRY_SIZE * kNumOfPendingShares))) {
+            return unfinishedRecipeFileCache_.end();
+        }
+        auto fileRecipeHead = journalHead.recipeHead;
+        fileRecipeHead.numOfShares = boost::numeric_cast<int>(journalHead.numOfSealedShares + kNumOfPendingShares);
+        return unfinishedRecipeFileCache_
+            .insert_or_assign(key, unfinishedRecipeFile_t{fileRecipeHead, journalHead.totalNumOfShares,
+                                                          journalHead.generation, journalHead.numOfSealedShares,
+                                                          journalHead.contentDigest, std::move(pendingEntries),
+                                                          std::chrono::steady_clock::now()})
+            .first;
+    }
+
+    /**
+     * @brief checkpoint the pending recipe entries of a file share fragment in the journal of the recipe file
+     * @param key index key for the recipe file
+     * @param recipeFile the unfinished recipe file
+     * @param fileShareMetaHead head of the file share fragment
+     * @param sealed whether recipe chunks were written out for this fragment, after which the journal is rewritten
+     * @note the unfinished recipe file cache lock should be held
+     */
+    void checkpointRecipeFile_(const key_t &key, const unfinishedRecipeFile_t &recipeFile,
+                               const fileShareMetaHead_t &fileShareMetaHead, bool sealed) {
+        auto journalName = formatRecipeJournalName(key);
+        /// index of the first pending entry to write, from which the journal is rewritten if it is missing
+        std::size_t firstEntry = fileShareMetaHead.numOfPastSecrets - recipeFile.numOfSealedShares;
+        std::fstream journal;
+        if (fileShareMetaHead.numOfPastSecrets != 0 && !sealed) {
+            journal.open(journalName, std::ios::in | std::ios::out | std::ios::binary);
+        }
+        if (journal.is_open()) {
+            journal.seekp(RECIPE_JOURNAL_HEAD_SIZE + static_cast<std::streamoff>(FILE_RECIPE_ENTRY_SIZE * firstEntry));
+        } else {
+            // the rewritten journal replaces the old one only once complete, as it drops the sealed entries
+            firstEntry = 0;
+            journalName += ".tmp";
+            journal.open(journalName, std::ios::out | std::ios::binary | std::ios::trunc);
+            recipeJournalHead_t journalHead{recipeFile.head, recipeFile.totalNumOfShares, recipeFile.generation,
+                                            recipeFile.numOfSealedShares, recipeFile.contentDigest};
+            journal.write(reinterpret_cast<const char *>(&journalHead), RECIPE_JOURNAL_HEAD_SIZE);
+        }
+        journal.write(reinterpret_cast<const char *>(recipeFile.pendingEntries.data() + firstEntry),
+                      static_cast<std::streamsize>(FILE_RECIPE_ENTRY_SIZE *
+                                                   (recipeFile.pendingEntries.size() - firstEntry)));
+        journal.flush();
+        journal.close();
+        std::error_code ec;
+        if (journal && firstEntry == 0) {
+            std::filesystem::rename(journalName, formatRecipeJournalName(key), ec);
+        }
+        if (!journal || ec) {
+            std::cerr << log::WARNING
+                      << log::FormatLog("fail to checkpoint the unfinished recipe file", {{"journal", journalName}})
+                      << std::endl;
+        }
+    }
+
+    /**
+     * @brief get the index key of a recipe chunk
+     * @param key index key for the recipe file
+     * @param generation generation of the recipe chunks
+     * @param chunkIndex index of the recipe chunk in the recipe file
+     */
+    static key_t ToRecipeChunkKey(const key_t &key, uint64_t generation, std::size_t chunkIndex) {
+        std::array<std::byte, sizeof(key_t) + sizeof(uint64_t) * 2> hashInput{};
+        const uint64_t kChunkIndex = chunkIndex;
+        std::copy(key.cbegin(), key.cend(), hashInput.begin());
+        std::memcpy(hashInput.data() + sizeof(key_t), &generation, sizeof(uint64_t));
+        std::memcpy(hashInput.data() + sizeof(key_t) + sizeof(uint64_t), &kChunkIndex, sizeof(uint64_t));
+        return ToIndexKey(IndexPrefix::RECIPE_CHUNK, ToFP({hashInput.data(), hashInput.size()}));
+    }
+
+    /**
+     * @brief erase the recipe chunks of a generation, whose space in the recipe segments is then reclaimed
+     * @param key index key for the recipe file
+     * @param generation generation of the recipe chunks
+     * @param numOfChunks number of the recipe chunks
+     */
+    void eraseRecipeChunks_(const key_t &key, uint64_t generation, std::size_t numOfChunks) {
+        if (numOfChunks == 0) {
+            return;
+        }
+        std::vector<key_t> chunkKeys(numOfChunks);
+        for (std::size_t chunkIndex = 0; chunkIndex < numOfChunks; chunkIndex++) {
+            chunkKeys[chunkIndex] = ToRecipeChunkKey(key, generation, chunkIndex);
+        }
+        recipeStore_.erase(chunkKeys);
+    }
+
+    /**
+     * @brief drop an unfinished recipe file whose upload is abandoned, with its recipe chunks and its journal
+     * @param key index key for the recipe file
+     * @param recipeFile the unfinished recipe file
+     * @note the unfinished recipe file cache lock should be held
+     */
+    void dropUnfinishedRecipeFile_(const key_t &key, const unfinishedRecipeFile_t &recipeFile) {
+        // the journal goes first, so that the upload is never resumed with the erased recipe chunks
+        std::error_code ec;
+        std::filesystem::remove(formatRecipeJournalName(key), ec);
+        eraseRecipeChunks_(key, recipeFile.generation, recipeFile.numOfSealedShares / config::RECIPE_CHUNK_ENTRY_NUM);
+    }
+
+    /**
+     * @brief get the root of a finished recipe file
+     * @param key index key for the recipe file
+     * @return option for the root, and nullopt if there is no such recipe file or it is stored as a whole
+     */
+    std::optional<fileRecipeRoot_t> findRecipeRoot_(const key_t &key) {
+        auto viewOpt = recipeStore_.get(key);
+        if (!viewOpt || viewOpt->data().size() != FILE_RECIPE_ROOT_SIZE) {
+            return std::nullopt;
+        }
+        return ParseFileRecipeRoot(viewOpt->data());
+    }
+
+    /**
+     * @brief retire the generation of the recipe chunks of a root replaced by a new version of the file, which is
+     * erased once no restore reads it
+     * @param key index key for the recipe file
+     * @param root the replaced root
+     * @note the unfinished recipe file cache lock should be held
+     */
+    void retireRecipeGeneration_(const key_t &key, const fileRecipeRoot_t &root) {
+        const auto kNumOfChunks =
+            (boost::numeric_cast<std::size_t>(root.recipeHead.numOfShares) + config::RECIPE_CHUNK_ENTRY_NUM - 1) /
+            config::RECIPE_CHUNK_ENTRY_NUM;
+        auto findIter = recipeGenerationReaders_.find({key, root.generation});
+        if (findIter != recipeGenerationReaders_.end()) {
+            findIter->second.retired = true;
+            findIter->second.numOfChunks = kNumOfChunks;
+            return;
+        }
+        eraseRecipeChunks_(key, root.generation, kNumOfChunks);
+    }
+
+    /**
+     * @brief release a root of a finished recipe file read by a restore, and erase its generation of the recipe
+     * chunks if it is retired and this is the last restore reading it
+     * @param key index key for the recipe file
+     * @param root the root
+     */
+    void releaseRecipeRoot_(const key_t &key, const fileRecipeRoot_t &root) noexcept {
+        std::lock_guard<decltype(unfinishedRecipeFileCacheMtx_)> lockGuard{unfinishedRecipeFileCacheMtx_};
+        auto findIter = recipeGenerationReaders_.find({key, root.generation});
+        if (findIter == recipeGenerationReaders_.end() || --findIter->second.numOfReaders != 0) {
+            return;
+        }
+        auto readers = findIter->second;
+        recipeGenerationReaders_.erase(findIter);
+        if (readers.retired) {
+            try {
+                eraseRecipeChunks_(key, root.generation, readers.numOfChunks);
+            } catch (DedupException &e) {
+                std::cerr << log::WARNING << e.what() << std::endl;
+            }
+        }
+    }
+
+    /**
+     * @brief write out the full recipe chunks of the pending entries of an unfinished recipe file, and the last
+     * partial one as well if the recipe file is complete
+     * @param key index key for the recipe file
+     * @param recipeFile <u>modify</u> the unfinished recipe file, whose written entries are dropped
+     * @return whether any recipe chunk is written
+     * @note the unfinished recipe file cache lock should be held
+     */
+    bool sealRecipeChunks_(const key_t &key, unfinishedRecipeFile_t &recipeFile) {
+        const bool kComplete = recipeFile.totalNumOfShares == static_cast<std::size_t>(recipeFile.head.numOfShares);
+        std::size_t numOfSealingShares = 0;
+        while (recipeFile.pendingEntries.size() - numOfSealingShares >= config::RECIPE_CHUNK_ENTRY_NUM ||
+               (kComplete && numOfSealingShares < recipeFile.pendingEntries.size())) {
+            const auto kChunkSize = std::min(recipeFile.pendingEntries.size() - numOfSealingShares,
+                                             config::RECIPE_CHUNK_ENTRY_NUM);
+            const auto kChunkIndex =
+                (recipeFile.numOfSealedShares + numOfSealingShares) / config::RECIPE_CHUNK_ENTRY_NUM;
+            recipeStore_.put(ToRecipeChunkKey(key, recipeFile.generation, kChunkIndex),
+                             {reinterpret_cast<const std::byte *>(recipeFile.pendingEntries.data() + numOfSealingShares),
+                              FILE_RECIPE_ENTRY_SIZE * kChunkSize});
+            numOfSealingShares += kChunkSize;
+        }
+        recipeFile.pendingEntries.erase(recipeFile.pendingEntries.begin(),
+                                        recipeFile.pendingEntries.begin() +
+                                            static_cast<std::ptrdiff_t>(numOfSealingShares));
+        recipeFile.numOfSealedShares += numOfSealingShares;
+        return numOfSealingShares != 0;
+    }
+
+    /**
+     * @brief store a recipe file written by an earlier version as a file of its own, as recipe chunks and a root
+     * @param key index key for the recipe file
+     * @param recipe recipe file data, in the file recipe format
+     * @return the root of the stored recipe file
+     * @note the unfinished recipe file cache lock should be held
+     */
+    fileRecipeRoot_t putWholeRecipe_(const key_t &key, const bytes_view &recipe) {
+        const auto kNumOfShares = recipe.size() < FILE_RECIPE_HEAD_SIZE
+                                      ? -1
+                                      : reinterpret_cast<const fileRecipeHead_t *>(recipe.data())->numOfShares;
+        if (kNumOfShares < 0 ||
+            recipe.size() !=
+                FILE_RECIPE_HEAD_SIZE + FILE_RECIPE_ENTRY_SIZE * boost::numeric_cast<std::size_t>(kNumOfShares)) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "file recipe is invalid", {{"key", ToHexDump(key)}});
+        }
+        auto [kFileRecipeHead, kFileRecipeEntries] = ParseFileRecipe(recipe);
+        fileRecipeRoot_t root{kFileRecipeHead, recipeGenerationEngine_()};
+        for (std::size_t first = 0; first < kFileRecipeEntries.size(); first += config::RECIPE_CHUNK_ENTRY_NUM) {
+            const auto kChunkSize = std::min(kFileRecipeEntries.size() - first, config::RECIPE_CHUNK_ENTRY_NUM);
+            recipeStore_.put(ToRecipeChunkKey(key, root.generation, first / config::RECIPE_CHUNK_ENTRY_NUM),
+                             {reinterpret_cast<const std::byte *>(kFileRecipeEntries.data() + first),
+                              FILE_RECIPE_ENTRY_SIZE * kChunkSize});
+        }
+        recipeStore_.put(key, {reinterpret_cast<const std::byte *>(&root), FILE_RECIPE_ROOT_SIZE});
+        return root;
+    }
+
+    /**
+     * @brief drop the unfinished recipe files and journals that have not been accessed within the timeout,
+     * which is done at most once a minute
+     * @note the unfinished recipe file cache lock should be held
+     */
+    void sweepUnfinishedRecipeFiles_() {
+        using namespace std::chrono_literals;
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastRecipeSweep_ < 1min) {
+            return;
+        }
+        lastRecipeSweep_ = now;
+        const auto kTimeout = config::GetUnfinishedRecipeTimeout();
+        for (auto iter = unfinishedRecipeFileCache_.begin(); iter != unfinishedRecipeFileCache_.end();) {
+            if (now - iter->second.lastAccess > kTimeout) {
+                dropUnfinishedRecipeFile_(iter->first, iter->second);
+                iter = unfinishedRecipeFileCache_.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+        // the journals left by a previous run are aged by their modification time
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator{config::GetRecipeJournalDir(), ec}) {
+            auto lastWrite = std::filesystem::last_write_time(entry.path(), ec);
+            if (ec || std::filesystem::file_time_type::clock::now() - lastWrite <= kTimeout) {
+                continue;
+            }
+            key_t key;
+            if (entry.path().extension() == ".rj" && FromHexDump(entry.path().stem().string(), key) &&
+                unfinishedRecipeFileCache_.find(key) == unfinishedRecipeFileCache_.end()) {
+                auto findIter = loadRecipeJournal_(key);
+                if (findIter != unfinishedRecipeFileCache_.end()) {
+                    dropUnfinishedRecipeFile_(key, findIter->second);
+                    unfinishedRecipeFileCache_.erase(findIter);
+                }
+            }
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+
 public:
     BackendFacade() {
         createShareContainer_();
@@ -67,6 +398,8 @@ public:
     enum class IndexPrefix : uint8_t {
         RECIPE = 0,
         SHARE_INDEX = 1,
+        RECIPE_CHUNK = 2,
+        RECIPE_SEGMENT = 3,
     };
 
     /**
@@ -94,26 +427,31 @@ public:
                                           const fileShareMetaHead_t &fileShareMetaHead,
                                           const std::size_t &totalNumOfShares) {
         std::lock_guard<decltype(unfinishedRecipeFileCacheMtx_)> lockGuard{unfinishedRecipeFileCacheMtx_};
+        sweepUnfinishedRecipeFiles_();
+        decltype(unfinishedRecipeFileCache_)::iterator findIter;
         if (fileShareMetaHead.numOfPastSecrets == 0) { // this is a new file
-            // allocate a buffer for the recipe file
-            const std::size_t kRecipFileBufferSize = FILE_RECIPE_HEAD_SIZE + FILE_RECIPE_ENTRY_SIZE * totalNumOfShares;
-            /// buffer for the recipe file in the cache
-            auto &recipeFileBuffer =
-                unfinishedRecipeFileCache_
-                    .emplace(key, std::make_pair(std::make_unique<std::byte[]>(kRecipFileBufferSize), totalNumOfShares))
-                    .first->second.first;
-
-            // set the file recipe head
-            auto &fileRecipeHead = *reinterpret_cast<fileRecipeHead_t *>(recipeFileBuffer.get());
-            fileRecipeHead.userID = userID;
-            fileRecipeHead.fileSize = fileShareMetaHead.fileSize;
-            fileRecipeHead.numOfShares = 0;
-
-            // return the buffer span for writing recipe file entries
-            return {reinterpret_cast<fileRecipeEntry_t *>(recipeFileBuffer.get() + FILE_RECIPE_HEAD_SIZE),
-                    boost::numeric_cast<std::size_t>(fileShareMetaHead.numOfComingSecrets)};
-        } else { // this is a remains of a previous file
-            auto findIter = unfinishedRecipeFileCache_.find(key);
+            // start a new generation of recipe chunks, replacing an abandoned upload of the same file
+            findIter = unfinishedRecipeFileCache_.find(key);
+            if (findIter == unfinishedRecipeFileCache_.end()) {
+                findIter = loadRecipeJournal_(key);
+            }
+            if (findIter != unfinishedRecipeFileCache_.end()) {
+                dropUnfinishedRecipeFile_(key, findIter->second);
+            }
+            findIter = unfinishedRecipeFileCache_
+                           .insert_or_assign(key, unfinishedRecipeFile_t{{userID, fileShareMetaHead.fileSize, 0},
+                                                                         totalNumOfShares,
+                                                                         recipeGenerationEngine_(),
+                                                                         0,
+                                                                         fileShareMetaHead.contentDigest,
+                                                                         {},
+                                                                         std::chrono::steady_clock::now()})
+                           .first;
+        } else { // this is a remains of a previous file, which may be resumed from its journal
+            findIter = unfinishedRecipeFileCache_.find(key);
+            if (findIter == unfinishedRecipeFileCache_.end()) {
+                findIter = loadRecipeJournal_(key);
+            }
             if (findIter == unfinishedRecipeFileCache_.end()) {
                 throw DedupException(BOOST_CURRENT_LOCATION, "fail to find the recipe file in cache",
                                      {
@@ -121,26 +459,44 @@ public:
                                          {"key",     ToHexDump(key)        }
                 });
             }
-            auto &recipeFileBuffer = findIter->second.first;
-            if constexpr (config::PARANOID_CHECK) {
-                auto &fileRecipeHead = *reinterpret_cast<const fileRecipeHead_t *>(recipeFileBuffer.get());
-                if (fileRecipeHead.userID != userID || findIter->second.second != totalNumOfShares) {
-                    throw DedupException(BOOST_CURRENT_LOCATION, "the file recipe head is invalid");
-                }
-            }
+        }
+        auto &recipeFile = findIter->second;
+        const auto kNumOfPastSecrets = boost::numeric_cast<std::size_t>(fileShareMetaHead.numOfPastSecrets);
+        const auto kNumOfComingSecrets = boost::numeric_cast<std::size_t>(fileShareMetaHead.numOfComingSecrets);
+        // the entries in the recipe chunks written out can not be overwritten
+        if (recipeFile.head.userID != userID || recipeFile.totalNumOfShares != totalNumOfShares ||
+            recipeFile.contentDigest != fileShareMetaHead.contentDigest ||
+            fileShareMetaHead.numOfPastSecrets > recipeFile.head.numOfShares ||
+            kNumOfPastSecrets < recipeFile.numOfSealedShares ||
+            kNumOfPastSecrets + kNumOfComingSecrets > totalNumOfShares) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "the file share does not follow the recipe file",
+                                 {
+                                     {"user id",          std::to_string(userID)                            },
+                                     {"key",              ToHexDump(key)                                    },
+                                     {"past secrets",     std::to_string(fileShareMetaHead.numOfPastSecrets)},
+                                     {"accepted secrets", std::to_string(recipeFile.head.numOfShares)       },
+                                     {"sealed secrets",   std::to_string(recipeFile.numOfSealedShares)      },
+                                     {"total shares",     std::to_string(totalNumOfShares)                  }
+            });
+        }
+        recipeFile.lastAccess = std::chrono::steady_clock::now();
 
-            return {reinterpret_cast<fileRecipeEntry_t *>(recipeFileBuffer.get() + FILE_RECIPE_HEAD_SIZE +
-                                                          FILE_RECIPE_ENTRY_SIZE * fileShareMetaHead.numOfPastSecrets),
-                    boost::numeric_cast<std::size_t>(fileShareMetaHead.numOfComingSecrets)};
+        // return the span of the pending entries for writing the recipe file entries of this file share
+        const auto kFirstEntry = kNumOfPastSecrets - recipeFile.numOfSealedShares;
+        if (recipeFile.pendingEntries.size() < kFirstEntry + kNumOfComingSecrets) {
+            recipeFile.pendingEntries.resize(kFirstEntry + kNumOfComingSecrets);
         }
+        return {recipeFile.pendingEntries.data() + kFirstEntry, kNumOfComingSecrets};
     }
 
     /**
      * @brief indicate the backend that all the recipe entries for a file share are set,
-     *  and the recipe file data can be written to the disk if possible
+     *  and the full recipe chunks can be written to the disk
      * @param userID user id
      * @param fileShareMetaHead head of the file share
      * @param key key for this recipe file
+     * @note the share index updates are flushed before the entries are written out or checkpointed in the journal,
+     * so that a resumed upload never skips a share whose index was lost
      */
     void finishRecipeFile(const user_id_t &userID, const fileShareMetaHead_t &fileShareMetaHead, const key_t &key) {
         std::lock_guard<decltype(unfinishedRecipeFileCacheMtx_)> lockGuard{unfinishedRecipeFileCacheMtx_};
@@ -149,30 +505,69 @@ public:
         if (findIter == unfinishedRecipeFileCache_.end()) {
             throw DedupException(BOOST_CURRENT_LOCATION, "fail to find the recipe file in cache");
         }
-        auto &recipeFileBuffer = findIter->second.first;
-        auto &fileRecipeHead = *reinterpret_cast<fileRecipeHead_t *>(recipeFileBuffer.get());
-        fileRecipeHead.numOfShares += fileShareMetaHead.numOfComingSecrets;
+        auto &recipeFile = findIter->second;
+        auto &fileRecipeHead = recipeFile.head;
+        // a resent fragment overwrites the entries accepted before
+        fileRecipeHead.numOfShares = std::max(fileRecipeHead.numOfShares, fileShareMetaHead.numOfPastSecrets +
+                                                                              fileShareMetaHead.numOfComingSecrets);
+        recipeFile.lastAccess = std::chrono::steady_clock::now();
         // log secret size
         Benchmark::LogSecretSize(fileShareMetaHead.sizeOfComingSecrets);
 
-        // if all the entries of this recipe file is set, write it to the disk
-        if (findIter->second.second == fileRecipeHead.numOfShares) {
-            auto recipeFileName = formatRecipeFileName(key);
-            const auto kRecipeSize = boost::numeric_cast<std::size_t>(
-                    FILE_RECIPE_HEAD_SIZE + FILE_RECIPE_ENTRY_SIZE * fileRecipeHead.numOfShares);
-            std::ofstream{recipeFileName, std::ios::binary | std::ios::trunc}.write(
-                    reinterpret_cast<const char *>(recipeFileBuffer.get()), kRecipeSize);
-            {
-                std::lock_guard<decltype(recipeCacheMtx_)> recipeLockGuard{recipeCacheMtx_};
-                recipeCache_.insert(
-                    key, std::make_pair(std::shared_ptr<std::byte[]>(std::move(recipeFileBuffer)), kRecipeSize));
+        // do db write after this file share was finished
+        DataBase::BatchFlush();
+
+        // write out the full recipe chunks, and if all the entries of this recipe file is set, the last chunk and
+        // the root, which makes the new version visible and retires the recipe chunks of the old one, or checkpoint
+        // the pending entries
+        auto sealed = sealRecipeChunks_(key, recipeFile);
+        if (recipeFile.totalNumOfShares == static_cast<std::size_t>(fileRecipeHead.numOfShares)) {
+            fileRecipeRoot_t root{fileRecipeHead, recipeFile.generation};
+            auto oldRootOpt = findRecipeRoot_(key);
+            recipeStore_.put(key, {reinterpret_cast<const std::byte *>(&root), FILE_RECIPE_ROOT_SIZE});
+            if (oldRootOpt) {
+                retireRecipeGeneration_(key, *oldRootOpt);
             }
+            std::error_code ec;
+            std::filesystem::remove(formatRecipeJournalName(key), ec);
             unfinishedRecipeFileCache_.erase(findIter);
             // log recipe size
-            Benchmark::LogRecipe(kRecipeSize);
+            Benchmark::LogRecipe(FILE_RECIPE_ROOT_SIZE + FILE_RECIPE_ENTRY_SIZE * fileRecipeHead.numOfShares);
+        } else {
+            checkpointRecipeFile_(key, recipeFile, fileShareMetaHead, sealed);
         }
-        // do db write after this recipe file was finished
-        DataBase::BatchFlush();
+    }
+
+    /**
+     * @brief get the number of secrets of an unfinished recipe file that have been accepted,
+     * from which the upload of the file can be resumed
+     * @param userID user id
+     * @param key key for this recipe file
+     * @param fileSize size of the file
+     * @param contentDigest digest of the file content
+     * @param totalNumOfShares total number of shares for this recipe file
+     * @return the number of accepted secrets, or 0 if there is no matching unfinished recipe file, e.g. the file has
+     * changed since the interrupted upload
+     */
+    int getRecipeFileProgress(const user_id_t &userID, const key_t &key, long fileSize, uint64_t contentDigest,
+                              std::size_t totalNumOfShares) {
+        std::lock_guard<decltype(unfinishedRecipeFileCacheMtx_)> lockGuard{unfinishedRecipeFileCacheMtx_};
+        sweepUnfinishedRecipeFiles_();
+        auto findIter = unfinishedRecipeFileCache_.find(key);
+        if (findIter == unfinishedRecipeFileCache_.end()) {
+            findIter = loadRecipeJournal_(key);
+        }
+        if (findIter == unfinishedRecipeFileCache_.end()) {
+            return 0;
+        }
+        auto &recipeFile = findIter->second;
+        auto &fileRecipeHead = recipeFile.head;
+        if (fileRecipeHead.userID != userID || fileRecipeHead.fileSize != fileSize ||
+            recipeFile.contentDigest != contentDigest || recipeFile.totalNumOfShares != totalNumOfShares) {
+            return 0;
+        }
+        recipeFile.lastAccess = std::chrono::steady_clock::now();
+        return fileRecipeHead.numOfShares;
     }
 
     /**
@@ -240,26 +635,67 @@ public:
         return DataBase::Get(key);
     }
 
-    std::optional<std::string> getRecipeData(const key_t &key) {
-        // try to find in the recipe cache
-        {
-            std::lock_guard<decltype(recipeCacheMtx_)> lockGuard{recipeCacheMtx_};
-            auto recipeOpt = recipeCache_.get(key);
-            if (recipeOpt) {
-                auto &recipe = recipeOpt.value().first;
-                auto size = recipeOpt.value().second;
-                return std::optional<std::string>{
-                        std::in_place, std::string{reinterpret_cast<const char *>(recipe.get()), size}
-                };
+    /**
+     * @brief get the root of a finished recipe file for a restore, whose generation of the recipe chunks is kept
+     * as long as the root lives, even if a new version of the file replaces it
+     * @param key key for the recipe file
+     * @return the root of the recipe file, and nullptr if not found
+     * @throw DedupException if the root is invalid or an error occurs on the recipe store
+     */
+    std::shared_ptr<const fileRecipeRoot_t> getRecipeRoot(const key_t &key) {
+        std::lock_guard<decltype(unfinishedRecipeFileCacheMtx_)> lockGuard{unfinishedRecipeFileCacheMtx_};
+        fileRecipeRoot_t root; // NOLINT(cppcoreguidelines-pro-type-member-init)
+        auto viewOpt = recipeStore_.get(key);
+        if (viewOpt) {
+            if (viewOpt->data().size() != FILE_RECIPE_ROOT_SIZE) {
+                throw DedupException(BOOST_CURRENT_LOCATION, "file recipe root is invalid", {{"key", ToHexDump(key)}});
             }
+            root = ParseFileRecipeRoot(viewOpt->data());
+        } else {
+            // a recipe file written by an earlier version as a file of its own is moved into the recipe store
+            auto recipeFileName = formatRecipeFileName(key);
+            std::ifstream recipeFile{recipeFileName, std::ios::binary};
+            if (!recipeFile.is_open()) {
+                return nullptr;
+            }
+            std::vector<char> recipeData{std::istreambuf_iterator<char>{recipeFile},
+                                         std::istreambuf_iterator<char>{}};
+            recipeFile.close();
+            root = putWholeRecipe_(key, {reinterpret_cast<const std::byte *>(recipeData.data()), recipeData.size()});
+            std::error_code ec;
+            std::filesystem::remove(recipeFileName, ec);
         }
-        std::ifstream recipeFile{formatRecipeFileName(key)};
-        if (not recipeFile.is_open()){
-            throw DedupException(BOOST_CURRENT_LOCATION, "fail to open recipe file",
-                                 {{"recipe key", ToHexDump(key)}});
+        recipeGenerationReaders_.try_emplace({key, root.generation}, recipeGenerationReaders_t{0, false, 0})
+            .first->second.numOfReaders++;
+        return {new fileRecipeRoot_t{root}, [this, key](const fileRecipeRoot_t *pRoot) {
+                    releaseRecipeRoot_(key, *pRoot);
+                    delete pRoot;
+                }};
+    }
+
+    /**
+     * @brief get a view of a recipe chunk of a finished recipe file, which refers to the mapped recipe segment
+     * without a copy
+     * @param key key for the recipe file
+     * @param root root of the recipe file
+     * @param chunkIndex index of the recipe chunk in the recipe file
+     * @return the view of the recipe chunk, in the recipe chunk format
+     * @throw DedupException if the recipe chunk is not found or invalid
+     */
+    RecipeView getRecipeChunk(const key_t &key, const fileRecipeRoot_t &root, std::size_t chunkIndex) {
+        const auto kNumOfShares = boost::numeric_cast<std::size_t>(root.recipeHead.numOfShares);
+        auto viewOpt = recipeStore_.get(ToRecipeChunkKey(key, root.generation, chunkIndex));
+        if (!viewOpt || chunkIndex * config::RECIPE_CHUNK_ENTRY_NUM >= kNumOfShares ||
+            viewOpt->data().size() !=
+                FILE_RECIPE_ENTRY_SIZE *
+                    std::min(kNumOfShares - chunkIndex * config::RECIPE_CHUNK_ENTRY_NUM, config::RECIPE_CHUNK_ENTRY_NUM)) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "recipe chunk is missing or invalid",
+                                 {
+                                     {"key",         ToHexDump(key)            },
+                                     {"chunk index", std::to_string(chunkIndex)}
+            });
         }
-        std::string recipeData{std::istreambuf_iterator<char>{recipeFile}, std::istreambuf_iterator<char>{}};
-        return {recipeData};
+        return *viewOpt;
     }
 
     /**
@@ -271,6 +707,7 @@ public:
     void getShareData(const internal_file_name_t &containerName, std::size_t off, mutable_bytes_view shareData) {
         std::lock_guard<decltype(readContainerCacheMtx_)> lockGuard{readContainerCacheMtx_};
         auto containerOpt = readContainerCache_.get(containerName);
+        Benchmark::LogContainerCache(containerOpt.has_value());
         if (containerOpt) {
             auto &container = *(containerOpt.value());
             if constexpr (config::PARANOID_CHECK) {
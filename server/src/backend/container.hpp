@@ -35,16 +35,19 @@ private:
 public:
     /**
      * @brief create a new container file
+     * @param dir directory of the container file
      * @param fileName container file name
+     * @param size size of the container file, default to the container size in the config
      */
-    void create(const std::string &dir, const internal_file_name_t &fileName) {
+    void create(const std::string &dir, const internal_file_name_t &fileName,
+                std::size_t size = config::GetContainerSize()) {
         using namespace std::filesystem;
         path filePath = dir + to_string(fileName);
         if (exists(filePath)) {
             throw DedupException(BOOST_CURRENT_LOCATION, "container file already exists");
         }
         auto params = bio_mapped_file_param_t{filePath};
-        params.new_file_size = config::CONTAINER_SIZE;
+        params.new_file_size = boost::numeric_cast<boost::iostreams::stream_offset>(size);
         params.flags = bio_mapped_file_t::mapmode::readwrite;
         if (mappedFile_.is_open()) {
             mappedFile_.close();
@@ -55,6 +58,32 @@ public:
         }
     }
 
+    /**
+     * @brief open an existing container file, to write after its content
+     * @param dir directory of the container file
+     * @param fileName container file name
+     */
+    void open(const std::string &dir, const internal_file_name_t &fileName) {
+        using namespace std::filesystem;
+        path filePath = dir + to_string(fileName);
+        if (!exists(filePath)) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "container file not exists");
+        }
+        auto params = bio_mapped_file_param_t{filePath};
+        params.flags = bio_mapped_file_t::mapmode::readwrite;
+        if (mappedFile_.is_open()) {
+            mappedFile_.close();
+        }
+        try {
+            mappedFile_.open(params);
+        } catch (std::exception &e) {
+            throw DedupException(BOOST_CURRENT_LOCATION, e.what());
+        }
+        if (!mappedFile_.is_open()) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "fail to open the mapped file");
+        }
+    }
+
     /**
      * @brief Create an empty container instance which associated to nothing
      */
@@ -92,9 +121,17 @@ public:
      * @brief open an existing container
      * @param fileName container name
      */
-    explicit Container(const internal_file_name_t &fileName) {
+    explicit Container(const internal_file_name_t &fileName) : Container(config::GetContianerDir(), fileName) {
+    }
+
+    /**
+     * @brief open an existing container in a directory
+     * @param dir directory of the container file
+     * @param fileName container name
+     */
+    Container(const std::string &dir, const internal_file_name_t &fileName) {
         using namespace std::filesystem;
-        path filePath = config::GetContianerDir() + to_string(fileName);
+        path filePath = dir + to_string(fileName);
         if (!exists(filePath)) {
             throw DedupException(BOOST_CURRENT_LOCATION, "container file not exists");
         }
@@ -5,42 +5,31 @@
 #ifndef DEDUP_SERVER_DB_WRAPPER_HPP
 #define DEDUP_SERVER_DB_WRAPPER_HPP
 
+#include <memory>
 #include <mutex>
 #include <optional>
 
-#include "leveldb/cache.h"
-#include "leveldb/db.h"
-#include "leveldb/filter_policy.h"
-#include "leveldb/write_batch.h"
-
+#include "backend/hash_table_engine.hpp"
+#include "backend/index_engine.hpp"
+#include "backend/leveldb_engine.hpp"
 #include "def/config.hpp"
 #include "def/exception.hpp"
 #include "def/log.hpp"
 #include "def/span.hpp"
 #include "def/util.hpp"
-#include "def/benchmark.hpp"
 
 namespace dedup {
 /**
  * @brief Singleton for backend database
+ * @note the underlying key-value engine is selected by the "index engine" option in the config
  */
 class DataBase {
 private:
-    /// pointer to the db instance
-    inline static leveldb::DB *db_{nullptr};
-    /// default read options for db
-    inline static const leveldb::ReadOptions readOptions_{};
-    /// default write options for db
-    inline static const leveldb::WriteOptions writeOptions_{};
-    /// write batch for accelerating db writing
-    inline static leveldb::WriteBatch writeBatch_{};
-    inline static std::recursive_mutex writeBatchMtx_{};
-    inline static int32_t batchCnt_{0};
-    /// default db options
-    inline static leveldb::Options dbOptions_{};
+    /// the engine instance
+    inline static std::unique_ptr<IndexEngine> engine_{nullptr};
 
-    static leveldb::DB &DB_() {
-        return *db_;
+    static IndexEngine &Engine_() {
+        return *engine_;
     }
 
 public:
@@ -48,13 +37,18 @@ public:
         static std::once_flag onceFlag{};
         std::call_once(onceFlag, []() {
             // open/create the key-value database
-            dbOptions_.create_if_missing = true;
-            dbOptions_.write_buffer_size = config::MEM_TABLE_SIZE;
-            dbOptions_.block_cache = leveldb::NewLRUCache(config::BLOCK_CACHE_SIZE);
-            dbOptions_.filter_policy = leveldb::NewBloomFilterPolicy(config::BLOOM_FILTER_KEY_BITS);
-            auto openStat = leveldb::DB::Open(dbOptions_, config::GetDBDir(), &db_);
-            if (!openStat.ok()) {
-                std::cerr << log::ERROR << log::FormatLog(BOOST_CURRENT_LOCATION, "error on initializing db");
+            try {
+                switch (config::GetIndexEngine()) {
+                    case config::index_engine_e::LEVELDB:
+                        engine_ = std::make_unique<LevelDBEngine>(config::GetDBDir());
+                        break;
+                    case config::index_engine_e::HASH_TABLE:
+                        engine_ = std::make_unique<HashTableEngine>(
+                            config::GetDBDir(), config::GetHashTableInitCapacity(), config::GetHashTableWalLimit());
+                        break;
+                }
+            } catch (DedupException &e) {
+                std::cerr << log::ERROR << e.what() << std::endl;
                 exit(-1);
             }
         });
@@ -68,36 +62,11 @@ public:
    * @throw DedupException if an error occurs on db_
    */
     [[nodiscard]] static std::optional<std::string> Get(const bytes_view &key) {
-        // do db_ read
-        std::string value{};
-        auto status = DB_().Get(readOptions_, {reinterpret_cast<const char *>(key.data()), key.size()}, &value);
-        // check result
-        if (status.ok()) {
-            return {std::move(value)};
-        } else if (status.IsNotFound()) {
-            return {};
-        } else {
-            throw DedupException(BOOST_CURRENT_LOCATION, "error on getting share index from db",
-                                 {
-                                     {"share fingerprint", ToHexDump(bytes_view{key.cbegin() + 1, key.cend()})},
-                                     {"db status",         status.ToString()                                  }
-            });
-        }
+        return Engine_().get(key);
     }
 
     static void BatchFlush() {
-        if constexpr (config::BATCH_SIZE > 0) {
-            std::lock_guard<decltype(writeBatchMtx_)> lockGuard{writeBatchMtx_};
-            auto status = DB_().Write(writeOptions_, &writeBatch_);
-            writeBatch_ = leveldb::WriteBatch{};
-            batchCnt_ = 0;
-            if (!status.ok()) {
-                throw DedupException(BOOST_CURRENT_LOCATION, "error on putting share index to db",
-                                     {
-                                         {"db status", status.ToString()}
-                });
-            }
-        }
+        Engine_().flush();
     }
 
     /**
@@ -107,33 +76,20 @@ public:
    * @throw DedupException if an error occurs on db_
    */
     static void Put(const bytes_view &key, const bytes_view &value) {
-        if constexpr (config::BATCH_SIZE > 0) {
-            // do db write in batch manner
-            std::lock_guard<decltype(writeBatchMtx_)> lockGuard{writeBatchMtx_};
-            // time benchmark
-            benchmark::ScopedLap lap{Benchmark::DiskWriteTimer()};
-            
-            writeBatch_.Put({reinterpret_cast<const char *>(key.data()), key.size()},
-                            {reinterpret_cast<const char *>(value.data()), value.size()});
-            if (++batchCnt_ > config::BATCH_SIZE) {
-                BatchFlush();
-            }
-        } else {
-            // do db_ write
-            auto status = DataBase::DB_().Put(writeOptions_, {reinterpret_cast<const char *>(key.data()), key.size()},
-                                              {reinterpret_cast<const char *>(value.data()), value.size()});
-            if (!status.ok()) {
-                throw DedupException(BOOST_CURRENT_LOCATION, "error on putting share index to db",
-                                     {
-                                         {"share fingerprint", ToHexDump(bytes_view{key.cbegin() + 1, key.cend()})},
-                                         {"db status",         status.ToString()                                  }
-                });
-            }
-        }
+        Engine_().put(key, value);
     }
     static void Put(const key_t &key, const bytes_view &value) {
         Put(bytes_view{key.data(), key.size()}, value);
     }
+
+    /**
+   * @brief erase the entry of a key from the db_ if it exists
+   * @param key key for the entry
+   * @throw DedupException if an error occurs on db_
+   */
+    static void Erase(const key_t &key) {
+        Engine_().erase({key.data(), key.size()});
+    }
 };
 } // namespace dedup
 
@@ -0,0 +1,569 @@
+#ifndef DEDUP_SERVER_HASH_TABLE_ENGINE_HPP
+#define DEDUP_SERVER_HASH_TABLE_ENGINE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/numeric/conversion/cast.hpp>
+
+#include "backend/index_engine.hpp"
+#include "def/benchmark.hpp"
+#include "def/config.hpp"
+#include "def/exception.hpp"
+#include "def/log.hpp"
+#include "def/span.hpp"
+#include "def/struct.hpp"
+#include "def/util.hpp"
+
+namespace dedup {
+/**
+ * @brief index engine backed by a persistent open-addressing hash table
+ * @note the engine consists of three files in its directory:
+ * - a slot table, which is a memory mapped array of fixed-size slots using linear probing
+ * - a value heap, which is a memory mapped file holding the values referred by the slots
+ * - a write-ahead log, which records every put and erase since the last checkpoint. \n
+ * Puts and erases are held in memory until flush, which syncs their log records before applying them to the mapped
+ * files, so that a page written back by the kernel never holds a change that the log can not redo.
+ * An erased entry leaves a tombstone in its slot, which keeps the probe sequences through the slot and is dropped
+ * when the table is rehashed, while the heap space of its value is not reused.
+ * The mapped files are synced and the log is truncated on checkpoint.
+ * After a crash, the table is rebuilt from the mapped files and the log is replayed.
+ */
+class HashTableEngine : public IndexEngine {
+private:
+    using bio_mapped_file_t = boost::iostreams::mapped_file;
+    using bio_mapped_file_param_t = boost::iostreams::mapped_file_params;
+
+    static constexpr uint64_t MAGIC{0x7864695F70756465}; // "edup_idx"
+    /// the table is doubled when the number of entries exceeds this ratio of its capacity
+    static constexpr double MAX_LOAD_FACTOR{0.7};
+    /// minimum capacity of a value in the heap, which leaves room for appending user reference entries in place
+    static constexpr uint32_t MIN_VALUE_CAPACITY{64};
+    static constexpr std::string_view TABLE_FILE_NAME{"index.tbl"};
+    static constexpr std::string_view HEAP_FILE_NAME{"index.val"};
+    static constexpr std::string_view WAL_FILE_NAME{"index.wal"};
+    static constexpr std::string_view TMP_SUFFIX{".tmp"};
+
+    /// head of the slot table file
+    struct tableHead_t {
+        uint64_t magic;
+        /// number of slots, which is a power of 2
+        uint64_t capacity;
+        /// number of occupied and erased slots
+        uint64_t size;
+        /// end of the allocated region in the value heap
+        uint64_t heapTail;
+        /// whether the mapped files are consistent with the head, i.e. synced by a checkpoint and not changed since
+        uint64_t clean;
+    };
+
+    enum class slot_state_e : uint8_t {
+        EMPTY = 0,
+        OCCUPIED = 1,
+        ERASED = 2,
+    };
+
+    struct slot_t {
+        slot_state_e state;
+        key_t key;
+        uint32_t valueSize;
+        uint32_t valueCapacity;
+        uint64_t valueOffset;
+    };
+
+    /// value size of the log record of an erase, which has no value
+    static constexpr uint32_t ERASE_RECORD{UINT32_MAX};
+
+    /// head of a write-ahead log record, which is followed by the key and the value
+    struct walRecordHead_t {
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint32_t checksum;
+    };
+
+    std::string dir_;
+    bio_mapped_file_t table_{};
+    bio_mapped_file_t heap_{};
+    int walFd_{-1};
+    /// log records not yet written to the log file
+    std::vector<std::byte> walBuffer_{};
+    /// puts and erases (without a value) not yet applied to the mapped files, whose log records are not synced
+    std::unordered_map<key_t, std::optional<std::string>> pendingUpdates_{};
+    /// size of the log file
+    std::size_t walSize_{0};
+    /// the log is checkpointed when its size exceeds this limit
+    std::size_t walLimit_;
+    std::shared_mutex mtx_{};
+
+    [[nodiscard]] std::string path_(std::string_view fileName) const {
+        return dir_ + std::string{fileName};
+    }
+
+    tableHead_t &head_() {
+        return *reinterpret_cast<tableHead_t *>(table_.data());
+    }
+
+    slot_t *slots_() {
+        return reinterpret_cast<slot_t *>(table_.data() + sizeof(tableHead_t));
+    }
+
+    static std::size_t TableFileSize_(uint64_t capacity) {
+        return sizeof(tableHead_t) + sizeof(slot_t) * capacity;
+    }
+
+    static uint64_t Hash_(const bytes_view &key) {
+        // the key is a prefix followed by a SHA-256 fingerprint, whose bytes are already uniformly distributed
+        uint64_t hash; // NOLINT(cppcoreguidelines-init-variables)
+        std::memcpy(&hash, key.data() + 1, sizeof(hash));
+        return hash ^ (static_cast<uint64_t>(key[0]) * 0x9E3779B97F4A7C15);
+    }
+
+    static uint32_t Checksum_(const bytes_view &key, const bytes_view &value) {
+        // FNV-1a, which is sufficient to detect a torn record at the tail of the log
+        uint32_t hash{2166136261};
+        for (auto data : {key, value}) {
+            for (auto b : data) {
+                hash = (hash ^ static_cast<uint32_t>(b)) * 16777619;
+            }
+        }
+        return hash;
+    }
+
+    static void CheckKey_(const bytes_view &key) {
+        if (key.size() != KEY_SIZE) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "invalid index key size",
+                                 {
+                                     {"key size", std::to_string(key.size())}
+            });
+        }
+    }
+
+    static void MapFile_(bio_mapped_file_t &file, const std::string &path, std::size_t newFileSize = 0) {
+        auto params = bio_mapped_file_param_t{path};
+        params.flags = bio_mapped_file_t::mapmode::readwrite;
+        params.new_file_size = boost::numeric_cast<boost::iostreams::stream_offset>(newFileSize);
+        try {
+            file.open(params);
+        } catch (std::exception &e) {
+            throw DedupException(BOOST_CURRENT_LOCATION, e.what(), {{"file", path}});
+        }
+        if (!file.is_open()) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "fail to open the mapped file", {{"file", path}});
+        }
+    }
+
+    static void SyncFile_(bio_mapped_file_t &file) {
+        if (::msync(file.data(), file.size(), MS_SYNC) != 0) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "fail to sync the mapped file",
+                                 {
+                                     {"error string", std::strerror(errno)}
+            });
+        }
+    }
+
+    /**
+     * @brief clear the clean flag of the head and sync it before the first change to the mapped files since the
+     * last checkpoint, so that a slot or a heap page written back by the kernel is never found behind a clean head,
+     * whose size and heap tail are stale
+     */
+    void markDirty_() {
+        auto &head = head_();
+        if (head.clean == 0) {
+            return;
+        }
+        head.clean = 0;
+        if (::msync(table_.data(), sizeof(tableHead_t), MS_SYNC) != 0) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "fail to sync the index table head",
+                                 {
+                                     {"error string", std::strerror(errno)}
+            });
+        }
+    }
+
+    /**
+     * @brief find the slot for the key, passing over the erased slots
+     * @return the slot holding the key, or the empty slot where the key should be inserted
+     */
+    slot_t &findSlot_(const bytes_view &key) {
+        const auto kMask = head_().capacity - 1;
+        auto slots = slots_();
+        for (auto i = Hash_(key) & kMask;; i = (i + 1) & kMask) {
+            auto &slot = slots[i];
+            if (slot.state == slot_state_e::EMPTY ||
+                (slot.state == slot_state_e::OCCUPIED && std::equal(key.begin(), key.end(), slot.key.cbegin()))) {
+                return slot;
+            }
+        }
+    }
+
+    /**
+     * @brief allocate a region in the value heap
+     * @return the offset and the capacity of the region
+     */
+    std::pair<uint64_t, uint32_t> allocateValue_(std::size_t valueSize) {
+        uint32_t capacity{MIN_VALUE_CAPACITY};
+        while (capacity < valueSize) {
+            capacity <<= 1;
+        }
+        auto &head = head_();
+        if (head.heapTail + capacity > heap_.size()) {
+            // double the heap, and the mapping address may be changed
+            heap_.resize(boost::numeric_cast<boost::iostreams::stream_offset>(
+                std::max<uint64_t>(heap_.size() * 2, head.heapTail + capacity)));
+        }
+        auto offset = head.heapTail;
+        head.heapTail += capacity;
+        return {offset, capacity};
+    }
+
+    /**
+     * @brief rehash all the entries into a new slot table, dropping the erased slots, whose capacity is doubled
+     * unless the erased slots make up half of the load
+     */
+    void rehash_() {
+        const auto kOldCapacity = head_().capacity;
+        auto oldSlots = slots_();
+        const auto kNumOfEntries = static_cast<uint64_t>(std::count_if(
+            oldSlots, oldSlots + kOldCapacity, [](const slot_t &slot) { return slot.state == slot_state_e::OCCUPIED; }));
+        const auto kNewCapacity =
+            static_cast<double>(kNumOfEntries + 1) > static_cast<double>(kOldCapacity) * MAX_LOAD_FACTOR / 2
+                ? kOldCapacity * 2
+                : kOldCapacity;
+        const auto kTmpPath = path_(TABLE_FILE_NAME) + std::string{TMP_SUFFIX};
+        std::filesystem::remove(kTmpPath);
+
+        bio_mapped_file_t newTable{};
+        MapFile_(newTable, kTmpPath, TableFileSize_(kNewCapacity));
+        auto &newHead = *reinterpret_cast<tableHead_t *>(newTable.data());
+        newHead = head_();
+        newHead.capacity = kNewCapacity;
+        newHead.size = kNumOfEntries;
+        // the heap may still hold values not synced, which the log redoes after a crash
+        newHead.clean = 0;
+        auto newSlots = reinterpret_cast<slot_t *>(newTable.data() + sizeof(tableHead_t));
+        for (uint64_t i = 0; i < kOldCapacity; ++i) {
+            if (oldSlots[i].state != slot_state_e::OCCUPIED) {
+                continue;
+            }
+            auto key = bytes_view{oldSlots[i].key.data(), oldSlots[i].key.size()};
+            for (auto j = Hash_(key) & (kNewCapacity - 1);; j = (j + 1) & (kNewCapacity - 1)) {
+                if (newSlots[j].state == slot_state_e::EMPTY) {
+                    newSlots[j] = oldSlots[i];
+                    break;
+                }
+            }
+        }
+        // the old table and the log are still a consistent state until the new table replaces the old one
+        SyncFile_(newTable);
+        newTable.close();
+        table_.close();
+        std::filesystem::rename(kTmpPath, path_(TABLE_FILE_NAME));
+        MapFile_(table_, path_(TABLE_FILE_NAME));
+    }
+
+    /**
+     * @brief apply a put to the mapped files
+     */
+    void apply_(const bytes_view &key, const bytes_view &value) {
+        markDirty_();
+        if (static_cast<double>(head_().size + 1) > static_cast<double>(head_().capacity) * MAX_LOAD_FACTOR) {
+            rehash_();
+        }
+        auto &head = head_();
+        auto &slot = findSlot_(key);
+        if (slot.state == slot_state_e::OCCUPIED && value.size() <= slot.valueCapacity) {
+            // overwrite the value in place
+            std::copy(value.begin(), value.end(), reinterpret_cast<std::byte *>(heap_.data()) + slot.valueOffset);
+            slot.valueSize = boost::numeric_cast<uint32_t>(value.size());
+            return;
+        }
+        auto [offset, capacity] = allocateValue_(value.size());
+        std::copy(value.begin(), value.end(), reinterpret_cast<std::byte *>(heap_.data()) + offset);
+        slot.valueOffset = offset;
+        slot.valueCapacity = capacity;
+        slot.valueSize = boost::numeric_cast<uint32_t>(value.size());
+        if (slot.state == slot_state_e::EMPTY) {
+            std::copy(key.begin(), key.end(), slot.key.begin());
+            // mark the slot occupied only after the entry is set
+            slot.state = slot_state_e::OCCUPIED;
+            head.size++;
+        }
+    }
+
+    /**
+     * @brief apply an erase to the mapped files, which turns the slot of the key into a tombstone
+     */
+    void applyErase_(const bytes_view &key) {
+        auto &slot = findSlot_(key);
+        if (slot.state == slot_state_e::OCCUPIED) {
+            markDirty_();
+            slot.state = slot_state_e::ERASED;
+        }
+    }
+
+    /**
+     * @brief append the log record of a put, or of an erase if there is no value
+     */
+    void appendWal_(const bytes_view &key, const std::optional<bytes_view> &value) {
+        walRecordHead_t recordHead{boost::numeric_cast<uint32_t>(key.size()),
+                                   value ? boost::numeric_cast<uint32_t>(value->size()) : ERASE_RECORD,
+                                   Checksum_(key, value.value_or(bytes_view{}))};
+        auto pHead = reinterpret_cast<const std::byte *>(&recordHead);
+        walBuffer_.insert(walBuffer_.end(), pHead, pHead + sizeof(recordHead));
+        walBuffer_.insert(walBuffer_.end(), key.begin(), key.end());
+        if (value) {
+            walBuffer_.insert(walBuffer_.end(), value->begin(), value->end());
+        }
+    }
+
+    void writeWal_() {
+        std::size_t written{0};
+        while (written < walBuffer_.size()) {
+            auto cnt = ::write(walFd_, walBuffer_.data() + written, walBuffer_.size() - written);
+            if (cnt == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw DedupException(BOOST_CURRENT_LOCATION, "fail to write the index log",
+                                     {
+                                         {"error string", std::strerror(errno)}
+                });
+            }
+            written += cnt;
+        }
+        walSize_ += walBuffer_.size();
+        walBuffer_.clear();
+    }
+
+    /**
+     * @brief write and sync the log records, and then apply the pending puts and erases to the mapped files
+     */
+    void flush_() {
+        writeWal_();
+        if (::fdatasync(walFd_) != 0) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "fail to sync the index log",
+                                 {
+                                     {"error string", std::strerror(errno)}
+            });
+        }
+        for (const auto &[kKey, kValue] : pendingUpdates_) {
+            if (kValue) {
+                apply_({kKey.data(), kKey.size()},
+                       {reinterpret_cast<const std::byte *>(kValue->data()), kValue->size()});
+            } else {
+                applyErase_({kKey.data(), kKey.size()});
+            }
+        }
+        pendingUpdates_.clear();
+    }
+
+    /**
+     * @brief sync the mapped files and truncate the log
+     */
+    void checkpoint_() {
+        SyncFile_(heap_);
+        SyncFile_(table_);
+        head_().clean = 1;
+        SyncFile_(table_);
+        if (::ftruncate(walFd_, 0) != 0 || ::fdatasync(walFd_) != 0) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "fail to truncate the index log",
+                                 {
+                                     {"error string", std::strerror(errno)}
+            });
+        }
+        walSize_ = 0;
+    }
+
+    /**
+     * @brief rebuild the table head from the slots, in case the mapped files were not synced before a crash
+     */
+    void repair_() {
+        auto &head = head_();
+        head.size = 0;
+        head.heapTail = 0;
+        auto slots = slots_();
+        for (uint64_t i = 0; i < head.capacity; ++i) {
+            if (slots[i].state != slot_state_e::EMPTY) {
+                head.size++;
+            }
+            if (slots[i].state == slot_state_e::OCCUPIED) {
+                head.heapTail = std::max(head.heapTail, slots[i].valueOffset + slots[i].valueCapacity);
+            }
+        }
+        if (head.heapTail > heap_.size()) {
+            heap_.resize(boost::numeric_cast<boost::iostreams::stream_offset>(head.heapTail));
+        }
+    }
+
+    /**
+     * @brief replay the records in the log, and discard the torn tail if any
+     */
+    void replay_() {
+        std::vector<std::byte> wal(boost::numeric_cast<std::size_t>(::lseek(walFd_, 0, SEEK_END)));
+        if (::pread(walFd_, wal.data(), wal.size(), 0) != static_cast<ssize_t>(wal.size())) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "fail to read the index log",
+                                 {
+                                     {"error string", std::strerror(errno)}
+            });
+        }
+        std::size_t offset{0};
+        while (offset + sizeof(walRecordHead_t) <= wal.size()) {
+            walRecordHead_t recordHead{};
+            std::memcpy(&recordHead, wal.data() + offset, sizeof(recordHead));
+            const bool kErase = recordHead.valueSize == ERASE_RECORD;
+            const std::size_t kValueSize = kErase ? 0 : recordHead.valueSize;
+            if (recordHead.keySize != KEY_SIZE ||
+                offset + sizeof(walRecordHead_t) + recordHead.keySize + kValueSize > wal.size()) {
+                break;
+            }
+            auto key = bytes_view{wal.data() + offset + sizeof(walRecordHead_t), recordHead.keySize};
+            auto value = bytes_view{key.data() + key.size(), kValueSize};
+            if (Checksum_(key, value) != recordHead.checksum) {
+                break;
+            }
+            if (kErase) {
+                applyErase_(key);
+            } else {
+                apply_(key, value);
+            }
+            offset += sizeof(walRecordHead_t) + key.size() + value.size();
+        }
+        if (offset != wal.size()) {
+            std::cerr << log::WARNING
+                      << log::FormatLog("discard the torn tail of the index log",
+                                        {
+                                            {"log size",       std::to_string(wal.size())},
+                                            {"discarded size", std::to_string(wal.size() - offset)}
+            });
+        }
+    }
+
+public:
+    /**
+     * @brief open/create a hash table index in the directory
+     * @param dir directory (which ends with '/') for the index files
+     * @param initCapacity initial number of slots for a new table, rounded up to a power of 2
+     * @param walLimit the log is checkpointed on flush when its size exceeds this limit
+     * @throw DedupException if fail to open the index files
+     */
+    explicit HashTableEngine(std::string dir, std::size_t initCapacity = 1 << 20, std::size_t walLimit = 64 << 20)
+        : dir_(std::move(dir)), walLimit_(walLimit) {
+        std::filesystem::remove(path_(TABLE_FILE_NAME) + std::string{TMP_SUFFIX});
+        if (!std::filesystem::exists(path_(TABLE_FILE_NAME))) {
+            uint64_t capacity{1};
+            while (capacity < initCapacity) {
+                capacity <<= 1;
+            }
+            MapFile_(table_, path_(TABLE_FILE_NAME), TableFileSize_(capacity));
+            head_() = {MAGIC, capacity, 0, 0, 1};
+            std::filesystem::remove(path_(HEAP_FILE_NAME));
+            MapFile_(heap_, path_(HEAP_FILE_NAME), capacity * MIN_VALUE_CAPACITY);
+        } else {
+            MapFile_(table_, path_(TABLE_FILE_NAME));
+            MapFile_(heap_, path_(HEAP_FILE_NAME));
+            if (head_().magic != MAGIC || table_.size() != TableFileSize_(head_().capacity)) {
+                throw DedupException(BOOST_CURRENT_LOCATION, "the index table file is corrupted",
+                                     {
+                                         {"file", path_(TABLE_FILE_NAME)}
+                });
+            }
+        }
+
+        walFd_ = ::open(path_(WAL_FILE_NAME).c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (walFd_ == -1) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "fail to open the index log",
+                                 {
+                                     {"file",         path_(WAL_FILE_NAME)},
+                                     {"error string", std::strerror(errno)}
+            });
+        }
+
+        // recover from the last crash if any
+        if (head_().clean == 0) {
+            repair_();
+        }
+        replay_();
+        checkpoint_();
+    }
+
+    HashTableEngine(const HashTableEngine &) = delete;
+
+    HashTableEngine(HashTableEngine &&) = delete;
+
+    HashTableEngine &operator=(const HashTableEngine &) = delete;
+
+    HashTableEngine &operator=(HashTableEngine &&) = delete;
+
+    ~HashTableEngine() override {
+        try {
+            std::lock_guard<decltype(mtx_)> lockGuard{mtx_};
+            flush_();
+            checkpoint_();
+        } catch (DedupException &e) {
+            std::cerr << e.what();
+        }
+        ::close(walFd_);
+    }
+
+    [[nodiscard]] std::optional<std::string> get(const bytes_view &key) override {
+        CheckKey_(key);
+        std::shared_lock<decltype(mtx_)> lock{mtx_};
+        key_t pendingKey;
+        std::copy(key.begin(), key.end(), pendingKey.begin());
+        auto findIter = pendingUpdates_.find(pendingKey);
+        if (findIter != pendingUpdates_.end()) {
+            return findIter->second;
+        }
+        auto &slot = findSlot_(key);
+        if (slot.state == slot_state_e::EMPTY) {
+            return {};
+        }
+        return std::optional<std::string>{std::in_place, heap_.const_data() + slot.valueOffset, slot.valueSize};
+    }
+
+    void put(const bytes_view &key, const bytes_view &value) override {
+        CheckKey_(key);
+        std::lock_guard<decltype(mtx_)> lockGuard{mtx_};
+        // time benchmark
+        benchmark::ScopedLap lap{Benchmark::DiskWriteTimer()};
+        appendWal_(key, value);
+        key_t pendingKey;
+        std::copy(key.begin(), key.end(), pendingKey.begin());
+        pendingUpdates_.insert_or_assign(pendingKey,
+                                         std::string{reinterpret_cast<const char *>(value.data()), value.size()});
+    }
+
+    void erase(const bytes_view &key) override {
+        CheckKey_(key);
+        std::lock_guard<decltype(mtx_)> lockGuard{mtx_};
+        appendWal_(key, std::nullopt);
+        key_t pendingKey;
+        std::copy(key.begin(), key.end(), pendingKey.begin());
+        pendingUpdates_.insert_or_assign(pendingKey, std::nullopt);
+    }
+
+    void flush() override {
+        std::lock_guard<decltype(mtx_)> lockGuard{mtx_};
+        flush_();
+        if (walSize_ > walLimit_) {
+            checkpoint_();
+        }
+    }
+};
+} // namespace dedup
+
+#endif //DEDUP_SERVER_HASH_TABLE_ENGINE_HPP
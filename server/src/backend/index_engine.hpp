@@ -0,0 +1,49 @@
+#ifndef DEDUP_SERVER_INDEX_ENGINE_HPP
+#define DEDUP_SERVER_INDEX_ENGINE_HPP
+
+#include <optional>
+#include <string>
+
+#include "def/span.hpp"
+
+namespace dedup {
+/**
+ * @brief interface for the key-value engine underlying the share index
+ * @note the share index only performs point lookups, point updates and point erasures on fixed-size keys,
+ * so an engine is not required to keep the keys ordered or support range scans
+ */
+struct IndexEngine { // NOLINT(cppcoreguidelines-special-member-functions)
+    /**
+     * @brief get the value of the entry according to a key
+     * @param key key for the entry
+     * @return option for the value if the corresponding entry found, and nullopt if not found
+     * @throw DedupException if an error occurs on the engine
+     */
+    [[nodiscard]] virtual std::optional<std::string> get(const bytes_view &key) = 0;
+
+    /**
+     * @brief put a key-value entry, overwriting the previous value of the key if it exists
+     * @param key key for the entry
+     * @param value value for the entry
+     * @throw DedupException if an error occurs on the engine
+     */
+    virtual void put(const bytes_view &key, const bytes_view &value) = 0;
+
+    /**
+     * @brief erase the entry of a key if it exists
+     * @param key key for the entry
+     * @throw DedupException if an error occurs on the engine
+     */
+    virtual void erase(const bytes_view &key) = 0;
+
+    /**
+     * @brief make all the entries put and erased before durable
+     * @throw DedupException if an error occurs on the engine
+     */
+    virtual void flush() = 0;
+
+    virtual ~IndexEngine() = default;
+};
+} // namespace dedup
+
+#endif //DEDUP_SERVER_INDEX_ENGINE_HPP
@@ -0,0 +1,168 @@
+#ifndef DEDUP_SERVER_LEVELDB_ENGINE_HPP
+#define DEDUP_SERVER_LEVELDB_ENGINE_HPP
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "leveldb/cache.h"
+#include "leveldb/db.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/write_batch.h"
+
+#include "backend/index_engine.hpp"
+#include "def/benchmark.hpp"
+#include "def/config.hpp"
+#include "def/exception.hpp"
+#include "def/span.hpp"
+#include "def/util.hpp"
+
+namespace dedup {
+/**
+ * @brief index engine backed by LevelDB
+ */
+class LevelDBEngine : public IndexEngine {
+private:
+    /// default db options
+    leveldb::Options dbOptions_{};
+    /// default read options for db
+    const leveldb::ReadOptions readOptions_{};
+    /// default write options for db
+    const leveldb::WriteOptions writeOptions_{};
+    /// the db instance
+    std::unique_ptr<leveldb::DB> db_{nullptr};
+    /// block cache and filter policy are owned by the engine, and must outlive the db instance
+    std::unique_ptr<leveldb::Cache> blockCache_{nullptr};
+    std::unique_ptr<const leveldb::FilterPolicy> filterPolicy_{nullptr};
+    /// write batch for accelerating db writing
+    leveldb::WriteBatch writeBatch_{};
+    std::recursive_mutex writeBatchMtx_{};
+    int batchCnt_{0};
+    /// number of puts in a write batch, 0 for writing without batching
+    const int batchSize_{config::GetBatchSize()};
+
+public:
+    /**
+     * @brief open/create a LevelDB database
+     * @param dir database directory
+     * @throw DedupException if fail to open the database
+     */
+    explicit LevelDBEngine(const std::string &dir) {
+        blockCache_.reset(leveldb::NewLRUCache(config::GetBlockCacheSize()));
+        filterPolicy_.reset(leveldb::NewBloomFilterPolicy(config::GetBloomFilterKeyBits()));
+        dbOptions_.create_if_missing = true;
+        dbOptions_.write_buffer_size = config::GetMemTableSize();
+        dbOptions_.block_cache = blockCache_.get();
+        dbOptions_.filter_policy = filterPolicy_.get();
+        leveldb::DB *db{nullptr};
+        auto openStat = leveldb::DB::Open(dbOptions_, dir, &db);
+        if (!openStat.ok()) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "error on initializing db",
+                                 {
+                                     {"db dir",    dir                 },
+                                     {"db status", openStat.ToString()}
+            });
+        }
+        db_.reset(db);
+    }
+
+    LevelDBEngine(const LevelDBEngine &) = delete;
+
+    LevelDBEngine(LevelDBEngine &&) = delete;
+
+    LevelDBEngine &operator=(const LevelDBEngine &) = delete;
+
+    LevelDBEngine &operator=(LevelDBEngine &&) = delete;
+
+    ~LevelDBEngine() override {
+        try {
+            flush();
+        } catch (DedupException &e) {
+            std::cerr << e.what();
+        }
+        // the db must be closed before releasing the block cache and filter policy
+        db_.reset();
+    }
+
+    [[nodiscard]] std::optional<std::string> get(const bytes_view &key) override {
+        // do db read
+        std::string value{};
+        auto status = db_->Get(readOptions_, {reinterpret_cast<const char *>(key.data()), key.size()}, &value);
+        // check result
+        if (status.ok()) {
+            return {std::move(value)};
+        } else if (status.IsNotFound()) {
+            return {};
+        } else {
+            throw DedupException(BOOST_CURRENT_LOCATION, "error on getting share index from db",
+                                 {
+                                     {"share fingerprint", ToHexDump(bytes_view{key.cbegin() + 1, key.cend()})},
+                                     {"db status",         status.ToString()                                  }
+            });
+        }
+    }
+
+    void flush() override {
+        if (batchSize_ > 0) {
+            std::lock_guard<decltype(writeBatchMtx_)> lockGuard{writeBatchMtx_};
+            auto status = db_->Write(writeOptions_, &writeBatch_);
+            writeBatch_ = leveldb::WriteBatch{};
+            batchCnt_ = 0;
+            if (!status.ok()) {
+                throw DedupException(BOOST_CURRENT_LOCATION, "error on putting share index to db",
+                                     {
+                                         {"db status", status.ToString()}
+                });
+            }
+        }
+    }
+
+    void put(const bytes_view &key, const bytes_view &value) override {
+        if (batchSize_ > 0) {
+            // do db write in batch manner
+            std::lock_guard<decltype(writeBatchMtx_)> lockGuard{writeBatchMtx_};
+            // time benchmark
+            benchmark::ScopedLap lap{Benchmark::DiskWriteTimer()};
+
+            writeBatch_.Put({reinterpret_cast<const char *>(key.data()), key.size()},
+                            {reinterpret_cast<const char *>(value.data()), value.size()});
+            if (++batchCnt_ > batchSize_) {
+                flush();
+            }
+        } else {
+            // do db write
+            auto status = db_->Put(writeOptions_, {reinterpret_cast<const char *>(key.data()), key.size()},
+                                   {reinterpret_cast<const char *>(value.data()), value.size()});
+            if (!status.ok()) {
+                throw DedupException(BOOST_CURRENT_LOCATION, "error on putting share index to db",
+                                     {
+                                         {"share fingerprint", ToHexDump(bytes_view{key.cbegin() + 1, key.cend()})},
+                                         {"db status",         status.ToString()                                  }
+                });
+            }
+        }
+    }
+
+    void erase(const bytes_view &key) override {
+        if (batchSize_ > 0) {
+            std::lock_guard<decltype(writeBatchMtx_)> lockGuard{writeBatchMtx_};
+            writeBatch_.Delete({reinterpret_cast<const char *>(key.data()), key.size()});
+            if (++batchCnt_ > batchSize_) {
+                flush();
+            }
+        } else {
+            auto status = db_->Delete(writeOptions_, {reinterpret_cast<const char *>(key.data()), key.size()});
+            if (!status.ok()) {
+                throw DedupException(BOOST_CURRENT_LOCATION, "error on erasing index from db",
+                                     {
+                                         {"key",       ToHexDump(key)   },
+                                         {"db status", status.ToString()}
+                });
+            }
+        }
+    }
+};
+} // namespace dedup
+
+#endif //DEDUP_SERVER_LEVELDB_ENGINE_HPP
@@ -0,0 +1,478 @@
+#ifndef DEDUP_SERVER_RECIPE_STORE_HPP
+#define DEDUP_SERVER_RECIPE_STORE_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "backend/container.hpp"
+#include "backend/db_wrapper.hpp"
+#include "backend/name_dispenser.hpp"
+#include "def/benchmark.hpp"
+#include "def/config.hpp"
+#include "def/exception.hpp"
+#include "def/log.hpp"
+#include "def/span.hpp"
+#include "def/struct.hpp"
+#include "def/util.hpp"
+
+namespace dedup {
+/**
+ * @brief a read-only view of a stored recipe, a file recipe root or a recipe chunk, in a mapped recipe segment,
+ * which keeps the segment mapped as long as the view lives
+ */
+class RecipeView {
+private:
+    std::shared_ptr<const Container> segment_{};
+    bytes_view recipe_{};
+
+public:
+    RecipeView(std::shared_ptr<const Container> segment, bytes_view recipe)
+        : segment_(std::move(segment)), recipe_(recipe) {
+    }
+
+    /**
+     * @brief get the recipe data, without copying it out of the segment
+     */
+    bytes_view data() const {
+        return recipe_;
+    }
+};
+
+/**
+ * @brief a log-structured store of the recipes, the roots of the finished recipe files and their recipe chunks
+ * @note The recipes are appended as records to recipe segment files under the recipe directory, which are memory
+ * mapped, and a recipe larger than a segment gets a segment of its own. Each recipe is indexed by its key
+ * (IndexPrefix::RECIPE or IndexPrefix::RECIPE_CHUNK) in the DB with its location, and each segment by its name with
+ * its usage, i.e. its tail and the size of the records still indexed. A recipe put again or erased leaves a dead
+ * record, and a segment less than half live is compacted, i.e. its live records are appended again and the segment
+ * file is removed. The segment being appended to is indexed as well, so that it is appended to after a restart. \n
+ * The recipes are read as views into the read-only mappings of their segments, and the recently read ones are
+ * kept in an LRU cache bounded by their total size.
+ */
+class RecipeStore {
+private:
+    /// prefix of the index keys of the segments
+    const std::byte segmentKeyPrefix_;
+    NameDispenser segmentNameDispenser_{};
+    MutableContainer segment_{};
+    internal_file_name_t segmentName_{};
+    /// usage of the segment being appended to
+    recipeSegmentUsage_t segmentUsage_{};
+    /// lock of the segments and the recipe indices, which is shared by the readers, so that a segment is never
+    /// removed between reading the location of a recipe and mapping its segment
+    std::shared_mutex segmentMtx_{};
+
+    /// read-only mappings of the segments, which are unmapped once no view refers to them
+    std::map<internal_file_name_t, std::weak_ptr<const Container>> mappedSegments_{};
+    std::mutex mappedSegmentsMtx_{};
+
+    /// the cached recipes, the most recently used at the front
+    std::list<std::pair<key_t, RecipeView>> cacheList_{};
+    std::unordered_map<key_t, decltype(cacheList_)::iterator> cacheMap_{};
+    /// total size of the cached recipes
+    std::size_t cachedSize_{0};
+    std::mutex cacheMtx_{};
+
+    /**
+     * @brief get the size of the record of a recipe in a segment, with its padding
+     * @param recipeSize size of the recipe
+     */
+    static std::size_t RecordSize_(std::size_t recipeSize) {
+        return (RECIPE_RECORD_HEAD_SIZE + recipeSize + RECIPE_ALIGNMENT - 1) / RECIPE_ALIGNMENT * RECIPE_ALIGNMENT;
+    }
+
+    /**
+     * @brief get the location of a recipe from its index
+     * @param key key of the recipe
+     * @return option for the location, and nullopt if the recipe is not indexed
+     * @throw DedupException if the recipe index is invalid
+     */
+    static std::optional<recipeLocation_t> GetLocation_(const key_t &key) {
+        auto valueOpt = DataBase::Get({key.data(), key.size()});
+        if (!valueOpt) {
+            return std::nullopt;
+        }
+        if (valueOpt->size() != RECIPE_LOCATION_SIZE) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "recipe index is invalid", {{"key", ToHexDump(key)}});
+        }
+        recipeLocation_t location; // NOLINT(cppcoreguidelines-pro-type-member-init)
+        std::memcpy(&location, valueOpt->data(), RECIPE_LOCATION_SIZE);
+        return location;
+    }
+
+    /**
+     * @brief get the index key of a segment
+     * @param name segment name
+     */
+    key_t toSegmentKey_(const internal_file_name_t &name) const {
+        key_t key;
+        key[0] = segmentKeyPrefix_;
+        auto fp = ToFP({reinterpret_cast<const std::byte *>(name.data()), name.size()});
+        std::copy(fp.cbegin(), fp.cend(), key.begin() + 1);
+        return key;
+    }
+
+    /**
+     * @brief get the index key of the name of the segment being appended to, whose fingerprint part is all zeros
+     */
+    key_t currentSegmentKey_() const {
+        key_t key{};
+        key[0] = segmentKeyPrefix_;
+        return key;
+    }
+
+    /**
+     * @brief get the usage of a segment
+     * @param name segment name
+     * @return usage of the segment
+     * @note the segment lock should be held
+     * @throw DedupException if the segment usage is missing or invalid
+     */
+    recipeSegmentUsage_t getUsage_(const internal_file_name_t &name) {
+        if (segment_.size() != 0 && name == segmentName_) {
+            return segmentUsage_;
+        }
+        auto key = toSegmentKey_(name);
+        auto valueOpt = DataBase::Get({key.data(), key.size()});
+        if (!valueOpt || valueOpt->size() != RECIPE_SEGMENT_USAGE_SIZE) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "recipe segment usage is missing or invalid",
+                                 {{"segment", to_string(name)}});
+        }
+        recipeSegmentUsage_t usage; // NOLINT(cppcoreguidelines-pro-type-member-init)
+        std::memcpy(&usage, valueOpt->data(), RECIPE_SEGMENT_USAGE_SIZE);
+        return usage;
+    }
+
+    /**
+     * @brief set the usage of a segment
+     * @note the segment lock should be held
+     */
+    void putUsage_(const internal_file_name_t &name, const recipeSegmentUsage_t &usage) {
+        if (segment_.size() != 0 && name == segmentName_) {
+            segmentUsage_ = usage;
+        }
+        DataBase::Put(toSegmentKey_(name), {reinterpret_cast<const std::byte *>(&usage), RECIPE_SEGMENT_USAGE_SIZE});
+    }
+
+    /**
+     * @brief get a name for a new segment
+     * @note the segments of a previous run are kept when the directories are not cleared
+     */
+    internal_file_name_t newSegmentName_() {
+        internal_file_name_t name;
+        do {
+            name = segmentNameDispenser_.get();
+        } while (std::filesystem::exists(config::GetRecipeDir() + to_string(name)));
+        return name;
+    }
+
+    /**
+     * @brief get the read-only mapping of a segment, which is shared by the views into it
+     * @param name segment name
+     */
+    std::shared_ptr<const Container> mapSegment_(const internal_file_name_t &name) {
+        std::lock_guard<decltype(mappedSegmentsMtx_)> lockGuard{mappedSegmentsMtx_};
+        auto &mappedSegment = mappedSegments_[name];
+        auto segment = mappedSegment.lock();
+        if (!segment) {
+            // drop the entries of the segments unmapped since
+            for (auto iter = mappedSegments_.begin(); iter != mappedSegments_.end();) {
+                if (iter->second.expired() && iter->first != name) {
+                    iter = mappedSegments_.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+            segment = std::make_shared<const Container>(config::GetRecipeDir(), name);
+            mappedSegment = segment;
+        }
+        return segment;
+    }
+
+    /**
+     * @brief get a view of a recipe at its location
+     * @param location location of the recipe
+     * @throw DedupException if the location is out of the segment
+     */
+    RecipeView view_(const recipeLocation_t &location) {
+        auto segment = mapSegment_(location.segmentName);
+        if (location.offset + location.size > segment->size()) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "recipe location is invalid",
+                                 {
+                                     {"segment", to_string(location.segmentName)},
+                                     {"offset",  std::to_string(location.offset)},
+                                     {"size",    std::to_string(location.size)  }
+            });
+        }
+        bytes_view recipe{segment->region().data() + location.offset, location.size};
+        return {std::move(segment), recipe};
+    }
+
+    /**
+     * @brief cache a recipe as the most recently used one, and evict the least recently used ones over the budget
+     * @note the cache lock should be held
+     */
+    void cache_(const key_t &key, const RecipeView &view) {
+        auto findIter = cacheMap_.find(key);
+        if (findIter != cacheMap_.end()) {
+            cachedSize_ -= findIter->second->second.data().size();
+            cacheList_.erase(findIter->second);
+            cacheMap_.erase(findIter);
+        }
+        cacheList_.emplace_front(key, view);
+        cacheMap_.emplace(key, cacheList_.begin());
+        cachedSize_ += view.data().size();
+        // the most recent one is kept even if it is over the budget alone
+        while (cachedSize_ > config::GetRecipeCacheSize() && cacheList_.size() > 1) {
+            auto &[kEvictedKey, kEvictedView] = cacheList_.back();
+            cachedSize_ -= kEvictedView.data().size();
+            cacheMap_.erase(kEvictedKey);
+            cacheList_.pop_back();
+        }
+    }
+
+    /**
+     * @brief append a recipe as a record to the segments, and index it
+     * @param key key of the recipe
+     * @param recipe recipe data
+     * @return location of the recipe
+     * @note the segment lock should be held
+     */
+    recipeLocation_t append_(const key_t &key, const bytes_view &recipe) {
+        recipeLocation_t location{};
+        location.size = recipe.size();
+        const recipeRecordHead_t kRecordHead{key, recipe.size()};
+        const auto kRecordSize = RecordSize_(recipe.size());
+        std::byte *record{nullptr};
+        if (kRecordSize > config::GetRecipeSegmentSize()) {
+            // a large recipe is written to a segment of its own, and the current segment goes on
+            MutableContainer largeSegment{};
+            location.segmentName = newSegmentName_();
+            largeSegment.create(config::GetRecipeDir(), location.segmentName, kRecordSize);
+            record = largeSegment.region().data();
+            std::memcpy(record, &kRecordHead, RECIPE_RECORD_HEAD_SIZE);
+            std::copy(recipe.begin(), recipe.end(), record + RECIPE_RECORD_HEAD_SIZE);
+            location.offset = RECIPE_RECORD_HEAD_SIZE;
+            putUsage_(location.segmentName, {kRecordSize, kRecordSize});
+        } else {
+            if (segmentUsage_.tail + kRecordSize > segment_.size()) {
+                // this segment is full, or none has been created, so start a new one
+                segmentName_ = newSegmentName_();
+                segment_.create(config::GetRecipeDir(), segmentName_, config::GetRecipeSegmentSize());
+                segmentUsage_ = {0, 0};
+                DataBase::Put(currentSegmentKey_(),
+                              {reinterpret_cast<const std::byte *>(segmentName_.data()), segmentName_.size()});
+            }
+            record = segment_.region().data() + segmentUsage_.tail;
+            std::memcpy(record, &kRecordHead, RECIPE_RECORD_HEAD_SIZE);
+            std::copy(recipe.begin(), recipe.end(), record + RECIPE_RECORD_HEAD_SIZE);
+            location.segmentName = segmentName_;
+            location.offset = segmentUsage_.tail + RECIPE_RECORD_HEAD_SIZE;
+            putUsage_(segmentName_, {segmentUsage_.tail + kRecordSize, segmentUsage_.liveSize + kRecordSize});
+        }
+
+        // the recipe is indexed once it is in the segment, and after the usage, so that the tail covers it
+        DataBase::Put(key, {reinterpret_cast<const std::byte *>(&location), RECIPE_LOCATION_SIZE});
+        return location;
+    }
+
+    /**
+     * @brief account the records of the recipes no longer indexed in a segment as dead
+     * @param name segment name
+     * @param deadSize total size of the records
+     * @note the segment lock should be held, and the DB should be flushed before the usage is read again, as a
+     * batched put may not be read back
+     */
+    void release_(const internal_file_name_t &name, uint64_t deadSize) {
+        auto usage = getUsage_(name);
+        usage.liveSize -= std::min(usage.liveSize, deadSize);
+        putUsage_(name, usage);
+    }
+
+    /**
+     * @brief compact a segment if less than half of it is live, i.e. append its live records again and remove it,
+     * which is never done to the segment being appended to
+     * @param name segment name
+     * @note the segment lock should be held
+     */
+    void compact_(const internal_file_name_t &name) {
+        if (segment_.size() != 0 && name == segmentName_) {
+            return;
+        }
+        const auto kUsage = getUsage_(name);
+        if (kUsage.liveSize * 2 >= kUsage.tail) {
+            return;
+        }
+        auto segment = mapSegment_(name);
+        const auto kRegion = segment->region();
+        std::size_t numOfMoved{0};
+        for (uint64_t offset = 0; offset < kUsage.tail;) {
+            recipeRecordHead_t recordHead; // NOLINT(cppcoreguidelines-pro-type-member-init)
+            bool valid = offset + RECIPE_RECORD_HEAD_SIZE <= kRegion.size();
+            if (valid) {
+                std::memcpy(&recordHead, kRegion.data() + offset, RECIPE_RECORD_HEAD_SIZE);
+                valid = recordHead.size <= kRegion.size() - offset - RECIPE_RECORD_HEAD_SIZE;
+            }
+            if (!valid) {
+                // the segment is kept as fully live, as its live records can not be told apart
+                std::cerr << log::WARNING
+                          << log::FormatLog("fail to compact the recipe segment",
+                                            {{"segment", to_string(name)}, {"offset", std::to_string(offset)}})
+                          << std::endl;
+                putUsage_(name, {kUsage.tail, kUsage.tail});
+                return;
+            }
+            const auto kRecipeOffset = offset + RECIPE_RECORD_HEAD_SIZE;
+            auto locationOpt = GetLocation_(recordHead.key);
+            if (locationOpt && locationOpt->segmentName == name && locationOpt->offset == kRecipeOffset) {
+                append_(recordHead.key, {kRegion.data() + kRecipeOffset, recordHead.size});
+                numOfMoved++;
+            }
+            offset += RecordSize_(recordHead.size);
+        }
+
+        // the segment is removed once the moved recipes are indexed at their new locations, while the views into it
+        // keep their mapping
+        DataBase::Erase(toSegmentKey_(name));
+        DataBase::BatchFlush();
+        std::error_code ec;
+        std::filesystem::remove(config::GetRecipeDir() + to_string(name), ec);
+        {
+            std::lock_guard<decltype(mappedSegmentsMtx_)> lockGuard{mappedSegmentsMtx_};
+            mappedSegments_.erase(name);
+        }
+        std::cout << log::INFO
+                  << log::FormatLog("compact the recipe segment",
+                                    {{"segment", to_string(name)}, {"moved recipes", std::to_string(numOfMoved)}})
+                  << std::endl;
+    }
+
+public:
+    /**
+     * @brief open the store, which goes on appending to the last segment of a previous run
+     * @param segmentKeyPrefix prefix of the index keys of the segments
+     * @throw DedupException if the last segment can not be opened, or its usage is missing or invalid
+     */
+    explicit RecipeStore(std::byte segmentKeyPrefix) : segmentKeyPrefix_(segmentKeyPrefix) {
+        auto key = currentSegmentKey_();
+        auto nameOpt = DataBase::Get({key.data(), key.size()});
+        if (!nameOpt || nameOpt->size() != INTERNAL_FILE_NAME_SIZE) {
+            return;
+        }
+        internal_file_name_t name;
+        std::copy(nameOpt->cbegin(), nameOpt->cend(), name.begin());
+        auto usage = getUsage_(name);
+        const auto kPath = config::GetRecipeDir() + to_string(name);
+        std::error_code ec;
+        if (!std::filesystem::exists(kPath, ec) || std::filesystem::file_size(kPath, ec) < usage.tail) {
+            return;
+        }
+        segment_.open(config::GetRecipeDir(), name);
+        segmentName_ = name;
+        segmentUsage_ = usage;
+    }
+
+    /**
+     * @brief append a recipe to the segments and index it, and the record of the recipe indexed before with the key
+     * is dead
+     * @param key key of the recipe
+     * @param recipe recipe data
+     * @return a view of the stored recipe
+     */
+    RecipeView put(const key_t &key, const bytes_view &recipe) {
+        std::lock_guard<decltype(segmentMtx_)> lockGuard{segmentMtx_};
+        auto oldLocationOpt = GetLocation_(key);
+        auto location = append_(key, recipe);
+        if (oldLocationOpt) {
+            release_(oldLocationOpt->segmentName, RecordSize_(oldLocationOpt->size));
+        }
+        DataBase::BatchFlush();
+        if (oldLocationOpt) {
+            compact_(oldLocationOpt->segmentName);
+        }
+
+        auto view = view_(location);
+        std::lock_guard<decltype(cacheMtx_)> cacheLockGuard{cacheMtx_};
+        cache_(key, view);
+        return view;
+    }
+
+    /**
+     * @brief erase the indices of recipes, whose records are dead
+     * @param keys keys of the recipes, which are skipped if not indexed
+     */
+    void erase(const std::vector<key_t> &keys) {
+        std::lock_guard<decltype(segmentMtx_)> lockGuard{segmentMtx_};
+        /// total size of the dead records in each segment
+        std::map<internal_file_name_t, uint64_t> deadSizes{};
+        for (const auto &kKey : keys) {
+            auto locationOpt = GetLocation_(kKey);
+            if (!locationOpt) {
+                continue;
+            }
+            DataBase::Erase(kKey);
+            deadSizes[locationOpt->segmentName] += RecordSize_(locationOpt->size);
+        }
+        for (const auto &[kSegmentName, kDeadSize] : deadSizes) {
+            release_(kSegmentName, kDeadSize);
+        }
+        {
+            std::lock_guard<decltype(cacheMtx_)> cacheLockGuard{cacheMtx_};
+            for (const auto &kKey : keys) {
+                auto findIter = cacheMap_.find(kKey);
+                if (findIter != cacheMap_.end()) {
+                    cachedSize_ -= findIter->second->second.data().size();
+                    cacheList_.erase(findIter->second);
+                    cacheMap_.erase(findIter);
+                }
+            }
+        }
+        // the erasures are flushed before the segments are compacted, so that the erased recipes are not moved
+        DataBase::BatchFlush();
+        for (const auto &[kSegmentName, kDeadSize] : deadSizes) {
+            compact_(kSegmentName);
+        }
+    }
+
+    /**
+     * @brief get a view of a recipe
+     * @param key key of the recipe
+     * @return option for the view of the recipe, and nullopt if the recipe is not indexed
+     * @throw DedupException if the recipe index is invalid
+     */
+    std::optional<RecipeView> get(const key_t &key) {
+        {
+            std::lock_guard<decltype(cacheMtx_)> lockGuard{cacheMtx_};
+            auto findIter = cacheMap_.find(key);
+            Benchmark::LogRecipeCache(findIter != cacheMap_.end());
+            if (findIter != cacheMap_.end()) {
+                cacheList_.splice(cacheList_.begin(), cacheList_, findIter->second);
+                return findIter->second->second;
+            }
+        }
+
+        // the view is cached under the segment lock, so that it never replaces a recipe put after it is read
+        std::shared_lock<decltype(segmentMtx_)> lock{segmentMtx_};
+        auto locationOpt = GetLocation_(key);
+        if (!locationOpt) {
+            return std::nullopt;
+        }
+        auto view = view_(*locationOpt);
+        std::lock_guard<decltype(cacheMtx_)> lockGuard{cacheMtx_};
+        cache_(key, view);
+        return view;
+    }
+};
+} // namespace dedup
+
+#endif // DEDUP_SERVER_RECIPE_STORE_HPP
@@ -0,0 +1,217 @@
+#ifndef DEDUP_SERVER_METRICS_EXPORTER_HPP
+#define DEDUP_SERVER_METRICS_EXPORTER_HPP
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "sockpp/tcp_acceptor.h"
+#include "sockpp/unix_acceptor.h"
+
+#include "def/benchmark.hpp"
+#include "def/config.hpp"
+#include "def/log.hpp"
+
+namespace dedup {
+/**
+ * @brief exporter for the benchmark counters, gauges and timers
+ * @note the metrics are exposed in the Prometheus text format over HTTP ('/metrics'), and in JSON ('/metrics.json'),
+ * on a local TCP port and/or a Unix socket, and JSON snapshots can be written to a file periodically. \n
+ * Sampling only loads the benchmark atomics and merges the per-thread timer histograms,
+ * so it never blocks the recording threads.
+ */
+class MetricsExporter {
+private:
+    static constexpr std::string_view METRIC_PREFIX{"dedup_"};
+    static constexpr std::size_t MAX_REQUEST_SIZE{4096};
+    static constexpr std::chrono::seconds REQUEST_TIMEOUT{1};
+    /// quantiles exported for each timer
+    static constexpr std::array<double, 4> QUANTILES{0.5, 0.9, 0.99, 0.999};
+
+    static double TicksToSeconds(uint64_t ticks) {
+        return std::chrono::duration<double>(
+                   benchmark::Timer::duration_t{boost::numeric_cast<benchmark::Timer::rep_count_t>(ticks)})
+            .count();
+    }
+
+    /**
+     * @brief read a HTTP request, and respond with the metrics
+     */
+    static void Serve_(sockpp::stream_socket &sock) {
+        sock.read_timeout(REQUEST_TIMEOUT);
+        std::string request{};
+        std::array<char, 1024> buffer{};
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_SIZE) {
+            auto cnt = sock.read(buffer.data(), buffer.size());
+            if (cnt <= 0) {
+                return;
+            }
+            request.append(buffer.data(), cnt);
+        }
+
+        // request line: <method> <path> <version>
+        std::istringstream requestLine{request.substr(0, request.find("\r\n"))};
+        std::string method{}, path{};
+        requestLine >> method >> path;
+        std::string status{"200 OK"}, contentType{}, body{};
+        if (method != "GET") {
+            status = "405 Method Not Allowed";
+        } else if (path == "/metrics") {
+            contentType = "text/plain; version=0.0.4";
+            body = PrometheusText();
+        } else if (path == "/metrics.json") {
+            contentType = "application/json";
+            body = JsonText();
+        } else {
+            status = "404 Not Found";
+        }
+
+        std::string response{"HTTP/1.1 " + status + "\r\n"};
+        if (!contentType.empty()) {
+            response += "Content-Type: " + contentType + "\r\n";
+        }
+        response += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        sock.write_n(response.data(), response.size());
+    }
+
+    template <typename Acceptor>
+    [[noreturn]] static void Listen_(Acceptor &acc) {
+        while (true) {
+            auto sock = acc.accept();
+            if (!sock) {
+                std::cerr << log::WARNING
+                          << log::FormatLog(BOOST_CURRENT_LOCATION, "error on accepting metrics connection",
+                                            {
+                                                {"error string", acc.last_error_str()}
+                })
+                          << std::flush;
+                continue;
+            }
+            Serve_(sock);
+        }
+    }
+
+    [[noreturn]] static void JsonLog_() {
+        const auto &kFileName = config::GetMetricsJsonFile();
+        const auto kTmpFileName = kFileName + ".tmp";
+        while (true) {
+            std::this_thread::sleep_for(config::GetMetricsJsonInterval());
+            // write to a temporary file, and rename it so that readers never see a partial snapshot
+            {
+                std::ofstream file{kTmpFileName, std::ios::trunc};
+                file << JsonText();
+            }
+            std::error_code ec{};
+            std::filesystem::rename(kTmpFileName, kFileName, ec);
+            if (ec) {
+                std::cerr << log::WARNING
+                          << log::FormatLog("fail to write the metrics snapshot",
+                                            {
+                                                {"file",         kFileName   },
+                                                {"error string", ec.message()}
+                })
+                          << std::flush;
+            }
+        }
+    }
+
+public:
+    /**
+     * @brief start the metrics endpoints and the snapshot writer enabled in the config
+     */
+    static void Init() {
+        static std::once_flag onceFlag{};
+        std::call_once(onceFlag, []() {
+            if (config::GetMetricsPort() != 0) {
+                // only listen on the loopback interface
+                auto acc = std::make_unique<sockpp::tcp_acceptor>(
+                    sockpp::inet_address{"127.0.0.1", config::GetMetricsPort()});
+                if (!*acc) {
+                    throw DedupException(BOOST_CURRENT_LOCATION, "fail to create the metrics socket",
+                                         {
+                                             {"port",         std::to_string(config::GetMetricsPort())},
+                                             {"error string", acc->last_error_str()                   }
+                    });
+                }
+                std::thread{[acc = std::move(acc)]() { Listen_(*acc); }}.detach();
+            }
+            if (!config::GetMetricsUnixSocket().empty()) {
+                std::error_code ec{};
+                std::filesystem::remove(config::GetMetricsUnixSocket(), ec);
+                auto acc = std::make_unique<sockpp::unix_acceptor>(
+                    sockpp::unix_address{config::GetMetricsUnixSocket()});
+                if (!*acc) {
+                    throw DedupException(BOOST_CURRENT_LOCATION, "fail to create the metrics socket",
+                                         {
+                                             {"path",         config::GetMetricsUnixSocket()},
+                                             {"error string", acc->last_error_str()         }
+                    });
+                }
+                std::thread{[acc = std::move(acc)]() { Listen_(*acc); }}.detach();
+            }
+            if (!config::GetMetricsJsonFile().empty()) {
+                std::thread{[]() { JsonLog_(); }}.detach();
+            }
+        });
+    }
+
+    /**
+     * @brief format the metrics in the Prometheus text exposition format
+     */
+    static std::string PrometheusText() {
+        std::ostringstream out{};
+        out << std::setprecision(9);
+        for (const auto &sample : Benchmark::MetricSamples()) {
+            out << "# HELP " << METRIC_PREFIX << sample.name << ' ' << sample.help << '\n'
+                << "# TYPE " << METRIC_PREFIX << sample.name << ' ' << (sample.isCounter ? "counter" : "gauge")
+                << '\n'
+                << METRIC_PREFIX << sample.name << ' ' << sample.value << '\n';
+        }
+        for (const auto &timer : Benchmark::TimerMetrics()) {
+            auto distribution = timer.timer.getDistribution();
+            out << "# HELP " << METRIC_PREFIX << timer.name << ' ' << timer.help << '\n'
+                << "# TYPE " << METRIC_PREFIX << timer.name << " summary\n";
+            for (auto quantile : QUANTILES) {
+                out << METRIC_PREFIX << timer.name << "{quantile=\"" << quantile << "\"} "
+                    << TicksToSeconds(distribution.percentile(quantile * 100)) << '\n';
+            }
+            out << METRIC_PREFIX << timer.name << "_sum " << TicksToSeconds(distribution.sum) << '\n'
+                << METRIC_PREFIX << timer.name << "_count " << distribution.count << '\n';
+        }
+        return out.str();
+    }
+
+    /**
+     * @brief format the metrics as a JSON object
+     */
+    static std::string JsonText() {
+        std::ostringstream out{};
+        out << std::setprecision(9) << "{\n  \"timestamp\": "
+            << std::chrono::duration_cast<std::chrono::seconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+        for (const auto &sample : Benchmark::MetricSamples()) {
+            out << ",\n  \"" << sample.name << "\": " << sample.value;
+        }
+        for (const auto &timer : Benchmark::TimerMetrics()) {
+            auto distribution = timer.timer.getDistribution();
+            out << ",\n  \"" << timer.name << "\": {\"count\": " << distribution.count
+                << ", \"sum\": " << TicksToSeconds(distribution.sum);
+            for (auto quantile : QUANTILES) {
+                out << ", \"p" << quantile * 100 << "\": " << TicksToSeconds(distribution.percentile(quantile * 100));
+            }
+            out << ", \"max\": " << TicksToSeconds(distribution.max) << '}';
+        }
+        out << "\n}\n";
+        return out.str();
+    }
+};
+} // namespace dedup
+
+#endif //DEDUP_SERVER_METRICS_EXPORTER_HPP
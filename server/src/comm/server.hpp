@@ -45,13 +45,15 @@ public:
         std::cout << log::INFO
                   << log::FormatLog("server running",
                                     {
-                                        {"address",                 acc_.address().to_string()                    },
-                                        {"thread count",            std::to_string(threadPool_.get_thread_count())},
-                                        {"local",                   config::FORCE_LOCAL ? "true" : "false"        },
-                                        {"db block cache size(MB)", std::to_string(config::BLOCK_CACHE_SIZE >> 20)},
-                                        {"db mem table size(MB)",   std::to_string(config::MEM_TABLE_SIZE >> 20)  },
-                                        {"db bloom filter bits",    std::to_string(config::BLOOM_FILTER_KEY_BITS) },
-                                        {"delta depth",             std::to_string(config::MAX_DELTA_DEPTH)       }
+                                        {"address",                 acc_.address().to_string()                       },
+                                        {"thread count",            std::to_string(threadPool_.get_thread_count())   },
+                                        {"local",                   config::FORCE_LOCAL ? "true" : "false"           },
+                                        {"db block cache size(MB)", std::to_string(config::GetBlockCacheSize() >> 20)},
+                                        {"db mem table size(MB)",   std::to_string(config::GetMemTableSize() >> 20)  },
+                                        {"db bloom filter bits",    std::to_string(config::GetBloomFilterKeyBits())  },
+                                        {"db batch size",           std::to_string(config::GetBatchSize())           },
+                                        {"container size(KB)",      std::to_string(config::GetContainerSize() >> 10) },
+                                        {"delta depth",             std::to_string(config::GetMaxDeltaDepth())       }
         })
                   << std::flush;
         while (true) {
@@ -65,7 +67,9 @@ public:
                           << std::flush;
             } else {
                 // add the task to the thread pool
+                Benchmark::LogSessionQueued();
                 threadPool_.push_task([this, sockHandler = sock.release()] {
+                    Benchmark::LogSessionStarted();
                     try {
                         /// socket to the client
                         auto sock = sockpp::tcp_socket{sockHandler};
@@ -82,6 +86,7 @@ public:
                         std::cerr << log::ERROR << "exception caught " << exception.what()
                                   << "\n\tAt: " << BOOST_CURRENT_LOCATION.to_string() << std::endl;
                     }
+                    Benchmark::LogSessionFinished();
                 });
             }
         }
@@ -5,37 +5,103 @@
 #ifndef DEDUP_SERVER_SERVICES_HPP
 #define DEDUP_SERVER_SERVICES_HPP
 
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <string>
 #include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "sockpp/tcp_socket.h"
 
 #include "dedup/dedup_core.hpp"
 #include "def/exception.hpp"
+#include "def/log.hpp"
 #include "def/struct.hpp"
 
 namespace dedup {
+class ClientUploadProgress {
+private:
+    user_id_t userID;
+    sockpp::tcp_socket &sock_;
+    ClientInterface &dedupObj_;
+
+    /// buffer for the request, with the file share meta head and the full file name of the unfinished file
+    std::unique_ptr<std::byte[]> requestBuffer_{nullptr};
+    packet_size_t requestSize_{};
+    std::array<std::byte, PACKET_HEADER_SIZE + sizeof(int)> responseData_{};
+
+    void receive_() {
+        // packet format: [number of total shares(uint32), file share meta head, full file name], the same as
+        // a batch of file share metas with one file and no share
+
+        // read the packet size
+        if (sock_.read_n(&requestSize_, sizeof(requestSize_)) == -1) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
+        }
+        if (requestSize_ > config::GetMetaBufferLen()) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "packet size is invalid",
+                                 {{"packet size", std::to_string(requestSize_)}});
+        }
+        // read the request
+        requestBuffer_ = std::make_unique<std::byte[]>(requestSize_);
+        if (sock_.read_n(requestBuffer_.get(), requestSize_) != static_cast<ssize_t>(requestSize_)) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
+        }
+    }
+
+    void respond_(int numOfPastSecrets) {
+        *reinterpret_cast<indicator_e *>(responseData_.data()) = indicator_e::RESP_UPLOAD_PROGRESS;
+        *reinterpret_cast<packet_size_t *>(responseData_.data() + INDICATOR_SIZE) = sizeof(numOfPastSecrets);
+        *reinterpret_cast<int *>(responseData_.data() + PACKET_HEADER_SIZE) = numOfPastSecrets;
+        if (sock_.write_n(responseData_.data(), responseData_.size()) == -1) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
+        }
+    }
+
+public:
+    ClientUploadProgress(const user_id_t &userID, sockpp::tcp_socket &sock, ClientInterface &dedupObj)
+        : userID(userID), sock_(sock), dedupObj_(dedupObj) {
+    }
+
+    void operator()() {
+        receive_();
+        auto [fileShareMeta, numOfTotalShares] = SplitFileShareBatch({requestBuffer_.get(), requestSize_}, 1).front();
+        respond_(dedupObj_.getUploadProgress(userID, fileShareMeta, numOfTotalShares));
+    }
+};
+
 class ClientUpload {
 private:
     const user_id_t userID_;
     sockpp::tcp_socket &sock_;
     ClientInterface &dedupObj_;
 
+    /// indicator of the coming file share meta, META, META_CACHED, META_BATCH or META_BATCH_CACHED
+    indicator_e indicator_;
+    /// number of shares in the cached file share meta on this connection that this user does not own
+    std::size_t numOfStaleShares_{0};
+    /// full file names of the files with such a share on this connection, whose recipes are not updated any more, so
+    /// that the last recipe of the file is kept, or the unfinished one is resumed when the client uploads it again
+    std::unordered_set<std::string> staleFiles_{};
     /// size of the file share meta
     packet_size_t metaSize_{0};
     /// size of the share data
     packet_size_t dataSize_{0};
-    /// number of shares in this file share
+    /// number of shares in this file share, or number of files in this batch of file shares
     uint32_t numOfTotalShares_{0};
-    /// number of coming shares in this file share fragment
+    /// number of coming shares in this file share fragment, or in all the file share fragments of this batch
     std::size_t numOfComingShares_{0};
+    /// the file share meta of each file in the meta buffer, with the number of total shares of its file
+    std::vector<std::pair<bytes_view, std::size_t>> fileShareMetas_;
     /// buffer for the file share meta
-    std::unique_ptr<std::byte[]> metaBuffer_{std::make_unique<std::byte[]>(config::META_BUFFER_LEN)};
+    std::unique_ptr<std::byte[]> metaBuffer_{std::make_unique<std::byte[]>(config::GetMetaBufferLen())};
     /// buffer for the response data
-    std::unique_ptr<std::byte[]> responseBuffer_{std::make_unique<std::byte[]>(config::STAT_BUFFER_LEN)};
+    std::unique_ptr<std::byte[]> responseBuffer_{std::make_unique<std::byte[]>(config::GetStatBufferLen())};
     /// buffer for the share data
-    std::unique_ptr<std::byte[]> dataBuffer_{std::make_unique<std::byte[]>(config::DATA_BUFFER_LEN)};
+    std::unique_ptr<std::byte[]> dataBuffer_{std::make_unique<std::byte[]>(config::GetDataBufferLen())};
 
     void firstStageReceive_() {
         // metadata format: [total packet size, number of total shares(uint32), metadata],
@@ -52,18 +118,40 @@ private:
         }
         metaSize_ -= sizeof(numOfTotalShares_);
 
+        // check whether the buffer can hold the metadata, where a packet size smaller than the number of shares
+        // wraps around
+        if (metaSize_ > config::GetMetaBufferLen()) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "buffer size is too small",
+                                 {{"packet size", std::to_string(metaSize_)}});
+        }
+
         // read the metadata
-        if (sock_.read_n(metaBuffer_.get(), metaSize_) == -1) {
+        if (sock_.read_n(metaBuffer_.get(), metaSize_) != static_cast<ssize_t>(metaSize_)) {
             throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
         }
+        // a batch packs the fragments of several files, each of which has its own recipe
+        if (indicator_ == indicator_e::META_BATCH || indicator_ == indicator_e::META_BATCH_CACHED) {
+            fileShareMetas_ = SplitFileShareBatch({metaBuffer_.get(), metaSize_}, numOfTotalShares_);
+        } else {
+            fileShareMetas_.clear();
+            fileShareMetas_.emplace_back(bytes_view{metaBuffer_.get(), metaSize_}, numOfTotalShares_);
+        }
+
         // read the number of coming shares
-        numOfComingShares_ = boost::numeric_cast<decltype(numOfComingShares_)>(
-            reinterpret_cast<const fileShareMetaHead_t *>(metaBuffer_.get())->numOfComingSecrets);
+        numOfComingShares_ = 0;
+        for (const auto &fileShareMeta : fileShareMetas_) {
+            numOfComingShares_ += boost::numeric_cast<decltype(numOfComingShares_)>(
+                reinterpret_cast<const fileShareMetaHead_t *>(fileShareMeta.first.data())->numOfComingSecrets);
+        }
+        if (PACKET_HEADER_SIZE + numOfComingShares_ > config::GetStatBufferLen()) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "buffer size is too small");
+        }
     }
 
     void firstStageRespond_() {
-        // set indicator and packet size
-        *reinterpret_cast<indicator_e *>(responseBuffer_.get()) = indicator_e::STAT;
+        // set indicator and packet size, the client learns from the indicator that its cache is stale
+        *reinterpret_cast<indicator_e *>(responseBuffer_.get()) =
+            numOfStaleShares_ > 0 ? indicator_e::STAT_STALE : indicator_e::STAT;
         *reinterpret_cast<packet_size_t *>(responseBuffer_.get() + INDICATOR_SIZE) =
             boost::numeric_cast<packet_size_t>(numOfComingShares_);
         if (sock_.write_n(responseBuffer_.get(), PACKET_HEADER_SIZE + numOfComingShares_) == -1) {
@@ -100,69 +188,136 @@ private:
         }
 
         // check whether the buffer can hold the data
-        if constexpr (config::PARANOID_CHECK) {
-            if (dataSize_ > config::DATA_BUFFER_LEN) {
-                throw DedupException(BOOST_CURRENT_LOCATION, "buffer size is too small");
-            }
+        if (dataSize_ > config::GetDataBufferLen()) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "buffer size is too small",
+                                 {{"packet size", std::to_string(dataSize_)}});
         }
 
-        // receive the share data
-        if (sock_.read_n(dataBuffer_.get(), dataSize_) == -1) {
+        // receive the share data, where a short read means the client is gone midway (e.g., killed before it
+        // resumes the upload), and the truncated shares must not be stored
+        if (sock_.read_n(dataBuffer_.get(), dataSize_) != static_cast<ssize_t>(dataSize_)) {
             throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
         }
     }
 
-    bool unfinished_() {
-        // receive the user id
-        user_id_t userID; // NOLINT(cppcoreguidelines-init-variables)
-        auto cnt = sock_.read_n(&userID, sizeof(userID));
-        if (cnt == 0) {
-            // socket is closed
-            return false;
-        }
-        if (cnt == -1) {
-            throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
-        }
-        if constexpr (config::PARANOID_CHECK) {
-            if (userID != userID_) {
-                throw DedupException(BOOST_CURRENT_LOCATION, "user id not match");
+    void cachedStageVerify_(const span<bool> &dupStat) {
+        // the client has uploaded every share of the cached meta before, so there is no share data to receive, and
+        // a share not owned by the user (e.g., the server is cleaned) is counted for the next status list, while the
+        // file it belongs to is already marked stale
+        auto numOfStaleShares = static_cast<std::size_t>(std::count(dupStat.begin(), dupStat.end(), false));
+        if (numOfStaleShares > 0) {
+            if (numOfStaleShares_ == 0) {
+                std::cerr << log::WARNING
+                          << log::FormatLog("stale client fingerprint cache",
+                                            {
+                                                {"user id",      std::to_string(userID_)         },
+                                                {"stale shares", std::to_string(numOfStaleShares)}
+                })
+                          << std::flush;
             }
+            numOfStaleShares_ += numOfStaleShares;
+            std::fill(dupStat.begin(), dupStat.end(), true);
         }
+        dataSize_ = 0;
+    }
 
-        // receive the indicator
+    bool unfinished_() {
         indicator_e indicator; // NOLINT(cppcoreguidelines-init-variables)
-        if (sock_.read_n(&indicator, sizeof(indicator)) == -1) {
-            throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
-        }
+        do {
+            // receive the user id
+            user_id_t userID; // NOLINT(cppcoreguidelines-init-variables)
+            auto cnt = sock_.read_n(&userID, sizeof(userID));
+            if (cnt == 0) {
+                // socket is closed
+                return false;
+            }
+            if (cnt == -1) {
+                throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
+            }
+            if constexpr (config::PARANOID_CHECK) {
+                if (userID != userID_) {
+                    throw DedupException(BOOST_CURRENT_LOCATION, "user id not match");
+                }
+            }
+
+            // receive the indicator
+            if (sock_.read_n(&indicator, sizeof(indicator)) == -1) {
+                throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
+            }
+
+            // the client asks for the upload progress of a file between two uploads, before it sends the file
+            if (indicator == indicator_e::UPLOAD_PROGRESS) {
+                ClientUploadProgress{userID_, sock_, dedupObj_}();
+            }
+        } while (indicator == indicator_e::UPLOAD_PROGRESS);
         if constexpr (config::PARANOID_CHECK) {
-            if (indicator != indicator_e::META) {
+            if (indicator != indicator_e::META && indicator != indicator_e::META_CACHED &&
+                indicator != indicator_e::META_BATCH && indicator != indicator_e::META_BATCH_CACHED) {
                 throw DedupException(BOOST_CURRENT_LOCATION, "unexpected indicator");
             }
         }
+        indicator_ = indicator;
 
         return true;
     }
 
 public:
-    ClientUpload(const user_id_t &userID, sockpp::tcp_socket &sock, ClientInterface &dedupObj)
-        : userID_(userID), sock_(sock), dedupObj_(dedupObj) {
+    ClientUpload(const user_id_t &userID, sockpp::tcp_socket &sock, ClientInterface &dedupObj,
+                 indicator_e indicator = indicator_e::META)
+        : userID_(userID), sock_(sock), dedupObj_(dedupObj), indicator_(indicator) {
     }
 
     void operator()() {
         do {
             // perform first stage deduplication
             firstStageReceive_();
-            dedupObj_.firstStageDedup(
-                userID_, {metaBuffer_.get(), metaSize_},
-                {reinterpret_cast<bool *>(responseBuffer_.get() + PACKET_HEADER_SIZE), numOfComingShares_});
-            firstStageRespond_();
-
-            // perform second stage deduplication
-            secondStageReceive_();
-            dedupObj_.secondStageDedup(
-                userID_, {metaBuffer_.get(), metaSize_}, {dataBuffer_.get(), dataSize_},
-                {reinterpret_cast<bool *>(responseBuffer_.get() + PACKET_HEADER_SIZE), numOfComingShares_},
-                numOfTotalShares_);
+            span<bool> dupStat{reinterpret_cast<bool *>(responseBuffer_.get() + PACKET_HEADER_SIZE),
+                               numOfComingShares_};
+            std::size_t shareIndex{0};
+            for (const auto &[fileShareMeta, numOfTotalShares] : fileShareMetas_) {
+                std::size_t numOfShares = std::get<2>(ParseFileShareMeta(fileShareMeta)).size();
+                dedupObj_.firstStageDedup(userID_, fileShareMeta, dupStat.subspan(shareIndex, numOfShares));
+                // a recipe must not refer to a cached share that the server does not store
+                if ((indicator_ == indicator_e::META_CACHED || indicator_ == indicator_e::META_BATCH_CACHED) &&
+                    std::find(dupStat.begin() + shareIndex, dupStat.begin() + shareIndex + numOfShares, false) !=
+                        dupStat.begin() + shareIndex + numOfShares) {
+                    staleFiles_.emplace(std::get<1>(ParseFileShareMeta(fileShareMeta)));
+                }
+                shareIndex += numOfShares;
+            }
+            if (indicator_ == indicator_e::META_CACHED || indicator_ == indicator_e::META_BATCH_CACHED) {
+                // the client neither waits for the status list nor sends the share data
+                cachedStageVerify_(dupStat);
+            } else {
+                firstStageRespond_();
+                secondStageReceive_();
+            }
+
+            // perform second stage deduplication, where the data of the unique shares of each file follow each other
+            shareIndex = 0;
+            std::size_t dataOffset{0};
+            for (const auto &[fileShareMeta, numOfTotalShares] : fileShareMetas_) {
+                auto shareMetaEntries = std::get<2>(ParseFileShareMeta(fileShareMeta));
+                std::size_t fileDataSize{0};
+                for (std::size_t i = 0; i < shareMetaEntries.size(); i++) {
+                    if (!dupStat[shareIndex + i]) {
+                        fileDataSize += boost::numeric_cast<std::size_t>(shareMetaEntries[i].shareSize);
+                    }
+                }
+                if (dataOffset + fileDataSize > dataSize_) {
+                    throw DedupException(BOOST_CURRENT_LOCATION, "share data is invalid");
+                }
+                // the fragments of a stale file are dropped, as the ones after a dropped one do not follow its recipe
+                if (staleFiles_.count(std::string{std::get<1>(ParseFileShareMeta(fileShareMeta))}) != 0) {
+                    shareIndex += shareMetaEntries.size();
+                    dataOffset += fileDataSize;
+                    continue;
+                }
+                dedupObj_.secondStageDedup(userID_, fileShareMeta, {dataBuffer_.get() + dataOffset, fileDataSize},
+                                           dupStat.subspan(shareIndex, shareMetaEntries.size()), numOfTotalShares);
+                shareIndex += shareMetaEntries.size();
+                dataOffset += fileDataSize;
+            }
         } while (unfinished_());
     }
 };
@@ -174,7 +329,7 @@ private:
     ClientInterface &dedupObj_;
 
     std::string fullFileName_{};
-    std::unique_ptr<std::byte[]> shareFileBuffer_{std::make_unique<std::byte[]>(config::SHARE_FILE_BUFFER_LEN)};
+    std::unique_ptr<std::byte[]> shareFileBuffer_{std::make_unique<std::byte[]>(config::GetShareFileBufferLen())};
 
     void receive_() {
         // read the size of the full file name
@@ -185,7 +340,7 @@ private:
         // resize the string for the full file name
         fullFileName_.resize(fileNameSize);
         // read the data
-        if (sock_.read_n(fullFileName_.data(), fileNameSize) == -1) {
+        if (sock_.read_n(fullFileName_.data(), fileNameSize) != static_cast<ssize_t>(fileNameSize)) {
             throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
         }
     }
@@ -207,7 +362,7 @@ public:
         receive_();
         dedupObj_.restoreShareFile(
             userID, fullFileName_,
-            {shareFileBuffer_.get() + PACKET_HEADER_SIZE, config::SHARE_FILE_BUFFER_LEN - PACKET_HEADER_SIZE},
+            {shareFileBuffer_.get() + PACKET_HEADER_SIZE, config::GetShareFileBufferLen() - PACKET_HEADER_SIZE},
             [this](std::size_t dataSize) { this->flush_(dataSize); });
     }
 };
@@ -281,7 +436,7 @@ class PeerInterUserIndex {
         dataSize_ -= fp_.size();
         // allocate a buffer and read the share data
         shareData_ = std::make_unique<std::byte[]>(dataSize_);
-        if (sock_.read_n(shareData_.get(), dataSize_) == -1) {
+        if (sock_.read_n(shareData_.get(), dataSize_) != static_cast<ssize_t>(dataSize_)) {
             throw DedupException(BOOST_CURRENT_LOCATION, "socket error");
         }
     }
@@ -378,11 +533,18 @@ public:
             // return a callable obj according to the indicator
             switch (indicator) {
             case indicator_e::META:
-                ClientUpload{userID, sock, dedupObj}();
+            case indicator_e::META_CACHED:
+            case indicator_e::META_BATCH:
+            case indicator_e::META_BATCH_CACHED:
+                ClientUpload{userID, sock, dedupObj, indicator}();
                 return;
             case indicator_e::DOWNLOAD:
                 ClientDownload{userID, sock, dedupObj}();
                 return;
+            case indicator_e::UPLOAD_PROGRESS:
+                // the client asks for the upload progress of a file before its first upload on the connection
+                ClientUploadProgress{userID, sock, dedupObj}();
+                break;
             case indicator_e::INTRA_USER_SHARE_IDX_UPDATE:
                 PeerIntraUserIndex{userID, sock, dedupObj}();
                 return;
@@ -16,6 +16,9 @@ struct ClientInterface { // NOLINT(cppcoreguidelines-special-member-functions)
     virtual void secondStageDedup(const user_id_t &userID, const bytes_view &shareMeta, const bytes_view &shareData,
                                   const span<const bool> &dupStat, const std::size_t &totalNumOfShares) = 0;
 
+    virtual int getUploadProgress(const user_id_t &userID, const bytes_view &shareMeta,
+                                  const std::size_t &totalNumOfShares) = 0;
+
     virtual void restoreShareFile(const user_id_t &userID, const std::string &fullFileName,
                                   const mutable_bytes_view &shareFileData,
                                   const std::function<void(std::size_t)> &flushCallBack) = 0;
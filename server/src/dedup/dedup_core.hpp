@@ -146,6 +146,23 @@ public:
         backend_.finishRecipeFile(userID, kFileShareMDHead, recipeKey);
     }
 
+    /**
+     * @brief get the number of secrets of an unfinished file that have been accepted, from which its upload can be
+     * resumed with a file share whose number of past secrets is that
+     * @param userID the user id
+     * @param shareMeta the file share metadata, whose head gives the file size and the digest of its content
+     * @param totalNumOfShares total number of shares of the file
+     * @return the number of accepted secrets, or 0 if the upload has to start over
+     */
+    int getUploadProgress(const user_id_t &userID, const bytes_view &shareMeta,
+                          const std::size_t &totalNumOfShares) override {
+        auto [kFileShareMDHead, fullFileNameView, shareMetaEntries] = ParseFileShareMeta(shareMeta);
+        auto fullFileName = FormatFullFileName(std::string{fullFileNameView});
+        auto recipeKey = BackendFacade::ToIndexKey(BackendFacade::IndexPrefix::RECIPE, ToRecipeFP(fullFileName, userID));
+        return backend_.getRecipeFileProgress(userID, recipeKey, kFileShareMDHead.fileSize,
+                                              kFileShareMDHead.contentDigest, totalNumOfShares);
+    }
+
     /**
      * @brief perform inter-user share index updating
      * @param shareFP share fingerprint
@@ -175,7 +192,7 @@ public:
                     auto &baseIndexValue = baseIndexValueOpt.value();
                     auto [kBaseShareIndexHead, baseShareUserRefEntries] = ParseShareIndex(
                         {reinterpret_cast<const std::byte *>(baseIndexValue.data()), baseIndexValue.size()});
-                    if (kBaseShareIndexHead.deltaDepth < config::MAX_DELTA_DEPTH) { // this share can be compressed
+                    if (kBaseShareIndexHead.deltaDepth < config::GetMaxDeltaDepth()) { // this share can be compressed
                         std::vector<std::byte> base(kBaseShareIndexHead.shareSize);
                         if (kBaseShareIndexHead.deltaDepth == 0) { // this base is a regular share
                             backend_.getShareData(kBaseShareIndexHead.containerName, kBaseShareIndexHead.offset, base);
@@ -286,16 +303,13 @@ public:
         auto recipeFP = ToRecipeFP(formattedFullFileName, userID);
         /// key for this recipe file
         auto recipeKey = BackendFacade::ToIndexKey(BackendFacade::IndexPrefix::RECIPE, recipeFP);
-        auto recipeValueOpt = backend_.getRecipeData(recipeKey);
-
-        if (recipeValueOpt) { // if such a recipe for full file name exists
-            /// span for the file recipe
-            auto &recipeValue = *recipeValueOpt;
+        /// root of the recipe file, which keeps its recipe chunks until the restore is done
+        auto recipeRoot = backend_.getRecipeRoot(recipeKey);
 
-            // read the file recipe head and entries
+        if (recipeRoot) { // if such a recipe for full file name exists
+            // read the file recipe head, while the entries are read recipe chunk by recipe chunk
             /// head of the file recipe (constant)
-            auto [kFileRecipeHead, kFileRecipeEntries] =
-                ParseFileRecipe({reinterpret_cast<const std::byte *>(recipeValue.data()), recipeValue.size()});
+            const auto &kFileRecipeHead = recipeRoot->recipeHead;
             restoreRecipeLap.stop();
 
             // set the share file head in the share file data buffer
@@ -311,29 +325,38 @@ public:
             if constexpr (config::LOOP_PARALLEL) { // perform each share restoring in parallel
                 throw DedupException(BOOST_CURRENT_LOCATION, "unimplemented");
             } else { // perform each share restoring serially
-                for (const auto &kFileRecipeEntry : kFileRecipeEntries) {
-                    // if the share file buffer cannot contain the coming data, flush the buffer
-                    /// size of the file share(share entry and share data)
-                    const std::size_t kFileShareSize = SHARE_ENTRY_SIZE + kFileRecipeEntry.shareSize;
-                    if (shareFileBufferOffset + kFileShareSize >= shareFileData.size()) {
-                        lap.stop();
-                        flushCallBack(shareFileBufferOffset);
-                        shareFileBufferOffset = 0;
-                        lap.start();
-                    }
+                for (std::size_t chunkIndex = 0;
+                     chunkIndex * config::RECIPE_CHUNK_ENTRY_NUM < static_cast<std::size_t>(kFileRecipeHead.numOfShares);
+                     chunkIndex++) {
+                    // only this recipe chunk is held, which stays in the mapped recipe segment
+                    restoreRecipeLap.start();
+                    auto recipeChunk = backend_.getRecipeChunk(recipeKey, *recipeRoot, chunkIndex);
+                    restoreRecipeLap.stop();
+                    for (const auto &kFileRecipeEntry : ParseRecipeChunk(recipeChunk.data())) {
+                        // if the share file buffer cannot contain the coming data, flush the buffer
+                        /// size of the file share(share entry and share data)
+                        const std::size_t kFileShareSize = SHARE_ENTRY_SIZE + kFileRecipeEntry.shareSize;
+                        if (shareFileBufferOffset + kFileShareSize >= shareFileData.size()) {
+                            lap.stop();
+                            flushCallBack(shareFileBufferOffset);
+                            shareFileBufferOffset = 0;
+                            lap.start();
+                        }
 
-                    // set the share entry
-                    auto &shareEntry = *reinterpret_cast<shareEntry_t *>(shareFileData.data() + shareFileBufferOffset);
-                    shareEntry.secretID = kFileRecipeEntry.secretID;
-                    shareEntry.secretSize = kFileRecipeEntry.secretSize;
-                    shareEntry.shareSize = kFileRecipeEntry.shareSize;
-                    shareFileBufferOffset += SHARE_ENTRY_SIZE;
-
-                    // perform share restore
-                    peerMediator_.restoreShare(kFileRecipeEntry.shareFP,
-                                               {shareFileData.data() + shareFileBufferOffset,
-                                                boost::numeric_cast<std::size_t>(kFileRecipeEntry.shareSize)});
-                    shareFileBufferOffset += kFileRecipeEntry.shareSize;
+                        // set the share entry
+                        auto &shareEntry =
+                            *reinterpret_cast<shareEntry_t *>(shareFileData.data() + shareFileBufferOffset);
+                        shareEntry.secretID = kFileRecipeEntry.secretID;
+                        shareEntry.secretSize = kFileRecipeEntry.secretSize;
+                        shareEntry.shareSize = kFileRecipeEntry.shareSize;
+                        shareFileBufferOffset += SHARE_ENTRY_SIZE;
+
+                        // perform share restore
+                        peerMediator_.restoreShare(kFileRecipeEntry.shareFP,
+                                                   {shareFileData.data() + shareFileBufferOffset,
+                                                    boost::numeric_cast<std::size_t>(kFileRecipeEntry.shareSize)});
+                        shareFileBufferOffset += kFileRecipeEntry.shareSize;
+                    }
                 }
             }
 
@@ -5,22 +5,186 @@
 #ifndef DEDUP_SERVER_BENCHMARK_HPP
 #define DEDUP_SERVER_BENCHMARK_HPP
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
 
 #include <boost/format.hpp>
+#include <boost/numeric/conversion/cast.hpp>
 
+#include "def/config.hpp"
 #include "def/exception.hpp"
 
 namespace dedup::benchmark {
 /**
- * @brief A timer that records the total time through multiple Laps
+ * @brief A log-bucketed (HDR-style) histogram for latencies in ticks
+ * @note values below 2^SUB_BUCKET_BITS are recorded exactly, and larger values are recorded in
+ * 2^SUB_BUCKET_BITS linear sub-buckets per power of 2, i.e. with a relative error below 2^-SUB_BUCKET_BITS. \n
+ * Each thread records into its own shard with uncontended relaxed stores, and the shards are merged on read.
+ */
+class Histogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS{5};
+    static constexpr std::size_t SUB_BUCKET_NUM{std::size_t{1} << SUB_BUCKET_BITS};
+    static constexpr std::size_t BUCKET_NUM{(64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_NUM};
+
+    /// a merged copy of the histogram
+    struct snapshot_t {
+        std::array<uint64_t, BUCKET_NUM> buckets{};
+        uint64_t count{0};
+        uint64_t sum{0};
+        uint64_t max{0};
+
+        /**
+         * @brief get the value at the percentile
+         * @param percentile percentile in [0, 100]
+         * @return the midpoint of the bucket where the percentile falls, or 0 if the histogram is empty
+         */
+        [[nodiscard]] uint64_t percentile(double percentile) const {
+            if (count == 0) {
+                return 0;
+            }
+            auto rank = static_cast<uint64_t>(std::ceil(percentile / 100 * static_cast<double>(count)));
+            rank = std::clamp<uint64_t>(rank, 1, count);
+            uint64_t seen{0};
+            for (std::size_t i = 0; i < BUCKET_NUM; ++i) {
+                seen += buckets[i];
+                if (seen >= rank) {
+                    return std::min(BucketLowerBound(i) + BucketWidth(i) / 2, max);
+                }
+            }
+            return max;
+        }
+    };
+
+private:
+    struct shard_t {
+        std::array<std::atomic<uint64_t>, BUCKET_NUM> buckets;
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+    };
+
+    /// id for indexing the thread local shard table, which is never reused
+    inline static std::atomic<std::size_t> NextID_{0};
+    const std::size_t id_{NextID_++};
+    std::mutex shardsMtx_{};
+    std::vector<std::unique_ptr<shard_t>> shards_{};
+
+    /**
+     * @brief get the shard of the calling thread, and register a new one on the first call of the thread
+     * @note the shards are owned by the histogram, so the records are kept after the thread exits
+     */
+    shard_t &localShard_() {
+        thread_local std::vector<shard_t *> localShards{};
+        if (id_ >= localShards.size()) {
+            localShards.resize(id_ + 1, nullptr);
+        }
+        auto &shard = localShards[id_];
+        if (shard == nullptr) {
+            std::lock_guard<decltype(shardsMtx_)> lockGuard{shardsMtx_};
+            shards_.push_back(std::make_unique<shard_t>());
+            shard = shards_.back().get();
+        }
+        return *shard;
+    }
+
+    /// add to a counter that is only written by the owner thread, avoiding a locked read-modify-write
+    static void Add_(std::atomic<uint64_t> &counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+public:
+    Histogram() = default;
+
+    Histogram(Histogram const &) = delete;
+
+    Histogram(Histogram &&) = delete;
+
+    Histogram &operator=(Histogram const &) = delete;
+
+    Histogram &operator=(Histogram &&) = delete;
+
+    static std::size_t BucketIndex(uint64_t value) {
+        if (value < SUB_BUCKET_NUM) {
+            return value;
+        }
+        auto exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+        auto subBucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_NUM - 1);
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKET_NUM + subBucket;
+    }
+
+    static uint64_t BucketLowerBound(std::size_t index) {
+        if (index < SUB_BUCKET_NUM) {
+            return index;
+        }
+        auto exponent = index / SUB_BUCKET_NUM + SUB_BUCKET_BITS - 1;
+        return (uint64_t{1} << exponent) | ((index % SUB_BUCKET_NUM) << (exponent - SUB_BUCKET_BITS));
+    }
+
+    static uint64_t BucketWidth(std::size_t index) {
+        if (index < SUB_BUCKET_NUM) {
+            return 1;
+        }
+        return uint64_t{1} << (index / SUB_BUCKET_NUM - 1);
+    }
+
+    /**
+     * @brief record a value
+     */
+    void record(uint64_t value) {
+        auto &shard = localShard_();
+        Add_(shard.buckets[BucketIndex(value)], 1);
+        Add_(shard.count, 1);
+        Add_(shard.sum, value);
+        if (value > shard.max.load(std::memory_order_relaxed)) {
+            shard.max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief merge the shards of all the threads
+     */
+    [[nodiscard]] snapshot_t snapshot() {
+        snapshot_t snapshot{};
+        std::lock_guard<decltype(shardsMtx_)> lockGuard{shardsMtx_};
+        for (const auto &shard : shards_) {
+            for (std::size_t i = 0; i < BUCKET_NUM; ++i) {
+                snapshot.buckets[i] += shard->buckets[i].load(std::memory_order_relaxed);
+            }
+            snapshot.count += shard->count.load(std::memory_order_relaxed);
+            snapshot.sum += shard->sum.load(std::memory_order_relaxed);
+            snapshot.max = std::max(snapshot.max, shard->max.load(std::memory_order_relaxed));
+        }
+        return snapshot;
+    }
+
+    /**
+     * @brief get the sum of the recorded values
+     */
+    [[nodiscard]] uint64_t sum() {
+        uint64_t sum{0};
+        std::lock_guard<decltype(shardsMtx_)> lockGuard{shardsMtx_};
+        for (const auto &shard : shards_) {
+            sum += shard->sum.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+};
+
+/**
+ * @brief A timer that records the total time and the latency distribution through multiple Laps
  */
 class Timer {
 private:
@@ -33,9 +197,26 @@ public:
 
 private:
     /**
-     * @brief total time recorded by this timer, representing the number of ticks
+     * @brief distribution of the laps recorded by this timer, in ticks
      */
-    std::atomic<rep_count_t> repCnt_;
+    mutable Histogram histogram_;
+
+    static std::string DurationToString(uint64_t ticks) {
+        auto nanosecs = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration_t{boost::numeric_cast<rep_count_t>(ticks)})
+                .count());
+        boost::format fmt{"%.1f%s"};
+        if (nanosecs < 1e3) {
+            fmt % nanosecs % "ns";
+        } else if (nanosecs < 1e6) {
+            fmt % (nanosecs / 1e3) % "us";
+        } else if (nanosecs < 1e9) {
+            fmt % (nanosecs / 1e6) % "ms";
+        } else {
+            fmt % (nanosecs / 1e9) % "s";
+        }
+        return fmt.str();
+    }
 
 public:
     Timer() = default;
@@ -52,14 +233,21 @@ public:
      * @brief getShareIndex the total time recorded by this timer
      */
     [[nodiscard]] auto getTotalDuration() const {
-        return duration_t{this->repCnt_};
+        return duration_t{boost::numeric_cast<rep_count_t>(histogram_.sum())};
+    }
+
+    /**
+     * @brief get the merged distribution of the laps recorded by this timer
+     */
+    [[nodiscard]] Histogram::snapshot_t getDistribution() const {
+        return histogram_.snapshot();
     }
 
     /**
      * @brief record a lap to the total time
      */
     void recordLap(const duration_t::rep &r) {
-        repCnt_ += r;
+        histogram_.record(r > 0 ? static_cast<uint64_t>(r) : 0);
     }
 
     /**
@@ -82,6 +270,21 @@ public:
         return strs.str();
     }
 
+    /**
+     * @brief convert the lap distribution to a string, in 'p50 p90 p99 p99.9 max (laps)' format
+     */
+    [[nodiscard]] std::string to_percentile_string() const {
+        auto distribution = getDistribution();
+        if (distribution.count == 0) {
+            return "no laps";
+        }
+        boost::format fmt{"p50 %1%, p90 %2%, p99 %3%, p99.9 %4%, max %5% (%6% laps)"};
+        fmt % DurationToString(distribution.percentile(50)) % DurationToString(distribution.percentile(90)) %
+            DurationToString(distribution.percentile(99)) % DurationToString(distribution.percentile(99.9)) %
+            DurationToString(distribution.max) % distribution.count;
+        return fmt.str();
+    }
+
     [[nodiscard]] uint64_t to_seconds() const {
         return std::chrono::duration_cast<std::chrono::seconds>(getTotalDuration()).count();
     }
@@ -284,6 +487,18 @@ private:
     inline static std::atomic<uint64_t> DedupSize_{0};
     inline static std::atomic<uint64_t> RecipeSize_{0};
 
+    inline static std::atomic<uint64_t> ContainerCacheHitCnt_{0};
+    inline static std::atomic<uint64_t> ContainerCacheMissCnt_{0};
+    inline static std::atomic<uint64_t> RecipeCacheHitCnt_{0};
+    inline static std::atomic<uint64_t> RecipeCacheMissCnt_{0};
+
+    inline static std::atomic<int64_t> SessionQueued_{0};
+    inline static std::atomic<int64_t> SessionRunning_{0};
+
+    static double HitRatio(uint64_t hitCnt, uint64_t missCnt) {
+        return hitCnt + missCnt == 0 ? 0 : static_cast<double>(hitCnt) / static_cast<double>(hitCnt + missCnt);
+    }
+
 public:
     static void Init() {
         static std::once_flag onceFlag{};
@@ -293,6 +508,83 @@ public:
         });
     }
 
+    /// a sample of a counter or a gauge for exporting
+    struct metricSample_t {
+        std::string_view name;
+        std::string_view help;
+        bool isCounter;
+        double value;
+    };
+
+    /// a timer for exporting
+    struct timerMetric_t {
+        std::string_view name;
+        std::string_view help;
+        const benchmark::Timer &timer;
+    };
+
+    /**
+     * @brief sample all the counters and gauges, which only loads the atomics
+     */
+    static std::vector<metricSample_t> MetricSamples() {
+        auto containerCacheHit = ContainerCacheHitCnt_.load();
+        auto containerCacheMiss = ContainerCacheMissCnt_.load();
+        auto recipeCacheHit = RecipeCacheHitCnt_.load();
+        auto recipeCacheMiss = RecipeCacheMissCnt_.load();
+        return {
+            {"unique_shares_total", "number of unique shares", true, static_cast<double>(UniqueCnt_.load())},
+            {"duplicate_shares_total", "number of duplicate shares", true, static_cast<double>(DuplicateCnt_.load())},
+            {"delta_compressed_shares_total", "number of delta compressed shares", true,
+             static_cast<double>(DeltaCompressedCnt_.load())},
+            {"secret_bytes_total", "total size of the secrets", true, static_cast<double>(SecretSize_.load())},
+            {"share_bytes_total", "total size of the stored shares", true, static_cast<double>(ShareSize_.load())},
+            {"dedup_bytes_total", "total size removed by deduplication", true, static_cast<double>(DedupSize_.load())},
+            {"delta_compressed_bytes_total", "total size removed by delta compression", true,
+             static_cast<double>(DeltaCompressedSize_.load())},
+            {"recipe_bytes_total", "total size of the file recipes", true, static_cast<double>(RecipeSize_.load())},
+            {"container_cache_hits_total", "number of hits in the read container cache", true,
+             static_cast<double>(containerCacheHit)},
+            {"container_cache_misses_total", "number of misses in the read container cache", true,
+             static_cast<double>(containerCacheMiss)},
+            {"recipe_cache_hits_total", "number of hits in the recipe cache", true,
+             static_cast<double>(recipeCacheHit)},
+            {"recipe_cache_misses_total", "number of misses in the recipe cache", true,
+             static_cast<double>(recipeCacheMiss)},
+            {"container_cache_hit_ratio", "hit ratio of the read container cache", false, HitRatio(containerCacheHit,
+             containerCacheMiss)},
+            {"recipe_cache_hit_ratio", "hit ratio of the recipe cache", false, HitRatio(recipeCacheHit,
+             recipeCacheMiss)},
+            {"session_queue_depth", "number of sessions waiting for a work thread", false,
+             static_cast<double>(SessionQueued_.load())},
+            {"sessions_running", "number of sessions being served", false, static_cast<double>(SessionRunning_.load())},
+        };
+    }
+
+    /**
+     * @brief get all the timers
+     */
+    static std::vector<timerMetric_t> TimerMetrics() {
+        return {
+            {"first_stage_dedup_seconds", "first stage deduplication time per file share fragment", FirstStageTimer()},
+            {"second_stage_dedup_seconds", "second stage deduplication time per file share fragment",
+             SecondStageTimer()},
+            {"super_feature_seconds", "super feature and delta computing time per unique share", SuperFeatureTimer()},
+            {"disk_write_seconds", "index writing time per update", DiskWriteTimer()},
+            {"restore_seconds", "restore time per file", RestoreTimer()},
+            {"restore_recipe_seconds", "recipe reading time per restored file", RestoreRecipeTimer()},
+            {"restore_share_index_seconds", "share index reading time per restored share", RestoreShareIndexTimer()},
+            {"restore_common_share_seconds", "restore time per unique/duplicate share", RestoreCommonShareTimer()},
+            {"restore_from_delta_seconds", "restore time per delta share", RestoreFromDeltaTimer()},
+            {"restore_delta_base_index_seconds", "base share index reading time per delta share",
+             RestoreDeltaBaseIndexTimer()},
+            {"restore_delta_base_share_data_seconds", "base share data reading time per delta share",
+             RestoreDeltaBaseShareDataTimer()},
+            {"restore_delta_share_data_seconds", "delta data reading time per delta share",
+             RestoreDeltaShareDataTimer()},
+            {"delta_restore_compute_seconds", "delta decoding time per delta share", DeltaRestoreComputeTimer()},
+        };
+    }
+
     static std::string Result() {
         boost::format outFmt{"[Benchmark]\n"
                              "\tfirst stage dedup time: %1%\n"
@@ -309,7 +601,13 @@ public:
                              "\tshare size: %14%\n"
                              "\tdedup size: %15%\n"
                              "\tdelta compressed size: %16%\n"
-                             "\trecipe size: %18%\n"};
+                             "\trecipe size: %18%\n"
+                             "\t-latency-\n"
+                             "\tfirst stage dedup: %19%\n"
+                             "\tsecond stage dedup: %20%\n"
+                             "\tsuper feature: %21%\n"
+                             "\trestore: %22%\n"
+                             "\tdisk write: %23%\n"};
         auto firstStageTime = FirstStageTimer().to_string();
         auto secondStageTime = SecondStageTimer().to_string();
         auto superFeatureTime = SuperFeatureTimer().to_string();
@@ -347,6 +645,11 @@ public:
         outFmt.bind_arg(16, deltaCompressedSize);
         outFmt.bind_arg(17, restoreFromDeltaTime);
         outFmt.bind_arg(18, recipeSize);
+        outFmt.bind_arg(19, FirstStageTimer().to_percentile_string());
+        outFmt.bind_arg(20, SecondStageTimer().to_percentile_string());
+        outFmt.bind_arg(21, SuperFeatureTimer().to_percentile_string());
+        outFmt.bind_arg(22, RestoreTimer().to_percentile_string());
+        outFmt.bind_arg(23, DiskWriteTimer().to_percentile_string());
 
         return outFmt.str();
     }
@@ -363,6 +666,14 @@ public:
                              "\tbase share data time: %7%\n"
                              "\tdelta data time: %8%\n"
                              "\tdelta compute time: %9%\n"
+                             "\t-latency per share-\n"
+                             "\tshare index: %10%\n"
+                             "\tunique/duplicate share: %11%\n"
+                             "\tdelta share: %12%\n"
+                             "\tbase share index: %13%\n"
+                             "\tbase share data: %14%\n"
+                             "\tdelta data: %15%\n"
+                             "\tdelta compute: %16%\n"
                              };
         outFmt.bind_arg(1, RestoreTimer().to_string());
         outFmt.bind_arg(2, RestoreFromDeltaTimer().to_string());
@@ -373,6 +684,13 @@ public:
         outFmt.bind_arg(7, RestoreDeltaBaseShareDataTimer().to_string());
         outFmt.bind_arg(8, RestoreDeltaShareDataTimer().to_string());
         outFmt.bind_arg(9, DeltaRestoreComputeTimer().to_string());
+        outFmt.bind_arg(10, RestoreShareIndexTimer().to_percentile_string());
+        outFmt.bind_arg(11, RestoreCommonShareTimer().to_percentile_string());
+        outFmt.bind_arg(12, RestoreFromDeltaTimer().to_percentile_string());
+        outFmt.bind_arg(13, RestoreDeltaBaseIndexTimer().to_percentile_string());
+        outFmt.bind_arg(14, RestoreDeltaBaseShareDataTimer().to_percentile_string());
+        outFmt.bind_arg(15, RestoreDeltaShareDataTimer().to_percentile_string());
+        outFmt.bind_arg(16, DeltaRestoreComputeTimer().to_percentile_string());
 
         return outFmt.str();
     }
@@ -470,6 +788,27 @@ public:
     static void LogRecipe(std::size_t recipeSize) {
         RecipeSize_ += recipeSize;
     }
+
+    static void LogContainerCache(bool hit) {
+        hit ? ContainerCacheHitCnt_++ : ContainerCacheMissCnt_++;
+    }
+
+    static void LogRecipeCache(bool hit) {
+        hit ? RecipeCacheHitCnt_++ : RecipeCacheMissCnt_++;
+    }
+
+    static void LogSessionQueued() {
+        SessionQueued_++;
+    }
+
+    static void LogSessionStarted() {
+        SessionQueued_--;
+        SessionRunning_++;
+    }
+
+    static void LogSessionFinished() {
+        SessionRunning_--;
+    }
 };
 } // namespace dedup
 
@@ -16,6 +16,7 @@
 #include <chrono>
 #include <vector>
 
+#include <boost/numeric/conversion/cast.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 
@@ -38,7 +39,29 @@ private:
      * ],\n
      * "database dir": "./meta/DedupDB/",\n
      * "container dir": "./meta/Container/",\n
-     * "clean": true\n
+     * "index engine": "leveldb",\n
+     * "clean": true,\n
+     * "work thread num": 0,\n
+     * "db mem table size(MB)": 512,\n
+     * "db block cache size(MB)": 1024,\n
+     * "db bloom filter bits": 20,\n
+     * "db batch size": 512,\n
+     * "hash table init capacity": 1048576,\n
+     * "hash table wal limit(MB)": 64,\n
+     * "container size(KB)": 256,\n
+     * "container cache size": 32768,\n
+     * "recipe segment size(MB)": 64,\n
+     * "recipe cache size(MB)": 64,\n
+     * "max delta depth": 1,\n
+     * "unfinished recipe timeout(s)": 86400,\n
+     * "data buffer size(MB)": 4,\n
+     * "meta buffer size(MB)": 2,\n
+     * "stat buffer size(MB)": 2,\n
+     * "share file buffer size(MB)": 4,\n
+     * "metrics port": 0,\n
+     * "metrics unix socket": "",\n
+     * "metrics json file": "",\n
+     * "metrics json interval(s)": 60\n
      * }\n
      */
     static constexpr std::string_view DEFAULT_CONFIG = {"{\n"
@@ -50,7 +73,29 @@ private:
                                                         "  ],\n"
                                                         "  \"database dir\": \"./meta/DedupDB/\",\n"
                                                         "  \"container dir\": \"./meta/Container/\",\n"
-                                                        "  \"clean\": true\n"
+                                                        "  \"index engine\": \"leveldb\",\n"
+                                                        "  \"clean\": true,\n"
+                                                        "  \"work thread num\": 0,\n"
+                                                        "  \"db mem table size(MB)\": 512,\n"
+                                                        "  \"db block cache size(MB)\": 1024,\n"
+                                                        "  \"db bloom filter bits\": 20,\n"
+                                                        "  \"db batch size\": 512,\n"
+                                                        "  \"hash table init capacity\": 1048576,\n"
+                                                        "  \"hash table wal limit(MB)\": 64,\n"
+                                                        "  \"container size(KB)\": 256,\n"
+                                                        "  \"container cache size\": 32768,\n"
+                                                        "  \"recipe segment size(MB)\": 64,\n"
+                                                        "  \"recipe cache size(MB)\": 64,\n"
+                                                        "  \"max delta depth\": 1,\n"
+                                                        "  \"unfinished recipe timeout(s)\": 86400,\n"
+                                                        "  \"data buffer size(MB)\": 4,\n"
+                                                        "  \"meta buffer size(MB)\": 2,\n"
+                                                        "  \"stat buffer size(MB)\": 2,\n"
+                                                        "  \"share file buffer size(MB)\": 4,\n"
+                                                        "  \"metrics port\": 0,\n"
+                                                        "  \"metrics unix socket\": \"\",\n"
+                                                        "  \"metrics json file\": \"\",\n"
+                                                        "  \"metrics json interval(s)\": 60\n"
                                                         "}"};
     /*
      * The default configuration used when the relevant configuration is not available
@@ -60,7 +105,35 @@ private:
     static constexpr bool DEFAULT_CLEAR_DIR_{true};
     static constexpr std::string_view DEFAULT_DB_DIR_{"./meta/DedupDB/"};
     static constexpr std::string_view DEFAULT_CONTAINER_DIR_{"./meta/Container/"};
+    static constexpr std::string_view DEFAULT_INDEX_ENGINE_{"leveldb"};
+    static constexpr std::size_t DEFAULT_MEM_TABLE_SIZE_{512 << 20};
+    static constexpr std::size_t DEFAULT_BLOCK_CACHE_SIZE_{1 << 30};
+    static constexpr int DEFAULT_BLOOM_FILTER_KEY_BITS_{20};
+    static constexpr int DEFAULT_BATCH_SIZE_{512};
+    static constexpr std::size_t DEFAULT_HASH_TABLE_INIT_CAPACITY_{1 << 20};
+    static constexpr std::size_t DEFAULT_HASH_TABLE_WAL_LIMIT_{64 << 20};
+    static constexpr std::size_t DEFAULT_CONTAINER_SIZE_{256 << 10};
+    static constexpr std::size_t DEFAULT_CONTAINER_CACHE_SIZE_{1024 * 32};
+    static constexpr std::size_t DEFAULT_RECIPE_SEGMENT_SIZE_{64 << 20};
+    static constexpr std::size_t DEFAULT_RECIPE_CACHE_SIZE_{64 << 20};
+    static constexpr int DEFAULT_MAX_DELTA_DEPTH_{1};
+    static constexpr int DEFAULT_UNFINISHED_RECIPE_TIMEOUT_{24 * 3600};
+    static constexpr std::size_t DEFAULT_DATA_BUFFER_LEN_{4 << 20};
+    static constexpr std::size_t DEFAULT_META_BUFFER_LEN_{2 << 20};
+    static constexpr std::size_t DEFAULT_STAT_BUFFER_LEN_{2 << 20};
+    static constexpr std::size_t DEFAULT_SHARE_FILE_BUFFER_LEN_{4 << 20};
+    static constexpr int DEFAULT_METRICS_JSON_INTERVAL_{60};
+    /// size of the share data in a packet that the client sends on upload and receives on download at most
+    static constexpr std::size_t CLIENT_PACKET_DATA_LEN_{4 << 20};
 
+public:
+    /// key-value engines available for the share index
+    enum class index_engine_e {
+        LEVELDB,
+        HASH_TABLE,
+    };
+
+private:
     /* dynamic switch options, defined at run time */
     /// whether to clear the directory if it exists, default to true
     inline static bool clearDir_;
@@ -68,15 +141,85 @@ private:
     inline static std::string dbDir_;
     /// container file directory
     inline static std::string containerDir_;
-    /// recipe file directory
+    /// key-value engine for the share index, default to LevelDB
+    inline static index_engine_e indexEngine_;
+    /// directory of the recipe segments, under the container directory
     inline static std::string recipeDir_;
+    /// directory of the journals of the unfinished recipe files, under the container directory
+    inline static std::string recipeJournalDir_;
     /// number of the working thread, default to DEFAULT_WORK_THREAD_NUM_
     inline static int workThreadNum_;
+    /// LevelDB mem table size in bytes
+    inline static std::size_t memTableSize_{DEFAULT_MEM_TABLE_SIZE_};
+    /// LevelDB block cache size in bytes
+    inline static std::size_t blockCacheSize_{DEFAULT_BLOCK_CACHE_SIZE_};
+    /// bits per key of the LevelDB bloom filter
+    inline static int bloomFilterKeyBits_{DEFAULT_BLOOM_FILTER_KEY_BITS_};
+    /// number of index updates in a write batch, 0 for writing without batching
+    inline static int batchSize_{DEFAULT_BATCH_SIZE_};
+    /// initial number of slots for a new hash table index
+    inline static std::size_t hashTableInitCapacity_{DEFAULT_HASH_TABLE_INIT_CAPACITY_};
+    /// the write-ahead log of the hash table index is checkpointed when its size in bytes exceeds this limit
+    inline static std::size_t hashTableWalLimit_{DEFAULT_HASH_TABLE_WAL_LIMIT_};
+    /// size of a container file in bytes
+    inline static std::size_t containerSize_{DEFAULT_CONTAINER_SIZE_};
+    /// number of containers in the read container cache
+    inline static std::size_t containerCacheSize_{DEFAULT_CONTAINER_CACHE_SIZE_};
+    /// size of a recipe segment file in bytes, unless a recipe is larger
+    inline static std::size_t recipeSegmentSize_{DEFAULT_RECIPE_SEGMENT_SIZE_};
+    /// total size in bytes of the recipes in the recipe cache
+    inline static std::size_t recipeCacheSize_{DEFAULT_RECIPE_CACHE_SIZE_};
+    /// maximum depth of a delta chain
+    inline static std::uint8_t maxDeltaDepth_{DEFAULT_MAX_DELTA_DEPTH_};
+    /// an unfinished recipe file is dropped with its journal when no share of it arrives for this long
+    inline static std::chrono::seconds unfinishedRecipeTimeout_{DEFAULT_UNFINISHED_RECIPE_TIMEOUT_};
+    /// size of the data buffer in bytes
+    inline static std::size_t dataBufferLen_{DEFAULT_DATA_BUFFER_LEN_};
+    /// size of the meta data buffer in bytes
+    inline static std::size_t metaBufferLen_{DEFAULT_META_BUFFER_LEN_};
+    /// size of the status list buffer in bytes
+    inline static std::size_t statBufferLen_{DEFAULT_STAT_BUFFER_LEN_};
+    /// size of the share file buffer in bytes
+    inline static std::size_t shareFileBufferLen_{DEFAULT_SHARE_FILE_BUFFER_LEN_};
+    /// local TCP port for the metrics endpoint, 0 for disabled
+    inline static in_port_t metricsPort_{0};
+    /// Unix socket path for the metrics endpoint, empty for disabled
+    inline static std::string metricsUnixSocket_{};
+    /// file for the periodic JSON metrics snapshots, empty for disabled
+    inline static std::string metricsJsonFile_{};
+    /// interval for the JSON metrics snapshots
+    inline static std::chrono::seconds metricsJsonInterval_{DEFAULT_METRICS_JSON_INTERVAL_};
     /// addresses of server clusters
     inline static std::vector<sockpp::inet_address> clusterAddress_;
     /// the addresses index of this server node in the config file
     inline static std::size_t selfIndex_;
 
+    /**
+     * @brief read a numeric option from ptree, and exit if it is out of range
+     * @param ptree configuration ptree, read from json
+     * @param name name of the option
+     * @param defaultValue value used when the option is absent
+     * @param minValue minimum valid value
+     * @param maxValue maximum valid value
+     */
+    template <typename T>
+    static T GetBoundedOption_(const boost::property_tree::ptree &ptree, const std::string &name, T defaultValue,
+                               T minValue, T maxValue) {
+        auto value = ptree.get<T>(name, defaultValue);
+        if (value < minValue || value > maxValue) {
+            std::cerr << log::ERROR
+                      << log::FormatLog("the option in the config file is out of range",
+                                        {
+                                            {"option",      name                   },
+                                            {"value",       std::to_string(value)   },
+                                            {"valid range", std::to_string(minValue) + " ~ " + std::to_string(maxValue)}
+            })
+                      << std::endl;
+            exit(-1);
+        }
+        return value;
+    }
+
     /**
      * @brief parse the configuration form ptree
      * @param ptree configuration ptree, read from json
@@ -107,14 +250,88 @@ private:
             clearDir_ = ptree.get<bool>("clean", DEFAULT_CLEAR_DIR_);
             dbDir_ = ptree.get<std::string>("database dir", std::string{DEFAULT_DB_DIR_});
             containerDir_ = ptree.get<std::string>("container dir", std::string{DEFAULT_CONTAINER_DIR_});
+            recipeDir_ = (std::filesystem::path{containerDir_} / "recipe").string() + '/';
+            recipeJournalDir_ = (std::filesystem::path{containerDir_} / "journal").string() + '/';
+
+            // read the index engine option
+            auto indexEngine = ptree.get<std::string>("index engine", std::string{DEFAULT_INDEX_ENGINE_});
+            if (indexEngine == "leveldb") {
+                indexEngine_ = index_engine_e::LEVELDB;
+            } else if (indexEngine == "hash table") {
+                indexEngine_ = index_engine_e::HASH_TABLE;
+            } else {
+                std::cerr << log::ERROR
+                          << log::FormatLog("the index engine in the config file is invalid",
+                                            {
+                                                {"index engine",     indexEngine              },
+                                                {"available engines", "\"leveldb\", \"hash table\""}
+                })
+                          << std::endl;
+                exit(-1);
+            }
 
             // load the working thread number, default to hardware concurrency,
-            // or DEFAULT_WORK_THREAD_NUM_(6) if hardware concurrency is not available,
-            workThreadNum_ =
-                std::thread::hardware_concurrency() == 0
-                    ? DEFAULT_WORK_THREAD_NUM_
-                    : boost::numeric_cast<decltype(workThreadNum_)>(
-                          std::thread::hardware_concurrency()); // NOLINT(cppcoreguidelines-narrowing-conversions)
+            // or DEFAULT_WORK_THREAD_NUM_(6) if hardware concurrency is not available
+            workThreadNum_ = GetBoundedOption_(ptree, "work thread num", 0, 0, 1024);
+            if (workThreadNum_ == 0) {
+                workThreadNum_ =
+                    std::thread::hardware_concurrency() == 0
+                        ? DEFAULT_WORK_THREAD_NUM_
+                        : boost::numeric_cast<decltype(workThreadNum_)>(
+                              std::thread::hardware_concurrency()); // NOLINT(cppcoreguidelines-narrowing-conversions)
+            }
+
+            // read the index options
+            constexpr std::size_t kMB = 1 << 20;
+            constexpr std::size_t kKB = 1 << 10;
+            memTableSize_ = kMB * GetBoundedOption_(ptree, "db mem table size(MB)", DEFAULT_MEM_TABLE_SIZE_ / kMB,
+                                                    std::size_t{1}, std::size_t{1} << 10);
+            blockCacheSize_ = kMB * GetBoundedOption_(ptree, "db block cache size(MB)",
+                                                      DEFAULT_BLOCK_CACHE_SIZE_ / kMB, std::size_t{1},
+                                                      std::size_t{1} << 20);
+            bloomFilterKeyBits_ =
+                GetBoundedOption_(ptree, "db bloom filter bits", DEFAULT_BLOOM_FILTER_KEY_BITS_, 0, 64);
+            batchSize_ = GetBoundedOption_(ptree, "db batch size", DEFAULT_BATCH_SIZE_, 0, 1 << 20);
+            hashTableInitCapacity_ =
+                GetBoundedOption_(ptree, "hash table init capacity", DEFAULT_HASH_TABLE_INIT_CAPACITY_,
+                                  std::size_t{1} << 10, std::size_t{1} << 34);
+            hashTableWalLimit_ = kMB * GetBoundedOption_(ptree, "hash table wal limit(MB)",
+                                                         DEFAULT_HASH_TABLE_WAL_LIMIT_ / kMB, std::size_t{1},
+                                                         std::size_t{1} << 16);
+
+            // read the container, cache and delta options
+            containerSize_ = kKB * GetBoundedOption_(ptree, "container size(KB)", DEFAULT_CONTAINER_SIZE_ / kKB,
+                                                     std::size_t{64}, std::size_t{1} << 20);
+            containerCacheSize_ = GetBoundedOption_(ptree, "container cache size", DEFAULT_CONTAINER_CACHE_SIZE_,
+                                                    std::size_t{1}, std::size_t{1} << 24);
+            recipeSegmentSize_ = kMB * GetBoundedOption_(ptree, "recipe segment size(MB)",
+                                                         DEFAULT_RECIPE_SEGMENT_SIZE_ / kMB, std::size_t{1},
+                                                         std::size_t{1} << 10);
+            recipeCacheSize_ = kMB * GetBoundedOption_(ptree, "recipe cache size(MB)",
+                                                       DEFAULT_RECIPE_CACHE_SIZE_ / kMB, std::size_t{1},
+                                                       std::size_t{1} << 20);
+            // read as int, since ptree treats uint8_t as a character
+            maxDeltaDepth_ = GetBoundedOption_(ptree, "max delta depth", DEFAULT_MAX_DELTA_DEPTH_, 0, 255);
+            unfinishedRecipeTimeout_ = std::chrono::seconds{GetBoundedOption_(
+                ptree, "unfinished recipe timeout(s)", DEFAULT_UNFINISHED_RECIPE_TIMEOUT_, 60, 30 * 24 * 3600)};
+
+            // read the buffer options, bounded by the packet size of the client
+            dataBufferLen_ = kMB * GetBoundedOption_(ptree, "data buffer size(MB)", DEFAULT_DATA_BUFFER_LEN_ / kMB,
+                                                     CLIENT_PACKET_DATA_LEN_ / kMB, std::size_t{1} << 10);
+            metaBufferLen_ = kMB * GetBoundedOption_(ptree, "meta buffer size(MB)", DEFAULT_META_BUFFER_LEN_ / kMB,
+                                                     std::size_t{1}, std::size_t{1} << 10);
+            statBufferLen_ = kMB * GetBoundedOption_(ptree, "stat buffer size(MB)", DEFAULT_STAT_BUFFER_LEN_ / kMB,
+                                                     std::size_t{1}, std::size_t{1} << 10);
+            shareFileBufferLen_ =
+                kMB * GetBoundedOption_(ptree, "share file buffer size(MB)", DEFAULT_SHARE_FILE_BUFFER_LEN_ / kMB,
+                                        std::size_t{1}, CLIENT_PACKET_DATA_LEN_ / kMB);
+
+            // read the metrics options
+            metricsPort_ = boost::numeric_cast<in_port_t>(GetBoundedOption_(ptree, "metrics port", 0, 0, 65535));
+            metricsUnixSocket_ = ptree.get<std::string>("metrics unix socket", "");
+            metricsJsonFile_ = ptree.get<std::string>("metrics json file", "");
+            metricsJsonInterval_ = std::chrono::seconds{
+                GetBoundedOption_(ptree, "metrics json interval(s)", DEFAULT_METRICS_JSON_INTERVAL_, 1, 24 * 3600)};
         } catch (boost::property_tree::ptree_error &exception) {
             std::cerr << log::ERROR << "exception occurs when loading config:" << exception.what() << '\n'
                       << "proper config format:\n"
@@ -196,6 +413,98 @@ public:
         return containerDir_;
     }
 
+    static const std::string &GetRecipeDir() {
+        return recipeDir_;
+    }
+
+    static const std::string &GetRecipeJournalDir() {
+        return recipeJournalDir_;
+    }
+
+    static index_engine_e GetIndexEngine() {
+        return indexEngine_;
+    }
+
+    static std::size_t GetMemTableSize() {
+        return memTableSize_;
+    }
+
+    static std::size_t GetBlockCacheSize() {
+        return blockCacheSize_;
+    }
+
+    static int GetBloomFilterKeyBits() {
+        return bloomFilterKeyBits_;
+    }
+
+    static int GetBatchSize() {
+        return batchSize_;
+    }
+
+    static std::size_t GetHashTableInitCapacity() {
+        return hashTableInitCapacity_;
+    }
+
+    static std::size_t GetHashTableWalLimit() {
+        return hashTableWalLimit_;
+    }
+
+    static std::size_t GetContainerSize() {
+        return containerSize_;
+    }
+
+    static std::size_t GetContainerCacheSize() {
+        return containerCacheSize_;
+    }
+
+    static std::size_t GetRecipeSegmentSize() {
+        return recipeSegmentSize_;
+    }
+
+    static std::size_t GetRecipeCacheSize() {
+        return recipeCacheSize_;
+    }
+
+    static std::uint8_t GetMaxDeltaDepth() {
+        return maxDeltaDepth_;
+    }
+
+    static std::chrono::seconds GetUnfinishedRecipeTimeout() {
+        return unfinishedRecipeTimeout_;
+    }
+
+    static std::size_t GetDataBufferLen() {
+        return dataBufferLen_;
+    }
+
+    static std::size_t GetMetaBufferLen() {
+        return metaBufferLen_;
+    }
+
+    static std::size_t GetStatBufferLen() {
+        return statBufferLen_;
+    }
+
+    static std::size_t GetShareFileBufferLen() {
+        return shareFileBufferLen_;
+    }
+
+    static in_port_t GetMetricsPort() {
+        return metricsPort_;
+    }
+
+    static const std::string &GetMetricsUnixSocket() {
+        return metricsUnixSocket_;
+    }
+
+    static const std::string &GetMetricsJsonFile() {
+        return metricsJsonFile_;
+    }
+
+    static std::chrono::seconds GetMetricsJsonInterval() {
+        return metricsJsonInterval_;
+    }
+
     /* static switch options, defined at compile time */
     /// debug option: force DedupCore to execute PeerInterface locally
     static constexpr bool FORCE_LOCAL{true};
@@ -208,36 +517,18 @@ public:
     static constexpr int MAX_CONN_NUM{FORCE_LOCAL ? 0 : 200};
     /// queue size for server acceptor
     static constexpr int ACC_QUEUE_SIZE{20};
-    /// default size for the data buffer
-    static constexpr int32_t DATA_BUFFER_LEN{4 << 20};
-    /// default size fot the meta data buffer
-    static constexpr int32_t META_BUFFER_LEN{2 << 20};
-    /// default size for the status list buffer
-    static constexpr int32_t STAT_BUFFER_LEN{2 << 20};
-    /// default size for the share file buffer
-    static constexpr int32_t SHARE_FILE_BUFFER_LEN{4 << 20};
     /// size of the fingerprint with the use of SHA-256 CryptoPrimitive instance
     static constexpr int32_t FP_SIZE{32};
     /// size of the key
     static constexpr int32_t KEY_SIZE{FP_SIZE + 1};
 
-    /*config for LevelDB option settings*/
-    static constexpr int32_t MEM_TABLE_SIZE{512 << 20};
-    static constexpr int32_t BLOCK_CACHE_SIZE{1 << 30};
-    static constexpr int32_t BLOOM_FILTER_KEY_BITS{20};
-    static constexpr int32_t BATCH_SIZE{512};
-
     /* config for container */
-    static constexpr std::size_t CONTAINER_SIZE{256 << 10};
     static constexpr std::size_t INTERNAL_FILE_NAME_SIZE{16};
-    static constexpr std::size_t CONTAINER_CACHE_SIZE{1024 * 32};
 
-    /* config for recipe cache */
-    static constexpr std::size_t RECIPE_CACHE_SIZE{3};
-    
-    /* config for delta compress */
-    static constexpr std::uint8_t MAX_DELTA_DEPTH{1};
-    
+    /* config for recipe */
+    /// number of file recipe entries in a recipe chunk, and the last recipe chunk of a file may have fewer
+    static constexpr std::size_t RECIPE_CHUNK_ENTRY_NUM{4096};
+
     /* config for benchmark */
     /// file name for benchmark log
     static constexpr std::string_view BENCHMARK_LOG_NAME{"benchmark-log"};
@@ -10,6 +10,7 @@
 #include "sockpp/socket.h"
 
 #include "backend/db_wrapper.hpp"
+#include "comm/metrics_exporter.hpp"
 #include "def/benchmark.hpp"
 #include "def/config.hpp"
 #include "def/util.hpp"
@@ -48,6 +49,13 @@ public:
         Benchmark::Init();
         Delta::Init();
 
+        try {
+            MetricsExporter::Init();
+        } catch (DedupException &e) {
+            std::cerr << log::ERROR << e.what() << std::endl;
+            exit(-1);
+        }
+
         try {
             crypto_primitive::CryptoPrimitive::OpensslLockSetup();
         } catch (std::exception &e) {
@@ -34,8 +34,25 @@ enum class indicator_e : int32_t {
     DATA = -2,
     /// login server sends dedup status list to client
     STAT = -3,
+    /// client sends file share metadata of shares it has uploaded before, which
+    /// the login server verifies without a status list nor the share data
+    META_CACHED = -4,
+    /// login server sends dedup status list to client, and reports that some
+    /// shares of the cached metadata on this connection are not stored
+    STAT_STALE = -6,
     /// client requests download
     DOWNLOAD = -7,
+    /// client sends the file share metadata of several files in one batch, each
+    /// prefixed by the number of total shares of its file
+    META_BATCH = -12,
+    /// client sends a batch of file share metadata of shares it has uploaded
+    /// before, as META_CACHED does
+    META_BATCH_CACHED = -13,
+    /// client asks how many secrets of an unfinished file the login server has
+    /// durably accepted, to resume uploading the file from there
+    UPLOAD_PROGRESS = -19,
+    /// login server returns the number of accepted secrets of the unfinished file
+    RESP_UPLOAD_PROGRESS = -20,
     /// the server sends part of the chunk to the client on downloading file
     RESP_DOWNLOAD = -5,
     /// server sends a share fp to perform the intra-user share index update to a
@@ -74,6 +91,7 @@ struct fileShareMetaHead_t {
     long sizeOfPastSecrets;
     int numOfComingSecrets; // number of the secrets in the file share to be processed
     long sizeOfComingSecrets;
+    uint64_t contentDigest; // digest of the file content, without which an interrupted upload is not resumed
 };
 /// size of the head structure of the file share metadata
 inline constexpr int FILE_SHARE_META_HEAD_SIZE{sizeof(fileShareMetaHead_t)};
@@ -119,7 +137,7 @@ inline constexpr int SHARE_USER_REF_ENTRY_SIZE{sizeof(shareUserRefEntry_t)};
 /**
  * @brief the head structure of the recipes of a file
  * @note file recipe format: [fileRecipeHead_t + fileRecipeEntry_t ...
- * fileRecipeEntry_t]
+ * fileRecipeEntry_t], in which the earlier versions store a whole recipe file
  */
 struct fileRecipeHead_t {
     user_id_t userID;
@@ -129,6 +147,76 @@ struct fileRecipeHead_t {
 /// size of the head structure of the recipes of a file
 inline constexpr int FILE_RECIPE_HEAD_SIZE{sizeof(fileRecipeHead_t)};
 
+/**
+ * @brief the root of a finished file recipe, which is stored under the recipe key, while its entries are stored in
+ * recipe chunks of config::RECIPE_CHUNK_ENTRY_NUM entries, each under a key derived from the recipe key, the
+ * generation and the index of the chunk
+ * @note recipe chunk format: [fileRecipeEntry_t ... fileRecipeEntry_t]
+ */
+struct fileRecipeRoot_t {
+    fileRecipeHead_t recipeHead;
+    /// generation of the recipe chunks, which is new for each upload of the file
+    uint64_t generation;
+};
+/// size of the root of a finished file recipe
+inline constexpr int FILE_RECIPE_ROOT_SIZE{sizeof(fileRecipeRoot_t)};
+
+/**
+ * @brief the head structure of the journal of an unfinished recipe file
+ * @note recipe journal format: [recipeJournalHead_t + fileRecipeEntry_t ...
+ * fileRecipeEntry_t], where the entries are those of the secrets accepted after the ones in the recipe chunks
+ * written out so far
+ */
+struct recipeJournalHead_t {
+    fileRecipeHead_t recipeHead;
+    uint64_t totalNumOfShares;
+    /// generation of the recipe chunks of the upload
+    uint64_t generation;
+    /// number of the entries in the recipe chunks written out
+    uint64_t numOfSealedShares;
+    /// digest of the content of the file being uploaded
+    uint64_t contentDigest;
+};
+/// size of the head structure of the journal of an unfinished recipe file
+inline constexpr int RECIPE_JOURNAL_HEAD_SIZE{sizeof(recipeJournalHead_t)};
+
+/**
+ * @brief the location of a file recipe root or a recipe chunk in the recipe segments, which is the value of its index
+ * @note recipe segment format: [recipeRecordHead_t + recipe + padding ... recipeRecordHead_t + recipe + padding],
+ * where each record starts at an offset aligned to RECIPE_ALIGNMENT, and the location is that of the recipe after the
+ * head.
+ */
+struct recipeLocation_t {
+    internal_file_name_t segmentName;
+    std::size_t offset;
+    std::size_t size;
+};
+/// size of the location of a recipe in the recipe segments
+inline constexpr int RECIPE_LOCATION_SIZE{sizeof(recipeLocation_t)};
+/// alignment of a recipe in a recipe segment, which is that of a file recipe root
+inline constexpr std::size_t RECIPE_ALIGNMENT{alignof(fileRecipeRoot_t)};
+
+/**
+ * @brief the head of a recipe record in a recipe segment, by which the recipes still indexed are found when the
+ * segment is compacted
+ */
+struct recipeRecordHead_t {
+    key_t key;
+    uint64_t size;
+};
+/// size of the head of a recipe record
+inline constexpr std::size_t RECIPE_RECORD_HEAD_SIZE{sizeof(recipeRecordHead_t)};
+
+/// usage of a recipe segment, which is the value of its index
+struct recipeSegmentUsage_t {
+    /// end of the records appended to the segment
+    uint64_t tail;
+    /// total size of the records whose recipes are still indexed, with their padding
+    uint64_t liveSize;
+};
+/// size of the usage of a recipe segment
+inline constexpr int RECIPE_SEGMENT_USAGE_SIZE{sizeof(recipeSegmentUsage_t)};
+
 /// the entry structure of the recipes of a file
 struct fileRecipeEntry_t {
     fingerprint_t shareFP;
@@ -5,6 +5,7 @@
 #ifndef DEDUP_SERVER_UTIL_HPP
 #define DEDUP_SERVER_UTIL_HPP
 
+#include <charconv>
 #include <filesystem>
 #include <iomanip>
 #include <iostream>
@@ -12,6 +13,7 @@
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include <boost/numeric/conversion/cast.hpp>
 
@@ -49,6 +51,29 @@ inline std::string ToHexDump(const span<T, N> &bv) {
     return ToHexDump({reinterpret_cast<const char *>(bv.data()), bv.size()});
 }
 
+/**
+ * @brief parse a hexadecimal representation dumped by ToHexDump back to a byte array.
+ * @param hex dumped string
+ * @param arr <u>return</u> the byte array
+ * @return whether the string is the dump of a byte array of this size
+ */
+template <typename T, std::size_t N>
+inline bool FromHexDump(std::string_view hex, std::array<T, N> &arr) {
+    static_assert(sizeof(T) == 1);
+    if (hex.size() != N * 2) {
+        return false;
+    }
+    for (std::size_t i = 0; i < N; i++) {
+        unsigned value{};
+        auto [end, ec] = std::from_chars(hex.data() + i * 2, hex.data() + i * 2 + 2, value, 16);
+        if (ec != std::errc{} || end != hex.data() + i * 2 + 2) {
+            return false;
+        }
+        arr[i] = static_cast<T>(value);
+    }
+    return true;
+}
+
 /**
  * @brief converts an enumeration to its underlying type.
  */
@@ -147,6 +172,8 @@ inline void DirInit(bool clear) noexcept {
     try {
         CreateDir(config::GetDBDir(), clear);
         CreateDir(config::GetContianerDir(), clear);
+        CreateDir(config::GetRecipeDir(), clear);
+        CreateDir(config::GetRecipeJournalDir(), clear);
     } catch (DedupException &e) {
         std::cerr << e.what() << std::endl;
         exit(-1);
@@ -232,6 +259,47 @@ ParseFileShareMeta(const bytes_view &fileShareMeta) {
     return {kfileShareMetaHead, fullFileName, shareMetaEntries};
 }
 
+/**
+ * @brief split a batch of file share metas into the file share meta of each file
+ * @param fileShareBatch buffer for the batch of file share metas
+ * @param numOfFiles number of files in the batch
+ * @return the file share meta of each file, with the number of total shares of its file
+ * @throw DedupException if the size of the fileShareBatch is inconsistent with the sizes that its heads indicate
+ * @note batch format: [number of total shares(uint32) + file share meta] ... [number of total shares(uint32) + file
+ * share meta], where each file share meta has the same format as that for ParseFileShareMeta()
+ */
+inline std::vector<std::pair<bytes_view, std::size_t>> SplitFileShareBatch(const bytes_view &fileShareBatch,
+                                                                           std::size_t numOfFiles) {
+    std::vector<std::pair<bytes_view, std::size_t>> fileShareMetas;
+    fileShareMetas.reserve(numOfFiles);
+
+    /// offset of the file share batch buffer
+    std::size_t offset{0};
+    for (std::size_t i = 0; i < numOfFiles; i++) {
+        // the heads are checked anyway, as the file share metas are located by them
+        if (fileShareBatch.size() - offset < sizeof(uint32_t) + FILE_SHARE_META_HEAD_SIZE) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "file share batch is invalid");
+        }
+        auto numOfTotalShares = *reinterpret_cast<const uint32_t *>(fileShareBatch.data() + offset);
+        offset += sizeof(uint32_t);
+        auto &kFileShareMetaHead = *reinterpret_cast<const fileShareMetaHead_t *>(fileShareBatch.data() + offset);
+        if (kFileShareMetaHead.fullNameSize < 0 || kFileShareMetaHead.numOfComingSecrets < 0) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "file share batch is invalid");
+        }
+        auto kFileShareMetaSize = FILE_SHARE_META_HEAD_SIZE + static_cast<std::size_t>(kFileShareMetaHead.fullNameSize) +
+                                  SHARE_META_ENTRY_SIZE * static_cast<std::size_t>(kFileShareMetaHead.numOfComingSecrets);
+        if (fileShareBatch.size() - offset < kFileShareMetaSize) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "file share batch is invalid");
+        }
+        fileShareMetas.emplace_back(fileShareBatch.subspan(offset, kFileShareMetaSize), numOfTotalShares);
+        offset += kFileShareMetaSize;
+    }
+    if (offset != fileShareBatch.size()) {
+        throw DedupException(BOOST_CURRENT_LOCATION, "file share batch is invalid");
+    }
+    return fileShareMetas;
+}
+
 /**
  * @brief parse the content of a file recipe buffer
  * @param fileRecipeData buffer for the file recipe to parse
@@ -258,6 +326,35 @@ ParseFileRecipe(const bytes_view &fileRecipeData) {
     return {kFileRecipeHead, fileRecipeEntries};
 }
 
+/**
+ * @brief parse the root of a finished file recipe
+ * @param fileRecipeRootData buffer for the file recipe root to parse
+ * @return the file recipe root
+ * @throw DedupException if the size of the buffer is invalid
+ */
+inline const fileRecipeRoot_t &ParseFileRecipeRoot(const bytes_view &fileRecipeRootData) {
+    if (fileRecipeRootData.size() != FILE_RECIPE_ROOT_SIZE) {
+        throw DedupException(BOOST_CURRENT_LOCATION, "file recipe root is invalid");
+    }
+    return *reinterpret_cast<const fileRecipeRoot_t *>(fileRecipeRootData.data());
+}
+
+/**
+ * @brief parse the content of a recipe chunk
+ * @param recipeChunkData buffer for the recipe chunk to parse
+ * @return span for the file recipe entries in the recipe chunk
+ * @note recipe chunk format: [fileRecipeEntry_t ... fileRecipeEntry_t]
+ */
+inline span<const fileRecipeEntry_t> ParseRecipeChunk(const bytes_view &recipeChunkData) {
+    if constexpr (config::PARANOID_CHECK) {
+        if (recipeChunkData.size() % FILE_RECIPE_ENTRY_SIZE != 0) {
+            throw DedupException(BOOST_CURRENT_LOCATION, "recipe chunk data is invalid");
+        }
+    }
+    return {reinterpret_cast<const fileRecipeEntry_t *>(recipeChunkData.data()),
+            recipeChunkData.size() / FILE_RECIPE_ENTRY_SIZE};
+}
+
 /**
  * @brief parse the content of a share index buffer
  * @param shareIndexData buffer for the share index data